@@ -39,6 +39,7 @@
 
 
 #include "bplan100.h"
+#include "ulogger.h"
 
 // create class object
 BPlan100 plan100;
@@ -153,6 +154,7 @@ void BPlan100::run()
   if (lost)
   { // there may be better options, but for now - stop
     toLog("Plan100 got lost");
+    logger.trigger("plan_lost");
     mixer.setVelocity(0);
     mixer.setTurnrate(0);
   }
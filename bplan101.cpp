@@ -42,6 +42,7 @@
 
 
 #include "bplan101.h"
+#include "ulogger.h"
 
 // create class object
 BPlan101 plan101;
@@ -142,6 +143,7 @@ void BPlan101::run()
   if (lost)
   { // there may be better options, but for now - stop
     toLog("Plan101 got lost");
+    logger.trigger("plan_lost");
     mixer.setVelocity(0);
     mixer.setTurnrate(0);
   }
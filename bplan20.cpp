@@ -38,6 +38,7 @@
 #include "cmixer.h"
 
 #include "bplan20.h"
+#include "ulogger.h"
 
 // create class object
 BPlan20 plan20;
@@ -123,6 +124,7 @@ void BPlan20::run()
   if (lost)
   { // there may be better options, but for now - stop
     toLog("Plan20 got lost");
+    logger.trigger("plan_lost");
     mixer.setVelocity(0);
     mixer.setTurnrate(0);
   }
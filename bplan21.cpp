@@ -38,6 +38,7 @@
 #include "cmixer.h"
 
 #include "bplan21.h"
+#include "ulogger.h"
 
 // create class object
 BPlan21 plan21;
@@ -133,6 +134,7 @@ void BPlan21::run()
   if (lost)
   { // there may be better options, but for now - stop
     toLog("Plan21 got lost");
+    logger.trigger("plan_lost");
     mixer.setVelocity(0);
     mixer.setTurnrate(0);
   }
@@ -39,6 +39,7 @@
 #include "sdist.h"
 
 #include "bplan40.h"
+#include "ulogger.h"
 
 // create class object
 BPlan40 plan40;
@@ -211,6 +212,7 @@ void BPlan40::run()
   if (lost)
   { // there may be better options, but for now - stop
     toLog("Plan40 got lost - stopping");
+    logger.trigger("plan_lost");
     mixer.setVelocity(0);
     mixer.setTurnrate(0);
   }
@@ -30,6 +30,9 @@
 #include "medge.h"
 #include "cedge.h"
 #include "cmixer.h"
+#include "ulogger.h"
+#include "uexecutor.h"
+#include "urealtime.h"
 
 // create value
 CEdge cedge;
@@ -72,7 +75,7 @@ void CEdge::setup()
   if (ini["edge"]["logCtrl"] == "true")
   { // open logfile
     std::string fn = service.logPath + "log_edge_pid.txt";
-    logfileCtrl = fopen(fn.c_str(), "w");
+    logfileCtrl = logger.open(fn.c_str());
     if (logfileCtrl != nullptr)
     {
       fprintf(logfileCtrl, "%% Edge control logfile: %s\n", fn.c_str());
@@ -85,7 +88,7 @@ void CEdge::setup()
   if (ini["edge"]["logCedge"] == "true")
   { // open logfile
     std::string fn = service.logPath + "log_edge_ctrl.txt";
-    logfile = fopen(fn.c_str(), "w");
+    logfile = logger.open(fn.c_str());
     if (logfile != nullptr)
     {
       fprintf(logfile, "%% Edge logfile: %s\n", fn.c_str());
@@ -100,7 +103,15 @@ void CEdge::setup()
     else
       printf("# cedge - Failed to create logfile at %s\n", fn.c_str());
   }
-  th1 = new std::thread(runObj, this);
+  loopMon.setup("cedge", sampleTime);
+  // after the edge detection in the edge rate group
+  if (not executor.add(UExecutor::EDGE, 20, "cedge", [this]{ step(); }))
+    th1 = new std::thread(runObj, this);
+}
+
+void CEdge::setSampleTime(float sTime)
+{ // new edge sensor rate, set in step() to not change the PID while in use
+  pendingSampleTime = sTime;
 }
 
 void CEdge::toLog()
@@ -109,15 +120,15 @@ void CEdge::toLog()
     return;
   if (logfile != nullptr)
   {
-    fprintf(logfile, "%lu.%04ld %d %d %.4f %.4f %.4f %d\n",
-            medge.updTime.getSec(), medge.updTime.getMicrosec()/100,
+    logger.log(logfile, "%lu.%04ld %d %d %.4f %.4f %.4f %d\n",
+            edge.updTime.getSec(), edge.updTime.getMicrosec()/100,
             mixer.headingMode, followLeft, followOffset, measuredValue,
             u, limited);
   }
   if (toConsole)
   { // debug print to console
     printf("%lu.%04ld %d %d %.4f %.4f %.4f %d\n",
-           medge.updTime.getSec(), medge.updTime.getMicrosec()/100,
+           edge.updTime.getSec(), edge.updTime.getMicrosec()/100,
            mixer.headingMode, followLeft, followOffset, measuredValue,
            u, limited);
   }
@@ -128,71 +139,80 @@ void CEdge::terminate()
   if (th1 != nullptr)
     th1->join();
   if (logfileCtrl != nullptr)
-    fclose(logfileCtrl);
+    logger.close(logfileCtrl);
   if (logfile != nullptr)
-    fclose(logfile);
+    logger.close(logfile);
 }
 
 
 void CEdge::run()
 {
-  int loop = 0;
-  bool wasEnabled = false;
-  int updateCnt = medge.updateCnt;
+  realtime.apply("cedge");
+  edgeUpdateCnt = medge.topic.count();
   while (not service.stop)
-  {
-    if (medge.updateCnt != updateCnt)
-    {
-      if (mixer.headingMode == CMixer::HM_EDGE)
-      { // follow edge
-        if (followLeft)
-          measuredValue = medge.leftEdge;
-        else
-          measuredValue = medge.rightEdge;
-        if (medge.edgeValid)
-        { // when measured are too positive, i.e. too far left
-          // we should go clockwise (CV), i.e positive turn-rate.
-          u = - pid.pid(followOffset, measuredValue, limited);
-          if (u > maxTurnrate)
-          {
-            limited = true;
-            u = maxTurnrate;
-          }
-          else if (u < -maxTurnrate)
-          {
-            limited = true;
-            u = -maxTurnrate;
-          }
-          else
-            limited = motor.limited;
-        }
-        else
-        {
-          u = 0.0;
-          limited = motor.limited;
-        }
-        // finished calculating turn rate
-        mixer.setInModeTurnrate(u);
-        // log control values
-        pid.saveToLog(logfileCtrl, medge.updTime);
-        toLog();
-        wasEnabled = true;
+  { // wait for new edge values (or timeout to test for stop)
+    if (medge.topic.wait(edgeUpdateCnt, 50000) != edgeUpdateCnt)
+      step();
+  }
+}
+
+void CEdge::step()
+{
+  edgeUpdateCnt = medge.topic.read(edge);
+  loopMon.begin(edge.updTime);
+  float ts = pendingSampleTime.exchange(0);
+  if (ts > 0)
+    // edge sensor rate is changed
+    pid.setSampleTime(ts);
+  if (mixer.headingMode == CMixer::HM_EDGE)
+  { // follow edge
+    if (followLeft)
+      measuredValue = edge.leftEdge;
+    else
+      measuredValue = edge.rightEdge;
+    if (edge.edgeValid)
+    { // when measured are too positive, i.e. too far left
+      // we should go clockwise (CV), i.e positive turn-rate.
+      u = - pid.pid(followOffset, measuredValue, limited);
+      if (u > maxTurnrate)
+      {
+        limited = true;
+        u = maxTurnrate;
       }
-      else if (wasEnabled)
+      else if (u < -maxTurnrate)
       {
-        wasEnabled = false;
-        u = 0;
-        mixer.setInModeTurnrate(u);
-        pid.resetHistory();
-        // log control values
-        pid.saveToLog(logfileCtrl, medge.updTime);
-        toLog();
+        limited = true;
+        u = -maxTurnrate;
       }
-      loop++;
-      updateCnt = medge.updateCnt;
+      else
+        limited = motor.limited;
     }
-    usleep(2000);
+    else
+    {
+      u = 0.0;
+      limited = motor.limited;
+      if (wasValid)
+        logger.trigger("edge_lost");
+    }
+    wasValid = edge.edgeValid;
+    // finished calculating turn rate
+    mixer.setInModeTurnrate(u);
+    // log control values
+    pid.saveToLog(logfileCtrl, edge.updTime);
+    toLog();
+    wasEnabled = true;
+  }
+  else if (wasEnabled)
+  {
+    wasEnabled = false;
+    u = 0;
+    mixer.setInModeTurnrate(u);
+    pid.resetHistory();
+    // log control values
+    pid.saveToLog(logfileCtrl, edge.updTime);
+    toLog();
   }
+  loopMon.end();
 }
 
 
@@ -24,10 +24,12 @@
 #pragma once
 
 #include <thread>
+#include <atomic>
 
 #include "medge.h"
 #include "utime.h"
 #include "upid.h"
+#include "uloopmon.h"
 
 using namespace std;
 
@@ -45,9 +47,18 @@ public:
   /**
    * thread to do updates, when new data is available */
   void run();
+  /**
+   * Edge control for new edge values
+   * (from run() or the executor edge rate group) */
+  void step();
   /**
    * terminate */
   void terminate();
+  /**
+   * change controller sample time (sec), when the edge sensor
+   * subscription rate is changed, see UService::setStreamProfile(),
+   * used from the next step() */
+  void setSampleTime(float sTime);
 
 public:
   /// controller output limit (same value positive and negative)
@@ -58,6 +69,8 @@ public:
   float followOffset = 0.0;
   // should control be enabled (default is off)
 //   bool enabled = false;
+  /// cycle timing (and watchdog)
+  ULoopMon loopMon;
 
 private:
   /// private stuff
@@ -70,6 +83,8 @@ private:
   /**
    * PID controller */
   UPID pid;
+  /// new sample time from setSampleTime() (0 = none)
+  std::atomic<float> pendingSampleTime = {0};
   float u;
   bool limited = false;
   //
@@ -78,9 +93,14 @@ private:
   FILE * logfile = {nullptr};
   bool toConsole;
   //   mutex dataLock; // data consistency lock, should not be needed
-  std::thread * th1;
+  std::thread * th1 = nullptr;
   bool stop = false;
   float measuredValue;
+  /// latest edge values
+  MEdge::Data edge;
+  uint32_t edgeUpdateCnt = 0;
+  bool wasEnabled = false;
+  bool wasValid = false;
 };
 
 /**
@@ -32,6 +32,9 @@
 #include "cmixer.h"
 
 #include "cheading.h"
+#include "ulogger.h"
+#include "uexecutor.h"
+#include "urealtime.h"
 
 // create value
 CHeading heading;
@@ -70,11 +73,19 @@ void CHeading::setup()
   if (ini["heading"]["log"] == "true")
   { // open logfile
     std::string fn = service.logPath + "log_heading.txt";
-    logfile = fopen(fn.c_str(), "w");
+    logfile = logger.open(fn.c_str());
     logfileLeadText(logfile);
     pid.logPIDparams(logfile, false);
   }
-  th1 = new std::thread(runObj, this);
+  loopMon.setup("heading", sampleTime);
+  // after the pose in the encoder rate group
+  if (not executor.add(UExecutor::ENCODER, 20, "heading", [this]{ step(); }))
+    th1 = new std::thread(runObj, this);
+}
+
+void CHeading::setSampleTime(float sTime)
+{ // new encoder rate, set in step() to not change the PID while in use
+  pendingSampleTime = sTime;
 }
 
 void CHeading::logfileLeadText(FILE * f)
@@ -96,7 +107,7 @@ void CHeading::terminate()
     th1->join();
   if (logfile != nullptr)
   {
-    fclose(logfile);
+    logger.close(logfile);
   }
 }
 
@@ -111,55 +122,59 @@ void CHeading::setRef(bool useTurnrate, float turnrate, float absHeading)
 
 void CHeading::run()
 {
-  int loop = 0;
+  realtime.apply("heading");
   while (not service.stop)
+  { // wait for new pose (or timeout to test for stop)
+    if (pose.topic.wait(poseUpdateCnt, 50000) != poseUpdateCnt)
+      step();
+  }
+}
+
+void CHeading::step()
+{ // do constant rate control
+  // that is; every time new encoder data is available,
+  // and therefore a new pose is published,
+  // then new motor control values should be calculated.
+  MPose::Data p;
+  poseUpdateCnt = pose.topic.read(p);
+  loopMon.begin(p.poseTime);
+  float ts = pendingSampleTime.exchange(0);
+  if (ts > 0)
+  { // encoder rate is changed
+    sampleTime = ts;
+    pid.setSampleTime(ts);
+  }
+  // do control.
+  // got new encoder data
+  float dt = p.poseTime - lastPose;
+  lastPose = p.poseTime;
+  // calculate new reference turnrate
+  if (turnrateControl)
+    desiredHeading += turnrateRef * dt;
+  else
   {
-    if (pose.updateCnt != poseUpdateCnt)
-    { // do constant rate control
-      // that is; every time new encoder data is available,
-      // and therefore pose.updateCnt increased,
-      // then new motor control values should be calculated.
-      poseUpdateCnt = pose.updateCnt;
-      // do control.
-      // got new encoder data
-      float dt = pose.poseTime - lastPose;
-      lastPose = pose.poseTime;
-      // calculate new reference turnrate
-      if (turnrateControl)
-        desiredHeading += turnrateRef * dt;
-      else
-      {
-        desiredHeading = headingRef;
-      }
-      if (dt < 1.0)
-      { // valid control timing
-        u = pid.pid(desiredHeading, pose.h, limited);
-        // test for output limiting
-        if (fabsf(u) > maxTurnrate or motor.limited)
-        { // don't turn too fast
-          limited = true;
-          if (u > maxTurnrate)
-            u = maxTurnrate;
-          else if (u < -maxTurnrate)
-            u = -maxTurnrate;
-        }
-        else
-          limited = false;
-      }
-      // log control values
-      pid.saveToLog(logfile, pose.poseTime);
-      // finished calculating turn rate
-      mixer.updateWheelVelocity();
+    desiredHeading = headingRef;
+  }
+  if (dt < 1.0)
+  { // valid control timing
+    u = pid.pid(desiredHeading, p.h, limited);
+    // test for output limiting
+    if (fabsf(u) > maxTurnrate or motor.limited)
+    { // don't turn too fast
+      limited = true;
+      if (u > maxTurnrate)
+        u = maxTurnrate;
+      else if (u < -maxTurnrate)
+        u = -maxTurnrate;
     }
-//     else
-//     { // no control - rely on motor velocity controller
-//       poseUpdateCnt = pose.updateCnt;
-//       mixer.setInModeTurnrate(turnrateRef);
-//       mixer.translateToWheelVelocity();
-//     }
-    loop++;
-    usleep(2000);
+    else
+      limited = false;
   }
+  // log control values
+  pid.saveToLog(logfile, p.poseTime);
+  // finished calculating turn rate
+  mixer.updateWheelVelocity();
+  loopMon.end();
 }
 
 
@@ -24,10 +24,12 @@
 #pragma once
 
 #include <thread>
+#include <atomic>
 
 #include "sencoder.h"
 #include "utime.h"
 #include "upid.h"
+#include "uloopmon.h"
 
 using namespace std;
 
@@ -45,9 +47,18 @@ public:
   /**
    * thread to do updates, when new data is available */
   void run();
+  /**
+   * Heading control for a new pose
+   * (from run() or the executor encoder rate group) */
+  void step();
   /**
    * terminate */
   void terminate();
+  /**
+   * change controller sample time (sec), when the encoder
+   * subscription rate is changed, see UService::setStreamProfile(),
+   * used from the next step() */
+  void setSampleTime(float sTime);
   /**
    * set desired turnrate
    * \param useTurnrate if true, then use turnrate to calculate desired heading
@@ -69,6 +80,8 @@ protected:
 public:
   // is output limited, this may be valuable for other controllers.
   bool limited = false;
+  /// cycle timing (and watchdog)
+  ULoopMon loopMon;
 
 private:
   /// private stuff
@@ -88,9 +101,11 @@ private:
   /**
    * PID controller */
   UPID pid;
-  UTime lastPose;
+  UTimeNs lastPose;
   //
   float sampleTime;
+  /// new sample time from setSampleTime() (0 = none)
+  std::atomic<float> pendingSampleTime = {0};
   /// old values for PID
   float ep1 = 0, up1 = 0, ui1 = 0;
   /// pre-calculated lead values
@@ -102,12 +117,12 @@ private:
   // support variables
   FILE * logfile = {nullptr};
 //   mutex dataLock; // data consistency lock, should not be needed
-  std::thread * th1;
+  std::thread * th1 = nullptr;
   bool stop = false;
   int dataCnt = 0;
   /// old mixer update count
   int mixerUpdateCnt = 0;
-  int poseUpdateCnt = 0;
+  uint32_t poseUpdateCnt = 0;
 };
 
 /**
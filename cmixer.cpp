@@ -32,6 +32,7 @@
 #include "cedge.h"
 #include "steensy.h"
 #include "uservice.h"
+#include "ulogger.h"
 
 // create value
 CMixer mixer;
@@ -57,7 +58,7 @@ void CMixer::setup()
   if (ini["mixer"]["log"] == "true")
   { // open logfile
     std::string fn = service.logPath + "log_mixer.txt";
-    logfile = fopen(fn.c_str(), "w");
+    logfile = logger.open(fn.c_str());
     fprintf(logfile, "%% Mixer logfile\n");
     fprintf(logfile, "%% Wheel base used in calculation: %g m\n", wheelbase);
     fprintf(logfile, "%% 1 \tTime (sec)\n");
@@ -77,7 +78,7 @@ void CMixer::terminate()
 {
   if (logfile != nullptr)
   {
-    fclose(logfile);
+    logger.close(logfile);
     logfile = nullptr;
   }
 }
@@ -184,7 +185,7 @@ void CMixer::toLog()
     return;
   if (logfile != nullptr)
   { // add to log after update
-    fprintf(logfile, "%lu.%04ld %d %.3f %d %.4f %.4f %.4f %.3f %.3f %.2f\n",
+    logger.log(logfile, "%lu.%04ld %d %.3f %d %.4f %.4f %.4f %.3f %.3f %.2f\n",
             updateTime.getSec(), updateTime.getMicrosec()/100,
             manualOverride, linVel, headingMode, desiredHeading,
             heading.getTurnrateRef(), heading.getTurnrate(),
@@ -31,6 +31,9 @@
 #include "uservice.h"
 #include "mpose.h"
 #include "cmixer.h"
+#include "ulogger.h"
+#include "uexecutor.h"
+#include "urealtime.h"
 
 // create value
 CMotor motor;
@@ -61,6 +64,7 @@ void CMotor::setup()
   maxMotV = strtof(ini["motor"]["maxMotV"].c_str(), nullptr);
   // sample time from encoder module
   sampleTime = strtof(ini["encoder"]["rate_ms"].c_str(), nullptr) / 1000.0;
+  deadline = strtof(ini["flight"]["deadline_ms"].c_str(), nullptr) / 1000.0;
   //
   pid[0].setup(sampleTime, kp, taud, alpha, taui);
   pid[1].setup(sampleTime, kp, taud, alpha, taui);
@@ -71,15 +75,23 @@ void CMotor::setup()
   if (ini["motor"]["log"] == "true")
   { // open logfile
     std::string fn = service.logPath + "log_motor_0.txt";
-    logfile[0] = fopen(fn.c_str(), "w");
+    logfile[0] = logger.open(fn.c_str());
     fn = service.logPath + "log_motor_1.txt";
-    logfile[1] = fopen(fn.c_str(), "w");
+    logfile[1] = logger.open(fn.c_str());
     logfileLeadText(logfile[0], "left");
     pid[0].logPIDparams(logfile[0], false);
     logfileLeadText(logfile[1], "right");
     pid[1].logPIDparams(logfile[1], false);
   }
-  th1 = new std::thread(runObj, this);
+  loopMon.setup("motor", sampleTime);
+  // last in the encoder rate group (after heading)
+  if (not executor.add(UExecutor::ENCODER, 30, "motor", [this]{ step(); }))
+    th1 = new std::thread(runObj, this);
+}
+
+void CMotor::setSampleTime(float sTime)
+{ // new encoder rate, set in step() to not change the PID while in use
+  pendingSampleTime = sTime;
 }
 
 void CMotor::logfileLeadText(FILE * f, const char * side)
@@ -99,15 +111,17 @@ void CMotor::terminate()
 {
   if (th1 != nullptr)
     th1->join();
+  // stop motors
+  teensy1.send("motv 0 0\n");
   if (logfile[0] != nullptr)
   {
     UTime t("now");
     char d[100];
     t.getDateTimeAsString(d);
-    fprintf(logfile[0], "%% ended at %lu.%4ld %s\n", t.getSec(), t.getMicrosec()/100, d);
-    fprintf(logfile[1], "%% ended at %lu.%4ld %s\n", t.getSec(), t.getMicrosec()/100, d);
-    fclose(logfile[0]);
-    fclose(logfile[1]);
+    logger.log(logfile[0], "%% ended at %lu.%4ld %s\n", t.getSec(), t.getMicrosec()/100, d);
+    logger.log(logfile[1], "%% ended at %lu.%4ld %s\n", t.getSec(), t.getMicrosec()/100, d);
+    logger.close(logfile[0]);
+    logger.close(logfile[1]);
     logfile[0] = nullptr;
     logfile[1] = nullptr;
   }
@@ -116,9 +130,8 @@ void CMotor::terminate()
 
 void CMotor::run()
 {
+  realtime.apply("motor");
 //   printf("# CMotor::run\n");
-  int loop = 0;
-  UTime lastPose;
   while (not service.stop)
   {
     if (false) //useTeensyControl)
@@ -134,60 +147,72 @@ void CMotor::run()
         snprintf(s, MSL, "rc 3 %.3f %.3f 0\n", v, d);
         teensy1.send(s, true);
       }
+      usleep(2000);
     }
-    else if (pose.updateCnt != poseUpdateCnt)
-    { // do constant rate control
-      // that is every time new encoder data is available
-      // new motor control values should be calculated.
-      poseUpdateCnt = pose.updateCnt;
-      // do velocity control.
-      // got new encoder data
-      float dt = lastPose - pose.poseTime;
-      // desired velocity from mixer
-      float * vr = mixer.getWheelVelocityArray();
-      if (dt < 1.0)
-      { // valid control timing
-        u[0] = pid[0].pid(vr[0], pose.wheelVel[0], limited);
-        u[1] = pid[1].pid(vr[1], pose.wheelVel[1], limited);
-        // test for output limiting
-        if (fabsf(u[0]) > maxMotV or fabsf(u[1]) > maxMotV)
-        { // some speed reduction is needed
-          limited = true;
-          // find speed reduction factor to allow turning
-          float fac;
-          if (fabsf(u[0]) > fabsf(u[1]))
-            fac = maxMotV/(fabsf(u[0]));
-          else
-            fac = maxMotV/(fabsf(u[1]));
-          u[0] *= fac;
-          u[1] *= fac;
-        }
-        else
-          limited = false;
-      }
-      lastPose = pose.poseTime;
-      // log_pose - for both motors
-      pid[0].saveToLog(logfile[0], pose.poseTime);
-      pid[1].saveToLog(logfile[1], pose.poseTime);
-      // finished calculating motor voltage
-      const int MSL = 100;
-      char s[MSL];
-      /// Left motor output actually inverts motor voltage.
-      /// So if both are commanded with a positive voltage
-      /// robot drives forward,
-      /// Here the sign must therefore be changed to compensate.
-      snprintf(s, MSL, "motv %.2f %.2f\n", u[0], u[1]);
-      teensy1.send(s, true);
+    else if (pose.topic.wait(poseUpdateCnt, 50000) != poseUpdateCnt)
+      // the sample time is given by the wait for a new pose,
+      // determined by the encoder (longer than 2ms)
+      // actually determined by the Teensy, so on average
+      // a constant sample rate (defined in the robot.ini file)
+      step();
+  }
+}
+
+void CMotor::step()
+{ // do constant rate control
+  // that is every time new encoder data is available
+  // new motor control values should be calculated.
+  MPose::Data p;
+  poseUpdateCnt = pose.topic.read(p);
+  loopMon.begin(p.poseTime);
+  float ts = pendingSampleTime.exchange(0);
+  if (ts > 0)
+  { // encoder rate is changed
+    sampleTime = ts;
+    pid[0].setSampleTime(ts);
+    pid[1].setSampleTime(ts);
+  }
+  // do velocity control.
+  // got new encoder data
+  float dt = lastPose - p.poseTime;
+  // desired velocity from mixer
+  float * vr = mixer.getWheelVelocityArray();
+  if (dt < 1.0)
+  { // valid control timing
+    u[0] = pid[0].pid(vr[0], p.wheelVel[0], limited);
+    u[1] = pid[1].pid(vr[1], p.wheelVel[1], limited);
+    // test for output limiting
+    if (fabsf(u[0]) > maxMotV or fabsf(u[1]) > maxMotV)
+    { // some speed reduction is needed
+      limited = true;
+      // find speed reduction factor to allow turning
+      float fac;
+      if (fabsf(u[0]) > fabsf(u[1]))
+        fac = maxMotV/(fabsf(u[0]));
+      else
+        fac = maxMotV/(fabsf(u[1]));
+      u[0] *= fac;
+      u[1] *= fac;
     }
-    loop++;
-    // sleep a little while, the sample time is
-    // determined by the encoder (longer than 2ms)
-    // actually determined by the Teensy, so on average
-    // a constant sample rate (defined in the robot.ini file)
-    usleep(2000);
+    else
+      limited = false;
   }
-  // stop motors
-  teensy1.send("motv 0 0\n");
+  lastPose = p.poseTime;
+  // log_pose - for both motors
+  pid[0].saveToLog(logfile[0], p.poseTime);
+  pid[1].saveToLog(logfile[1], p.poseTime);
+  // finished calculating motor voltage
+  const int MSL = 100;
+  char s[MSL];
+  /// Left motor output actually inverts motor voltage.
+  /// So if both are commanded with a positive voltage
+  /// robot drives forward,
+  /// Here the sign must therefore be changed to compensate.
+  snprintf(s, MSL, "motv %.2f %.2f\n", u[0], u[1]);
+  teensy1.send(s, true);
+  loopMon.end();
+  if (deadline > 0 and p.poseTime.getTimePassed() > deadline)
+    logger.trigger("deadline");
 }
 
 
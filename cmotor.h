@@ -25,10 +25,12 @@
 #define UMOTOR_H
 
 #include <thread>
+#include <atomic>
 
 #include "sencoder.h"
 #include "utime.h"
 #include "upid.h"
+#include "uloopmon.h"
 
 using namespace std;
 
@@ -46,9 +48,18 @@ public:
   /**
    * thread to do updates, when new data is available */
   void run();
+  /**
+   * Velocity control for a new pose, and send motor voltage
+   * (from run() or the executor encoder rate group) */
+  void step();
   /**
    * terminate */
   void terminate();
+  /**
+   * change controller sample time (sec), when the encoder
+   * subscription rate is changed, see UService::setStreamProfile(),
+   * used from the next step() */
+  void setSampleTime(float sTime);
 
 protected:
   /** velocity controller - left and right
@@ -63,6 +74,8 @@ protected:
 public:
   // is output limited, this may be valuable for other controllers.
   bool limited = false;
+  /// cycle timing (and watchdog)
+  ULoopMon loopMon;
 
 private:
   /// private stuff
@@ -79,6 +92,8 @@ private:
   UPID pid[2];
   //
   float sampleTime;
+  /// new sample time from setSampleTime() (0 = none)
+  std::atomic<float> pendingSampleTime = {0};
   /// old values for PID
   float ep1[2] = {0}, up1[2] = {0}, ui1[2] = {0};
   /// pre-calculated lead values
@@ -90,12 +105,15 @@ private:
   // support variables
   FILE * logfile[2] = {nullptr};
 //   mutex dataLock; // data consistency lock, should not be needed
-  std::thread * th1;
+  std::thread * th1 = nullptr;
   bool stop = false;
   int dataCnt = 0;
   /// old mixer update count
   int mixerUpdateCnt = 0;
-  int poseUpdateCnt = 0;
+  uint32_t poseUpdateCnt = 0;
+  UTimeNs lastPose;
+  /// max time from encoder data to motor voltage send (flight recorder trigger, 0 = no trigger)
+  float deadline = 0.03;
 };
 
 /**
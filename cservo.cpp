@@ -27,6 +27,9 @@
 #include "cservo.h"
 #include "steensy.h"
 #include "uservice.h"
+#include "udispatch.h"
+#include "uscan.h"
+#include "ulogger.h"
 // create value
 CServo servo;
 
@@ -41,6 +44,7 @@ void CServo::setup()
   }
   // use values and subscribe to source data
   // like teensy1.send("sub pose 4\n");
+  dispatch.add("svo", [this](const char * msg, UTime & t) { return decode(msg, t); });
   std::string s = "sub svo " + ini["servo"]["rate_ms"] + "\n";
   teensy1.send(s.c_str());
   // debug print
@@ -49,7 +53,7 @@ void CServo::setup()
   if (ini["servo"]["log"] == "true")
   { // open logfile for servo data from Teensy
     std::string fn = service.logPath + "log_servo.txt";
-    logfile = fopen(fn.c_str(), "w");
+    logfile = logger.open(fn.c_str());
     fprintf(logfile, "%% Servo logfile\n");
     fprintf(logfile, "%% 1 \tTime (sec)\n");
     fprintf(logfile, "%% 2,3,4 \tservo 1: enabled, position, velocity\n");
@@ -58,7 +62,7 @@ void CServo::setup()
     fprintf(logfile, "%% 11,12,13 \tservo 1: enabled, position, velocity\n");
     fprintf(logfile, "%% 14,15,16 \tservo 1: enabled, position, velocity\n");
     fn = service.logPath + "log_servo_ctrl.txt";
-    logfileCtrl = fopen(fn.c_str(), "w");
+    logfileCtrl = logger.open(fn.c_str());
     fprintf(logfileCtrl, "%% Servo commands logfile\n");
     fprintf(logfileCtrl, "%% 1 \tTime (sec)\n");
     fprintf(logfileCtrl, "%% 2 \tServo number\n");
@@ -78,7 +82,7 @@ void CServo::setServo(int servo, bool enabled, int position, int velocity)
   teensy1.send(s);
   if (logfileCtrl != nullptr)
   {
-    fprintf(logfileCtrl, "%lu.%03ld %d %d %d\n",
+    logger.log(logfileCtrl, "%lu.%03ld %d %d %d\n",
             t.getSec(), t.getMilisec(),
             enabled, position, velocity);
   }
@@ -88,10 +92,10 @@ void CServo::terminate()
 {
   if (logfile != nullptr)
   {
-    fclose(logfile);
+    logger.close(logfile);
   }
   if (logfileCtrl != nullptr)
-    fclose(logfileCtrl);
+    logger.close(logfileCtrl);
 }
 
 bool CServo::decode(const char* msg, UTime & msgTime)
@@ -104,12 +108,21 @@ bool CServo::decode(const char* msg, UTime & msgTime)
       p1 += 4;
     else
       return false;
+    // enabled, position and velocity for 5 servos
+    int v[15];
+    UScan sc(p1);
+    sc.get(v, 15);
+    if (not sc.ok(15))
+    {
+      sc.report("CServo::decode", msg);
+      return true;
+    }
     updTime = msgTime;
     for (int i = 0; i < 5; i++)
     {
-      servo_enabled[i] = strtol(p1, (char**)&p1, 10);
-      servo_position[i] = strtol(p1, (char**)&p1, 10);
-      servo_velocity[i] = strtol(p1, (char**)&p1, 10);
+      servo_enabled[i] = v[i * 3];
+      servo_position[i] = v[i * 3 + 1];
+      servo_velocity[i] = v[i * 3 + 2];
     }
     // notify users of a new update
     updateCnt++;
@@ -125,7 +138,7 @@ void CServo::toLog()
 {
   if (logfile != nullptr and not service.stop)
   {
-    fprintf(logfile, "%lu.%03ld %d %d %d  %d %d %d  %d %d %d  %d %d %d %d %d %d\n",
+    logger.log(logfile, "%lu.%03ld %d %d %d  %d %d %d  %d %d %d  %d %d %d %d %d %d\n",
             updTime.getSec(), updTime.getMilisec(),
             servo_enabled[0], servo_position[0], servo_velocity[0],
             servo_enabled[1], servo_position[1], servo_velocity[1],
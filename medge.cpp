@@ -31,6 +31,9 @@
 #include "sencoder.h"
 #include "steensy.h"
 #include "uservice.h"
+#include "ulogger.h"
+#include "uexecutor.h"
+#include "urealtime.h"
 
 // create value
 MEdge medge;
@@ -79,7 +82,7 @@ void MEdge::setup()
   if (ini["edge"]["log"] == "true")
   { // open logfile
     std::string fn = service.logPath + "log_edge.txt";
-    logfile = fopen(fn.c_str(), "w");
+    logfile = logger.open(fn.c_str());
     fprintf(logfile, "%% Edge sensor logfile %s\n", fn.c_str());
     // save calibration values as text
     fprintf(logfile, "%% \tCalib white");
@@ -105,7 +108,7 @@ void MEdge::setup()
   if (ini["edge"]["log"] == "true")
   { // open logfile
     std::string fn = service.logPath + "log_edge_normalized.txt";
-    logfileNorm = fopen(fn.c_str(), "w");
+    logfileNorm = logger.open(fn.c_str());
     fprintf(logfileNorm, "%% Edge sensor logfile normalized '%s'\n", fn.c_str());
     // and extracted values
     fprintf(logfileNorm, "%% 1 \tTime (sec)\n");
@@ -115,7 +118,9 @@ void MEdge::setup()
     if (not calibrationValid)
       fprintf(logfile, "\n ### Calibration is not valid - see log_edge.txt or robot.ini\n");
   }
-  th1 = new std::thread(runObj, this);
+  // at every line sensor sample, as first in the edge rate group
+  if (not executor.add(UExecutor::EDGE, 10, "medge", [this]{ step(); }))
+    th1 = new std::thread(runObj, this);
 }
 
 
@@ -123,6 +128,16 @@ void MEdge::terminate()
 { // wait for thread to finish
   if (th1 != nullptr)
     th1->join();
+  if (logfile != nullptr)
+  {
+    logger.close(logfile);
+  }
+  if (logfileNorm != nullptr)
+  {
+    logger.close(logfileNorm);
+  }
+  logfile = nullptr;
+  logfileNorm = nullptr;
 }
 
 void MEdge::findEdge()
@@ -142,7 +157,7 @@ void MEdge::findEdge()
   // make calibrated values and scale to 1000
   for (int i = 0; i < 8; i++)
   {
-    int v = sedge.edgeRaw[i] - calibBlack[i];
+    int v = raw.edgeRaw[i] - calibBlack[i];
     v = (v * 1000) / (calibWhite[i] - calibBlack[i]);
     if (v > 1000)
       v = 1000;
@@ -214,85 +229,77 @@ void MEdge::findEdge()
 
 void MEdge::run()
 {
-  int loop = 0;
+  realtime.apply("medge");
   while (not service.stop)
-  {
-    if ((sensorCalibrateWhite or sensorCalibrateBlack) and
-      sedge.updateCnt > 100      )
-    { // start summing calibration values
-      if (sensorCalibrateCount == 0)
-      { // start collect values now
-        sensorCalibrateCount = sensorCalibrateSamples;
-        for (int i=0; i < 8; i++)
-          sensorCalibrateValue[i] = 0;
-      }
+  { // wait for new line sensor values (or timeout to test for stop)
+    if (sedge.topic.wait(lineUpdateCnt, 50000) != lineUpdateCnt)
+      step();
+  }
+}
+
+void MEdge::step()
+{
+  if ((sensorCalibrateWhite or sensorCalibrateBlack) and
+    sedge.topic.count() > 100)
+  { // start summing calibration values
+    if (sensorCalibrateCount == 0)
+    { // start collect values now
+      sensorCalibrateCount = sensorCalibrateSamples;
+      for (int i=0; i < 8; i++)
+        sensorCalibrateValue[i] = 0;
     }
-    if (sedge.updateCnt != lineUpdateCnt)
-    { // new values are available
-      updTime = sedge.updTime;
-      lineUpdateCnt = sedge.updateCnt;
-      loop++;
-      // calculate edge position
-      if (not (sensorCalibrateWhite or sensorCalibrateBlack))
-      { // regular update
-        findEdge();
-        // inform users of update
-        updateCnt++;
+  }
+  // new values are available
+  lineUpdateCnt = sedge.topic.read(raw);
+  updTime = raw.updTime;
+  // calculate edge position
+  if (not (sensorCalibrateWhite or sensorCalibrateBlack))
+  { // regular update
+    findEdge();
+    // inform users of update
+    topic.publish({updTime, edgeValid, leftEdge, rightEdge, width});
+  }
+  else if (sensorCalibrateCount > 0)
+  { // calibration active
+    for (int i = 0; i < 8; i++)
+    { // add new value
+      sensorCalibrateValue[i] += raw.edgeRaw[i];
+    }
+    sensorCalibrateCount--;
+    if (sensorCalibrateCount <= 0)
+    { // show old calibration value
+      printf("# Old calibration values:\n# white:");
+      for (int i = 0; i < 8; i++)
+        printf(" %5d", calibWhite[i]);
+      printf("\n# black:");
+      for (int i = 0; i < 8; i++)
+        printf(" %5d", calibBlack[i]);
+      printf("\n");
+      // save new values as string for ini structure
+      const int MSL = 400;
+      char s[MSL];
+      snprintf(s, MSL, "%d %d %d %d %d %d %d %d",
+          sensorCalibrateValue[0] / sensorCalibrateSamples,
+          sensorCalibrateValue[1] / sensorCalibrateSamples,
+          sensorCalibrateValue[2] / sensorCalibrateSamples,
+          sensorCalibrateValue[3] / sensorCalibrateSamples,
+          sensorCalibrateValue[4] / sensorCalibrateSamples,
+          sensorCalibrateValue[5] / sensorCalibrateSamples,
+          sensorCalibrateValue[6] / sensorCalibrateSamples,
+          sensorCalibrateValue[7] / sensorCalibrateSamples);
+      if (sensorCalibrateWhite)
+      { // save average as white value
+        sensorCalibrateWhite = false;
+        printf("# New calibration values:\n# white %s\n", s);
+        ini["edge"]["calibWhite"] = s;
       }
-      else if (sensorCalibrateCount > 0)
-      { // calibration active
-        for (int i = 0; i < 8; i++)
-        { // add new value
-          sensorCalibrateValue[i] += sedge.edgeRaw[i];
-        }
-        sensorCalibrateCount--;
-        if (sensorCalibrateCount <= 0)
-        { // show old calibration value
-          printf("# Old calibration values:\n# white:");
-          for (int i = 0; i < 8; i++)
-            printf(" %5d", calibWhite[i]);
-          printf("\n# black:");
-          for (int i = 0; i < 8; i++)
-            printf(" %5d", calibBlack[i]);
-          printf("\n");
-          // save new values as string for ini structure
-          const int MSL = 400;
-          char s[MSL];
-          snprintf(s, MSL, "%d %d %d %d %d %d %d %d",
-              sensorCalibrateValue[0] / sensorCalibrateSamples,
-              sensorCalibrateValue[1] / sensorCalibrateSamples,
-              sensorCalibrateValue[2] / sensorCalibrateSamples,
-              sensorCalibrateValue[3] / sensorCalibrateSamples,
-              sensorCalibrateValue[4] / sensorCalibrateSamples,
-              sensorCalibrateValue[5] / sensorCalibrateSamples,
-              sensorCalibrateValue[6] / sensorCalibrateSamples,
-              sensorCalibrateValue[7] / sensorCalibrateSamples);
-          if (sensorCalibrateWhite)
-          { // save average as white value
-            sensorCalibrateWhite = false;
-            printf("# New calibration values:\n# white %s\n", s);
-            ini["edge"]["calibWhite"] = s;
-          }
-          else
-          { // save average as black value
-            sensorCalibrateBlack = false;
-            ini["edge"]["calibBlack"] = s;
-            printf("# New calibration values:\n# black %s\n", s);
-          }
-        }
+      else
+      { // save average as black value
+        sensorCalibrateBlack = false;
+        ini["edge"]["calibBlack"] = s;
+        printf("# New calibration values:\n# black %s\n", s);
       }
     }
-    else
-      // no new value; just wait a bit (1000 = 1ms)
-      usleep(2000);
-  }
-  if (logfile != nullptr)
-  {
-    fclose(logfile);
-  }
-  if (logfileNorm != nullptr)
-  {
-    fclose(logfileNorm);
   }
 }
 
@@ -303,7 +310,7 @@ void MEdge::toLog()
   {
     if (logfile != nullptr)
     { // log_line sensor detection
-      fprintf(logfile, "%lu.%04ld %d %.3f %.3f %.4f\n", updTime.getSec(), updTime.getMicrosec()/100,
+      logger.log(logfile, "%lu.%04ld %d %.3f %.3f %.4f\n", updTime.getSec(), updTime.getMicrosec()/100,
               edgeValid, leftEdge, rightEdge, leftEdge - rightEdge);
     }
     if (toConsole)
@@ -313,9 +320,9 @@ void MEdge::toLog()
     }
     if (logfileNorm != nullptr)
     {
-      fprintf(logfileNorm, "%lu.%04ld %d %d %d %d %d %d %d %d  %.4f\n",
-             sedge.updTime.getSec(),
-             sedge.updTime.getMicrosec()/100,
+      logger.log(logfileNorm, "%lu.%04ld %d %d %d %d %d %d %d %d  %.4f\n",
+             updTime.getSec(),
+             updTime.getMicrosec()/100,
               ls[0], ls[1], ls[2], ls[3],
               ls[4], ls[5], ls[6], ls[7], leftEdge - rightEdge
       );
@@ -26,13 +26,14 @@
 
 #include "sedge.h"
 #include "utime.h"
+#include "utopic.h"
 
 using namespace std;
 
 /**
  * Class that extrach edge position of the line sensor
  * as well as crossing lines.
- * An updateCnt is incremented at every update
+ * A copy is published (topic) at every update
  * */
 class MEdge
 {
@@ -42,6 +43,10 @@ public:
   /**
    * thread to do updates, when new data is available */
   void run();
+  /**
+   * Find edges for new line sensor values
+   * (from run() or the executor edge rate group) */
+  void step();
   /**
    * terminate */
   void terminate();
@@ -54,8 +59,7 @@ protected:
 
 public:
   /// PC time of last update
-  UTime updTime;
-  int updateCnt = 0;
+  UTimeNs updTime;
   // calbration
   int calibWhite[8];
   int calibBlack[8];
@@ -70,6 +74,15 @@ public:
   // flag for doing a white line sensor calibration
   bool sensorCalibrateWhite = false;
   bool sensorCalibrateBlack = false;
+  /// edge values for other modules
+  struct Data
+  {
+    UTimeNs updTime;
+    bool edgeValid;
+    float leftEdge, rightEdge, width;
+  };
+  /// consistent copy of latest values, and wait for new values
+  UTopic<Data> topic;
 
 private:
   /// private stuff
@@ -83,12 +96,14 @@ private:
   void toLog();
   //
   int ls[8] = {0};
-  int lineUpdateCnt = 0;
+  /// latest line sensor values
+  SEdge::Data raw;
+  uint32_t lineUpdateCnt = 0;
   // debug print
   bool toConsole = false;
   FILE * logfile = nullptr;
   FILE * logfileNorm = nullptr;
-  std::thread * th1;
+  std::thread * th1 = nullptr;
   // mostly debug
   int eeL, ddL, eeR, ddR;
   int l, r;
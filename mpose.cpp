@@ -32,6 +32,9 @@
 #include "steensy.h"
 #include "uservice.h"
 #include "cmixer.h"
+#include "ulogger.h"
+#include "uexecutor.h"
+#include "urealtime.h"
 
 // create value
 MPose pose;
@@ -59,7 +62,7 @@ void MPose::setup()
   if (ini["pose"]["log"] == "true")
   { // open logfile
     std::string fn = service.logPath + "log_pose.txt";
-    logfile = fopen(fn.c_str(), "w");
+    logfile = logger.open(fn.c_str());
     fprintf(logfile, "%% Pose and velocity (%s)\n", fn.c_str());
     fprintf(logfile, "%% 1 \tTime (sec)\n");
     fprintf(logfile, "%% 2,3 \tVelocity left, right (m/s)\n");
@@ -72,7 +75,7 @@ void MPose::setup()
     fprintf(logfile, "%% 11 \tTurned angle (rad) - signed\n");
     // and absolute pose
     fn = service.logPath + "log_pose_abs.txt";
-    logAbs = fopen(fn.c_str(), "w");
+    logAbs = logger.open(fn.c_str());
     fprintf(logAbs, "%% Pose without folding and reset (%s)\n", fn.c_str());
     fprintf(logAbs, "%% 1 \tTime (sec)\n");
     fprintf(logAbs, "%% 2,3 \tPosition x,y (m)\n");
@@ -80,7 +83,11 @@ void MPose::setup()
     fprintf(logAbs, "%% 5 \tDriven distance (m) - signed\n");
     fprintf(logAbs, "%% 6 \tTurned angle (rad) - signed\n");
   }
-  th1 = new std::thread(runObj, this);
+  encTimeLast[0].now();
+  encTimeLast[1].now();
+  // new pose at every encoder update, as first in the encoder rate group
+  if (not executor.add(UExecutor::ENCODER, 10, "pose", [this]{ step(); }))
+    th1 = new std::thread(runObj, this);
 }
 
 
@@ -91,124 +98,124 @@ void MPose::terminate()
     th1->join();
     th1 = nullptr;
   }
+  if (logfile != nullptr)
+  {
+    logger.close(logfile);
+  }
+  if (logAbs != nullptr)
+    logger.close(logAbs);
+  logfile = nullptr;
+  logAbs = nullptr;
 }
 
 
 void MPose::run()
 {
+  realtime.apply("pose");
 //   printf("# MPose::run started\n");
-  int loop = 0;
-  int64_t encLast[2] = {0};
-  UTime t("now"); // time of update
-  UTime encTimeLast[2];
-  encTimeLast[0].now();
-  encTimeLast[1].now();
-  float dd[2]; // wheel moved since last update
   while (not service.stop)
-  {
-    if (encoder.updateCnt != encoderUpdateCnt)
-    {
-      encoderUpdateCnt = encoder.updateCnt;
-      // get new data
-      t = encoder.encTime;
-      int64_t enc[2] = {encoder.enc[0], encoder.enc[1]};
-      // debug
+  { // wait for new encoder values (or timeout to test for stop)
+    if (encoder.topic.wait(encoderUpdateCnt, 50000) != encoderUpdateCnt)
+      step();
+  }
+}
+
+void MPose::step()
+{
+  SEncoder::Data e;
+  float dd[2]; // wheel moved since last update
+  // get new data
+  encoderUpdateCnt = encoder.topic.read(e);
+  t = e.encTime;
+  int64_t * enc = e.enc;
+  // debug
 //       printf("# Pose got new encoder data %d,%d, at %.3fs\n",
 //              enc[0], enc[1], t.getDecSec(teensy1.justConnectedTime));
-      // debug end
-      if (loop < 2)
-      { // first two updates take last value as current
-        encLast[0] = enc[0]; // left
-        encLast[1] = enc[1]; // right
-      }
-      float dtt = 1.0; // in seconds - for turnrate
-      float dt[2];
-      int64_t de[2];
-      for (int i = 0; i < 2; i++)
-      { // find movement in time and distance for each wheel
-        dt[i] = t - encTimeLast[i]; // time
-        if (dt[i] < dtt)
-        { // the minimum update time (the other wheel may be stationary)
-          dtt = dt[i];
-        }
-        // left wheel - gives wrong results on Teensy
-        // so calculate folding explicitly
-        de[i] = enc[i] - encLast[i];
-        if (llabs(de[i]) > 1000)
-        { // given up in calculating folding around MAXINT,
-          // so one sample of zero change should be OK.
-          de[i] = 0;
-        }
-        // distance traveled since last
-        dd[i] = float(de[i]) * distPerTick; // encoder ticks
-        if (enc[i] != encLast[i])
-        { // wheel has moved since last update
-          encLast[i] = enc[i];
-          encTimeLast[i] = t;
-          wheelVel[i] = dd[i]/dt[i];
-        }
-        else
-        { // no tick change since last update
-          // update (reduce) velocity waiting for next tick
-          wheelVel[i] = copysignf(1.0, wheelVel[i]) * distPerTick/dt[i];
-        }
-      }
-      // turned angle in radians
-      // dh is positive for CCV, i.e. when right wheel (dd[1]) goes faster
-      float dh = (dd[1] - dd[0])/wheelBase;
-      // moved distance in meters
-      float ds = (dd[0] + dd[1])/2.0;
-      // update position
-      // both relative (x,y,h) and absolute (x2,y2,h2)
-      h += dh/2.0;
-      h2 += dh/2.0;
-      x += cosf(h) * ds;
-      y += sinf(h) * ds;
-      x2 += cosf(h2) * ds;
-      y2 += sinf(h2) * ds;
-      h += dh/2.0;
-      h2 += dh/2.0;
-      // fold angle
-      if (h > M_PI)
-        h -= M_PI * 2;
-      else if (h < -M_PI)
-        h += M_PI * 2;
-      if (h2 > M_PI)
-        h2 -= M_PI * 2;
-      else if (h2 < -M_PI)
-        h2 += M_PI * 2;
-      // update traveled distance and turned angle
-      dist += ds;
-      dist2 += ds;
-      //
-      turned += dh;
-      turned2 += dh;
-      //
-      turnrate = dh/dtt;
-      robVel = ds/dtt;
-      const float minTurnrate = 0.001;
-      if (fabs(turnrate) > minTurnrate)
-        // positive radius for positive turn-rate
-        turnRadius = robVel / turnrate;
-      else
-        // max radius is limited to minimum about 30m (at low speed (3cm/s))
-        // to avoid infinity
-        turnRadius = robVel / minTurnrate * copysignf(1.0, turnrate);
-      //
-      poseTime = t;
-      updateCnt++;
-      // finished making a new pose
-      toLog();
-      loop++;
+  // debug end
+  if (loop < 2)
+  { // first two updates take last value as current
+    encLast[0] = enc[0]; // left
+    encLast[1] = enc[1]; // right
+  }
+  float dtt = 1.0; // in seconds - for turnrate
+  float dt[2];
+  int64_t de[2];
+  for (int i = 0; i < 2; i++)
+  { // find movement in time and distance for each wheel
+    dt[i] = t - encTimeLast[i]; // time
+    if (dt[i] < dtt)
+    { // the minimum update time (the other wheel may be stationary)
+      dtt = dt[i];
+    }
+    // left wheel - gives wrong results on Teensy
+    // so calculate folding explicitly
+    de[i] = enc[i] - encLast[i];
+    if (llabs(de[i]) > 1000)
+    { // given up in calculating folding around MAXINT,
+      // so one sample of zero change should be OK.
+      de[i] = 0;
+    }
+    // distance traveled since last
+    dd[i] = float(de[i]) * distPerTick; // encoder ticks
+    if (enc[i] != encLast[i])
+    { // wheel has moved since last update
+      encLast[i] = enc[i];
+      encTimeLast[i] = t;
+      wheelVel[i] = dd[i]/dt[i];
     }
     else
-      // just wait a bit (1ms)
-      usleep(1000);
-  }
-  if (logfile != nullptr)
-  {
-    fclose(logfile);
+    { // no tick change since last update
+      // update (reduce) velocity waiting for next tick
+      wheelVel[i] = copysignf(1.0, wheelVel[i]) * distPerTick/dt[i];
+    }
   }
+  // turned angle in radians
+  // dh is positive for CCV, i.e. when right wheel (dd[1]) goes faster
+  float dh = (dd[1] - dd[0])/wheelBase;
+  // moved distance in meters
+  float ds = (dd[0] + dd[1])/2.0;
+  // update position
+  // both relative (x,y,h) and absolute (x2,y2,h2)
+  h += dh/2.0;
+  h2 += dh/2.0;
+  x += cosf(h) * ds;
+  y += sinf(h) * ds;
+  x2 += cosf(h2) * ds;
+  y2 += sinf(h2) * ds;
+  h += dh/2.0;
+  h2 += dh/2.0;
+  // fold angle
+  if (h > M_PI)
+    h -= M_PI * 2;
+  else if (h < -M_PI)
+    h += M_PI * 2;
+  if (h2 > M_PI)
+    h2 -= M_PI * 2;
+  else if (h2 < -M_PI)
+    h2 += M_PI * 2;
+  // update traveled distance and turned angle
+  dist += ds;
+  dist2 += ds;
+  //
+  turned += dh;
+  turned2 += dh;
+  //
+  turnrate = dh/dtt;
+  robVel = ds/dtt;
+  const float minTurnrate = 0.001;
+  if (fabs(turnrate) > minTurnrate)
+    // positive radius for positive turn-rate
+    turnRadius = robVel / turnrate;
+  else
+    // max radius is limited to minimum about 30m (at low speed (3cm/s))
+    // to avoid infinity
+    turnRadius = robVel / minTurnrate * copysignf(1.0, turnrate);
+  //
+  poseTime = t;
+  // finished making a new pose
+  topic.publish({poseTime, x, y, h, dist, turned, {wheelVel[0], wheelVel[1]}, turnrate, robVel});
+  toLog();
+  loop++;
 }
 
 void MPose::resetPose()
@@ -227,14 +234,14 @@ void MPose::toLog()
   {
     if (logfile != nullptr)
     { // log_pose
-      fprintf(logfile, "%lu.%04ld %.4f %.4f %.4f %.5f %.3f %.3f %.3f %.4f %.3f %.4f\n", poseTime.getSec(), poseTime.getMicrosec()/100,
+      logger.log(logfile, "%lu.%04ld %.4f %.4f %.4f %.5f %.3f %.3f %.3f %.4f %.3f %.4f\n", poseTime.getSec(), poseTime.getMicrosec()/100,
               wheelVel[0], wheelVel[1], robVel,
               turnrate, turnRadius,
               x, y, h, dist, turned);
     }
     if (logAbs != nullptr)
     { // log_absolute pose
-      fprintf(logAbs, "%lu.%04ld %.3f %.3f %.4f %.3f %.4f\n",
+      logger.log(logAbs, "%lu.%04ld %.3f %.3f %.4f %.3f %.4f\n",
               poseTime.getSec(), poseTime.getMicrosec()/100,
               x2, y2, h2, dist2, turned2);
     }
@@ -26,6 +26,7 @@
 
 #include "sencoder.h"
 #include "utime.h"
+#include "utopic.h"
 #include "thread"
 
 using namespace std;
@@ -37,7 +38,7 @@ using namespace std;
  *   h (heading)
  *   time of last encoder update (poseTime)
  *   wheel velocity (eheelVel)
- * An updateCnt is incremented at every update
+ * A copy is published (topic) at every update
  * */
 class MPose
 {
@@ -47,6 +48,10 @@ public:
   /**
    * thread to do updates, when new data is available */
   void run();
+  /**
+   * Calculate new pose from the latest encoder values
+   * (from run() or the executor encoder rate group) */
+  void step();
   /**
    * terminate */
   void terminate();
@@ -70,14 +75,23 @@ public:
   float dist = 0;
   float turned = 0;
   /// PC time of last update
-  UTime poseTime;
+  UTimeNs poseTime;
   //  Calculated wheel velocity
   float wheelVel[2] = {0.0};
   float turnrate = 0.0;
   float turnRadius = 0.0;
   float robVel = 0.0;
-  // new pose is calculated count
-  int updateCnt = 0;
+  /// pose values for other modules
+  struct Data
+  {
+    UTimeNs poseTime;
+    float x, y, h;
+    float dist, turned;
+    float wheelVel[2];
+    float turnrate, robVel;
+  };
+  /// consistent copy of latest pose, and wait for new pose
+  UTopic<Data> topic;
 
 private:
   /// private stuff
@@ -97,9 +111,13 @@ private:
   FILE * logfile = nullptr;
   // just absolute pose (and distance)
   FILE * logAbs = nullptr;
-  std::thread * th1;
+  std::thread * th1 = nullptr;
   // source data iteration
-  int encoderUpdateCnt = 0;
+  uint32_t encoderUpdateCnt = 0;
+  int loop = 0;
+  int64_t encLast[2] = {0};
+  UTimeNs t; // time of update
+  UTimeNs encTimeLast[2];
   /// pose that can't be reset (for debug/map use)
   float x2 = 0.0, y2 = 0.0, h2 = 0.0;
   float dist2 = 0;
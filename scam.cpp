@@ -27,6 +27,7 @@
 #include <sys/types.h>
 #include <filesystem>
 #include <opencv2/core/mat.hpp>
+#include <opencv2/core/utility.hpp>
 #include <opencv2/calib3d/calib3d.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
 #include <stdio.h>
@@ -34,6 +35,7 @@
 
 #include "scam.h"
 #include "uservice.h"
+#include "urealtime.h"
 
 // create connection object
 UCam cam;
@@ -60,6 +62,9 @@ void UCam::setup()
   if (ini["camera"]["enabled"] == "true")
   { // create directory for images
     fs::create_directory(ini["camera"]["imagepath"]);
+    if (realtime.isEnabled() and realtime.visionThreads > 0)
+      // OpenCV threads are started from the main thread, so use the same CPUs
+      cv::setNumThreads(realtime.visionThreads);
     //
     // create log file
     toConsole = ini["camera"]["print"] == "true";
@@ -182,6 +187,7 @@ void UCam::terminate()
 
 void UCam::run()
 {
+  realtime.apply("cam");
   printf("# Camera is running (to stabilize illumination)\n");
   toLog("Camera open");
   while (not service.stop and not stopCam)
@@ -27,6 +27,10 @@
 #include "sdist.h"
 #include "steensy.h"
 #include "uservice.h"
+#include "udispatch.h"
+#include "uscan.h"
+#include "ubinframe.h"
+#include "ulogger.h"
 // create value
 SIrDist dist;
 
@@ -70,14 +74,15 @@ void SIrDist::setup()
   snprintf(s, MSL, "irc %d %d %d %d 1\n", ir13cm[0], ir50cm[0], ir13cm[1], ir50cm[1]);
   teensy1.send(s);
   // subscribe to sensor data
-  std::string ss = "sub ir " + ini["dist"]["rate_ms"] + "\n";
-  teensy1.send(ss.c_str());
+  dispatch.add("ir", [this](const char * msg, UTime & t) { return decode(msg, t); });
+  dispatch.addBin(UBinFrame::BIN_IR, [this](const uint8_t * p, UTime & t) { decodeBin(p, t); });
+  teensy1.subscribe("ir", ini["dist"]["rate_ms"]);
   // logfiles
   toConsole = ini["dist"]["print"] == "true";
   if (ini["dist"]["log"] == "true")
   { // open logfile
     std::string fn = service.logPath + "log_irdist.txt";
-    logfile = fopen(fn.c_str(), "w");
+    logfile = logger.open(fn.c_str());
     fprintf(logfile, "%% IR distance sensor logfile %s\n", fn.c_str());
     fprintf(logfile, "%% 1 \tTime (sec)\n");
     fprintf(logfile, "%% 2,3 \tsensor 1, 2 (m)\n");
@@ -94,7 +99,7 @@ void SIrDist::terminate()
 {
   if (logfile != nullptr)
   {
-    fclose(logfile);
+    logger.close(logfile);
   }
 }
 
@@ -108,67 +113,91 @@ bool SIrDist::decode(const char* msg, UTime & msgTime)
       p1 += 3;
     else
       return false;
-    updTime = msgTime;
     // get values
-    dist[0] = strtof(p1, (char**)&p1); // already converted by Teensy as sharp sensor
-    dist[1] = strtof(p1, (char**)&p1);
-    distAD[0] = strtol(p1, (char**)&p1, 10);
-    distAD[1] = strtol(p1, (char**)&p1, 10);
-    // could be an URM09 sensor
-    if (sensortype[0] == URM09)
-      dist[0] = distAD[0] * urm09factor;
-    if (sensortype[1] == URM09)
-      dist[1] = distAD[1] * urm09factor;
-    // notify users of a new update
-    updateCnt++;
-    // save to log_encoder_pose
-    toLog();
-    // calibration
-    if (inCalibration)
+    float d[2]; // already converted by Teensy as sharp sensor
+    int ad[2];
+    UScan sc(p1);
+    sc.get(d, 2);
+    sc.get(ad, 2);
+    if (not sc.ok(4))
+    {
+      sc.report("SIrDist::decode", msg);
+      return true;
+    }
+    dist[0] = d[0];
+    dist[1] = d[1];
+    distAD[0] = ad[0];
+    distAD[1] = ad[1];
+    distUpdated(msgTime);
+  }
+  else
+    used = false;
+  return used;
+}
+
+void SIrDist::decodeBin(const uint8_t * payload, UTime & msgTime)
+{ // same values as the 'ir' text message
+  dist[0] = UBinFrame::getF32(payload);
+  dist[1] = UBinFrame::getF32(&payload[4]);
+  distAD[0] = UBinFrame::getI32(&payload[8]);
+  distAD[1] = UBinFrame::getI32(&payload[12]);
+  distUpdated(msgTime);
+}
+
+void SIrDist::distUpdated(UTime & msgTime)
+{
+  updTime = msgTime;
+  // could be an URM09 sensor
+  if (sensortype[0] == URM09)
+    dist[0] = distAD[0] * urm09factor;
+  if (sensortype[1] == URM09)
+    dist[1] = distAD[1] * urm09factor;
+  // notify users of a new update
+  updateCnt++;
+  // save to log_encoder_pose
+  toLog();
+  // calibration
+  if (inCalibration)
+  {
+    if (calibSensor == 1)
+      calibSum += distAD[0];
+    else
+      calibSum += distAD[1];
+    calibCount++;
+    if (calibCount >= calibCountMax)
     {
       if (calibSensor == 1)
-        calibSum += distAD[0];
-      else
-        calibSum += distAD[1];
-      calibCount++;
-      if (calibCount >= calibCountMax)
       {
-        if (calibSensor == 1)
-        {
-          if (calibDist == 13)
-            ir13cm[0] = calibSum / calibCount;
-          else
-            ir50cm[0] = calibSum / calibCount;
-        }
+        if (calibDist == 13)
+          ir13cm[0] = calibSum / calibCount;
         else
-        {
-          if (calibDist == 13)
-            ir13cm[1] = calibSum / calibCount;
-          else
-            ir50cm[1] = calibSum / calibCount;
-        }
-        // save as new value to the ini structure
-        const int MSL = 100;
-        char s[MSL];
+          ir50cm[0] = calibSum / calibCount;
+      }
+      else
+      {
         if (calibDist == 13)
-        {
-          snprintf(s, MSL, "%d %d", ir13cm[0], ir13cm[1]);
-          ini["dist"]["ir13cm"] = s;
-        }
+          ir13cm[1] = calibSum / calibCount;
         else
-        {
-          snprintf(s, MSL, "%d %d", ir50cm[0], ir50cm[1]);
-          ini["dist"]["ir50cm"] = s;
-        }
-        //
-        inCalibration = false;
-        printf("# IR distance for sensor %d at %dcm finished: %s\n", calibSensor, calibDist, s);
+          ir50cm[1] = calibSum / calibCount;
+      }
+      // save as new value to the ini structure
+      const int MSL = 100;
+      char s[MSL];
+      if (calibDist == 13)
+      {
+        snprintf(s, MSL, "%d %d", ir13cm[0], ir13cm[1]);
+        ini["dist"]["ir13cm"] = s;
       }
+      else
+      {
+        snprintf(s, MSL, "%d %d", ir50cm[0], ir50cm[1]);
+        ini["dist"]["ir50cm"] = s;
+      }
+      //
+      inCalibration = false;
+      printf("# IR distance for sensor %d at %dcm finished: %s\n", calibSensor, calibDist, s);
     }
   }
-  else
-    used = false;
-  return used;
 }
 
 void SIrDist::toLog()
@@ -177,7 +206,7 @@ void SIrDist::toLog()
   {
     if (logfile != nullptr)
     {
-      fprintf(logfile,"%lu.%04ld %.3f %.3f %d %d\n", updTime.getSec(), updTime.getMicrosec()/100,
+      logger.log(logfile,"%lu.%04ld %.3f %.3f %d %d\n", updTime.getSec(), updTime.getMicrosec()/100,
               dist[0], dist[1],
               distAD[0], distAD[1]);
     }
@@ -43,6 +43,8 @@ public:
   /** decode an unpacked incoming messages
    * \returns true if the message us used */
   bool decode(const char * msg, UTime & msgTime);
+  /** decode a binary 'ir' frame payload (see UBinFrame) */
+  void decodeBin(const uint8_t * payload, UTime & msgTime);
   /**
    * terminate */
   void terminate();
@@ -65,6 +67,8 @@ public:
   bool inCalibration = false;
 private:
   void toLog();
+  /** new values in dist[] and distAD[], convert, log, notify and calibrate */
+  void distUpdated(UTime & msgTime);
   bool toConsole = false;
   FILE * logfile = nullptr;
   //
@@ -27,6 +27,11 @@
 #include "sedge.h"
 #include "steensy.h"
 #include "uservice.h"
+#include "udispatch.h"
+#include "uscan.h"
+#include "ubinframe.h"
+#include "ulogger.h"
+#include "uexecutor.h"
 // create value
 SEdge sedge;
 
@@ -45,15 +50,17 @@ void SEdge::setup()
   bool high = ini["edge"]["highPower"] == "true";
   setSensor(true, high);
   //
-  std::string s = "sub liv " + ini["edge"]["rate_ms"] + "\n";
-  teensy1.send(s.c_str());
+  dispatch.add("liv", [this](const char * msg, UTime & t) { return decode(msg, t); });
+  dispatch.add("ls", [this](const char * msg, UTime & t) { return decode(msg, t); });
+  dispatch.addBin(UBinFrame::BIN_LIV, [this](const uint8_t * p, UTime & t) { decodeBin(p, t); });
+  teensy1.subscribe("liv", ini["edge"]["rate_ms"]);
   //
   toConsole = ini["edge"]["printRaw"] == "true";
   // logfile
   if (ini["edge"]["logRaw"] == "true")
   { // open logfile
     std::string fn = service.logPath + "log_edge_raw.txt";
-    logfile = fopen(fn.c_str(), "w");
+    logfile = logger.open(fn.c_str());
     fprintf(logfile, "%% Linesensor raw values logfile (reflectance values)\n");
     fprintf(logfile, "%% Sensor power high=%d\n", high);
     fprintf(logfile, "%% 1 \tTime (sec)\n");
@@ -66,7 +73,7 @@ void SEdge::terminate()
   setSensor(false, false);
   if (logfile != nullptr)
   {
-    fclose(logfile);
+    logger.close(logfile);
   }
 }
 
@@ -80,16 +87,20 @@ bool SEdge::decode(const char* msg, UTime & msgTime)
       p1 += 4;
     else
       return false;
-    updTime = msgTime;
 //     printf("# edgeraw: %s", msg);
-    for (int i = 0; i < 8; i++)
-    { // get integer value (averaged over sample time)
-      edgeRaw[i] = strtol(p1, (char**)&p1, 10);
+    // get integer values (averaged over sample time)
+    int v[8];
+    UScan sc(p1);
+    sc.get(v, 8);
+    if (not sc.ok(8))
+    {
+      sc.report("SEdge::decode", msg);
+      return true;
     }
-    // notify users of a new update
-    updateCnt++;
-    // save received data (if desired)
-    toLog();
+    updTime = msgTime;
+    for (int i = 0; i < 8; i++)
+      edgeRaw[i] = v[i];
+    edgeUpdated();
   }
   else if (strncmp(p1, "ls ", 3) == 0)
   { // debug for very raw values (illuminated and not illuminated values)
@@ -101,6 +112,27 @@ bool SEdge::decode(const char* msg, UTime & msgTime)
   return used;
 }
 
+void SEdge::decodeBin(const uint8_t * payload, UTime & msgTime)
+{ // 8 line sensor values as in 'liv'
+  updTime = msgTime;
+  for (int i = 0; i < 8; i++)
+    edgeRaw[i] = UBinFrame::getI16(&payload[i * 2]);
+  edgeUpdated();
+}
+
+void SEdge::edgeUpdated()
+{
+  Data d;
+  d.updTime = UTimeNs::from(updTime);
+  for (int i = 0; i < 8; i++)
+    d.edgeRaw[i] = edgeRaw[i];
+  // notify users of a new update
+  topic.publish(d);
+  executor.trigger(UExecutor::EDGE);
+  // save received data (if desired)
+  toLog();
+}
+
 void SEdge::setSensor(bool on, bool high)
 {
   const int MSL = 150;
@@ -121,7 +153,7 @@ void SEdge::toLog()
   {
     if (logfile != nullptr)
     {
-      fprintf(logfile,"%lu.%04ld %d %d %d %d %d %d %d %d\n", updTime.getSec(), updTime.getMicrosec()/100,
+      logger.log(logfile,"%lu.%04ld %d %d %d %d %d %d %d %d\n", updTime.getSec(), updTime.getMicrosec()/100,
               edgeRaw[0],
               edgeRaw[1],
               edgeRaw[2],
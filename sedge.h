@@ -25,6 +25,7 @@
 
 
 #include "utime.h"
+#include "utopic.h"
 
 using namespace std;
 
@@ -44,6 +45,8 @@ public:
   /** decode an unpacked incoming messages
    * \returns true if the message us used */
   bool decode(const char * msg, UTime & msgTime);
+  /** decode a binary 'liv' frame payload (see UBinFrame) */
+  void decodeBin(const uint8_t * payload, UTime & msgTime);
   /**
    * terminate */
   void terminate();
@@ -52,13 +55,21 @@ public:
   void setSensor(bool on, bool high);
 
 public:
-//   mutex dataLock; // ensure consistency
-  int updateCnt = false;
+  /// line sensor values for other modules
+  struct Data
+  {
+    UTimeNs updTime;
+    int edgeRaw[8];
+  };
+  /// consistent copy of latest values, and wait for new values
+  UTopic<Data> topic;
   UTime updTime;
   int edgeRaw[8];
 
 private:
   void toLog();
+  /** new values in edgeRaw[], inform users and log */
+  void edgeUpdated();
   bool toConsole = false;
   FILE * logfile = nullptr;
   //   std::condition_variable_any nd; // new data service
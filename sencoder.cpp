@@ -27,6 +27,11 @@
 #include "sencoder.h"
 #include "steensy.h"
 #include "uservice.h"
+#include "udispatch.h"
+#include "uscan.h"
+#include "ubinframe.h"
+#include "ulogger.h"
+#include "uexecutor.h"
 // create value
 SEncoder encoder;
 
@@ -43,8 +48,9 @@ void SEncoder::setup()
   // reset encoder and pose
   teensy1.send("enc0\n");
   // use values and subscribe to source data
-  std::string s = "sub enc " + ini["encoder"]["rate_ms"] + "\n";
-  teensy1.send(s.c_str());
+  dispatch.add("enc", [this](const char * msg, UTime & t) { return decode(msg, t); });
+  dispatch.addBin(UBinFrame::BIN_ENC, [this](const uint8_t * p, UTime & t) { decodeBin(p, t); });
+  teensy1.subscribe("enc", ini["encoder"]["rate_ms"]);
   toConsole = ini["encoder"]["print"] == "true";
   // ensure default is true if no 'encoder_reversed' entry is available
   // Robobot motors has reversed encoders (encoder A and B is swapped)
@@ -52,6 +58,7 @@ void SEncoder::setup()
   encoder_reversed = true;
   if (ini["encoder"].has("encoder_reversed"))
     encoder_reversed = ini["encoder"]["encoder_reversed"] == "true";
+  std::string s;
   if (encoder_reversed)
     s = "encrev 1\n";
   else
@@ -61,7 +68,7 @@ void SEncoder::setup()
   if (ini["encoder"]["log"] == "true")
   { // open logfile
     std::string fn = service.logPath + "log_encoder.txt";
-    logfile = fopen(fn.c_str(), "w");
+    logfile = logger.open(fn.c_str());
     fprintf(logfile, "%% Encoder logfile\n");
     fprintf(logfile, "%% 1 \tTime (sec)\n");
     fprintf(logfile, "%% 2,3 \tenc left, right\n");
@@ -73,7 +80,7 @@ void SEncoder::terminate()
 {
   if (logfile != nullptr)
   {
-    fclose(logfile);
+    logger.close(logfile);
   }
 }
 
@@ -87,22 +94,43 @@ bool SEncoder::decode(const char* msg, UTime & msgTime)
       p1 += 4;
     else
       return false;
-    encTime = msgTime;
-    enc[0] = -strtoll(p1, (char**)&p1, 10);
-    enc[1] = strtoll(p1, (char**)&p1, 10);
-    // notify users of a new update
-    updateCnt++;
-    // save to log_encoder_pose
-    toLog();
-    // save new value as old value
-    encLast[0] = enc[0];
-    encLast[1] = enc[1];
+    int64_t v[2];
+    UScan sc(p1);
+    sc.get(v, 2);
+    if (not sc.ok(2))
+    {
+      sc.report("SEncoder::decode", msg);
+      return true;
+    }
+    enc[0] = -v[0];
+    enc[1] = v[1];
+    encUpdated(msgTime);
   }
   else
     used = false;
   return used;
 }
 
+void SEncoder::decodeBin(const uint8_t * payload, UTime & msgTime)
+{ // same values (and sign) as the 'enc' text message
+  enc[0] = -int64_t(UBinFrame::getI32(payload));
+  enc[1] = UBinFrame::getI32(&payload[4]);
+  encUpdated(msgTime);
+}
+
+void SEncoder::encUpdated(UTime & msgTime)
+{
+  encTime = msgTime;
+  // notify users of a new update
+  topic.publish({UTimeNs::from(encTime), {enc[0], enc[1]}});
+  executor.trigger(UExecutor::ENCODER);
+  // save to log_encoder_pose
+  toLog();
+  // save new value as old value
+  encLast[0] = enc[0];
+  encLast[1] = enc[1];
+}
+
 /*
 bool SEncoder::decode_float(const char* msg, UTime & msgTime)
 {
@@ -116,7 +144,7 @@ void SEncoder::toLog()
   {
     if (logfile != nullptr)
     {
-      fprintf(logfile,"%lu.%04ld %lu %lu %d %d\n", encTime.getSec(), encTime.getMicrosec()/100,
+      logger.log(logfile,"%lu.%04ld %lu %lu %d %d\n", encTime.getSec(), encTime.getMicrosec()/100,
               (unsigned long int)enc[0], (unsigned long int)enc[1], int(enc[0] - encLast[0]), int(enc[1] - encLast[1]));
     }
     if (toConsole)
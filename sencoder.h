@@ -36,6 +36,7 @@
 #include <math.h>
 
 #include "utime.h"
+#include "utopic.h"
 
 using namespace std;
 
@@ -53,18 +54,28 @@ public:
   /** decode an unpacked incoming messages
    * \returns true if the message us used */
   bool decode(const char * msg, UTime & msgTime);
+  /** decode a binary 'enc' frame payload (see UBinFrame) */
+  void decodeBin(const uint8_t * payload, UTime & msgTime);
   /**
    * terminate */
   void terminate();
 
 public:
-//   mutex dataLock; // ensure consistency
-  int updateCnt = false;
+  /// encoder values for other modules
+  struct Data
+  {
+    UTimeNs encTime;
+    int64_t enc[2];
+  };
+  /// consistent copy of latest values, and wait for new values
+  UTopic<Data> topic;
   UTime encTime, encTimeLast;
   int64_t enc[2] = {0};
 
 private:
   void toLog();
+  /** new encoder values in enc[], update time, log and users */
+  void encUpdated(UTime & msgTime);
   int64_t encLast[2] = {0};
   bool firstEnc = true;
   bool encoder_reversed = true;
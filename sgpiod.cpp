@@ -33,6 +33,8 @@
 
 // inspired from https://github.com/brgl/libgpiod/blob/master/bindings/cxx/gpiod.hpp
 #include "gpiod.h"
+#include "ulogger.h"
+#include "urealtime.h"
 
 using namespace std::chrono;
 
@@ -132,7 +134,7 @@ void SGpiod::setup()
   if (ini["gpio"]["log"] == "true")
   { // open logfile
     std::string fn = service.logPath + "log_gpio.txt";
-    logfile = fopen(fn.c_str(), "w");
+    logfile = logger.open(fn.c_str());
     fprintf(logfile, "%% gpio logfile\n");
     fprintf(logfile, "%% pins_out %s\n", ini["gpio"]["pins_out"].c_str());
     fprintf(logfile, "%% 1 \tTime (sec)\n");
@@ -156,7 +158,7 @@ void SGpiod::terminate()
     th1->join();
   if (logfile != nullptr)
   {
-    fclose(logfile);
+    logger.close(logfile);
   }
   try
   {
@@ -225,6 +227,7 @@ void SGpiod::setPin(const int pin, bool value)
 
 void SGpiod::run()
 {
+  realtime.apply("gpio");
   bool pv[MAX_PINS] = {false};
   bool changed = true;
   int loop = 0;
@@ -299,7 +302,7 @@ void SGpiod::toLog(bool pv[])
   UTime t("now");
   if (logfile != nullptr)
   {
-    fprintf(logfile,"%lu.%04ld %d %d %d %d %d %d %d\n",
+    logger.log(logfile,"%lu.%04ld %d %d %d %d %d %d %d\n",
             t.getSec(), t.getMicrosec()/100,
             pv[0], pv[1], pv[2], pv[3], pv[4], pv[5], pv[6]);
   }
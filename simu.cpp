@@ -27,6 +27,10 @@
 #include "simu.h"
 #include "steensy.h"
 #include "uservice.h"
+#include "udispatch.h"
+#include "uscan.h"
+#include "ubinframe.h"
+#include "ulogger.h"
 // create value
 SImu imu;
 
@@ -44,10 +48,12 @@ void SImu::setup() {
 
 	// use values and subscribe to source data
 	// like teensy1.send("sub pose 4\n");
-	std::string s = "sub gyro0 " + ini["imu"]["rate_ms"] + "\n";
-	teensy1.send(s.c_str());
-	s = "sub acc0 " + ini["imu"]["rate_ms"] + "\n";
-	teensy1.send(s.c_str());
+	dispatch.add("gyro0", [this](const char * msg, UTime & t) { return decode(msg, t); });
+	dispatch.add("acc0", [this](const char * msg, UTime & t) { return decode(msg, t); });
+	dispatch.addBin(UBinFrame::BIN_GYRO, [this](const uint8_t * p, UTime & t) { decodeBin(false, p, t); });
+	dispatch.addBin(UBinFrame::BIN_ACC, [this](const uint8_t * p, UTime & t) { decodeBin(true, p, t); });
+	teensy1.subscribe("gyro0", ini["imu"]["rate_ms"]);
+	teensy1.subscribe("acc0", ini["imu"]["rate_ms"]);
 	
 	// gyro offset
 	const char * p1 = ini["imu"]["gyro_offset"].c_str();
@@ -67,14 +73,14 @@ void SImu::setup() {
 	if (ini["imu"]["log"] == "true")
 	{ // open logfile
 		std::string fn = service.logPath + "log_gyro.txt";
-		logfile = fopen(fn.c_str(), "w");
+		logfile = logger.open(fn.c_str());
 		fprintf(logfile, "%% Gyro logfile\n");
 		fprintf(logfile, "%% 1 \tTime (sec)\n");
 		fprintf(logfile, "%% 2-4 \tGyro (x,y,z)\n");
 		fprintf(logfile, "%% Gyro offset %g %g %g\n", gyroOffset[0], gyroOffset[1], gyroOffset[2]);
 		//
 		fn = service.logPath + "log_acc.txt";
-		logfileAcc = fopen(fn.c_str(), "w");
+		logfileAcc = logger.open(fn.c_str());
 		fprintf(logfileAcc, "%% Accelerometer logfile\n");
 		fprintf(logfileAcc, "%% 1 \tTime (sec)\n");
 		fprintf(logfileAcc, "%% 2-4 \tAccelerometer (x,y,z)\n");
@@ -84,11 +90,11 @@ void SImu::setup() {
 void SImu::terminate()
 {
   if (logfileAcc != nullptr) {
-    fclose(logfileAcc);
+    logger.close(logfileAcc);
   }
 
   if (logfile != nullptr) {
-    fclose(logfile);
+    logger.close(logfile);
     logfile = nullptr;
   }
 }
@@ -106,16 +112,18 @@ bool SImu::decode(const char* msg, UTime & msgTime)
 		return false;
 	}
 
-	updTimeAcc = msgTime;
-	acc[0] = strtof(p1, (char**)&p1);
-	acc[1] = strtof(p1, (char**)&p1);
-	acc[2] = strtof(p1, (char**)&p1);
-	
-	// notify users of a new update
-	updateCnt++;
-	
-	// save to log
-	toLog(true);
+	float v[3];
+	UScan sc(p1);
+	sc.get(v, 3);
+	if (not sc.ok(3))
+	{
+		sc.report("SImu::decode", msg);
+		return true;
+	}
+	acc[0] = v[0];
+	acc[1] = v[1];
+	acc[2] = v[2];
+	accUpdated(msgTime);
 	}
 	else if (strncmp(p1, "gyro0 ", 5) == 0) {
 
@@ -125,38 +133,18 @@ bool SImu::decode(const char* msg, UTime & msgTime)
 			return false;
 		}
 
-		updTime = msgTime;	
-		gyro[0] = strtof(p1, (char**)&p1);
-		gyro[1] = strtof(p1, (char**)&p1);
-		gyro[2] = strtof(p1, (char**)&p1);
-		
-		// notify users of a new update
-		updateCnt++;
-		
-		// save to log
-		toLog(false);
-		
-		//Some calibration stuff
-		if (inCalibration)
+		float v[3];
+		UScan sc(p1);
+		sc.get(v, 3);
+		if (not sc.ok(3))
 		{
-			for (int j = 0; j < 3; j++)
-			calibSum[j] = gyro[j];
-			calibCount++;
-			if (calibCount >= calibCountMax)
-			{
-				for (int j = 0; j < 3; j++) {
-					gyroOffset[j] = calibSum[j]/calibCount;
-				}
-				
-				// implement new values
-				const int MSL = 100;
-				char s[MSL];
-				snprintf(s, MSL, "%g %g %g", gyroOffset[0], gyroOffset[1], gyroOffset[2]);
-				ini["imu"]["gyro_offset"] = s;
-				inCalibration = false;
-				printf("# gyro calibration finished: %s\n", s);
-			}
+			sc.report("SImu::decode", msg);
+			return true;
 		}
+		gyro[0] = v[0];
+		gyro[1] = v[1];
+		gyro[2] = v[2];
+		gyroUpdated(msgTime);
 	}
 	else {
 		used = false;
@@ -165,6 +153,66 @@ bool SImu::decode(const char* msg, UTime & msgTime)
 	return used;
 }
 
+void SImu::decodeBin(bool isAcc, const uint8_t * payload, UTime & msgTime)
+{ // 3 float values as in 'acc0' or 'gyro0'
+	if (isAcc)
+	{
+		for (int i = 0; i < 3; i++)
+			acc[i] = UBinFrame::getF32(&payload[i * 4]);
+		accUpdated(msgTime);
+	}
+	else
+	{
+		for (int i = 0; i < 3; i++)
+			gyro[i] = UBinFrame::getF32(&payload[i * 4]);
+		gyroUpdated(msgTime);
+	}
+}
+
+void SImu::accUpdated(UTime & msgTime)
+{
+	updTimeAcc = msgTime;
+	
+	// notify users of a new update
+	updateCnt++;
+	
+	// save to log
+	toLog(true);
+}
+
+void SImu::gyroUpdated(UTime & msgTime)
+{
+	updTime = msgTime;
+	
+	// notify users of a new update
+	updateCnt++;
+	
+	// save to log
+	toLog(false);
+	
+	//Some calibration stuff
+	if (inCalibration)
+	{
+		for (int j = 0; j < 3; j++)
+		calibSum[j] = gyro[j];
+		calibCount++;
+		if (calibCount >= calibCountMax)
+		{
+			for (int j = 0; j < 3; j++) {
+				gyroOffset[j] = calibSum[j]/calibCount;
+			}
+			
+			// implement new values
+			const int MSL = 100;
+			char s[MSL];
+			snprintf(s, MSL, "%g %g %g", gyroOffset[0], gyroOffset[1], gyroOffset[2]);
+			ini["imu"]["gyro_offset"] = s;
+			inCalibration = false;
+			printf("# gyro calibration finished: %s\n", s);
+		}
+	}
+}
+
 void SImu::toLog(bool accChanged)
 {
   if (service.stop)
@@ -173,7 +221,7 @@ void SImu::toLog(bool accChanged)
   { // accelerometer
     if (logfileAcc != nullptr)
     {
-      fprintf(logfileAcc,"%lu.%04ld %.4f %.4f %.4f\n", updTimeAcc.getSec(), updTimeAcc.getMicrosec()/100,
+      logger.log(logfileAcc,"%lu.%04ld %.4f %.4f %.4f\n", updTimeAcc.getSec(), updTimeAcc.getMicrosec()/100,
               acc[0], acc[1], acc[2]);
     }
     if (toConsoleAcc)
@@ -186,7 +234,7 @@ void SImu::toLog(bool accChanged)
   { // gyro data
     if (logfile != nullptr)
     {
-      fprintf(logfile,"%lu.%04ld %.4f %.4f %.4f\n", updTimeAcc.getSec(), updTimeAcc.getMicrosec()/100,
+      logger.log(logfile,"%lu.%04ld %.4f %.4f %.4f\n", updTimeAcc.getSec(), updTimeAcc.getMicrosec()/100,
               gyro[0], gyro[1], gyro[2]);
     }
     if (toConsoleGyro)
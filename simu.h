@@ -42,6 +42,9 @@ public:
   /** decode an unpacked incoming messages
    * \returns true if the message us used */
   bool decode(const char * msg, UTime & msgTime);
+  /** decode a binary 'gyro0' or 'acc0' frame payload (see UBinFrame)
+   * \param isAcc true for 'acc0' payload, else 'gyro0' */
+  void decodeBin(bool isAcc, const uint8_t * payload, UTime & msgTime);
   /**
    * terminate */
   void terminate();
@@ -63,6 +66,10 @@ private:
   /** save to logfile (and/or console)
    * \param accChanged if new data is from accelerometer, else it is gyro */
   void toLog(bool accChanged);
+  /** new accelerometer values in acc[], log and notify */
+  void accUpdated(UTime & msgTime);
+  /** new gyro values in gyro[], log, notify and calibrate */
+  void gyroUpdated(UTime & msgTime);
   //
   FILE * logfile = nullptr;
   FILE * logfileAcc = nullptr;
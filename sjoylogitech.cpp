@@ -33,6 +33,8 @@
 #include "uservice.h"
 #include "cmixer.h"
 #include "cservo.h"
+#include "ulogger.h"
+#include "urealtime.h"
 
 #define JS_EVENT_BUTTON         0x01    /* button pressed/released */
 #define JS_EVENT_AXIS           0x02    /* joystick moved */
@@ -125,7 +127,7 @@ void SJoyLogitech::setup()
     if (ini["Joy_Logitech"]["log"] == "true")
     { // open logfile
       std::string fn = service.logPath + "log_joy_logitech.txt";
-      logfile = fopen(fn.c_str(), "w");
+      logfile = logger.open(fn.c_str());
       fprintf(logfile, "%% Logitech gamepad interface logfile\n");
       fprintf(logfile, "%% Device %s\n", joyDevice.c_str());
       fprintf(logfile, "%% Device type %s\n", deviceName.c_str());
@@ -160,7 +162,7 @@ void SJoyLogitech::terminate()
     th1->join();
   if (logfile != nullptr)
   {
-    fclose(logfile);
+    logger.close(logfile);
 //     printf("# SJoyLogitech:: logfile closed\n");
     logfile = nullptr;
   }
@@ -168,6 +170,7 @@ void SJoyLogitech::terminate()
 
 void SJoyLogitech::run()
 {
+  realtime.apply("joy");
   UTime t;
   t.now();
   sleep(3);
@@ -356,27 +359,27 @@ void SJoyLogitech::toLog()
   {
     if (logfile != nullptr)
     { // save all axis and buttons
-      fprintf(logfile, "%lu.%04ld %d %g %g %g ", updTime.getSec(), updTime.getMicrosec()/100,
+      logger.log(logfile, "%lu.%04ld %d %g %g %g ", updTime.getSec(), updTime.getMicrosec()/100,
               not mixer.autonomous(), velocity, turnVelocity, servoPosition
       );
       for (int i = 0; i < number_of_buttons; i++)
-        fprintf(logfile, " %d", joyValues.button[i]);
-      fprintf(logfile, " ");
+        logger.log(logfile, " %d", joyValues.button[i]);
+      logger.log(logfile, " ");
       for (int i = 0; i < number_of_axes; i++)
-        fprintf(logfile, " %d", joyValues.axes[i]);
-      fprintf(logfile, "\n");
+        logger.log(logfile, " %d", joyValues.axes[i]);
+      logger.log(logfile, "\n");
     }
     if (toConsole)
     { // save all axis and buttons
-      fprintf(logfile, "%lu.%04ld %d %g %g %g ", updTime.getSec(), updTime.getMicrosec()/100,
+      logger.log(logfile, "%lu.%04ld %d %g %g %g ", updTime.getSec(), updTime.getMicrosec()/100,
               not mixer.autonomous(), velocity, turnVelocity, servoPosition
       );
       for (int i = 0; i < number_of_buttons; i++)
-        fprintf(logfile, " %d", joyValues.button[i]);
-      fprintf(logfile, " ");
+        logger.log(logfile, " %d", joyValues.button[i]);
+      logger.log(logfile, " ");
       for (int i = 0; i < number_of_axes; i++)
-        fprintf(logfile, " %5d", joyValues.axes[i]);
-      fprintf(logfile, "\n");
+        logger.log(logfile, " %5d", joyValues.axes[i]);
+      logger.log(logfile, "\n");
     }
   }
 }
@@ -28,6 +28,8 @@
 #include "spyvision.h"
 #include "steensy.h"
 #include "uservice.h"
+#include "uscan.h"
+#include "urealtime.h"
 
 // create connection object
 SPyVision pyvision;
@@ -110,6 +112,7 @@ bool SPyVision::sendCommand(const char* command)
 
 void SPyVision::run()
 {
+  realtime.apply("pyvision");
   printf("# SPyVision is running\n");
   while (not service.stop)
   { // wait for reply
@@ -127,12 +130,24 @@ void SPyVision::decodeReply(const char* reply)
 {
   if (strncmp(reply, "arucopos ", 8) == 0)
   {
-    const char * p1 = &reply[8];
-    aruco_valid = strtol(p1, (char**)&p1, 10);
-    aruco_x = strtof(p1, (char**)&p1);
-    aruco_y = strtof(p1, (char**)&p1);
-    aruco_h = strtof(p1, (char**)&p1);
-    aruco_ID = strtol(p1, (char**)&p1, 10);
+    // valid x y h ID
+    bool valid = false;
+    float v[3];
+    int id;
+    UScan sc(&reply[8]);
+    sc.get(valid);
+    sc.get(v, 3);
+    sc.get(id);
+    if (sc.ok(5))
+    {
+      aruco_valid = valid;
+      aruco_x = v[0];
+      aruco_y = v[1];
+      aruco_h = v[2];
+      aruco_ID = id;
+    }
+    else
+      sc.report("SPyVision::decodeReply", reply);
   }
   else if (strncmp(reply, "golfpos ", 8) == 0)
   {
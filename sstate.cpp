@@ -27,6 +27,10 @@
 #include "steensy.h"
 #include "sstate.h"
 #include "uservice.h"
+#include "udispatch.h"
+#include "uscan.h"
+#include "ubinframe.h"
+#include "ulogger.h"
 
 // create the class with received info
 SState state;
@@ -41,11 +45,13 @@ void SState::setup()
     ini["state"]["regbot_version"] = "000";
   }
   toConsole = ini["state"]["print"] == "true";
-  teensy1.send("sub hbt 500\n");
+  dispatch.add("hbt", [this](const char * msg, UTime & t) { return decode(msg, t); });
+  dispatch.addBin(UBinFrame::BIN_HBT, [this](const uint8_t * p, UTime & t) { decodeBin(p, t); });
+  teensy1.subscribe("hbt", "500");
   if (ini["state"]["log"] == "true")
   { // open logfile
     std::string fn = service.logPath + "log_hbt.txt";
-    logfile = fopen(fn.c_str(), "w");
+    logfile = logger.open(fn.c_str());
     fprintf(logfile, "%% Heartbeat logfile\n");
     fprintf(logfile, "%% 1 \tTime (sec)\n");
     fprintf(logfile, "%% 2 \tRobot name index\n");
@@ -63,7 +69,7 @@ void SState::terminate()
   if (logfile != nullptr)
   {
     dataLock.lock();
-    fclose(logfile);
+    logger.close(logfile);
     logfile = nullptr;
     dataLock.unlock();
   }
@@ -87,42 +93,37 @@ bool SState::decode(const char* msg, UTime & msgTime)
   { // decode pose message
     // advance to first parameter
     if (strlen(p1) > 5)
-      p1 += 5;
+      p1 += 4;
     else
       return false;
     // get data
-    dataLock.lock();
-    // time in seconds from Teensy
-    double tt = strtof64(p1, (char**)&p1);
-    teensyTime = tt;
-    int x = strtol(p1, (char**)&p1, 10); // index (robot number)
-    if (x != idx)
-    { // set robot number into ini-file
-      idx = x;
-      ini["id"]["idx"] = to_string(idx);
-      // also ask for the new name
-      teensy1.send("idi\n", true);
-      printf("# SState::decode: asked for new name (idi -> dname)\n");
-    }
-    int rv = strtol(p1, (char**)&p1, 10); // index (from SVN)
-    if (rv != version)
+    double tt; // time in seconds from Teensy
+    int x; // index (robot number)
+    int rv; // index (from SVN)
+    float bat;
+    UScan sc(p1);
+    sc.get(tt);
+    sc.get(x);
+    sc.get(rv);
+    sc.get(bat);
+    if (not sc.ok(4))
     {
-      version = rv;
-      ini["state"]["regbot_version"] = to_string(rv);
+      sc.report("SState::decode", msg);
+      return true;
     }
-    batteryVoltage = strtof(p1, (char**)&p1); // y
-    controlState = strtol(p1, (char**)&p1, 10); // control state 0=no control, 2=user mission
-    //
-    type = strtol(p1, (char**)&p1, 10); // hardware type
-    ini["teensy"]["hardware"] = to_string(type);
-    //
-    load = strtol(p1, (char**)&p1, 10); // Teensy load in %
-    motorEnabled[0] = strtol(p1, (char**)&p1, 10); // motor 1
-    motorEnabled[1] = strtol(p1, (char**)&p1, 10); // motor 2
-    //
-    hbtTime = msgTime;
-    // save to log if file is open
-    toLog();
+    // control state (0=no control, 2=user mission), hardware type,
+    // Teensy load in %, motor 1 and 2 enabled.
+    // Older firmware may not have them all
+    int v[5] = {controlState, type, int(load), motorEnabled[0], motorEnabled[1]};
+    sc.get(v, 5);
+    dataLock.lock();
+    batteryVoltage = bat;
+    controlState = v[0];
+    type = v[1];
+    load = v[2];
+    motorEnabled[0] = v[3];
+    motorEnabled[1] = v[4];
+    hbtUpdated(tt, x, rv, msgTime);
     dataLock.unlock();
   }
   else
@@ -130,6 +131,47 @@ bool SState::decode(const char* msg, UTime & msgTime)
   return used;
 }
 
+void SState::decodeBin(const uint8_t * payload, UTime & msgTime)
+{ // same values as 'hbt' text message
+  dataLock.lock();
+  double tt = UBinFrame::getF64(payload);
+  int x = UBinFrame::getI16(&payload[8]);
+  int rv = UBinFrame::getI16(&payload[10]);
+  batteryVoltage = UBinFrame::getF32(&payload[12]);
+  controlState = payload[16];
+  type = payload[17];
+  load = payload[18];
+  motorEnabled[0] = (payload[19] & 0x01) != 0;
+  motorEnabled[1] = (payload[19] & 0x02) != 0;
+  hbtUpdated(tt, x, rv, msgTime);
+  dataLock.unlock();
+}
+
+void SState::hbtUpdated(double tt, int x, int rv, UTime & msgTime)
+{
+  teensyTime = tt;
+  teensy1.clockSync.add(tt, msgTime);
+  teensy1.txBucket.loadReport(load);
+  if (x != idx)
+  { // set robot number into ini-file
+    idx = x;
+    ini["id"]["idx"] = to_string(idx);
+    // also ask for the new name
+    teensy1.send("idi\n", true);
+    printf("# SState::decode: asked for new name (idi -> dname)\n");
+  }
+  if (rv != version)
+  {
+    version = rv;
+    ini["state"]["regbot_version"] = to_string(rv);
+  }
+  ini["teensy"]["hardware"] = to_string(type);
+  //
+  hbtTime = msgTime;
+  // save to log if file is open
+  toLog();
+}
+
 
 void SState::toLog()
 {
@@ -137,7 +179,7 @@ void SState::toLog()
     return;
   if (logfile != nullptr)
   {
-    fprintf(logfile, "%lu.%03ld %d %d %d %.2f %.1f %d %d\n", hbtTime.getSec(), hbtTime.getMilisec(),
+    logger.log(logfile, "%lu.%03ld %d %d %d %.2f %.1f %d %d\n", hbtTime.getSec(), hbtTime.getMilisec(),
             idx, version, controlState, batteryVoltage,
             load, motorEnabled[0], motorEnabled[1]);
   }
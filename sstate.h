@@ -37,6 +37,8 @@ public:
   /** decode an unpacked incoming messages
    * \returns true if the message us used */
   bool decode(const char * msg, UTime & msgTime);
+  /** decode a binary 'hbt' frame payload (see UBinFrame) */
+  void decodeBin(const uint8_t * payload, UTime & msgTime);
   /**
    * terminate */
   void terminate();
@@ -64,6 +66,9 @@ public:
   std::mutex dataLock;
 private:
   void toLog();
+  /** new heartbeat values, update robot index and version (if changed) and log.
+   * Called with dataLock locked */
+  void hbtUpdated(double tt, int x, int rv, UTime & msgTime);
   // logfile
   bool toConsole = false;
   FILE * logfile = nullptr;
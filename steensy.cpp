@@ -32,12 +32,19 @@
 #include <unistd.h>
 #include <math.h>
 #include <string.h>
-#include <termios.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/uio.h>
+#include <vector>
+#include <algorithm>
 
 #include "steensy.h"
 #include "uservice.h"
 #include "sstate.h"
 #include "sencoder.h"
+#include "udispatch.h"
+#include "ulogger.h"
+#include "urealtime.h"
 
 using namespace std;
 
@@ -92,24 +99,150 @@ void STeensy::setup()
     ini["teensy"]["confirm_timeout"] = "0.04";
     ini["teensy"]["encrev"] = "true";
   }
+  if (not ini["teensy"].has("rto_min"))
+  { // retransmit timeout is estimated from confirm round-trip times,
+    // confirm_timeout is used until the first confirm
+    ini["teensy"]["rto_min"] = "0.005";
+    ini["teensy"]["rto_max"] = "0.5";
+  }
+  if (not ini["teensy"].has("transport"))
+  { // connection to Teensy
+    ini["teensy"]["transport"] = "serial";
+    ini["teensy"]["; transport = serial (device), tcp (host, port), unix (socket) or loop (emulator in this process)"] = "";
+    ini["teensy"]["host"] = "localhost";
+    ini["teensy"]["port"] = "24001";
+    ini["teensy"]["socket"] = "/tmp/teensy.sock";
+  }
+  if (not ini["teensy"].has("queue_size"))
+  { // confirm queue size and what to do if it is full
+    ini["teensy"]["queue_size"] = "64";
+    ini["teensy"]["queue_full"] = "direct";
+    ini["teensy"]["; queue_full = direct sends unconfirmed, else drop"] = "";
+  }
+  if (not ini["teensy"].has("window"))
+  { // number of messages send before first confirm is received
+    ini["teensy"]["window"] = "1";
+  }
+  if (not ini["teensy"].has("tx_bytes_per_sec"))
+  { // pacing of traffic to Teensy, max rates are reduced when Teensy load is high
+    ini["teensy"]["tx_bytes_per_sec"] = "50000";
+    ini["teensy"]["tx_msg_per_sec"] = "1000";
+    ini["teensy"]["; tx rates are adapted down to tx_rate_min times max, from load in hbt"] = "";
+    ini["teensy"]["tx_rate_min"] = "0.1";
+    ini["teensy"]["tx_burst_sec"] = "0.05";
+    ini["teensy"]["; tx_reserve is part of burst reserved for tx_urgent messages"] = "";
+    ini["teensy"]["tx_reserve"] = "0.25";
+  }
+  if (not ini["teensy"].has("tx_urgent"))
+  { // priority classes from first keyword, urgent messages are written first,
+    // bulk (configuration) messages after normal messages
+    ini["teensy"]["tx_urgent"] = "motv stop leave";
+    ini["teensy"]["tx_bulk"] = "sub bin irc gyrocal setid eew";
+  }
+  if (not ini["teensy"].has("replay"))
+  { // commands that set Teensy state, the latest of each is send again after a reconnect
+    ini["teensy"]["replay"] = "sub bin lip irc gyrocal encrev servo";
+  }
+  if (not ini["teensy"].has("binary"))
+  { // data streams to get as binary frames, if supported by Teensy
+    ini["teensy"]["binary"] = "";
+    ini["teensy"]["; binary = list of streams, e.g. 'enc liv ir gyro0 acc0 hbt'"] = "";
+  }
+  if (not ini["teensy"].has("sync_window"))
+    // number of hbt used for Teensy clock to host clock estimate
+    ini["teensy"]["sync_window"] = "20";
+  if (not ini["teensy"].has("bin_timestamp"))
+  {
+    ini["teensy"]["bin_timestamp"] = "false";
+    ini["teensy"]["; bin_timestamp = true: binary frames are timestamped by Teensy"] = "";
+  }
   // get ini-file values
-  usbDevName = ini["teensy"]["device"];
+  { // the connection, USB serial device unless
+    // transport is 'tcp', 'unix' (socket) or 'loop' (in-process emulator)
+    std::string tr = ini["teensy"]["transport"];
+    if (tr == "tcp")
+      port = new UTransportTcp(ini["teensy"]["host"], strtol(ini["teensy"]["port"].c_str(), nullptr, 10));
+    else if (tr == "unix")
+      port = new UTransportUnix(ini["teensy"]["socket"]);
+    else if (tr == "loop")
+      port = new UTransportLoop();
+    else
+      port = new UTransportSerial(ini["teensy"]["device"]);
+  }
   toConsole = ini["teensy"]["print"] == "true";
   robotName = ini.get("id").get("type");
   confirmTimeout = strtof(ini["teensy"]["confirm_timeout"].c_str(), nullptr);
   encoderReversed = ini["teensy"]["encrev"] != "false";
   if (confirmTimeout < 0.01)
     confirmTimeout = 0.02;
+  confirmRetryTimeMax = confirmTimeout * confirmRetryCntMax;
+  outQueueSize = strtol(ini["teensy"]["queue_size"].c_str(), nullptr, 10);
+  if (outQueueSize < 8)
+    outQueueSize = 8;
+  queueFullSendDirect = ini["teensy"]["queue_full"] != "drop";
+  // preallocate all slots
+  outQueue.setup(outQueueSize);
+  if (confirmWindow <= 0)
+    // not set from command line
+    confirmWindow = strtol(ini["teensy"]["window"].c_str(), nullptr, 10);
+  if (confirmWindow < 1)
+    confirmWindow = 1;
+  else if (confirmWindow > outQueue.capacity())
+    confirmWindow = outQueue.capacity();
+  for (int i = 0; i < TX_PRIO_CNT; i++)
+    txRing[i].setup(TX_RING_SIZE);
+  txBucket.setup(strtod(ini["teensy"]["tx_bytes_per_sec"].c_str(), nullptr),
+                 strtod(ini["teensy"]["tx_msg_per_sec"].c_str(), nullptr),
+                 strtod(ini["teensy"]["tx_burst_sec"].c_str(), nullptr),
+                 strtod(ini["teensy"]["tx_reserve"].c_str(), nullptr),
+                 strtod(ini["teensy"]["tx_rate_min"].c_str(), nullptr));
+  for (UTxPrio c : {TX_URGENT, TX_BULK})
+  { // keywords for priority classes, urgent messages may use the pacing reserve
+    std::string us = ini["teensy"][c == TX_URGENT ? "tx_urgent" : "tx_bulk"];
+    char * save = nullptr;
+    char * p1 = strtok_r(us.data(), " ,", &save);
+    while (p1 != nullptr and prioKeyCnt < MAX_PRIO_KEYS)
+    {
+      strncpy(prioKey[prioKeyCnt], p1, MPKL - 1);
+      prioKey[prioKeyCnt][MPKL - 1] = '\0';
+      prioKeyClass[prioKeyCnt] = c;
+      prioKeyCnt++;
+      p1 = strtok_r(nullptr, " ,", &save);
+    }
+  }
+  replay.setup(ini["teensy"]["replay"].c_str());
+  crcBurst = strtol(ini["flight"]["crc_burst"].c_str(), nullptr, 10);
+  rtt.setup(confirmTimeout, strtod(ini["teensy"]["rto_min"].c_str(), nullptr),
+            strtod(ini["teensy"]["rto_max"].c_str(), nullptr));
+  clockSync.setup(strtol(ini["teensy"]["sync_window"].c_str(), nullptr, 10));
+  binTimestamp = ini["teensy"]["bin_timestamp"] == "true";
+  { // streams requested as binary frames
+    std::string bs = ini["teensy"]["binary"];
+    char * save = nullptr;
+    char * p1 = strtok_r(bs.data(), " ,", &save);
+    while (p1 != nullptr)
+    {
+      int type = UBinFrame::typeFromName(p1);
+      if (type > 0)
+        binRequest[type] = true;
+      else
+        printf("# STeensy::setup: '%s' is not available as binary stream\n", p1);
+      p1 = strtok_r(nullptr, " ,", &save);
+    }
+    for (int i = 0; i < UBinFrame::BIN_TYPE_CNT; i++)
+      binSeq[i] = -1;
+  }
   //
   if (ini["teensy"]["log"] == "true")
   { // open log file and write the header - else no logging
     std::string fn = service.logPath + "log_teensy_io.txt";
-    logfile = fopen(fn.c_str(), "w");
+    logfile = logger.open(fn.c_str());
     fprintf(logfile, "%% teensy communication to/from Teensy\n");
     fprintf(logfile, "%% 1 \tTime (sec) from system\n");
     fprintf(logfile, "%% 2 \t(Tx) Send to Teensy\n");
     fprintf(logfile, "%%   \t(Rx) Received from Teensy\n");
     fprintf(logfile, "%%   \t(Qu N) Put in queue to Teensy, now queue size N\n");
+    fprintf(logfile, "%%   \t(Rb) Binary frame received (type name, sequence number, payload size)\n");
     fprintf(logfile, "%% 3 \tMessage string queued, send or received\n");
   }
   // tell the Teensy its type-name - should be "robobot"
@@ -142,6 +275,14 @@ void STeensy::setup()
     // save to Regbot flash
     teensy1.send("eew\n");
   }
+  // messages handled here
+  dispatch.add("dname", [this](const char * msg, UTime &) { return decodeTeensy(msg); });
+  dispatch.add("bin", [this](const char * msg, UTime &) { return decodeTeensy(msg); });
+  // event to wake the receive thread, when a message is queued
+  wakeFd = eventfd(0, EFD_NONBLOCK);
+  // writer thread, for everything send to Teensy
+  txWakeFd = eventfd(0, EFD_NONBLOCK);
+  thWriter = new std::thread(runWriterObj, this);
   // start thread and open teensy connection
   th1 = new std::thread(runObj, this);
   // allow thread to open connection
@@ -169,13 +310,68 @@ void STeensy::terminate()
     th1->join();
 //     printf("# STeensy:: read thread closed\n");
   }
+  if (thWriter != nullptr)
+  {
+    thWriter->join();
+    thWriter = nullptr;
+  }
+  if (port != nullptr)
+  { // closed by the receive thread
+    delete port;
+    port = nullptr;
+  }
+  if (wakeFd >= 0)
+  {
+    close(wakeFd);
+    wakeFd = -1;
+  }
+  if (txWakeFd >= 0)
+  {
+    close(txWakeFd);
+    txWakeFd = -1;
+  }
+  if (txWriteCnt > 0)
+  {
+    printf("# STeensy:: writer: %d frames in %d writes (max %d), %d not send (queue full)\n",
+           txFrameCnt, txWriteCnt, txBatchMax, txFullCnt.load());
+    printf("# STeensy:: pacing: rate %.0f msg/s %.0f B/s (factor %.2f, %d down, %d up), "
+           "%d waits, %d urgent in debt, Teensy load %.0f%%, RTT min %.2f ms smooth %.2f ms\n",
+           txBucket.getMsgRate(), txBucket.getByteRate(), txBucket.getRateFactor(),
+           txBucket.decreaseCnt, txBucket.increaseCnt, txBucket.waitCnt, txBucket.debtCnt,
+           txBucket.lastLoad, txBucket.getMinRtt() * 1000, txBucket.getSmoothRtt() * 1000);
+  }
+  if (binFrameCnt > 0 or binCrcErrCnt > 0)
+  { // binary frame statistics
+    std::string acc;
+    for (int i = 1; i < UBinFrame::BIN_TYPE_CNT; i++)
+      if (binAccepted[i])
+        acc += std::string(" ") + UBinFrame::typeName(i);
+    printf("# STeensy:: binary frames %d, CRC errors %d, lost %d (streams:%s)\n",
+           binFrameCnt, binCrcErrCnt, binLostCnt, acc.c_str());
+  }
+  if (clockSync.isValid())
+    printf("# STeensy:: clock sync from %d hbt, drift %.1f ppm, max arrival delay %.2f ms\n",
+           clockSync.getPairCnt(), clockSync.getDriftPpm(), clockSync.getMaxDelay() * 1000);
+  if (txFrameCnt > 0)
+  { // queueing delay for each priority class
+    const char * prioName[TX_PRIO_CNT] = {"urgent", "normal", "bulk"};
+    printf("# STeensy:: tx delay  count  mean(us)   max(us)  histogram (from us:count)\n");
+    for (int i = 0; i < TX_PRIO_CNT; i++)
+      if (txDelay[i].getCount() > 0)
+        txDelay[i].print(prioName[i]);
+  }
+  if (rtt.sampleCnt > 0)
+    printf("# STeensy:: confirm RTT from %d msgs (%d resend not used): srtt %.2f ms, rttvar %.2f ms, "
+           "min %.2f ms, max %.2f ms, RTO %.2f ms; %d resend, max backoff %d\n",
+           rtt.sampleCnt, rtt.ambiguousCnt, rtt.getSrtt() * 1000, rtt.getRttVar() * 1000,
+           rtt.getMinRtt() * 1000, rtt.getMaxRtt() * 1000, rtt.getRto(1) * 1000,
+           confirmRetryCnt, rtt.maxBackoff);
+  printLinkStats();
   // close logfile if open
   if (logfile != nullptr)
   {
-    dataLock.lock();
-    fclose(logfile);
+    logger.close(logfile);
     logfile = nullptr;
-    dataLock.unlock(); // ensure consistency
   }
 }
 
@@ -184,6 +380,8 @@ void STeensy::terminate()
 bool STeensy::send(const char* message, bool direct)
 {
   bool sendOK = false;
+  // keep subscriptions and other settings for a reconnect
+  replay.record(message);
   if (direct)
   {
     sendOK = sendDirect(message);
@@ -202,11 +400,36 @@ void STeensy::sendToQueue(const char* message)
 //   if (strncmp(message, "sub enc", 7) == 0)
 //     printf("# STeensy 'sub enc' just before queue %s", message);
   // debug end
-  outQueue.push(UOutQueue(message));
-  dataLock.lock(); // ensure consistency
-  toLogQu();
-//   printf("# STeensy::sendToQueue: added '%s' tx-queue, now size %d\n", outQueue.back().msg, (int)outQueue.size());
-  dataLock.unlock();
+  if (strnlen(message, UOutQueue::MML) + 5 >= UOutQueue::MML)
+  { // the queue slots can not hold this
+    printf("# STeensy::sendToQueue: messages longer than %d chars are not allowed! '%s'\n", UOutQueue::MML - 5, message);
+    return;
+  }
+  int idx = outQueue.claim();
+  if (idx < 0)
+  { // queue is full - never wait here
+    queueFullCnt++;
+    if (queueFullSendDirect)
+      sendDirect(message);
+    else
+      printf("# STeensy::sendToQueue: queue full (%d), dropped '%s'\n", outQueue.capacity(), message);
+    return;
+  }
+  int qs = outQueue.size();
+  if (qs > outQueueMax)
+    outQueueMax = qs;
+  UOutQueue & m = outQueue.slot(idx);
+  m.prepare(message);
+  m.prio = txPrio(message);
+  toLogQu(m, outQueue.size());
+//   printf("# STeensy::sendToQueue: added '%s' tx-queue, now size %d\n", m.msg, outQueue.size());
+  outQueue.publish(idx);
+  // wake the receive thread to get it send
+  if (wakeFd >= 0)
+  {
+    uint64_t ev = 1;
+    write(wakeFd, &ev, sizeof(ev));
+  }
 }
 
 bool STeensy::generateCRC(const char * cmd, char * crc)
@@ -235,85 +458,243 @@ bool STeensy::generateCRC(const char * cmd, char * crc)
 }
 
 bool STeensy::sendDirect(const char* message)
-{ // this function may be called by more than one thread
-  // so make sure that only one send at any one time
-  int timeoutMs = 100;
-//   printf("# STeensy try to send timeout=%dms, confirmSend=%d, msg:%s", timeoutMs, confirmSend, message);
-  int t = 0;
-  bool lostConnection = false;
-  bool sendOK = false;
-  std::string cmd = message;
-  // remove any source information as this is not relevant for the Teensy
-  if (teensyConnectionOpen and cmd[0] != '#')
-  { // simulator or not
-    // add CRC code
-    const int MCL = 4;
-    char crc[MCL];
-    bool gotNewline = generateCRC(message, crc);
-    cmd.insert(0, crc);
-    if (not gotNewline)
-      cmd.append(1, '\n');
-    int n = cmd.size();
-    //
+{ // this function may be called by any thread,
+  // the message is formatted and queued for the writer thread, that
+  // will send it as soon as possible, this will never wait.
+  if (not teensyConnectionOpen or message[0] == '#')
+    return false;
+  int n = strnlen(message, UTxFrame::MFL);
+  if (n + 5 >= UTxFrame::MFL)
+  {
+    printf("# STeensy::sendDirect: messages longer than %d chars are not allowed! '%s'\n", UTxFrame::MFL - 5, message);
+    return false;
+  }
+  UTxPrio prio = txPrio(message);
+  URing<UTxFrame> & ring = txRing[prio];
+  int idx = ring.claim();
+  if (idx < 0)
+  { // writer is behind - drop
+    txFullCnt++;
+    return false;
+  }
+  UTxFrame & f = ring.slot(idx);
+  // add CRC code in front
+  bool gotNewline = generateCRC(message, f.data);
+  memcpy(&f.data[3], message, n);
+  f.len = n + 3;
+  if (not gotNewline)
+    f.data[f.len++] = '\n';
+  f.data[f.len] = '\0';
+  f.direct = true;
+  f.queued = nullptr;
+  f.queuedAt.now();
+  ring.publish(idx);
+  // wake writer
+  uint64_t one = 1;
+  if (write(txWakeFd, &one, sizeof(one)) < 0)
+    perror("# STeensy::sendDirect wake writer");
+  return true;
+}
+
+bool STeensy::txEnqueue(UOutQueue * m)
+{ // queue a formatted message
+  URing<UTxFrame> & ring = txRing[m->prio];
+  int idx = ring.claim();
+  if (idx < 0)
+    return false;
+  UTxFrame & f = ring.slot(idx);
+  memcpy(f.data, m->msg, m->len);
+  f.len = m->len;
+  f.data[f.len] = '\0';
+  f.direct = false;
+  f.queued = m;
+  // set by the writer
+  m->writtenAtUs = 0;
+  m->txPending++;
+  if (m->resendCnt == 0)
+    f.queuedAt = m->queuedAt;
+  else
+    // a resend is queued now
+    f.queuedAt.now();
+  ring.publish(idx);
+  uint64_t one = 1;
+  if (write(txWakeFd, &one, sizeof(one)) < 0)
+    perror("# STeensy::txEnqueue wake writer");
+  return true;
+}
+
+UTxPrio STeensy::txPrio(const char* msg)
+{ // compare first keyword
+  if (*msg == '!')
+    msg++;
+  int n = strcspn(msg, " \n");
+  for (int i = 0; i < prioKeyCnt; i++)
+  {
+    if (strncmp(msg, prioKey[i], n) == 0 and prioKey[i][n] == '\0')
+      return prioKeyClass[i];
+  }
+  return TX_NORMAL;
+}
+
+bool STeensy::txRingsEmpty()
+{
+  for (int i = 0; i < TX_PRIO_CNT; i++)
+    if (not txRing[i].empty())
+      return false;
+  return true;
+}
+
+void STeensy::runWriter()
+{ // take pending frames, highest class first, as far as pacing allows, and write them in one go
+  realtime.apply("teensy_writer");
+  struct iovec iov[MAX_TX_IOV];
+  // number of frames in iov from each ring (from the front)
+  int taken[TX_PRIO_CNT];
+  // time to wait for tokens (sec), when frames are pending
+  double wait = 0;
+  while (not stopUSB or not txRingsEmpty())
+  {
+    if (txRingsEmpty() or wait > 0)
+    { // wait for new frames (an urgent frame may be send at once),
+      // or for tokens to the next frame
+      struct pollfd pfd = {txWakeFd, POLLIN, 0};
+      struct timespec ts = {0, 100000000};
+      if (wait > 0 and wait < 0.1)
+        ts.tv_nsec = long(wait * 1e9);
+      ppoll(&pfd, 1, &ts, nullptr);
+    }
+    // clear wake event, any frame published after this will set it again
+    uint64_t ev;
+    if (read(txWakeFd, &ev, sizeof(ev)) < 0 and errno != EAGAIN)
+      perror("# STeensy::runWriter");
+    // urgent frames are all taken, not delayed by pacing,
+    // then normal and bulk frames in order, as long as there is tokens
+    // and the batch is not too big, a lower class never passes a waiting frame
+    UTime t;
+    t.now();
+    int n = 0;
+    int bytes = 0;
+    bool blocked = false;
+    wait = 0;
+    for (int p = 0; p < TX_PRIO_CNT; p++)
+    {
+      taken[p] = 0;
+      while (n < MAX_TX_IOV and not blocked)
+      {
+        UTxFrame * f = txRing[p].at(taken[p]);
+        if (f == nullptr)
+          break;
+        if (p != TX_URGENT)
+        { // paced, and limited, so that a new urgent frame gets through soon
+          if (bytes + f->len > MAX_TX_BATCH and bytes > 0)
+            blocked = true;
+          else
+          {
+            wait = txBucket.waitTime(f->len, false, t);
+            blocked = wait > 0;
+          }
+          if (blocked)
+            break;
+        }
+        txBucket.take(f->len, t);
+        iov[n].iov_base = f->data;
+        iov[n].iov_len = f->len;
+        bytes += f->len;
+        taken[p]++;
+        n++;
+      }
+    }
+    if (n == 0)
+      continue;
+    bool isOK = false;
     sendLock.lock();
     // may have been closed in the meantime
     if (teensyConnectionOpen)
+      isOK = writeAll(iov, n);
+    sendLock.unlock();
+    UTime tw("now");
+    uint64_t us = uint64_t(tw.getSec()) * 1000000 + tw.getMicrosec();
+    if (isOK)
     {
-      sendCnt++;
-//       printf("# STeensy sending directly CRC:'%s', msg:'%s'\n", crc, cmd);
-//       int m = write(usbport, crc, 3);
-      int d = 0;
-      int m;
-      while ((d < n) and (t < timeoutMs))
-      { // want to send n bytes to usbport within timeout period
-        m = write(usbport, &cmd[d], n - d);
-        if (m < 0)
-        { // error - an error occurred while sending
-          switch (errno)
-          { // may be an error, or just nothing send (buffer full)
-            case EAGAIN:
-              //not all send - just continue
-              printf("STeensy::sendDirect: waiting - nothing send %d/%d\n", d, n);
-              usleep(1000);
-              t += 1;
-              break;
-            default:
-              perror("STeensy::sendDirect (closing connection): ");
-              lostConnection = true;
-              break;
-          }
-          // dump the rest on most errors
-          if (lostConnection)
-            break;
+      lastTxTime = tw;
+      txByteCnt += bytes;
+      txWriteCnt++;
+      txFrameCnt += n;
+      if (n > txBatchMax)
+        txBatchMax = n;
+      for (int p = 0; p < TX_PRIO_CNT; p++)
+      {
+        for (int i = 0; i < taken[p]; i++)
+        {
+          UTxFrame * f = txRing[p].at(i);
+          txDelay[p].add(lastTxTime - f->queuedAt);
+          if (f->direct)
+            sendCnt++;
         }
-        else
-          // count bytes send
-          d += m;
       }
-      sendOK = d == n;
-      dataLock.lock();
       if (logfile != nullptr)
+      { // log direct messages (queued messages are logged when queued)
+        for (int p = 0; p < TX_PRIO_CNT; p++)
+        {
+          for (int i = 0; i < taken[p]; i++)
+          {
+            UTxFrame * f = txRing[p].at(i);
+            if (f->direct)
+              logger.log(logfile, "%lu.%04ld Txd %s", lastTxTime.getSec(), lastTxTime.getMicrosec()/100, f->data);
+          }
+        }
+      }
+    }
+    // release the slots (also if lost as the port is closed)
+    for (int p = 0; p < TX_PRIO_CNT; p++)
+    {
+      for (int i = 0; i < taken[p]; i++)
       {
-        UTime t;
-        t.now();
-        fprintf(logfile, "%lu.%04ld Txd %s", t.getSec(), t.getMicrosec()/100, cmd.c_str());
-        if (not gotNewline)
-          fprintf(logfile, "\n");
+        UTxFrame * f = txRing[p].at(0);
+        if (not f->direct)
+        { // the retransmit timer starts now, also if the write failed,
+          // then the confirm queue slot may be reused
+          f->queued->writtenAtUs = us;
+          f->queued->txPending--;
+        }
+        txRing[p].pop();
       }
-      dataLock.unlock();
-      // include a short break to ensure that Teensy do not get overloaded
-      usleep(500);
     }
-    if (lostConnection)
+  }
+}
+
+bool STeensy::writeAll(struct iovec* iov, int n)
+{ // write all, also if the port accepts a part only
+  int waitMs = 0;
+  while (n > 0)
+  {
+    ssize_t m = port->writev(iov, n);
+    if (m < 0)
     {
-      closeUSB();
+      if (errno == EAGAIN and waitMs < 100)
+      { // buffer full, wait for space
+        port->waitWritable(10);
+        waitMs += 10;
+        continue;
+      }
+      perror("STeensy::writeAll (dropped)");
+      // the receive thread will detect a lost connection
+      return false;
+    }
+    // skip what is written
+    while (n > 0 and size_t(m) >= iov->iov_len)
+    {
+      m -= iov->iov_len;
+      iov++;
+      n--;
+    }
+    if (n > 0)
+    {
+      iov->iov_base = (char*)iov->iov_base + m;
+      iov->iov_len -= m;
     }
-    else
-      lastTxTime.now();
-    sendLock.unlock();
   }
-//  printf("# STeensy:: send finished\n");
-  return sendOK;
+  return true;
 }
 
 ////////////////////////////////////////////////////////////////////////
@@ -327,15 +708,15 @@ void STeensy::closeUSB()
 //     printf("# STeensy::run - no relevant activity, shutting down\n");
 //     printf("# STeensy::run but open=%d, gotAct=%d, lastTime=%f, just=%d, justTime=%g\n",
 //           teensyConnectionOpen, gotActivityRecently, lastRxTime.getTimePassed(), justConnected, justConnectedTime.getTimePassed());
-    // then close the connection (after 100ms)
-    usleep(100000);
-    close(usbport);
-    usbport = -1;
+    // then close the connection (the caller holds the send lock,
+    // so the writer is not writing)
+    port->close();
     justConnected = false;
     // stop the tx queue and empty any remaining
+    // (by the receive thread, as it is the only one to take from the queue)
     confirmSend = false;
-    while (not outQueue.empty())
-      outQueue.pop();
+    flushOutQueue = true;
+    replayOnConnect = true;
   }
 }
 
@@ -345,6 +726,7 @@ void STeensy::closeUSB()
   * receive thread */
 void STeensy::run()
 { // read thread for REGBOT messages
+  realtime.apply("teensy");
   int n = 0;
   rxCnt = 0;
   int readIdleLoops = 0;
@@ -353,14 +735,14 @@ void STeensy::run()
   terr.now();
   const int MTS = 10;
   UTime tit[MTS];
-  UTime msgTime;
+  UTime chunkTime;
   float titsum[MTS] = {0};
   // get robot name
   tit[9].now();
-  bool ntpUpdate = false;
+  bool loopStalled = false;
   while (not stopUSB)
   { // handle Teensy connection
-    if ((not ntpUpdate) and
+    if ((not loopStalled) and
         (
           (teensyConnectionOpen and
             not gotActivityRecently and
@@ -375,7 +757,9 @@ void STeensy::run()
       // - shut down connection and try another
       tit[0].now();
       // close for now
+      sendLock.lock();
       closeUSB();
+      sendLock.unlock();
       // try another device
 //       usbdeviceNum = (usbdeviceNum + 1) % MAX_USB_DEVS;
       titsum[0] += tit[0].getTimePassed();
@@ -395,9 +779,22 @@ void STeensy::run()
       { // no name is received yet, so try again
         tit[2].now();
         // justconnected flag is cleared when receiving a 'dname' message from Teensy
-        send("hbti\n", true); // this may be lost - but no problem
-        send("leave\n", true); // stop any old subscriptions
+        sendDirect("hbti\n"); // this may be lost - but no problem
+        sendDirect("leave\n"); // stop any old subscriptions
         justConnected = false;
+        if (replayOnConnect)
+        { // reconnected, drop what was queued before and
+          // restore subscriptions and settings in one batch
+          emptyOutQueue();
+          replay.forEach([this](const char * msg) { sendToQueue(msg); });
+          replay.replayCnt++;
+          replayOnConnect = false;
+          const int MSL = 100;
+          char s[MSL];
+          snprintf(s, MSL, "# STeensy::run: reconnected, replayed %d commands\n", replay.size());
+          toLog(s);
+          printf("%s", s);
+        }
         t.now();
         titsum[2] += tit[2].getTimePassed();
       }
@@ -405,152 +802,381 @@ void STeensy::run()
       { // are loosing data - may be just temporarily
         gotActivityRecently = false;
       }
-      // read from USB
-      tit[3].now();
+      // send (or resend) from the confirm queue
+      tit[7].now();
+      handleTxQueue();
+      titsum[7] += tit[7].getTimePassed();
       //
-      n = read(usbport, &rx[rxCnt], 1);
-      if (n < 0 and errno == EAGAIN)
-      { // no data
-        n = 0;
-      }
-      else if (n < 0)
-      { // other error - close connection
-        perror("Teensy::run port error");
-        usleep(100000);
-        sendLock.lock();
-        // don't close while sending
-        closeUSB();
-        sendLock.unlock();
+      // wait for data from Teensy, or for a new message in the tx queue
+      tit[5].now();
+      struct pollfd pfd[2];
+      pfd[0].fd = port->pollFd();
+      pfd[0].events = POLLIN;
+      pfd[0].revents = 0;
+      pfd[1].fd = wakeFd;
+      pfd[1].events = POLLIN;
+      pfd[1].revents = 0;
+      int p = poll(pfd, 2, txQueueWaitMs());
+      // the arrival time of this chunk of data
+      chunkTime.now();
+      titsum[5] += tit[5].getTimePassed();
+      if (p == 0)
+        readIdleLoops++;
+      if (pfd[1].revents & POLLIN)
+      { // new message in queue, just clear the event
+        uint64_t ev;
+        n = read(wakeFd, &ev, sizeof(ev));
       }
-      titsum[3] += tit[3].getTimePassed();
-      //
-      // got a character - assemble to a text line
-      if (n == 1)
-      { // got a new character
-        tit[4].now(); // timing
-        //
-        if (rxCnt > 0)
-        {
-          rxCnt++;
-        }
-        else if (rx[0] == ';')
-        { // first character in a new message
-          msgTime.now();
-          rxCnt = 1;
-        }
-        // check for end of message, i.e. a new-line
-        if (rx[rxCnt-1] == '\n')
-        { // terminate string - end of new line
-          rx[rxCnt] = '\0';
-          // save to logfile if open
-          dataLock.lock();
-          toLogRx(rx, msgTime);
-          dataLock.unlock();
-          // handle this message line
-          if (crcCheck(rx))
-          { // got (at least) one valid message
-            const char * okMsg = &rx[3];
-            // check if this is a confirm message
-            if (strncmp(okMsg, "confirm", 7) == 0)
-            { // release next message
-              confirmSend = true;
-//               printf("# STeensy::run: received a confirm: '%s'\n", rx);
-              messageConfirmed(rx);
-            }
-            else
-            {
-              decode(okMsg, msgTime);
-            }
-          }
-          else
-            printf("# Teenst message discarded (crc-error) %s\n", rx);
-          // set activity timeer
-          gotActivityRecently = true;
-          lastRxTime.now();
-          // reset receive buffer
-          rxCnt = 0;
+      if (pfd[0].revents & POLLIN)
+      { // read all available (up to buffer space)
+        tit[3].now();
+        n = port->read(&rx[rxCnt], MAX_RX_CNT - 1 - rxCnt);
+        titsum[3] += tit[3].getTimePassed();
+        if (n < 0 and errno == EAGAIN)
+        { // no data after all
           n = 0;
-          gotCnt++;
         }
-        titsum[4] += tit[4].getTimePassed();
-      }
-      else if (n == 0)
-      {  // no data, so wait a bit
-        tit[5].now();
-        //
-        usleep(1000);
-        readIdleLoops++;
-        titsum[5] += tit[5].getTimePassed();
-      }
-      else
-      { // debug n!= 0 and n!= 1
-        tit[6].now();
-        printf("# Teensy::run: got n=%d chars, when asking for 1!\n", n);
-        fflush(nullptr);
-        titsum[6] += tit[6].getTimePassed();
-      }
-      if (not outQueue.empty())
-      { // got the first confirm
-//         printf("#STeensy:: que not empty\n");
-        tit[7].now();
-        if (not outQueue.front().isSend)
-        { // new message to send
+        else if (n <= 0)
+        { // other error (or hang-up) - close connection
+          if (n == 0)
+            printf("# Teensy::run port closed\n");
+          else
+            perror("Teensy::run port error");
           sendLock.lock();
-          if (teensyConnectionOpen)
-          { // send queued message to Teensy
-            write(usbport, outQueue.front().msg, outQueue.front().len);
-            outQueue.front().sendAt.now();
-            outQueue.front().isSend = true;
-            outQueue.front().resendCnt++;
-            toLogTx();
-          }
+          // don't close while sending
+          closeUSB();
           sendLock.unlock();
         }
         else
-        { // waiting for confirmation - check for too old
-//           printf("# STeensy:: is send - waiting for confirm\n");
-          float dt = outQueue.front().sendAt.getTimePassed();
-          if (dt > confirmTimeout)
-          {
-            // debug
-            const int MSL = 150;
-            char s[MSL];
-            snprintf(s, MSL, "# STeensy::run: msg retry after %.5f sec (retry=%d, queue=%d):%s",
-                    outQueue.front().sendAt.getTimePassed(),
-                    outQueue.front().resendCnt,
-                    (int)outQueue.size(),
-                    outQueue.front().msg);
-            toLog(s);
-//             printf("%s\n", s);
-            // debug end
-            if (outQueue.front().resendCnt < confirmRetryCntMax)
-            { // just try again
-              outQueue.front().isSend = false;
-              confirmRetryCnt++;
-            }
-            else
-            { // remove from queue
-              outQueue.pop();
-              confirmRetryDump++;
-            }
-          }
+        { // split into lines and handle each
+          rxByteCnt += n;
+          tit[4].now();
+          rxCnt += n;
+          splitRxLines(chunkTime);
+          titsum[4] += tit[4].getTimePassed();
         }
-        titsum[7] += tit[7].getTimePassed();
+      }
+      else if (pfd[0].revents & (POLLERR | POLLHUP | POLLNVAL))
+      { // device is gone
+        printf("# Teensy::run port error (poll revents=%x)\n", pfd[0].revents);
+        sendLock.lock();
+        closeUSB();
+        sendLock.unlock();
       }
     } // connected
-    ntpUpdate = false;
+    loopStalled = false;
     if (tit[9].getTimePassed() > 2.0)
-    { // likely NTP update received
+    { // this thread did not run for a while (time is monotonic, so not an NTP update)
       titsum[9]+= tit[9].getTimePassed();
-      // don't close connection based on a NPT update
-      ntpUpdate = true;
-      printf("# NTP update? time glitch of %.3f sec\n", tit[9].getTimePassed());
+      // don't close connection based on the time the loop was stalled
+      loopStalled = true;
+      printf("# STeensy::run: receive loop stalled for %.3f sec\n", tit[9].getTimePassed());
       fflush(nullptr);
     }
     tit[9].now();
   }
+  sendLock.lock();
   closeUSB();
-}  
+  sendLock.unlock();
+  printf("# STeensy::run: loop time (sec): close %.3f, open %.3f, connect %.3f, read %.3f, "
+         "split %.3f, poll %.3f, tx queue %.3f, stalled %.3f, idle polls %d\n",
+         titsum[0], titsum[1], titsum[2], titsum[3], titsum[4], titsum[5], titsum[7], titsum[9],
+         readIdleLoops);
+}
+
+void STeensy::splitRxLines(UTime & chunkTime)
+{ // the buffer may hold any number of lines and binary frames, and a
+  // partial line (or frame) at the end, that is to be completed by the next chunk.
+  int start = 0;
+  while (start < rxCnt)
+  { // a line or frame started in an earlier chunk keeps the time of that chunk
+    UTime & msgTime = (start == 0 and rxPartialTime.valid) ? rxPartialTime : chunkTime;
+    const uint8_t * f = (const uint8_t *)&rx[start];
+    if (f[0] == UBinFrame::SYNC)
+    { // binary frame
+      if (rxCnt - start < UBinFrame::HDR)
+        // not all of header yet
+        break;
+      int len = f[2];
+      if (len > UBinFrame::MAX_PAYLOAD)
+      { // not a valid frame - skip the sync character
+        start++;
+        binCrcErrCnt++;
+        crcError();
+        continue;
+      }
+      int n = UBinFrame::headerSize(f[1]) + len + UBinFrame::TAIL;
+      if (rxCnt - start < n)
+        // partial frame
+        break;
+      if (handleBinFrame(f, msgTime))
+        start += n;
+      else
+        // look for next frame or line after this sync
+        start++;
+    }
+    else
+    { // text line, a text line can not hold the sync character
+      char * nl = (char*)memchr(&rx[start], '\n', rxCnt - start);
+      int end = (nl == nullptr) ? rxCnt : nl - rx + 1;
+      char * sync = (char*)memchr(&rx[start], UBinFrame::SYNC, end - start);
+      if (sync != nullptr)
+      { // a frame starts before end of line - discard line start
+        start = sync - rx;
+        continue;
+      }
+      if (nl == nullptr)
+        // partial line
+        break;
+      // skip anything before the first ';'
+      char * p1 = (char*)memchr(&rx[start], ';', end - start);
+      if (p1 != nullptr)
+      { // terminate in place, the overwritten character is restored after use
+        char c = rx[end];
+        rx[end] = '\0';
+        handleRxLine(p1, msgTime);
+        rx[end] = c;
+      }
+      start = end;
+    }
+    rxPartialTime.clear();
+  }
+  if (start > 0)
+  { // move the rest (a partial line) to the start of the buffer
+    rxCnt -= start;
+    memmove(rx, &rx[start], rxCnt);
+    rxPartialTime.clear();
+  }
+  if (rxCnt > 0 and not rxPartialTime.valid)
+    // a new line (or frame) has started in this chunk
+    rxPartialTime = chunkTime;
+  if (rxCnt >= MAX_RX_CNT - 1)
+  { // line too long - discard
+    rx[MAX_RX_CNT - 1] = '\0';
+    printf("# STeensy::splitRxLines: no new-line in %d characters - discarded: %.30s...\n", rxCnt, rx);
+    rxCnt = 0;
+    rxPartialTime.clear();
+  }
+}
+
+bool STeensy::handleBinFrame(const uint8_t * frame, UTime & msgTime)
+{ // frame is complete, but not checked
+  if (not UBinFrame::check(frame))
+  {
+    binCrcErrCnt++;
+    crcError();
+    return false;
+  }
+  int type = frame[1] & ~UBinFrame::TIME_FLAG;
+  int len = frame[2];
+  int seq = UBinFrame::getU16(&frame[3]);
+  int hs = UBinFrame::headerSize(frame[1]);
+  const char * name = UBinFrame::typeName(type);
+  if (name != nullptr and len == UBinFrame::payloadSize(type))
+  { // known frame type
+    if (binSeq[type] >= 0)
+    { // count missing frames (16 bit sequence number)
+      int lost = ((seq - binSeq[type]) & 0xffff) - 1;
+      if (lost > 0)
+        binLostCnt += lost;
+    }
+    binSeq[type] = seq;
+    binFrameCnt++;
+    dispatch.arrived(name, msgTime);
+    if (logfile != nullptr or toConsole)
+    {
+      const int MSL = 50;
+      char s[MSL];
+      snprintf(s, MSL, "%s %d %d\n", name, seq, len);
+      toLogRx(s, msgTime, true);
+    }
+    if ((frame[1] & UBinFrame::TIME_FLAG) and type != UBinFrame::BIN_HBT and clockSync.isValid())
+    { // use the sample time from Teensy
+      UTime t = clockSync.teensyUsToHost(UBinFrame::getU32(&frame[UBinFrame::HDR]));
+      dispatch.decodeBin(type, &frame[hs], t);
+    }
+    else
+      dispatch.decodeBin(type, &frame[hs], msgTime);
+  }
+  else
+    printf("# STeensy::handleBinFrame: unknown frame type %d (payload %d bytes)\n", type, len);
+  // set activity timer
+  gotActivityRecently = true;
+  lastRxTime.now();
+  gotCnt++;
+  return true;
+}
+
+void STeensy::handleRxLine(char * line, UTime & msgTime)
+{ // line is a full line (starting with ';' and ending with '\n')
+  // save to logfile if open
+  toLogRx(line, msgTime);
+  // handle this message line
+  if (crcCheck(line))
+  { // got (at least) one valid message
+    const char * okMsg = &line[3];
+    // check if this is a confirm message
+    if (strncmp(okMsg, "confirm", 7) == 0)
+    { // release next message
+      confirmSend = true;
+//       printf("# STeensy::run: received a confirm: '%s'\n", line);
+      messageConfirmed(line);
+    }
+    else
+    {
+      decode(okMsg, msgTime);
+    }
+  }
+  else
+    printf("# Teenst message discarded (crc-error) %s\n", line);
+  // set activity timeer
+  gotActivityRecently = true;
+  lastRxTime.now();
+  gotCnt++;
+}
+
+void STeensy::handleTxQueue()
+{ // send the messages in the confirm window,
+  // and resend those with no confirm in time
+  if (flushOutQueue)
+    // connection closed - empty queue
+    emptyOutQueue();
+  // release confirmed (or dumped) messages at the front
+  popConfirmed();
+  int inWindow = 0;
+  for (int i = 0; i < outQueue.capacity(); i++)
+  { // all messages in window, and urgent messages after the window
+    UOutQueue * m = outQueue.at(i);
+    if (m == nullptr)
+      // no more messages (ready) in queue
+      break;
+    if (m->prio != TX_URGENT)
+    { // the window is for normal and bulk messages only
+      if (inWindow >= confirmWindow)
+        continue;
+      inWindow++;
+    }
+    if (m->confirmed)
+      continue;
+    // the timeout is from when it was written, not the time waiting for the writer
+    double dt = sinceWritten(m);
+    if (m->isSend and dt > rtt.getRto(m->resendCnt))
+    { // waiting for confirmation - and is too old
+      // debug
+      const int MSL = 150;
+      char s[MSL];
+      snprintf(s, MSL, "# STeensy::run: msg retry after %.5f sec (retry=%d, queue=%d):%s",
+              dt,
+              m->resendCnt,
+              outQueue.size(),
+              m->msg);
+      toLog(s);
+//             printf("%s\n", s);
+      // debug end
+      if (m->resendCnt < confirmRetryCntMax and
+          m->firstSendAt.getTimePassed() < confirmRetryTimeMax)
+      { // just try again (this message only)
+        m->isSend = false;
+        confirmRetryCnt++;
+      }
+      else
+      { // give up on this message, removed when at the front of the queue
+        m->confirmed = true;
+        confirmRetryDump++;
+        continue;
+      }
+    }
+    if (not m->isSend and teensyConnectionOpen)
+    { // new message (or a retry) to send, by the writer thread
+      if (not txEnqueue(m))
+        // writer queue is full, try again later
+        break;
+      m->sendAt.now();
+      if (m->resendCnt == 0)
+        m->firstSendAt = m->sendAt;
+      m->isSend = true;
+      m->resendCnt++;
+      toLogTx(m);
+    }
+  }
+  // may be dumped
+  popConfirmed();
+}
+
+double STeensy::sinceWritten(UOutQueue * m)
+{
+  uint64_t w = m->writtenAtUs;
+  if (w == 0)
+    return -1;
+  UTime t("now");
+  uint64_t us = uint64_t(t.getSec()) * 1000000 + t.getMicrosec();
+  if (us < w)
+    return 0;
+  return (us - w) * 1e-6;
+}
+
+void STeensy::emptyOutQueue()
+{ // give up on all, a message with a frame at the writer
+  // is removed when the writer has released it
+  for (int i = 0; i < outQueue.capacity(); i++)
+  {
+    UOutQueue * m = outQueue.at(i);
+    if (m == nullptr)
+      break;
+    m->confirmed = true;
+  }
+  popConfirmed();
+  flushOutQueue = false;
+}
+
+void STeensy::popConfirmed()
+{
+  UOutQueue * m = outQueue.front();
+  while (m != nullptr and m->confirmed and m->txPending == 0)
+  {
+    outQueue.pop();
+    m = outQueue.front();
+  }
+}
+
+int STeensy::txQueueWaitMs()
+{ // how long the receive thread may wait in poll()
+  // without delaying the confirm queue.
+  int ms = 100;
+  if (flushOutQueue)
+    ms = 0;
+  int inWindow = 0;
+  for (int i = 0; i < outQueue.capacity() and ms > 0; i++)
+  {
+    UOutQueue * m = outQueue.at(i);
+    if (m == nullptr)
+      break;
+    if (m->prio != TX_URGENT)
+    { // as in handleTxQueue()
+      if (inWindow >= confirmWindow)
+        continue;
+      inWindow++;
+    }
+    if (m->confirmed)
+      continue;
+    if (not m->isSend)
+      ms = 0;
+    else
+    { // wake up when the confirm is overdue
+      // (if not written yet, then check again after a timeout)
+      double dt = sinceWritten(m);
+      if (dt < 0)
+        dt = 0;
+      float rest = rtt.getRto(m->resendCnt) - dt;
+      int w = int(ceilf(rest * 1000.0));
+      if (w < 0)
+        w = 0;
+      if (w < ms)
+        ms = w;
+    }
+  }
+  return ms;
+}
 
 bool STeensy::crcCheck(const char* msg)
 { // not really a standard CRC check, just modulus of all visible characters
@@ -571,40 +1197,82 @@ bool STeensy::crcCheck(const char* msg)
       int q1 = (sum % 99) + 1;
       int q2 = (msg[1] - '0') * 10 + msg[2] - '0';
       if (q1 != q2)
+      {
         printf("# UHandler::handleCommand: CRC check failed (from Teensy) q1=%d != q2=%d (msg=%s\n", q1, q2, msg);
+        rxCrcErrCnt++;
+        crcError();
+      }
       dataOK = true;
     }
   }
+  if (not dataOK)
+  {
+    rxCrcErrCnt++;
+    crcError();
+  }
   return dataOK;
 }
 
+void STeensy::crcError()
+{
+  if (crcBurst <= 0)
+    return;
+  if (crcBurstCnt == 0 or crcBurstTime.getTimePassed() > 1.0)
+  { // first error in a new second
+    crcBurstTime.now();
+    crcBurstCnt = 0;
+  }
+  crcBurstCnt++;
+  if (crcBurstCnt == crcBurst)
+    logger.trigger("crc_burst");
+}
+
 
 void STeensy::messageConfirmed(const char* confirm)
 { // got a confirm message
-  // test for first message in tx queue
-  // remove if a match - else ignore
-  if (not outQueue.empty())
+  // the Teensy echoes the message, so find the oldest
+  // send message with this text (queue order is the sequence)
+  // and mark it as confirmed - else ignore,
+  // urgent messages may be send after the window
+  bool found = false;
+  for (int i = 0; i < outQueue.capacity() and not found; i++)
   {
-    if (outQueue.front().isSend)
+    UOutQueue * m = outQueue.at(i);
+    if (m == nullptr)
+      break;
+    if (m->isSend and not m->confirmed)
     { // this message is send, but is it equal
-      bool eq = outQueue.front().compare(&confirm[11]);
-      if (eq)
+      found = m->compare(&confirm[11]);
+      if (found)
       {
-        if (outQueue.front().resendCnt > 1)
-        {
+        if (m->resendCnt > 1)
+        { // not known which send this is a confirm for
+          rtt.ambiguous();
           printf("# STeensy::run: Confirm OK after %d retry and %.4fs: send'%s'",
-                  outQueue.front().resendCnt,
-                  outQueue.front().queuedAt.getTimePassed(),
-                  outQueue.front().msg);
+                  m->resendCnt,
+                  m->queuedAt.getTimePassed(),
+                  m->msg);
         }
-        outQueue.pop();
-      }
-      else
-      { // no match
-        confirmMismatchCnt++;
+        else
+        { // not resend, so the round-trip time is unambiguous
+          double dt = sinceWritten(m);
+          if (dt >= 0)
+          {
+            rtt.sample(dt);
+            txBucket.rttSample(dt);
+          }
+        }
+        m->confirmed = true;
+        confirmCnt++;
       }
     }
   }
+  if (found)
+    popConfirmed();
+  else
+  { // no match
+    confirmMismatchCnt++;
+  }
 }
 
 
@@ -613,59 +1281,47 @@ void STeensy::messageConfirmed(const char* confirm)
   * \returns true if successful */
 bool STeensy::openToTeensy()
 {
-   // should use USB port
-  if (usbport != -1)
+  if (port->isOpen())
   {
-    printf("# Teensy::openToTeensy device %s is open already\n", usbDevName.c_str());
+    printf("# Teensy::openToTeensy device %s is open already\n", port->name.c_str());
   }
   else
   { // not open already - try
-//     printf("# Teensy::openToTeensy '%s' - opening\n", usbDevName);
-    // make reservation
-    usbport = open(usbDevName.c_str(), O_RDWR | O_NOCTTY | O_NDELAY);
-    if (usbport == -1)
+    if (not port->open())
     { // open failed
       if (connectErrCnt < 5)
       { // don't spam with too many error messages
         const int MSL = 100;
         char s[MSL];
-        snprintf(s, MSL, "# STeensy::openToTeensy open '%s' failed:",  usbDevName.c_str());
+        snprintf(s, MSL, "# STeensy::openToTeensy open '%s' failed:",  port->name.c_str());
         perror(s);
       }
-      // wait a bit before re-connection
-      usleep(300000);
+      // wait a bit before re-connection, short at first,
+      // as a USB device may be back soon
+      int us = 10000 << connectErrCnt;
+      if (connectErrCnt > 5 or us > 300000)
+        us = 300000;
+      usleep(us);
       connectErrCnt++;
     }
     else
-    { // set connection to non-blocking
-//       printf("# STeensy::openToTeensy opened '%s'\n", usbDevName);
-      int flags;
-      if (-1 == (flags = fcntl(usbport, F_GETFL, 0)))
-        flags = 0;
-      fcntl(usbport, F_SETFL, flags | O_NONBLOCK);
-  // #ifdef armv7l
-      struct termios options;
-      tcgetattr(usbport, &options);
-      options.c_cflag = B115200 | CS8 | CLOCAL | CREAD; //<Set baud rate
-      options.c_iflag = IGNPAR;
-      options.c_oflag = 0;
-      options.c_lflag = 0;
-      tcsetattr(usbport, TCSANOW, &options);
-  // #endif
-      tcflush(usbport, TCIFLUSH);
       connectErrCnt = 0;
-    }
-    teensyConnectionOpen = usbport != -1;
+    teensyConnectionOpen = port->isOpen();
     if (teensyConnectionOpen)
     { // request base data
-//       printf("# STeensy::run - just connected to '%s'\n", usbDevName);
+//       printf("# STeensy::run - just connected to '%s'\n", port->name.c_str());
       justConnected = true;
       toLog("Connection to USB open\n");
       justConnectedTime.now();
-      teensy1.send("hbti\n", true);
-      usleep(5000);
-      teensy1.send("sub hbt 50\n", true);
-      usleep(50000);
+      for (int i = 0; i < UBinFrame::BIN_TYPE_CNT; i++)
+        binSeq[i] = -1;
+      clockSync.reset();
+      linkStatsFrom.now();
+      txBucket.reset();
+      rtt.reset();
+      // not kept for replay, the writer keeps the order
+      sendDirect("hbti\n");
+      sendDirect("sub hbt 50\n");
       //         initMessageTypes();
       // assume there is activity - in order not to
       // get an error right away
@@ -689,12 +1345,27 @@ bool STeensy::decode(const char * msg, UTime & msgTime)
   }
   // debug end
   bool used = true;
-  const char * p1 = msg;
-
-  if      (service.decode(msg, msgTime))
+  if (msg[0] == '#')
+  { // service message - just ignored
+//     printf("# UTeensy:: service message from Teensy: %s", msg);
+  }
+  else if (dispatch.decode(msg, msgTime))
   { // nothing to do here
   }
-  else if (strncmp(p1, "dname ", 6) == 0)
+  else
+  { // modules may not have subscribed yet
+    used = false;
+    if (service.isSetupComplete())
+      printf(" UTeensy:: unused Teensy message: %s", msg);
+  }
+  return used;
+}
+
+bool STeensy::decodeTeensy(const char * msg)
+{ // messages about the connection itself
+  bool used = true;
+  const char * p1 = msg;
+  if (strncmp(p1, "dname ", 6) == 0)
   { // got the robot name from Teensy
     p1 += 6;
     p1 = strchr(p1, ' ');
@@ -703,15 +1374,133 @@ bool STeensy::decode(const char * msg, UTime & msgTime)
       ini["id"]["name"] = ++p1;
     }
   }
-  else if (msg[0] == '#')
-  { // service message - just ignored
-//     printf("# UTeensy:: service message from Teensy: %s", msg);
+  else if (strncmp(p1, "bin ", 4) == 0)
+  { // Teensy accepts (or rejects) binary frames for a stream, like 'bin enc 1'
+    const int MNL = 20;
+    char name[MNL];
+    int on = 0;
+    if (sscanf(p1 + 4, "%19s %d", name, &on) == 2)
+    {
+      int type = UBinFrame::typeFromName(name);
+      if (type > 0)
+        binAccepted[type] = on != 0;
+    }
   }
   else
+    used = false;
+  return used;
+}
+
+void STeensy::subscribe(const char* stream, const std::string & rate_ms)
+{
+  const int MSL = 100;
+  char s[MSL];
+  snprintf(s, MSL, "sub %s %s\n", stream, rate_ms.c_str());
+  send(s);
+  int type = UBinFrame::typeFromName(stream);
+  if (type > 0 and binRequest[type])
+  { // request binary frames, queued to keep the order after 'sub'
+    // (the firmware confirms any message, also if not understood)
+    snprintf(s, MSL, "bin %s %d\n", stream, binTimestamp ? 2 : 1);
+    send(s);
+  }
+}
+
+void STeensy::printLinkStats()
+{
+  float dt = linkStatsFrom.getTimePassed();
+  if (dt < 0.001)
+    dt = 0.001;
+  printf("# STeensy:: link over %.1f s: rx %.0f B/s, tx %.0f B/s, rx CRC errors %d (binary %d), "
+         "resend %d, dropped %d, queue %d (max %d), queue full %d\n",
+         dt, rxByteCnt / dt, txByteCnt / dt, rxCrcErrCnt, binCrcErrCnt,
+         confirmRetryCnt, confirmRetryDump, outQueue.size(), outQueueMax.load(), queueFullCnt.load());
+  // subscribed intervals, as kept for replay (e.g. 'sub enc 8')
+  const int MSC = 16;
+  char subKey[MSC][16];
+  double subInterval[MSC];
+  int subCnt = 0;
+  replay.forEach([&](const char * msg)
+  {
+    int ms;
+    if (subCnt < MSC and sscanf(msg, "sub %15s %d", subKey[subCnt], &ms) == 2)
+      subInterval[subCnt++] = ms / 1000.0;
+  });
+  dispatch.printStats(true, [&](const char * key)
+  {
+    for (int i = 0; i < subCnt; i++)
+      if (strcmp(key, subKey[i]) == 0)
+        return subInterval[i];
+    return 0.0;
+  });
+}
+
+void STeensy::benchmark(float seconds)
+{
+  if (not teensyConnectionOpen)
   {
-    printf(" UTeensy:: unused Teensy message: %s", msg);
+    printf("# STeensy::benchmark: no connection to Teensy\n");
+    return;
   }
-  return used;
+  // 'hbti' is confirmed, and has a short reply only
+  const char * ping = "hbti\n";
+  // ping-pong, one message at a time, time from send until confirmed
+  const int MRC = 100000;
+  std::vector<float> rtts;
+  rtts.reserve(MRC);
+  int lost = 0;
+  UTime t("now");
+  while (t.getTimePassed() < seconds / 2 and int(rtts.size()) < MRC)
+  {
+    UTime ts("now");
+    int confirm0 = confirmCnt;
+    sendToQueue(ping);
+    while (outQueue.size() > 0 and ts.getTimePassed() < 1.0)
+      usleep(20);
+    if (outQueue.size() > 0 or confirmCnt == confirm0)
+    { // no confirm (or dumped), wait for queue to get empty
+      lost++;
+      while (outQueue.size() > 0 and teensyConnectionOpen)
+        usleep(1000);
+    }
+    else
+      rtts.push_back(ts.getTimePassed());
+  }
+  if (rtts.size() > 0)
+  {
+    std::sort(rtts.begin(), rtts.end());
+    int n = rtts.size();
+    auto pct = [&](float p) { return rtts[std::min(n - 1, int(p * n))] * 1000.0; };
+    printf("# STeensy::benchmark: ping-pong %d msgs (%d with no confirm in 1 s): RTT (ms) "
+           "min %.3f, p50 %.3f, p90 %.3f, p99 %.3f, p99.9 %.3f, max %.3f\n",
+           n, lost, rtts[0] * 1000.0, pct(0.5), pct(0.9), pct(0.99), pct(0.999), rtts[n - 1] * 1000.0);
+  }
+  // throughput, keep the confirm queue half full
+  int sent = 0;
+  int retry0 = confirmRetryCnt;
+  int confirm0 = confirmCnt;
+  int dump0 = confirmRetryDump;
+  uint64_t tx0 = txByteCnt;
+  uint64_t rx0 = rxByteCnt;
+  t.now();
+  while (t.getTimePassed() < seconds / 2)
+  {
+    while (outQueue.size() < outQueue.capacity() / 2)
+    {
+      sendToQueue(ping);
+      sent++;
+    }
+    usleep(200);
+  }
+  // confirmed in the time, dumped messages are not confirmed
+  int done = confirmCnt - confirm0;
+  float dt = t.getTimePassed();
+  printf("# STeensy::benchmark: throughput %.0f msgs/s confirmed (window %d, %d send), tx %.0f B/s, rx %.0f B/s, "
+         "%d resend, %d dumped\n",
+         done / dt, confirmWindow, sent, (txByteCnt - tx0) / dt, (rxByteCnt - rx0) / dt,
+         confirmRetryCnt - retry0, confirmRetryDump - dump0);
+  while (outQueue.size() > 0 and teensyConnectionOpen and t.getTimePassed() < seconds / 2 + 2)
+    usleep(1000);
 }
 
 int STeensy::getTeensyCommError(int& retryCnt)
@@ -732,7 +1521,7 @@ void STeensy::toLog(const char* msg)
     return;
   if (logfile != nullptr)
   {
-    fprintf(logfile, "%lu.%04ld ## %s", t.getSec(), t.getMicrosec()/100, msg);
+    logger.log(logfile, "%lu.%04ld ## %s", t.getSec(), t.getMicrosec()/100, msg);
   }
   if (toConsole)
   {
@@ -741,58 +1530,59 @@ void STeensy::toLog(const char* msg)
 }
 
 
-void STeensy::toLogRx(const char*, UTime & mt)
+void STeensy::toLogRx(const char* line, UTime & mt, bool binary)
 {
   if (service.stop)
     return;
+  const char * tag = binary ? "Rb" : "Rx";
   if (logfile != nullptr)
   {
-    fprintf(logfile, "%lu.%04ld Rx %s", mt.getSec(), mt.getMicrosec()/100, rx);
+    logger.log(logfile, "%lu.%04ld %s %s", mt.getSec(), mt.getMicrosec()/100, tag, line);
   }
   if (toConsole)
   {
-    printf("%lu.%04ld Rx %s", mt.getSec(), mt.getMicrosec()/100, rx);
+    printf("%lu.%04ld %s %s", mt.getSec(), mt.getMicrosec()/100, tag, line);
   }
 }
 
-void STeensy::toLogTx()
+void STeensy::toLogTx(UOutQueue * m)
 {
   if (service.stop)
     return;
   if (logfile != nullptr)
   {
-    fprintf(logfile, "%lu.%04ld Tx %s",
-            outQueue.front().sendAt.getSec(),
-            outQueue.front().sendAt.getMicrosec()/100,
-            outQueue.front().msg);
+    logger.log(logfile, "%lu.%04ld Tx %s",
+            m->sendAt.getSec(),
+            m->sendAt.getMicrosec()/100,
+            m->msg);
   }
   if (toConsole)
   {
     printf("%lu.%04ld Tx %s",
-            outQueue.front().sendAt.getSec(),
-            outQueue.front().sendAt.getMicrosec()/100,
-            outQueue.front().msg);
+            m->sendAt.getSec(),
+            m->sendAt.getMicrosec()/100,
+            m->msg);
   }
 }
 
-void STeensy::toLogQu()
+void STeensy::toLogQu(UOutQueue & m, int queueSize)
 {
   if (service.stop)
     return;
   if (logfile != nullptr)
   {
-    fprintf(logfile, "%lu.%04ld Qu %d %s",
-            outQueue.back().queuedAt.getSec(),
-            outQueue.back().queuedAt.getMicrosec()/100,
-            (int)outQueue.size(),
-            outQueue.back().msg);
+    logger.log(logfile, "%lu.%04ld Qu %d %s",
+            m.queuedAt.getSec(),
+            m.queuedAt.getMicrosec()/100,
+            queueSize,
+            m.msg);
   }
   if (toConsole)
   {
     printf("%lu.%04ld Qu %d %s",
-            outQueue.back().queuedAt.getSec(),
-            outQueue.back().queuedAt.getMicrosec()/100,
-            (int)outQueue.size(),
-            outQueue.back().msg);
+            m.queuedAt.getSec(),
+            m.queuedAt.getMicrosec()/100,
+            queueSize,
+            m.msg);
   }
 }
@@ -26,12 +26,25 @@
 #define SREGBOT_H
 
 #include <mutex>
-#include <queue>
+#include <atomic>
 #include <thread>
 #include <string.h>
 #include <string>
 
 #include "utime.h"
+#include "uring.h"
+#include "ubinframe.h"
+#include "uclocksync.h"
+#include "utokenbucket.h"
+#include "urtt.h"
+#include "udelayhist.h"
+#include "ureplay.h"
+#include "utransport.h"
+
+/**
+ * Priority class of messages to the Teensy (from the first keyword),
+ * the writer takes frames from higher classes first */
+enum UTxPrio {TX_URGENT, TX_NORMAL, TX_BULK, TX_PRIO_CNT};
 
 /**
  * Queue class for messages that require confirmation
@@ -43,17 +56,31 @@ public:
   char msg[MML];
   int len;
   bool isSend = false;
+  /// confirm received (or given up), may be removed from queue
+  bool confirmed = false;
   UTime queuedAt;
   UTime sendAt;
+  /// first send, to limit the total retry time
+  UTime firstSendAt;
   int resendCnt;
+  /// urgent messages are send also when the confirm window is full
+  UTxPrio prio = TX_NORMAL;
+  /// time this message was written to the port by the writer thread (host time in us),
+  /// also set if the write failed, so that it is resend after the timeout
+  std::atomic<uint64_t> writtenAtUs = {0};
+  /// frames for this message not yet released by the writer thread,
+  /// the slot is not reused before this is 0
+  std::atomic<int> txPending = {0};
   /**
-   * Constructor */
-  UOutQueue(const char * msg)
+   * Prepare this (preallocated) slot for a new message */
+  void prepare(const char * message)
   {
-    setMessage(msg);
+    setMessage(message);
     queuedAt.now();
     isSend = false;
+    confirmed = false;
     resendCnt = 0;
+    writtenAtUs = 0;
   }
   /**
    * set new message */
@@ -69,6 +96,22 @@ public:
 };
 
 
+/**
+ * A formatted frame (CRC, message and new-line) ready for the writer thread */
+class UTxFrame
+{
+public:
+  static const int MFL = UOutQueue::MML;
+  char data[MFL];
+  int len;
+  /// send direct (not from the confirm queue), to be logged as 'Txd'
+  bool direct;
+  /// slot in confirm queue, when not direct
+  UOutQueue * queued;
+  /// when the message was given to send (for queueing delay)
+  UTime queuedAt;
+};
+
 /**
  * The robot class handles the 
  * port to the REGBOT part of the robot,
@@ -91,27 +134,37 @@ public:
   int regbotHardware = -1;
   // all used motors has encoder (A,B) reversed.
   bool encoderReversed = true;
+  // number of queued messages send before a confirm is needed
+  // (from ini-file, if not set from command line)
+  int confirmWindow = 0;
+  /// Teensy clock to host clock, updated from hbt
+  UClockSync clockSync;
+  /// pacing of all traffic to Teensy, adapted from Teensy load (in hbt)
+  UTokenBucket txBucket;
+  /// retransmit timeout from confirm round-trip times
+  URtt rtt;
+  /// stateful commands, replayed after a reconnect
+  UReplay replay;
 
   
 private:
-  // serial port handle
-  int usbport = -1;
-  // serial port (USB)
-//   int usbdeviceNum = 0;
-  // simulator hostname
-//   const char * simHost;
-  // simulator port
-//   int simPort = 0;
+  // connection to Teensy (USB serial, socket or in-process emulator)
+  UTransport * port = nullptr;
   // mutex to ensure commands to regbot is not mixed
 //   mutex txLock;
 //   mutex logMtx;
   std::mutex eventUpdate;
   std::mutex sendLock;
-  // receive buffer
+  // receive buffer, filled in chunks by read() and split into lines
+  // (and binary frames) in place
   static const int MAX_RX_CNT = 1000;
   char rx[MAX_RX_CNT];
   // number of characters in rx buffer
-  int rxCnt;
+  int rxCnt = 0;
+  // arrival time of a partial line (or frame) at the start of rx buffer
+  UTime rxPartialTime;
+  // eventfd to wake the receive thread from poll(), when a message is queued
+  int wakeFd = -1;
   //
   UTime lastTxTime;
   // socket to simulator
@@ -122,6 +175,8 @@ private:
   int sendCnt = 0;
   /** interface just opened */
   bool justConnected = false;
+  /** connection was lost, so replay stateful commands when connected */
+  bool replayOnConnect = false;
   bool confirmSend = false;
 //   bool sendDirectFromNowOn = false;
 
@@ -142,15 +197,33 @@ public:
    * for streaming use then send directly, setting direct=true)
    * \param message is c_string to send,
    * \param direct for bypassing the default message queue
-   * \returns true if send direct and delivered OK */
+   * \returns true if send direct and accepted by the writer thread (never waits) */
   bool send(const char * message, bool direct = false);
+  /**
+   * Subscribe to a Teensy data stream, like 'sub enc 8'.
+   * If the stream is listed in [teensy] binary, then binary frames
+   * are requested too ('bin enc 1'), a Teensy without support for
+   * binary frames will just continue in text.
+   * \param stream is the stream keyword, e.g. "enc"
+   * \param rate_ms is the sample interval in ms */
+  void subscribe(const char * stream, const std::string & rate_ms);
+  /**
+   * Print link statistics: bytes/s each way, errors, retries, queue depth,
+   * and rate and interval jitter for each received keyword */
+  void printLinkStats();
+  /**
+   * Active benchmark of the link, first ping-pong of one confirmed message
+   * at a time (round-trip time percentiles), then throughput with a full queue.
+   * The confirm queue must be idle.
+   * \param seconds is total time, half for each part */
+  void benchmark(float seconds);
   /**
    * runs the receive thread 
    * This run() function is called in a thread after a start() call.
    * This function will not return until the thread is stopped. */
   void run();
   /**
-  * decode commands potentially for this device */
+  * decode messages from Teensy, using the keyword registry (UDispatch) */
   bool decode(const char* msg, UTime & msgTime);
   /** Generate 3 character CRC as ";XX", where
    * NN is sum of character value modulus 99 + 1.
@@ -179,11 +252,67 @@ private:
    * \param rawMsg is the message preceded by crc
    * \return true if OK */
   bool crcCheck(const char * rawMsg);
+  /**
+   * Count a CRC error (line or binary frame), and trigger the
+   * flight recorder if too many within a second */
+  void crcError();
+  /**
+   * Split received characters into lines and binary frames and handle all complete.
+   * A partial line (or frame) is moved to the start of the rx buffer.
+   * \param chunkTime is the time the latest chunk of characters arrived */
+  void splitRxLines(UTime & chunkTime);
+  /**
+   * Handle one binary frame (CRC check, sequence check, log and decode)
+   * \param frame starts with UBinFrame::SYNC and holds the full frame
+   * \returns false if CRC failed */
+  bool handleBinFrame(const uint8_t * frame, UTime & msgTime);
+  /**
+   * Handle one received line (CRC check, log, confirm or decode)
+   * \param line is zero terminated line starting with ';'
+   * \param msgTime is the arrival time of the line */
+  void handleRxLine(char * line, UTime & msgTime);
+  /**
+   * Send next message in the confirm queue,
+   * or resend if confirm is overdue */
+  void handleTxQueue();
+  /**
+   * Put a message from the confirm queue in the writer queue
+   * \returns false if there is no space */
+  bool txEnqueue(UOutQueue * m);
+  /**
+   * Priority class of this message, from first keyword
+   * in [teensy] tx_urgent or tx_bulk, else normal
+   * \param msg is message without CRC (may start with '!') */
+  UTxPrio txPrio(const char * msg);
+  /**
+   * Are all writer rings empty */
+  bool txRingsEmpty();
+  /**
+   * Writer thread, writes all pending frames in one writev() */
+  void runWriter();
+  /**
+   * Write all in iov to Teensy port
+   * \returns false on a port error */
+  bool writeAll(struct iovec * iov, int n);
+  /**
+   * Remove confirmed messages from front of queue */
+  void popConfirmed();
+  /**
+   * Drop all messages in the confirm queue (by the receive thread only) */
+  void emptyOutQueue();
+  /**
+   * Time (sec) since this message was written by the writer thread
+   * \returns a negative value if not written (yet) */
+  double sinceWritten(UOutQueue * m);
+  /**
+   * Get time (ms) until confirm queue needs attention
+   * \returns 0 if a message is ready to be send */
+  int txQueueWaitMs();
   /**
    * is data source active (is device open) */
   virtual bool isActive()
   {
-    return (usbport >= 0) and gotActivityRecently and not justConnected;
+    return port != nullptr and port->isOpen() and gotActivityRecently and not justConnected;
   }
 
   static void runObj(STeensy * obj)
@@ -191,6 +320,10 @@ private:
     // transfer to the class run() function.
     obj->run();
   }
+  static void runWriterObj(STeensy * obj)
+  {
+    obj->runWriter();
+  }
 
 private:
   /**
@@ -204,35 +337,104 @@ private:
    * Check, and
    * release the next in the queue */
   void messageConfirmed(const char * confirm);
+  /**
+   * Decode messages about the Teensy itself (dname, bin) */
+  bool decodeTeensy(const char * msg);
   void closeUSB();
   int connectErrCnt = 0;
   ///
   bool gotActivityRecently = true;
   UTime lastRxTime;
-  std::string usbDevName;
   bool initialized = false;
   bool stopUSB = false;
   /**
-   * uotgoing message queue */
-  std::queue<UOutQueue> outQueue;
+   * outgoing message queue, filled by any thread, emptied by the receive thread */
+  URing<UOutQueue> outQueue;
+  /// queue size (from ini-file)
+  int outQueueSize = 64;
+  /// when the queue is full: send the message directly (unconfirmed), else drop it
+  bool queueFullSendDirect = true;
+  /// messages not queued because the queue was full
+  std::atomic<int> queueFullCnt = {0};
+  /// empty queue request, handled by the receive thread
+  std::atomic<bool> flushOutQueue = {false};
+  /**
+   * frames to be written by the writer thread, filled by any thread,
+   * one ring for each priority class */
+  URing<UTxFrame> txRing[TX_PRIO_CNT];
+  static const int TX_RING_SIZE = 128;
+  /// max frames in one writev()
+  static const int MAX_TX_IOV = 64;
+  /// max bytes of normal and bulk frames in one writev(),
+  /// an urgent frame waits at most for one such write
+  static const int MAX_TX_BATCH = 1024;
+  /// eventfd to wake the writer thread
+  int txWakeFd = -1;
+  std::thread * thWriter = nullptr;
+  /// keywords for urgent and bulk messages (from ini-file)
+  static const int MAX_PRIO_KEYS = 24;
+  static const int MPKL = 16;
+  char prioKey[MAX_PRIO_KEYS][MPKL];
+  UTxPrio prioKeyClass[MAX_PRIO_KEYS];
+  int prioKeyCnt = 0;
+public:
+  /// link statistics (since connect)
+  UTime linkStatsFrom;
+  uint64_t rxByteCnt = 0;
+  std::atomic<uint64_t> txByteCnt = {0};
+  /// received lines with no or a wrong CRC
+  int rxCrcErrCnt = 0;
+  /// largest number of messages in confirm queue
+  std::atomic<int> outQueueMax = {0};
+  /// writer statistics
+  std::atomic<int> txFullCnt = {0};
+  int txWriteCnt = 0;
+  int txFrameCnt = 0;
+  int txBatchMax = 0;
+  /// delay from send (or queued) to written, for each priority class
+  UDelayHist txDelay[TX_PRIO_CNT];
+private:
+  /// streams to request as binary frames (from ini-file)
+  bool binRequest[UBinFrame::BIN_TYPE_CNT] = {false};
+  /// streams where Teensy has accepted binary frames
+  bool binAccepted[UBinFrame::BIN_TYPE_CNT] = {false};
+  /// last sequence number for each frame type
+  int binSeq[UBinFrame::BIN_TYPE_CNT];
+  /// request Teensy timestamp in binary frames
+  bool binTimestamp = false;
+public:
+  /// binary frame statistics
+  int binFrameCnt = 0;
+  int binCrcErrCnt = 0;
+  /// frames missing in sequence numbers
+  int binLostCnt = 0;
+private:
+  /// CRC errors within a second for a flight recorder trigger (0 = no trigger)
+  int crcBurst = 5;
+  int crcBurstCnt = 0;
+  UTime crcBurstTime;
   float confirmTimeout = 0.03; // timeout in seconds for writing to Teensy
   // transmission statistics
   int confirmMismatchCnt = 0;
   int confirmRetryCnt = 0;
   /// number of retry attempts before drop
   int confirmRetryCntMax = 50;
+  /// time (sec) from first send before drop, confirm_timeout times
+  /// confirmRetryCntMax, as the RTO backoff would else extend it many times
+  float confirmRetryTimeMax = 2.0;
   /// count of dropped messages requiring confirm
   int confirmRetryDump = 0;
+  /// count of messages confirmed by Teensy
+  int confirmCnt = 0;
   /// save in log with different time + marking
   void toLog(const char * msg);
-  void toLogRx(const char*, UTime& mt);
-  void toLogTx();
-  void toLogQu();
+  void toLogRx(const char*, UTime& mt, bool binary = false);
+  void toLogTx(UOutQueue * m);
+  void toLogQu(UOutQueue & m, int queueSize);
   /// should logged messages be printed on console too.
   bool toConsole = false;
-  /// data io logfile
+  /// data io logfile (written by the logger thread)
   FILE * logfile = nullptr;
-  std::mutex dataLock; // ensure consistency
 
 };
 
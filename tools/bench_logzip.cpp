@@ -0,0 +1,120 @@
+/* #***************************************************************************
+ #*   Copyright (C) 2023 by DTU
+ #*   jcan@dtu.dk
+ #*
+ #*
+ #* The MIT License (MIT)  https://mit-license.org/
+ #*
+ #* Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+ #* and associated documentation files (the “Software”), to deal in the Software without restriction,
+ #* including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ #* sublicense, and/or sell copies of the Software, and to permit persons to whom the Software
+ #* is furnished to do so, subject to the following conditions:
+ #*
+ #* The above copyright notice and this permission notice shall be included in all copies
+ #* or substantial portions of the Software.
+ #*
+ #* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ #* INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ #* PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+ #* FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ #* ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ #* THE SOFTWARE. */
+
+/**
+ * Benchmark of the compressed text logfiles (see ULogger::setupFiles).
+ * Writes simulated pose, encoder, edge raw and imu logfiles for 20 s
+ * at a 1 kHz pose rate (about 4 times faster than real time) through
+ * the logger, with the given compression level.
+ * The logger prints lines, size, ratio and CPU time for each file
+ * at terminate, this adds the process CPU time for the run.
+ *
+ * build (from this directory):
+ *   g++ -O2 -I.. -o bench_logzip bench_logzip.cpp ../ulogger.cpp
+ *       ../uflightrec.cpp ../ulogbin.cpp ../ulogzip.cpp ../utime.cpp ../utimebase.cpp
+ *       ../urealtime.cpp ../udelayhist.cpp -lpthread -lz
+ * usage:
+ *   ./bench_logzip directory [level] [dir_mb] [pose_decimation]
+ *   e.g. ./bench_logzip /tmp/logzip 6
+ * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <math.h>
+#include <time.h>
+#include <string>
+
+#include "ulogger.h"
+#include "uini.h"
+
+/// used by the time base and real-time profile (defaults only)
+mINI::INIStructure ini;
+
+static double cpuSec()
+{
+  timespec ts;
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char ** argv)
+{
+  if (argc < 2)
+  {
+    printf("usage: %s directory [level] [dir_mb] [pose_decimation]\n", argv[0]);
+    return 1;
+  }
+  std::string dir = argv[1];
+  if (dir.back() != '/')
+    dir += '/';
+  int level = 1;
+  float dirMb = 0;
+  int decimate = 1;
+  if (argc > 2)
+    level = strtol(argv[2], nullptr, 10);
+  if (argc > 3)
+    dirMb = strtof(argv[3], nullptr);
+  if (argc > 4)
+    decimate = strtol(argv[4], nullptr, 10);
+  ULogger * lg = new ULogger();
+  lg->setupFiles(level, dirMb);
+  if (decimate > 1)
+    lg->setDecimation("log_pose.txt", decimate);
+  lg->setup(false);
+  FILE * fp = lg->open((dir + "log_pose.txt").c_str());
+  FILE * fe = lg->open((dir + "log_encoder.txt").c_str());
+  FILE * fr = lg->open((dir + "log_edge_raw.txt").c_str());
+  FILE * fi = lg->open((dir + "log_imu.txt").c_str());
+  if (fp == nullptr or fe == nullptr or fr == nullptr or fi == nullptr)
+  {
+    printf("# failed to create logfiles in %s\n", dir.c_str());
+    return 1;
+  }
+  fprintf(fp, "%% pose logfile\n%% 1 \tTime (sec)\n%% 2 \tx\n");
+  double c0 = cpuSec();
+  for (int i = 0; i < 20000; i++)
+  { // 20 s at 1 kHz, edge at 500 Hz and imu at 250 Hz
+    unsigned long s = 1700000000ul + i / 1000;
+    long us = (i % 1000) * 10;
+    double t = i * 0.001;
+    lg->log(fp, "%lu.%04ld %.4f %.4f %.4f %.5f %.3f %.3f %.3f %.4f %.3f %.4f\n", s, us,
+            0.3 * t, 0.01 * sin(t), fmod(t, 6.28), 0.3f, 0.001 * i, 0.0, 1.2, 0.0, 0.3, 0.1);
+    lg->log(fe, "%lu.%04ld %d %d %d %d\n", s, us, i * 3, i * 3 + (i % 7), 120 + i % 5, 3);
+    if (i % 2 == 0)
+      lg->log(fr, "%lu.%04ld %d %d %d %d %d %d %d %d\n", s, us, 400 + i % 13, 410 + i % 17, 620,
+              800 + i % 3, 790, 630, 405 + i % 11, 399);
+    if (i % 4 == 0)
+      lg->log(fi, "%lu.%04ld %.3f %.3f %.3f %.4f %.4f %.4f\n", s, us, 0.01 * (i % 9), -0.02, 9.81,
+              0.001 * (i % 5), 0.0, -0.002);
+    usleep(250);
+  }
+  lg->close(fp);
+  lg->close(fe);
+  lg->close(fr);
+  lg->close(fi);
+  lg->terminate();
+  printf("# level %d: process CPU %.2f s\n", level, cpuSec() - c0);
+  delete lg;
+  return 0;
+}
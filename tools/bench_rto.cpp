@@ -0,0 +1,230 @@
+/* #***************************************************************************
+ #*   Copyright (C) 2023 by DTU
+ #*   jcan@dtu.dk
+ #*
+ #*
+ #* The MIT License (MIT)  https://mit-license.org/
+ #*
+ #* Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+ #* and associated documentation files (the “Software”), to deal in the Software without restriction,
+ #* including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ #* sublicense, and/or sell copies of the Software, and to permit persons to whom the Software
+ #* is furnished to do so, subject to the following conditions:
+ #*
+ #* The above copyright notice and this permission notice shall be included in all copies
+ #* or substantial portions of the Software.
+ #*
+ #* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ #* INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ #* PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+ #* FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ #* ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ #* THE SOFTWARE. */
+
+/**
+ * Validation of the retransmit timeout (URtt) against a fixed confirm
+ * timeout, with latency, jitter and loss injected by UTeensyEmu.
+ * A number of confirmed messages are sent through a confirm window
+ * as in STeensy, with the same retry limits (count and total time from
+ * first send), in simulated time, so a run takes no real time.
+ * Prints messages confirmed, dumped, resends and the simulated time used,
+ * first with the fixed timeout, then with the adaptive.
+ *
+ * build (from this directory):
+ *   g++ -O2 -I.. -o bench_rto bench_rto.cpp ../urtt.cpp ../uteensyemu.cpp ../ubinframe.cpp
+ * usage e.g.:
+ *   ./bench_rto -l 15 -j 20 -p 0.05
+ * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+#include "uteensyemu.h"
+#include "urtt.h"
+
+struct Msg
+{
+  int n;
+  bool sent = false;
+  bool confirmed = false;
+  bool dumped = false;
+  int sendCnt = 0;
+  double sendAt = 0;
+  double firstSendAt = 0;
+};
+
+struct Setup
+{
+  double latency = 0.001;
+  double jitter = 0;
+  double loss = 0;
+  int msgs = 2000;
+  int window = 4;
+  /// as [teensy] confirm_timeout, rto_min and rto_max
+  double timeout = 0.03;
+  double rtoMin = 0.005;
+  double rtoMax = 0.5;
+  /// as STeensy::confirmRetryCntMax
+  int retryMax = 50;
+  unsigned int seed = 1;
+};
+
+/** message with CRC, as STeensy::UOutQueue::setMessage */
+static std::string crcLine(const char * msg)
+{
+  int sum = 0;
+  for (const char * p1 = msg; *p1 != '\0'; p1++)
+  {
+    if (*p1 >= ' ')
+      sum += *p1;
+  }
+  char s[110];
+  snprintf(s, sizeof(s), ";%02d%s\n", (sum % 99) + 1, msg);
+  return s;
+}
+
+static void run(const Setup & su, bool adaptive)
+{
+  UTeensyEmu emu;
+  emu.impair.latency = su.latency;
+  emu.impair.jitter = su.jitter;
+  emu.impair.loss = su.loss;
+  URtt rtt;
+  rtt.setup(su.timeout, su.rtoMin, su.rtoMax);
+  // the total retry time is limited as in STeensy
+  double retryTimeMax = su.timeout * su.retryMax;
+  std::vector<Msg> q(su.msgs);
+  for (int i = 0; i < su.msgs; i++)
+    q[i].n = i;
+  int front = 0;
+  int resendCnt = 0;
+  int dumpCnt = 0;
+  double dumpAfterMax = 0;
+  double now = 0;
+  std::string rx;
+  emu.output = [&](const char * data, int n)
+  { // split into lines and match confirms in the window
+    for (int i = 0; i < n; i++)
+    {
+      if (data[i] != '\n')
+      {
+        rx += data[i];
+        continue;
+      }
+      int k;
+      if (rx.size() > 3 and sscanf(&rx[3], "confirm !svo 1 %d", &k) == 1)
+      {
+        for (int j = front; j < front + su.window and j < su.msgs; j++)
+        {
+          Msg & m = q[j];
+          if (m.n == k and m.sent and not m.confirmed)
+          {
+            m.confirmed = true;
+            if (m.sendCnt == 1)
+              rtt.sample(now - m.sendAt);
+            else
+              rtt.ambiguous();
+            break;
+          }
+        }
+      }
+      rx.clear();
+    }
+  };
+  emu.reset(0, su.seed);
+  for (; front < su.msgs and now < 3600; now += 0.0002)
+  {
+    emu.tick(now);
+    while (front < su.msgs and q[front].confirmed)
+      front++;
+    for (int j = front; j < front + su.window and j < su.msgs; j++)
+    {
+      Msg & m = q[j];
+      if (m.confirmed)
+        continue;
+      double rto = adaptive ? rtt.getRto(m.sendCnt) : su.timeout;
+      if (m.sent and now - m.sendAt > rto)
+      { // timeout
+        if (m.sendCnt < su.retryMax and now - m.firstSendAt < retryTimeMax)
+        {
+          m.sent = false;
+          resendCnt++;
+        }
+        else
+        { // give up
+          m.confirmed = true;
+          m.dumped = true;
+          dumpCnt++;
+          if (now - m.firstSendAt > dumpAfterMax)
+            dumpAfterMax = now - m.firstSendAt;
+          continue;
+        }
+      }
+      if (not m.sent)
+      {
+        char s[100];
+        snprintf(s, sizeof(s), "!svo 1 %d 200", m.n);
+        std::string line = crcLine(s);
+        emu.received(line.c_str(), line.size(), now);
+        if (m.sendCnt == 0)
+          m.firstSendAt = now;
+        m.sent = true;
+        m.sendAt = now;
+        m.sendCnt++;
+      }
+    }
+  }
+  printf("%-8s %6d %6d %7d %9.2f %9.2f   srtt %.1f ms, rttvar %.1f ms, rto %.1f ms\n",
+         adaptive ? "adaptive" : "fixed", front - dumpCnt, dumpCnt, resendCnt, now, dumpAfterMax,
+         rtt.getSrtt() * 1000, rtt.getRttVar() * 1000, rtt.getRto(1) * 1000);
+}
+
+static void usage(const char * app)
+{
+  printf("usage: %s [options]\n", app);
+  printf("  -l ms     reply latency (default 1)\n");
+  printf("  -j ms     reply jitter, random extra delay up to this value (default 0)\n");
+  printf("  -p prob   probability of a lost line in each direction (default 0)\n");
+  printf("  -n msgs   number of confirmed messages (default 2000)\n");
+  printf("  -w n      confirm window (default 4)\n");
+  printf("  -t ms     fixed timeout, and adaptive until first sample (default 30)\n");
+  printf("  -r n      retries before a message is dumped (default 50)\n");
+  printf("  -s seed   random seed (default 1)\n");
+}
+
+int main(int argc, char ** argv)
+{
+  Setup su;
+  int opt;
+  while ((opt = getopt(argc, argv, "l:j:p:n:w:t:r:s:h")) != -1)
+  {
+    switch (opt)
+    {
+      case 'l': su.latency = strtod(optarg, nullptr) / 1000.0; break;
+      case 'j': su.jitter = strtod(optarg, nullptr) / 1000.0; break;
+      case 'p': su.loss = strtod(optarg, nullptr); break;
+      case 'n': su.msgs = strtol(optarg, nullptr, 10); break;
+      case 'w': su.window = strtol(optarg, nullptr, 10); break;
+      case 't': su.timeout = strtod(optarg, nullptr) / 1000.0; break;
+      case 'r': su.retryMax = strtol(optarg, nullptr, 10); break;
+      case 's': su.seed = strtoul(optarg, nullptr, 10); break;
+      default:
+        usage(argv[0]);
+        return 1;
+    }
+  }
+  if (su.msgs < 1 or su.window < 1)
+  {
+    usage(argv[0]);
+    return 1;
+  }
+  printf("# latency %.1f ms, jitter %.1f ms, loss %.3f, window %d, timeout %.1f ms, %d retries\n",
+         su.latency * 1000, su.jitter * 1000, su.loss, su.window, su.timeout * 1000, su.retryMax);
+  printf("%% timeout   conf.  dumped  resend  time(s)  dump after(s)\n");
+  run(su, false);
+  run(su, true);
+  return 0;
+}
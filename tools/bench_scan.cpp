@@ -0,0 +1,259 @@
+/* #***************************************************************************
+ #*   Copyright (C) 2023 by DTU
+ #*   jcan@dtu.dk
+ #*
+ #*
+ #* The MIT License (MIT)  https://mit-license.org/
+ #*
+ #* Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+ #* and associated documentation files (the “Software”), to deal in the Software without restriction,
+ #* including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ #* sublicense, and/or sell copies of the Software, and to permit persons to whom the Software
+ #* is furnished to do so, subject to the following conditions:
+ #*
+ #* The above copyright notice and this permission notice shall be included in all copies
+ #* or substantial portions of the Software.
+ #*
+ #* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ #* INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ #* PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+ #* FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ #* ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ #* THE SOFTWARE. */
+
+/**
+ * Microbenchmark of the numeric field decoding of Teensy messages,
+ * the strtol/strtof based decoding against UScan (std::from_chars).
+ * Uses the received lines (Rx) in a log_teensy_io.txt file.
+ *
+ * build (from this directory):
+ *   g++ -O2 -I.. -o bench_scan bench_scan.cpp ../uscan.cpp
+ * usage:
+ *   ./bench_scan log/log_teensy_io.txt [repeat]
+ * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <string>
+#include <vector>
+
+#include "uscan.h"
+
+struct Line
+{
+  int type;
+  std::string msg;
+};
+
+static const char * keys[] = {"enc ", "liv ", "ir ", "gyro0 ", "acc0 ", "hbt ", "svo "};
+static const int keyCnt = sizeof(keys) / sizeof(keys[0]);
+/// fields in each message type
+static double result[20];
+
+static double monoSec()
+{
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/** decode as the original code, values are put in result[] */
+static int decodeStrto(int type, const char * p1)
+{
+  switch (type)
+  {
+    case 0: // enc
+      result[0] = -strtoll(p1, (char**)&p1, 10);
+      result[1] = strtoll(p1, (char**)&p1, 10);
+      return 2;
+    case 1: // liv
+      for (int i = 0; i < 8; i++)
+        result[i] = strtol(p1, (char**)&p1, 10);
+      return 8;
+    case 2: // ir
+      result[0] = strtof(p1, (char**)&p1);
+      result[1] = strtof(p1, (char**)&p1);
+      result[2] = strtol(p1, (char**)&p1, 10);
+      result[3] = strtol(p1, (char**)&p1, 10);
+      return 4;
+    case 3: // gyro0
+    case 4: // acc0
+      for (int i = 0; i < 3; i++)
+        result[i] = strtof(p1, (char**)&p1);
+      return 3;
+    case 5: // hbt
+      result[0] = strtod(p1, (char**)&p1);
+      result[1] = strtol(p1, (char**)&p1, 10);
+      result[2] = strtol(p1, (char**)&p1, 10);
+      result[3] = strtof(p1, (char**)&p1);
+      for (int i = 4; i < 9; i++)
+        result[i] = strtol(p1, (char**)&p1, 10);
+      return 9;
+    case 6: // svo
+      for (int i = 0; i < 15; i++)
+        result[i] = strtol(p1, (char**)&p1, 10);
+      return 15;
+  }
+  return 0;
+}
+
+/** decode using UScan, values are put in result[] */
+static int decodeScan(int type, const char * p1)
+{
+  UScan sc(p1);
+  switch (type)
+  {
+    case 0:
+    {
+      int64_t v[2];
+      sc.get(v, 2);
+      result[0] = -v[0];
+      result[1] = v[1];
+      return sc.ok(2) ? 2 : 0;
+    }
+    case 1:
+    case 6:
+    {
+      int n = (type == 1) ? 8 : 15;
+      int v[15];
+      sc.get(v, n);
+      for (int i = 0; i < n; i++)
+        result[i] = v[i];
+      return sc.ok(n) ? n : 0;
+    }
+    case 2:
+    {
+      float d[2];
+      int ad[2];
+      sc.get(d, 2);
+      sc.get(ad, 2);
+      result[0] = d[0];
+      result[1] = d[1];
+      result[2] = ad[0];
+      result[3] = ad[1];
+      return sc.ok(4) ? 4 : 0;
+    }
+    case 3:
+    case 4:
+    {
+      float v[3];
+      sc.get(v, 3);
+      for (int i = 0; i < 3; i++)
+        result[i] = v[i];
+      return sc.ok(3) ? 3 : 0;
+    }
+    case 5:
+    {
+      double tt;
+      float bat;
+      int v[7];
+      sc.get(tt);
+      sc.get(v, 2);
+      sc.get(bat);
+      sc.get(&v[2], 5);
+      result[0] = tt;
+      result[1] = v[0];
+      result[2] = v[1];
+      result[3] = bat;
+      for (int i = 4; i < 9; i++)
+        result[i] = v[i - 2];
+      return sc.ok(9) ? 9 : 0;
+    }
+  }
+  return 0;
+}
+
+int main(int argc, char ** argv)
+{
+  if (argc < 2)
+  {
+    printf("usage: %s log_teensy_io.txt [repeat]\n", argv[0]);
+    return 1;
+  }
+  int repeat = 20;
+  if (argc > 2)
+    repeat = strtol(argv[2], nullptr, 10);
+  FILE * f = fopen(argv[1], "r");
+  if (f == nullptr)
+  {
+    printf("# failed to open %s\n", argv[1]);
+    return 1;
+  }
+  std::vector<Line> lines;
+  const int MLL = 500;
+  char s[MLL];
+  while (fgets(s, MLL, f) != nullptr)
+  { // like: 1692262035.6011 Rx ;45enc 1234 5678
+    const char * p1 = strstr(s, " Rx ;");
+    if (p1 == nullptr)
+      continue;
+    p1 += 7;
+    for (int k = 0; k < keyCnt; k++)
+    {
+      int n = strlen(keys[k]);
+      if (strncmp(p1, keys[k], n) == 0)
+      {
+        lines.push_back({k, std::string(p1 + n)});
+        break;
+      }
+    }
+  }
+  fclose(f);
+  printf("# %d usable lines in %s, repeated %d times\n", int(lines.size()), argv[1], repeat);
+  if (lines.empty())
+    return 1;
+  // check both give the same values
+  int mismatch = 0;
+  int malformed = 0;
+  for (auto & l : lines)
+  {
+    double a[20];
+    int n = decodeStrto(l.type, l.msg.c_str());
+    memcpy(a, result, sizeof(a));
+    int m = decodeScan(l.type, l.msg.c_str());
+    if (m == 0)
+      malformed++;
+    else if (m != n or memcmp(a, result, n * sizeof(double)) != 0)
+    {
+      if (mismatch++ < 5)
+        printf("# mismatch: %s%s", keys[l.type], l.msg.c_str());
+    }
+  }
+  printf("# %d mismatches, %d malformed (rejected by UScan)\n", mismatch, malformed);
+  // timing per message type
+  printf("%% type   lines  strto(ns)  UScan(ns)  speedup\n");
+  double sum[2] = {0, 0};
+  for (int k = 0; k < keyCnt; k++)
+  {
+    double t[2] = {0, 0};
+    int cnt = 0;
+    for (int method = 0; method < 2; method++)
+    {
+      double t0 = monoSec();
+      for (int r = 0; r < repeat; r++)
+      {
+        for (auto & l : lines)
+        {
+          if (l.type != k)
+            continue;
+          if (method == 0)
+            decodeStrto(k, l.msg.c_str());
+          else
+            decodeScan(k, l.msg.c_str());
+          if (method == 0 and r == 0)
+            cnt++;
+        }
+      }
+      t[method] = monoSec() - t0;
+      sum[method] += t[method];
+    }
+    if (cnt > 0)
+      printf("%-6s %7d %10.1f %10.1f %8.2f\n", keys[k], cnt,
+             t[0] * 1e9 / cnt / repeat, t[1] * 1e9 / cnt / repeat, t[0] / t[1]);
+  }
+  printf("%-6s %7d %10.1f %10.1f %8.2f\n", "all", int(lines.size()),
+         sum[0] * 1e9 / lines.size() / repeat, sum[1] * 1e9 / lines.size() / repeat, sum[0] / sum[1]);
+  return 0;
+}
@@ -0,0 +1,33 @@
+#!/bin/bash
+# Robot startup latency against confirm window size.
+#
+# Runs raubase a number of times for each window size and reports the time
+# UService::setup waited for all Teensy setup messages to be confirmed.
+# Must be run from the directory with robot.ini (e.g. the build directory).
+#
+# usage: bench_startup.sh [raubase] [runs] [window sizes...]
+#   e.g. ../tools/bench_startup.sh ./raubase 5 1 2 4 8 16
+
+APP=${1:-./raubase}
+RUNS=${2:-5}
+shift 2
+WINDOWS=${@:-1 2 4 8 16}
+
+printf "%% window  runs  mean(s)  min(s)  max(s)  retries\n"
+for w in $WINDOWS
+do
+  times=""
+  retries=0
+  for ((i = 0; i < RUNS; i++))
+  do
+    out=$($APP -d -t 0.1 -W $w 2>&1)
+    t=$(echo "$out" | sed -n 's/.*waited \([0-9.e-]*\) sec for full setup.*/\1/p')
+    r=$(echo "$out" | sed -n 's/.*msg resend \([0-9]*\),.*/\1/p')
+    times="$times ${t:-nan}"
+    retries=$((retries + ${r:-0}))
+  done
+  echo $times | awk -v w=$w -v n=$RUNS -v r=$retries '{
+    s = 0; mi = 1e9; ma = 0;
+    for (i = 1; i <= NF; i++) { s += $i; if ($i < mi) mi = $i; if ($i > ma) ma = $i; }
+    printf "%8d %5d %8.4f %7.4f %7.4f %8d\n", w, n, s/NF, mi, ma, r }'
+done
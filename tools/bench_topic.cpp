@@ -0,0 +1,164 @@
+/* #***************************************************************************
+ #*   Copyright (C) 2023 by DTU
+ #*   jcan@dtu.dk
+ #*
+ #*
+ #* The MIT License (MIT)  https://mit-license.org/
+ #*
+ #* Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+ #* and associated documentation files (the “Software”), to deal in the Software without restriction,
+ #* including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ #* sublicense, and/or sell copies of the Software, and to permit persons to whom the Software
+ #* is furnished to do so, subject to the following conditions:
+ #*
+ #* The above copyright notice and this permission notice shall be included in all copies
+ #* or substantial portions of the Software.
+ #*
+ #* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ #* INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ #* PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+ #* FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ #* ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ #* THE SOFTWARE. */
+
+/**
+ * Wakeup latency and consistency test of UTopic.
+ * A value is published every 2 ms, one reader waits for each update
+ * and measures the time from publish to wakeup, a second reader
+ * calls read() continuously, both check that no torn value is read.
+ * For comparison, the same with a reader polling an update count
+ * with usleep(1000), as the modules did before.
+ *
+ * build (from this directory):
+ *   g++ -O2 -I.. -o bench_topic bench_topic.cpp -lpthread
+ * usage:
+ *   ./bench_topic [updates]
+ * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+#include "utopic.h"
+
+struct Data
+{
+  int64_t publishNs;
+  /// all the same value, else the read is torn
+  int64_t value[6];
+};
+
+static int64_t monoNs()
+{
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return int64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+static bool torn(const Data & d)
+{
+  for (int i = 1; i < 6; i++)
+  {
+    if (d.value[i] != d.value[0])
+      return true;
+  }
+  return false;
+}
+
+static void printLatency(const char * name, std::vector<double> & us)
+{
+  if (us.empty())
+  {
+    printf("%s: no updates\n", name);
+    return;
+  }
+  std::sort(us.begin(), us.end());
+  int n = us.size();
+  printf("%s: %d updates, latency (us) p50 %.1f, p99 %.1f, max %.1f\n",
+         name, n, us[n / 2], us[std::min(n - 1, n * 99 / 100)], us[n - 1]);
+}
+
+int main(int argc, char ** argv)
+{
+  int updates = 2000;
+  if (argc > 1)
+    updates = strtol(argv[1], nullptr, 10);
+  UTopic<Data> topic;
+  std::atomic<bool> stop = {false};
+  std::vector<double> latency;
+  std::atomic<long> tornCnt = {0};
+  long reads = 0;
+  std::thread waiter([&]
+  { // wait for each update
+    uint32_t seen = 0;
+    Data d;
+    while (not stop)
+    {
+      if (topic.wait(seen, 50000) == seen)
+        continue;
+      seen = topic.read(d);
+      latency.push_back((monoNs() - d.publishNs) / 1000.0);
+      if (torn(d))
+        tornCnt++;
+    }
+  });
+  std::thread reader([&]
+  { // read as fast as possible
+    Data d;
+    while (not stop)
+    {
+      topic.read(d);
+      reads++;
+      if (torn(d))
+        tornCnt++;
+    }
+  });
+  for (int i = 0; i < updates; i++)
+  {
+    Data d;
+    for (int k = 0; k < 6; k++)
+      d.value[k] = i;
+    d.publishNs = monoNs();
+    topic.publish(d);
+    usleep(2000);
+  }
+  stop = true;
+  waiter.join();
+  reader.join();
+  printLatency("topic", latency);
+  printf("topic: %ld reads, %ld torn\n", reads, tornCnt.load());
+  // the old way, poll an update count every 1 ms
+  std::atomic<int> updateCnt = {0};
+  std::atomic<int64_t> publishNs = {0};
+  latency.clear();
+  stop = false;
+  std::thread poller([&]
+  {
+    int last = 0;
+    while (not stop)
+    {
+      if (updateCnt != last)
+      {
+        last = updateCnt;
+        latency.push_back((monoNs() - publishNs) / 1000.0);
+      }
+      else
+        usleep(1000);
+    }
+  });
+  for (int i = 0; i < updates; i++)
+  {
+    publishNs = monoNs();
+    updateCnt++;
+    usleep(2000);
+  }
+  stop = true;
+  poller.join();
+  printLatency("poll", latency);
+  return 0;
+}
@@ -0,0 +1,102 @@
+/* #***************************************************************************
+ #*   Copyright (C) 2023 by DTU
+ #*   jcan@dtu.dk
+ #*
+ #*
+ #* The MIT License (MIT)  https://mit-license.org/
+ #*
+ #* Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+ #* and associated documentation files (the “Software”), to deal in the Software without restriction,
+ #* including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ #* sublicense, and/or sell copies of the Software, and to permit persons to whom the Software
+ #* is furnished to do so, subject to the following conditions:
+ #*
+ #* The above copyright notice and this permission notice shall be included in all copies
+ #* or substantial portions of the Software.
+ #*
+ #* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ #* INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ #* PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+ #* FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ #* ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ #* THE SOFTWARE. */
+
+/**
+ * Check of the 'hbt' (heartbeat) decoding in SState against known values,
+ * and that the decoded Teensy time gives a valid Teensy to host
+ * clock estimate (see UClockSync).
+ * Returns 0 if all is OK, else 1.
+ *
+ * build (from this directory):
+ *   g++ -O2 -I.. -o check_hbt check_hbt.cpp ../sstate.cpp ../steensy.cpp ../utime.cpp
+ *       ../utimebase.cpp ../urtt.cpp ../utokenbucket.cpp ../udelayhist.cpp ../uclocksync.cpp
+ *       ../ubinframe.cpp ../udispatch.cpp ../uscan.cpp ../ureplay.cpp ../utransport.cpp
+ *       ../uteensyemu.cpp ../ulogger.cpp ../uflightrec.cpp ../ulogbin.cpp ../ulogzip.cpp
+ *       ../urealtime.cpp -lpthread -lz
+ * usage:
+ *   ./check_hbt
+ * */
+
+#include <stdio.h>
+#include <math.h>
+#include <mutex>
+#include <string>
+
+#include "utime.h"
+#include "sstate.h"
+#include "steensy.h"
+#include "uservice.h"
+
+mINI::INIStructure ini;
+UService service;
+
+static int errCnt = 0;
+
+static void expect(const char * what, double got, double expected, double tol)
+{
+  bool ok = fabs(got - expected) <= tol;
+  printf("# %-22s %14.4f (expected %.4f) %s\n", what, got, expected, ok ? "OK" : "FAILED");
+  if (not ok)
+    errCnt++;
+}
+
+int main()
+{
+  UTime t("now");
+  // a line from a Regbot
+  state.decode("hbt 37708.7329 74 1430 5.01 0 6 1 1\n", t);
+  expect("teensy time", state.teensyTime, 37708.7329, 1e-6);
+  expect("robot index", state.idx, 74, 0);
+  expect("version", state.version, 1430, 0);
+  expect("battery", state.batteryVoltage, 5.01, 1e-4);
+  expect("hardware type", state.type, 6, 0);
+  expect("load", state.load, 1, 0);
+  // older firmware has the first 4 values only
+  state.decode("hbt 12.5 74 1430 12.2\n", t);
+  expect("teensy time (short)", state.teensyTime, 12.5, 1e-6);
+  expect("battery (short)", state.batteryVoltage, 12.2, 1e-4);
+  // clock estimate from a heartbeat every 0.5 s, with 1 ms transport delay
+  teensy1.clockSync.setup(20);
+  double t0 = 37708.7329;
+  long hostSec = t.getSec();
+  for (int i = 0; i < 20; i++)
+  {
+    const int MSL = 100;
+    char s[MSL];
+    snprintf(s, MSL, "hbt %.4f 74 1430 12.2 0 6 1 1 1\n", t0 + i * 0.5);
+    UTime ht;
+    ht.setTime(hostSec + i / 2, (i % 2) * 500000 + 1000);
+    state.decode(s, ht);
+  }
+  expect("clock estimate valid", teensy1.clockSync.isValid(), 1, 0);
+  if (teensy1.clockSync.isValid())
+  { // Teensy time of the last heartbeat should map to its arrival time
+    // (the delay is the same for all)
+    UTime last;
+    last.setTime(hostSec + 9, 501000);
+    UTime h = teensy1.clockSync.teensyToHost(t0 + 19 * 0.5);
+    expect("host time error (ms)", (h - last) * 1000, 0.0, 0.5);
+  }
+  printf("# %d errors\n", errCnt);
+  return errCnt > 0;
+}
@@ -0,0 +1,142 @@
+/* #***************************************************************************
+ #*   Copyright (C) 2023 by DTU
+ #*   jcan@dtu.dk
+ #*
+ #*
+ #* The MIT License (MIT)  https://mit-license.org/
+ #*
+ #* Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+ #* and associated documentation files (the “Software”), to deal in the Software without restriction,
+ #* including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ #* sublicense, and/or sell copies of the Software, and to permit persons to whom the Software
+ #* is furnished to do so, subject to the following conditions:
+ #*
+ #* The above copyright notice and this permission notice shall be included in all copies
+ #* or substantial portions of the Software.
+ #*
+ #* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ #* INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ #* PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+ #* FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ #* ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ #* THE SOFTWARE. */
+
+/**
+ * Convert a binary logfile (robot.ini [service] log_binary = true)
+ * to the text logfile, as it would have been written with log_binary = false,
+ * e.g. log_pose.bin to log_pose.txt.
+ *
+ * build (from this directory):
+ *   g++ -O2 -I.. -o logbin2txt logbin2txt.cpp ../ulogbin.cpp
+ * usage e.g.:
+ *   ./logbin2txt log_pose.bin log_motor_0.bin
+ *   ./logbin2txt -i log_pose.bin        (channels and index only)
+ *   ./logbin2txt -f 1706101234.5 -t 1706101240 -o - log_pose.bin
+ * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <string>
+
+#include "ulogbin.h"
+
+static void usage()
+{
+  printf("Usage: logbin2txt [-i] [-f from_sec] [-t to_sec] [-o out.txt|-] file.bin ...\n"
+         "  -i  show channels and time index only\n"
+         "  -f  first data line at or after this time (sec since epoch)\n"
+         "  -t  last data line before this time\n"
+         "  -o  output file (default is the .bin file name as .txt, '-' is stdout)\n");
+}
+
+int main(int argc, char ** argv)
+{
+  bool info = false;
+  double from = 0, to = 0;
+  const char * outName = nullptr;
+  int opt;
+  while ((opt = getopt(argc, argv, "if:t:o:h")) != -1)
+  {
+    switch (opt)
+    {
+      case 'i': info = true; break;
+      case 'f': from = strtod(optarg, nullptr); break;
+      case 't': to = strtod(optarg, nullptr); break;
+      case 'o': outName = optarg; break;
+      default: usage(); return 1;
+    }
+  }
+  if (optind >= argc)
+  {
+    usage();
+    return 1;
+  }
+  int err = 0;
+  for (int i = optind; i < argc; i++)
+  {
+    ULogBinReader r;
+    if (not r.open(argv[i]))
+    {
+      fprintf(stderr, "# %s is not a binary logfile\n", argv[i]);
+      err++;
+      continue;
+    }
+    if (info)
+    {
+      printf("# %s: start %.4f, %zu bytes data, %d channels, %zu index entries%s\n",
+             argv[i], r.startUs * 1e-6, r.dataEnd - r.dataStart, (int)r.channels.size(),
+             r.index.size(), r.complete ? "" : " (not closed, scanned)");
+      for (int c = 0; c < (int)r.channels.size(); c++)
+        printf("#   channel %d: types '%s' (%d bytes), format '%s'\n", c,
+               r.channels[c].types.c_str(), r.channels[c].valueSize, r.channels[c].format.c_str());
+      continue;
+    }
+    std::string fn;
+    if (outName != nullptr)
+      fn = outName;
+    else
+    {
+      fn = argv[i];
+      int n = fn.size() - 4;
+      if (n > 0 and fn.substr(n) == ".bin")
+        fn.replace(n, 4, ".txt");
+      else
+        fn += ".txt";
+    }
+    FILE * out = stdout;
+    if (fn != "-")
+      out = fopen(fn.c_str(), "w");
+    if (out == nullptr)
+    {
+      perror(fn.c_str());
+      err++;
+      continue;
+    }
+    // text blocks (header) are written also before 'from'
+    int64_t fromUs = from * 1e6;
+    int64_t toUs = to * 1e6;
+    size_t first = r.dataStart;
+    if (fromUs > 0)
+      first = r.seek(fromUs);
+    size_t pos = r.dataStart;
+    size_t at = pos;
+    ULogBinReader::Block b;
+    while (r.next(pos, b))
+    {
+      if (b.type == ULogBin::TEXT)
+        r.toText(b, out);
+      else if (b.type == ULogBin::DATA and at >= first)
+      {
+        if (toUs > 0 and b.us >= toUs)
+          break;
+        r.toText(b, out);
+      }
+      at = pos;
+    }
+    if (out != stdout)
+      fclose(out);
+  }
+  return err;
+}
@@ -0,0 +1,263 @@
+/* #***************************************************************************
+ #*   Copyright (C) 2023 by DTU
+ #*   jcan@dtu.dk
+ #*
+ #*
+ #* The MIT License (MIT)  https://mit-license.org/
+ #*
+ #* Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+ #* and associated documentation files (the “Software”), to deal in the Software without restriction,
+ #* including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ #* sublicense, and/or sell copies of the Software, and to permit persons to whom the Software
+ #* is furnished to do so, subject to the following conditions:
+ #*
+ #* The above copyright notice and this permission notice shall be included in all copies
+ #* or substantial portions of the Software.
+ #*
+ #* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ #* INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ #* PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+ #* FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ #* ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ #* THE SOFTWARE. */
+
+/**
+ * Teensy emulator on a pseudo terminal (or a socket).
+ * Makes a link (default /tmp/ttyTEENSY) to a pty, that can be used as
+ * [teensy] device in robot.ini, or listens on a Unix socket (-u, [teensy] transport = unix)
+ * or a TCP port (-P, [teensy] transport = tcp), and emulates the Teensy line protocol
+ * (see UTeensyEmu), with optional latency, jitter, loss and CRC errors.
+ *
+ * build (from this directory):
+ *   g++ -O2 -I.. -o teensy_emu teensy_emu.cpp ../uteensyemu.cpp ../ubinframe.cpp -lutil
+ * usage e.g.:
+ *   ./teensy_emu -d /tmp/ttyTEENSY -l 2 -j 1 -p 0.001 -c 0.001 -r 4
+ * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <termios.h>
+#include <pty.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <string>
+
+#include "uteensyemu.h"
+
+static volatile bool stop = false;
+
+static void sigHandler(int)
+{
+  stop = true;
+}
+
+static double monoSec()
+{
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void usage(const char * app)
+{
+  printf("usage: %s [options]\n", app);
+  printf("  -d link   device link name (default /tmp/ttyTEENSY)\n");
+  printf("  -u path   listen on this Unix socket, instead of a pty\n");
+  printf("  -P port   listen on this TCP port, instead of a pty\n");
+  printf("  -l ms     reply latency (default 0)\n");
+  printf("  -j ms     reply jitter, random extra delay up to this value (default 0)\n");
+  printf("  -p prob   probability of a lost line in each direction (default 0)\n");
+  printf("  -c prob   probability of a corrupted reply (default 0)\n");
+  printf("  -r fac    multiply subscription rates by this factor (default 1)\n");
+  printf("  -m lps    handle at most this many lines per second, rest is buffered (default no limit)\n");
+  printf("  -n name   robot name (default emu)\n");
+  printf("  -s seed   random seed (default 0)\n");
+  printf("  -t        text only (ignore binary frame requests)\n");
+  printf("  -v        print statistics every second\n");
+}
+
+int main(int argc, char ** argv)
+{
+  std::string link = "/tmp/ttyTEENSY";
+  UTeensyEmu emu;
+  unsigned int seed = 0;
+  bool verbose = false;
+  std::string sockPath;
+  int tcpPort = 0;
+  int opt;
+  while ((opt = getopt(argc, argv, "d:u:P:l:j:p:c:r:m:n:s:tvh")) != -1)
+  {
+    switch (opt)
+    {
+      case 'd': link = optarg; break;
+      case 'u': sockPath = optarg; break;
+      case 'P': tcpPort = strtol(optarg, nullptr, 10); break;
+      case 'l': emu.impair.latency = strtod(optarg, nullptr) / 1000.0; break;
+      case 'j': emu.impair.jitter = strtod(optarg, nullptr) / 1000.0; break;
+      case 'p': emu.impair.loss = strtod(optarg, nullptr); break;
+      case 'c': emu.impair.corrupt = strtod(optarg, nullptr); break;
+      case 'r': emu.rateFactor = strtod(optarg, nullptr); break;
+      case 'm': emu.rxCapacity = strtod(optarg, nullptr); break;
+      case 'n': emu.name = optarg; break;
+      case 's': seed = strtoul(optarg, nullptr, 10); break;
+      case 't': emu.binarySupport = false; break;
+      case 'v': verbose = true; break;
+      default:
+        usage(argv[0]);
+        return 1;
+    }
+  }
+  if (emu.rateFactor <= 0)
+    emu.rateFactor = 1;
+  // fd for data to and from host (pty master or accepted connection)
+  int master = -1;
+  int slave = -1;
+  // listening socket
+  int listenFd = -1;
+  if (not sockPath.empty() or tcpPort > 0)
+  { // one connection at a time
+    if (tcpPort > 0)
+    {
+      listenFd = socket(AF_INET, SOCK_STREAM, 0);
+      int one = 1;
+      setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+      sockaddr_in addr;
+      memset(&addr, 0, sizeof(addr));
+      addr.sin_family = AF_INET;
+      addr.sin_addr.s_addr = htonl(INADDR_ANY);
+      addr.sin_port = htons(tcpPort);
+      if (bind(listenFd, (sockaddr *)&addr, sizeof(addr)) < 0)
+      {
+        perror("bind");
+        return 1;
+      }
+      printf("# teensy_emu: listening on TCP port %d\n", tcpPort);
+    }
+    else
+    {
+      listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+      sockaddr_un addr;
+      memset(&addr, 0, sizeof(addr));
+      addr.sun_family = AF_UNIX;
+      strncpy(addr.sun_path, sockPath.c_str(), sizeof(addr.sun_path) - 1);
+      unlink(sockPath.c_str());
+      if (bind(listenFd, (sockaddr *)&addr, sizeof(addr)) < 0)
+      {
+        perror("bind");
+        return 1;
+      }
+      printf("# teensy_emu: listening on %s\n", sockPath.c_str());
+    }
+    listen(listenFd, 1);
+  }
+  else
+  {
+    if (openpty(&master, &slave, nullptr, nullptr, nullptr) < 0)
+    {
+      perror("openpty");
+      return 1;
+    }
+    // raw mode, no echo, no line editing
+    termios tio;
+    tcgetattr(slave, &tio);
+    cfmakeraw(&tio);
+    tcsetattr(slave, TCSANOW, &tio);
+    // keep slave open, so that host may close and reopen
+    fcntl(master, F_SETFL, fcntl(master, F_GETFL) | O_NONBLOCK);
+    unlink(link.c_str());
+    if (symlink(ttyname(slave), link.c_str()) < 0)
+    {
+      perror("symlink");
+      return 1;
+    }
+    printf("# teensy_emu: %s -> %s\n", link.c_str(), ttyname(slave));
+  }
+  signal(SIGINT, sigHandler);
+  signal(SIGTERM, sigHandler);
+  // a closed connection is found by read()
+  signal(SIGPIPE, SIG_IGN);
+  int txFullCnt = 0;
+  emu.output = [&](const char * data, int n)
+  { // host may be slow (or not connected) - then drop
+    if (master < 0 or write(master, data, n) != n)
+      txFullCnt++;
+  };
+  emu.reset(monoSec(), seed);
+  double nextReport = monoSec() + 1.0;
+  const int MRL = 4096;
+  char buf[MRL];
+  while (not stop)
+  {
+    double now = monoSec();
+    double wait = emu.nextEventAt() - now;
+    if (verbose and nextReport - now < wait)
+      wait = nextReport - now;
+    timespec ts;
+    if (wait < 0)
+      wait = 0;
+    ts.tv_sec = long(wait);
+    ts.tv_nsec = long((wait - ts.tv_sec) * 1e9);
+    // wait for data, or for a connection
+    pollfd pfd = {master >= 0 ? master : listenFd, POLLIN, 0};
+    int r = ppoll(&pfd, 1, &ts, nullptr);
+    now = monoSec();
+    if (r > 0 and master < 0)
+    { // host connects (the emulated Teensy keeps its state)
+      master = accept(listenFd, nullptr, nullptr);
+      if (master >= 0)
+      {
+        fcntl(master, F_SETFL, fcntl(master, F_GETFL) | O_NONBLOCK);
+        int one = 1;
+        setsockopt(master, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+      }
+    }
+    else if (r > 0 and (pfd.revents & POLLIN))
+    {
+      int n = read(master, buf, MRL);
+      if (n > 0)
+        emu.received(buf, n, now);
+      else if (n == 0 and listenFd >= 0)
+      { // host closed the connection
+        close(master);
+        master = -1;
+      }
+    }
+    else if (r > 0)
+      // host closed the port (POLLHUP), wait for reopen
+      usleep(1000);
+    emu.tick(now);
+    if (verbose and now >= nextReport)
+    {
+      printf("# rx %d (crc err %d, lost %d, overflow %d), confirm %d, tx lines %d, frames %d (lost %d, corrupt %d, dropped %d)\n",
+             emu.rxLineCnt, emu.rxCrcErrCnt, emu.rxLostCnt, emu.rxOverflowCnt, emu.confirmCnt, emu.txLineCnt,
+             emu.txFrameCnt, emu.txLostCnt, emu.txCorruptCnt, txFullCnt);
+      nextReport += 1.0;
+    }
+  }
+  printf("# teensy_emu: rx %d (crc err %d, lost %d, overflow %d), confirm %d, tx lines %d, frames %d (lost %d, corrupt %d, dropped %d)\n",
+         emu.rxLineCnt, emu.rxCrcErrCnt, emu.rxLostCnt, emu.rxOverflowCnt, emu.confirmCnt, emu.txLineCnt,
+         emu.txFrameCnt, emu.txLostCnt, emu.txCorruptCnt, txFullCnt);
+  if (listenFd >= 0)
+  {
+    close(listenFd);
+    if (not sockPath.empty())
+      unlink(sockPath.c_str());
+  }
+  else
+  {
+    unlink(link.c_str());
+    close(slave);
+  }
+  if (master >= 0)
+    close(master);
+  return 0;
+}
@@ -0,0 +1,99 @@
+/* #***************************************************************************
+ #*   Copyright (C) 2023 by DTU
+ #*   jcan@dtu.dk
+ #*
+ #*
+ #* The MIT License (MIT)  https://mit-license.org/
+ #*
+ #* Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+ #* and associated documentation files (the “Software”), to deal in the Software without restriction,
+ #* including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ #* sublicense, and/or sell copies of the Software, and to permit persons to whom the Software
+ #* is furnished to do so, subject to the following conditions:
+ #*
+ #* The above copyright notice and this permission notice shall be included in all copies
+ #* or substantial portions of the Software.
+ #*
+ #* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ #* INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ #* PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+ #* FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ #* ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ #* THE SOFTWARE. */
+
+#include "ubinframe.h"
+
+namespace
+{
+  const char * typeNames[UBinFrame::BIN_TYPE_CNT] = {nullptr, "enc", "liv", "ir", "gyro0", "acc0", "hbt"};
+  const int payloadSizes[UBinFrame::BIN_TYPE_CNT] = {0, 8, 16, 16, 12, 12, 20};
+}
+
+const char * UBinFrame::typeName(int type)
+{
+  if (type > 0 and type < BIN_TYPE_CNT)
+    return typeNames[type];
+  else
+    return nullptr;
+}
+
+int UBinFrame::typeFromName(const char* name)
+{
+  for (int i = 1; i < BIN_TYPE_CNT; i++)
+  {
+    if (strcmp(name, typeNames[i]) == 0)
+      return i;
+  }
+  return 0;
+}
+
+int UBinFrame::payloadSize(int type)
+{
+  if (type > 0 and type < BIN_TYPE_CNT)
+    return payloadSizes[type];
+  else
+    return 0;
+}
+
+uint16_t UBinFrame::crc16(const uint8_t* data, int n)
+{
+  uint16_t crc = 0xffff;
+  for (int i = 0; i < n; i++)
+  {
+    crc ^= uint16_t(data[i]) << 8;
+    for (int b = 0; b < 8; b++)
+    {
+      if (crc & 0x8000)
+        crc = (crc << 1) ^ 0x1021;
+      else
+        crc <<= 1;
+    }
+  }
+  return crc;
+}
+
+bool UBinFrame::check(const uint8_t* frame)
+{
+  int len = frame[2];
+  int hs = headerSize(frame[1]);
+  uint16_t crc = crc16(&frame[1], hs - 1 + len);
+  return crc == getU16(&frame[hs + len]);
+}
+
+int UBinFrame::pack(uint8_t* buf, int type, uint16_t seq, const uint8_t* payload, int len,
+                    bool withTime, uint32_t timeUs)
+{
+  buf[0] = SYNC;
+  buf[1] = withTime ? (type | TIME_FLAG) : type;
+  buf[2] = len;
+  buf[3] = seq & 0xff;
+  buf[4] = seq >> 8;
+  int hs = headerSize(buf[1]);
+  if (withTime)
+    putI32(&buf[HDR], timeUs);
+  memcpy(&buf[hs], payload, len);
+  uint16_t crc = crc16(&buf[1], hs - 1 + len);
+  buf[hs + len] = crc & 0xff;
+  buf[hs + len + 1] = crc >> 8;
+  return hs + len + TAIL;
+}
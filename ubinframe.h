@@ -0,0 +1,151 @@
+/* #***************************************************************************
+ #*   Copyright (C) 2023 by DTU
+ #*   jcan@dtu.dk
+ #*
+ #*
+ #* The MIT License (MIT)  https://mit-license.org/
+ #*
+ #* Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+ #* and associated documentation files (the “Software”), to deal in the Software without restriction,
+ #* including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ #* sublicense, and/or sell copies of the Software, and to permit persons to whom the Software
+ #* is furnished to do so, subject to the following conditions:
+ #*
+ #* The above copyright notice and this permission notice shall be included in all copies
+ #* or substantial portions of the Software.
+ #*
+ #* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ #* INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ #* PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+ #* FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ #* ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ #* THE SOFTWARE. */
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * Compact binary frame for high rate Teensy data streams.
+ * A frame is
+ *   SYNC (0xA5), type, payload length, sequence number (16 bit),
+ *   payload (little-endian), CRC-16 (CCITT, over type to end of payload).
+ * A text line can never hold the SYNC character, so binary frames
+ * and text lines can be mixed on the same connection.
+ * A stream is switched to binary by a 'bin stream 1' request after
+ * the 'sub' command; a Teensy that do not know the request continues in text.
+ * With 'bin stream 2' the frames has TIME_FLAG set in the type, and
+ * a 32 bit Teensy timestamp (us) after the sequence number.
+ * */
+class UBinFrame
+{
+public:
+  static const uint8_t SYNC = 0xA5;
+  /// bytes before payload
+  static const int HDR = 5;
+  /// type flag for a frame with Teensy timestamp (4 bytes more in header)
+  static const uint8_t TIME_FLAG = 0x80;
+  /// bytes after payload (CRC)
+  static const int TAIL = 2;
+  static const int MAX_PAYLOAD = 64;
+  /// frame type numbers
+  enum FrameType {
+    BIN_ENC = 1,   // int32 enc left, int32 enc right (as in 'enc')
+    BIN_LIV = 2,   // int16 x 8 line sensor values (as in 'liv')
+    BIN_IR = 3,    // float32 dist1, dist2, int32 AD1, AD2 (as in 'ir')
+    BIN_GYRO = 4,  // float32 x,y,z (as in 'gyro0')
+    BIN_ACC = 5,   // float32 x,y,z (as in 'acc0')
+    BIN_HBT = 6,   // float64 time, int16 idx, int16 version, float32 battery,
+                   // uint8 state, uint8 hw type, uint8 load, uint8 motor enabled (bit 0,1)
+    BIN_TYPE_CNT
+  };
+  /**
+   * Get stream (keyword) name of this frame type, e.g. "enc"
+   * \returns nullptr if type is unknown */
+  static const char * typeName(int type);
+  /**
+   * Get frame type for this stream name
+   * \returns 0 if not a binary stream */
+  static int typeFromName(const char * name);
+  /**
+   * Get expected payload size for this type */
+  static int payloadSize(int type);
+  /**
+   * Header size for this type byte (with or without timestamp) */
+  static inline int headerSize(uint8_t typeByte)
+  {
+    return (typeByte & TIME_FLAG) ? HDR + 4 : HDR;
+  }
+  /**
+   * CRC-16 CCITT (0x1021, initial 0xFFFF) */
+  static uint16_t crc16(const uint8_t * data, int n);
+  /**
+   * Check a full frame
+   * \param frame starts with SYNC and holds at least header + payload + TAIL bytes
+   * \returns true if CRC is OK */
+  static bool check(const uint8_t * frame);
+  /**
+   * Build a frame (used by test tools and emulator)
+   * \param buf must hold HDR + 4 + len + TAIL bytes
+   * \param withTime adds the Teensy timestamp timeUs
+   * \returns number of bytes in frame */
+  static int pack(uint8_t * buf, int type, uint16_t seq, const uint8_t * payload, int len,
+                  bool withTime = false, uint32_t timeUs = 0);
+  //
+  // little-endian field access
+  static inline int16_t getI16(const uint8_t * p)
+  {
+    return int16_t(p[0] | (p[1] << 8));
+  }
+  static inline uint16_t getU16(const uint8_t * p)
+  {
+    return uint16_t(p[0] | (p[1] << 8));
+  }
+  static inline int32_t getI32(const uint8_t * p)
+  {
+    return int32_t(uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24));
+  }
+  static inline uint32_t getU32(const uint8_t * p)
+  {
+    return uint32_t(getI32(p));
+  }
+  static inline float getF32(const uint8_t * p)
+  {
+    uint32_t u = getI32(p);
+    float f;
+    memcpy(&f, &u, 4);
+    return f;
+  }
+  static inline double getF64(const uint8_t * p)
+  {
+    uint64_t u = uint64_t(uint32_t(getI32(p))) | (uint64_t(uint32_t(getI32(p + 4))) << 32);
+    double d;
+    memcpy(&d, &u, 8);
+    return d;
+  }
+  static inline void putI16(uint8_t * p, int16_t v)
+  {
+    p[0] = v & 0xff;
+    p[1] = (v >> 8) & 0xff;
+  }
+  static inline void putI32(uint8_t * p, int32_t v)
+  {
+    uint32_t u = v;
+    for (int i = 0; i < 4; i++)
+      p[i] = (u >> (i * 8)) & 0xff;
+  }
+  static inline void putF32(uint8_t * p, float f)
+  {
+    uint32_t u;
+    memcpy(&u, &f, 4);
+    putI32(p, u);
+  }
+  static inline void putF64(uint8_t * p, double d)
+  {
+    uint64_t u;
+    memcpy(&u, &d, 8);
+    putI32(p, uint32_t(u));
+    putI32(p + 4, uint32_t(u >> 32));
+  }
+};
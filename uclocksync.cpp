@@ -0,0 +1,142 @@
+/* #***************************************************************************
+ #*   Copyright (C) 2023 by DTU
+ #*   jcan@dtu.dk
+ #*
+ #*
+ #* The MIT License (MIT)  https://mit-license.org/
+ #*
+ #* Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+ #* and associated documentation files (the “Software”), to deal in the Software without restriction,
+ #* including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ #* sublicense, and/or sell copies of the Software, and to permit persons to whom the Software
+ #* is furnished to do so, subject to the following conditions:
+ #*
+ #* The above copyright notice and this permission notice shall be included in all copies
+ #* or substantial portions of the Software.
+ #*
+ #* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ #* INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ #* PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+ #* FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ #* ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ #* THE SOFTWARE. */
+
+#include <math.h>
+
+#include "uclocksync.h"
+
+void UClockSync::setup(int windowSize)
+{
+  if (windowSize < MIN_PAIRS)
+    windowSize = MIN_PAIRS;
+  this->windowSize = windowSize;
+  reset();
+}
+
+void UClockSync::reset()
+{
+  std::lock_guard<std::mutex> guard(lock);
+  pairs.clear();
+  pairs.reserve(windowSize);
+  next = 0;
+  pairCnt = 0;
+  offset = 0;
+  slope = 1.0;
+  maxDelay = 0;
+  ref.clear();
+}
+
+void UClockSync::add(double teensyTime, UTime& hostTime)
+{
+  std::lock_guard<std::mutex> guard(lock);
+  if (pairCnt > 0 and teensyTime < lastTeensy - 0.5)
+  { // Teensy restarted
+    pairs.clear();
+    next = 0;
+    pairCnt = 0;
+  }
+  if (pairCnt == 0)
+    ref = hostTime;
+  lastTeensy = teensyTime;
+  double h = double(long(hostTime.getSec()) - long(ref.getSec())) +
+             (long(hostTime.getMicrosec()) - long(ref.getMicrosec())) * 1e-6;
+  if (int(pairs.size()) < windowSize)
+    pairs.push_back({teensyTime, h});
+  else
+    pairs[next] = {teensyTime, h};
+  next = (next + 1) % windowSize;
+  pairCnt++;
+  estimate();
+}
+
+void UClockSync::estimate()
+{
+  int n = pairs.size();
+  double s = 1.0;
+  if (n >= MIN_PAIRS)
+  { // least squares slope (centered values)
+    double mt = 0, mh = 0;
+    for (auto & p : pairs)
+    {
+      mt += p.teensy;
+      mh += p.host;
+    }
+    mt /= n;
+    mh /= n;
+    double stt = 0, sth = 0;
+    for (auto & p : pairs)
+    {
+      stt += (p.teensy - mt) * (p.teensy - mt);
+      sth += (p.teensy - mt) * (p.host - mh);
+    }
+    if (stt > 1e-6)
+      s = sth / stt;
+    // a crystal is not that bad, so more is noise
+    if (fabs(s - 1.0) > 1e-3)
+      s = 1.0;
+  }
+  slope = s;
+  // offset from least delayed pair
+  double mo = 1e9, mx = -1e9;
+  for (auto & p : pairs)
+  {
+    double o = p.host - slope * p.teensy;
+    if (o < mo)
+      mo = o;
+    if (o > mx)
+      mx = o;
+  }
+  offset = mo;
+  maxDelay = mx - mo;
+}
+
+UTime UClockSync::fromRef(double sec)
+{
+  double fs = floor(sec);
+  long s = ref.getSec() + long(fs);
+  long us = ref.getMicrosec() + lround((sec - fs) * 1e6);
+  if (us >= 1000000)
+  {
+    s++;
+    us -= 1000000;
+  }
+  UTime t;
+  t.setTime(s, us);
+  return t;
+}
+
+UTime UClockSync::teensyToHost(double teensyTime)
+{
+  std::lock_guard<std::mutex> guard(lock);
+  return fromRef(offset + slope * teensyTime);
+}
+
+UTime UClockSync::teensyUsToHost(uint32_t teensyUs)
+{
+  std::lock_guard<std::mutex> guard(lock);
+  // resolve wrap using latest Teensy time
+  const double wrap = 4294967296.0;
+  double last = lastTeensy * 1e6;
+  double t = teensyUs + wrap * round((last - teensyUs) / wrap);
+  return fromRef(offset + slope * t * 1e-6);
+}
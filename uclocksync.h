@@ -0,0 +1,108 @@
+/* #***************************************************************************
+ #*   Copyright (C) 2023 by DTU
+ #*   jcan@dtu.dk
+ #*
+ #*
+ #* The MIT License (MIT)  https://mit-license.org/
+ #*
+ #* Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+ #* and associated documentation files (the “Software”), to deal in the Software without restriction,
+ #* including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ #* sublicense, and/or sell copies of the Software, and to permit persons to whom the Software
+ #* is furnished to do so, subject to the following conditions:
+ #*
+ #* The above copyright notice and this permission notice shall be included in all copies
+ #* or substantial portions of the Software.
+ #*
+ #* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ #* INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ #* PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+ #* FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ #* ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ #* THE SOFTWARE. */
+
+#pragma once
+
+#include <stdint.h>
+#include <mutex>
+#include <vector>
+
+#include "utime.h"
+
+/**
+ * Estimate of the relation between Teensy time and host time,
+ * from pairs of Teensy time (in 'hbt') and the host time the message arrived.
+ * The drift is found by regression over a window of pairs, and the
+ * offset from the pair with the least transport delay (lower envelope),
+ * as a delay can only add to the arrival time.
+ * Mapped times therefore include the minimum transport delay only,
+ * not the USB batching and scheduling jitter of each message.
+ * */
+class UClockSync
+{
+public:
+  /**
+   * Set window size (number of pairs used), and clear */
+  void setup(int windowSize);
+  /**
+   * Forget all pairs (e.g. after reconnect or Teensy restart) */
+  void reset();
+  /**
+   * Add a pair
+   * \param teensyTime is Teensy time in seconds (since Teensy start)
+   * \param hostTime is host time at arrival of the message */
+  void add(double teensyTime, UTime & hostTime);
+  /**
+   * Is there enough pairs for a mapping */
+  bool isValid()
+  {
+    return pairCnt >= MIN_PAIRS;
+  }
+  /**
+   * Host time for this Teensy time (seconds since Teensy start) */
+  UTime teensyToHost(double teensyTime);
+  /**
+   * Host time for this Teensy time in microseconds (32 bit, wraps after 71 minutes),
+   * e.g. from a binary frame. The wrap is resolved using the latest Teensy time */
+  UTime teensyUsToHost(uint32_t teensyUs);
+  /**
+   * Teensy clock drift relative to host clock (ppm) */
+  double getDriftPpm()
+  {
+    return (slope - 1.0) * 1e6;
+  }
+  /**
+   * Largest arrival delay above the minimum in window (sec) */
+  double getMaxDelay()
+  {
+    return maxDelay;
+  }
+  int getPairCnt()
+  {
+    return pairCnt;
+  }
+
+private:
+  static const int MIN_PAIRS = 4;
+  struct Pair
+  {
+    double teensy;
+    /// host time relative to ref
+    double host;
+  };
+  std::vector<Pair> pairs;
+  int windowSize = 20;
+  int next = 0;
+  int pairCnt = 0;
+  UTime ref;
+  /// latest Teensy time
+  double lastTeensy = 0;
+  /// host = offset + slope * teensy (relative to ref)
+  double offset = 0;
+  double slope = 1.0;
+  double maxDelay = 0;
+  std::mutex lock;
+  /** update offset and slope from pairs */
+  void estimate();
+  UTime fromRef(double sec);
+};
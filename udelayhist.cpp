@@ -0,0 +1,64 @@
+/* #***************************************************************************
+ #*   Copyright (C) 2023 by DTU
+ #*   jcan@dtu.dk
+ #*
+ #*
+ #* The MIT License (MIT)  https://mit-license.org/
+ #*
+ #* Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+ #* and associated documentation files (the “Software”), to deal in the Software without restriction,
+ #* including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ #* sublicense, and/or sell copies of the Software, and to permit persons to whom the Software
+ #* is furnished to do so, subject to the following conditions:
+ #*
+ #* The above copyright notice and this permission notice shall be included in all copies
+ #* or substantial portions of the Software.
+ #*
+ #* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ #* INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ #* PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+ #* FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ #* ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ #* THE SOFTWARE. */
+
+#include <stdio.h>
+#include <string>
+
+#include "udelayhist.h"
+
+void UDelayHist::add(double delay)
+{
+  if (delay < 0)
+    delay = 0;
+  uint64_t us = uint64_t(delay * 1e6);
+  int b = 0;
+  while (us > 1 and b < BIN_CNT - 1)
+  {
+    us >>= 1;
+    b++;
+  }
+  bins[b]++;
+  count++;
+  sum += delay;
+  if (delay > maxDelay)
+    maxDelay = delay;
+}
+
+void UDelayHist::print(const char* name)
+{
+  std::string s;
+  const int MSL = 40;
+  char b[MSL];
+  for (int i = 0; i < BIN_CNT; i++)
+  {
+    if (bins[i] > 0)
+    { // lower limit of bin (us) and count
+      snprintf(b, MSL, " %lu:%d", i == 0 ? 0lu : 1lu << i, bins[i]);
+      s += b;
+    }
+  }
+  double mean = 0;
+  if (count > 0)
+    mean = sum / count;
+  printf("#   %-7s %7d %9.1f %9.1f %s\n", name, count, mean * 1e6, maxDelay * 1e6, s.c_str());
+}
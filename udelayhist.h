@@ -0,0 +1,58 @@
+/* #***************************************************************************
+ #*   Copyright (C) 2023 by DTU
+ #*   jcan@dtu.dk
+ #*
+ #*
+ #* The MIT License (MIT)  https://mit-license.org/
+ #*
+ #* Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+ #* and associated documentation files (the “Software”), to deal in the Software without restriction,
+ #* including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ #* sublicense, and/or sell copies of the Software, and to permit persons to whom the Software
+ #* is furnished to do so, subject to the following conditions:
+ #*
+ #* The above copyright notice and this permission notice shall be included in all copies
+ #* or substantial portions of the Software.
+ #*
+ #* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ #* INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ #* PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+ #* FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ #* ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ #* THE SOFTWARE. */
+
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * Histogram of delays with bins in powers of 2 microseconds,
+ * bin 0 is below 2us, bin k is [2^k, 2^(k+1)) us, the last bin takes the rest.
+ * Not thread safe, to be updated by one thread only.
+ * */
+class UDelayHist
+{
+public:
+  static const int BIN_CNT = 22;
+  /**
+   * Add a delay (sec) */
+  void add(double delay);
+  /**
+   * Print count, mean, max and the used bins on one line
+   * \param name is printed first */
+  void print(const char * name);
+  int getCount()
+  {
+    return count;
+  }
+  double getMax()
+  {
+    return maxDelay;
+  }
+
+private:
+  int bins[BIN_CNT] = {0};
+  int count = 0;
+  double sum = 0;
+  double maxDelay = 0;
+};
@@ -0,0 +1,209 @@
+/* #***************************************************************************
+ #*   Copyright (C) 2023 by DTU
+ #*   jcan@dtu.dk
+ #*
+ #*
+ #* The MIT License (MIT)  https://mit-license.org/
+ #*
+ #* Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+ #* and associated documentation files (the “Software”), to deal in the Software without restriction,
+ #* including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ #* sublicense, and/or sell copies of the Software, and to permit persons to whom the Software
+ #* is furnished to do so, subject to the following conditions:
+ #*
+ #* The above copyright notice and this permission notice shall be included in all copies
+ #* or substantial portions of the Software.
+ #*
+ #* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ #* INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ #* PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+ #* FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ #* ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ #* THE SOFTWARE. */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "udispatch.h"
+#include "utimebase.h"
+
+UDispatch dispatch;
+
+uint32_t UDispatch::hashKey(const char* key, int n)
+{ // FNV-1a
+  uint32_t h = 2166136261u;
+  for (int i = 0; i < n; i++)
+  {
+    h ^= uint8_t(key[i]);
+    h *= 16777619u;
+  }
+  return h;
+}
+
+UDispatch::Entry * UDispatch::find(const char* key, int n, uint32_t hash)
+{ // open addressing, linear probing
+  for (int i = 0; i < TABLE_SIZE; i++)
+  {
+    Entry * e = &table[(hash + i) & (TABLE_SIZE - 1)];
+    if (not e->used.load(std::memory_order_acquire))
+      // not in table
+      return nullptr;
+    if (e->keyLength == n and strncmp(e->key, key, n) == 0)
+      return e;
+  }
+  return nullptr;
+}
+
+bool UDispatch::add(const char* keyword, DecodeFunc decode)
+{
+  int n = strlen(keyword);
+  if (n == 0 or n >= MAX_KEY_LENGTH)
+  {
+    printf("# UDispatch::add: keyword '%s' has invalid length\n", keyword);
+    return false;
+  }
+  uint32_t h = hashKey(keyword, n);
+  if (find(keyword, n, h) != nullptr)
+  {
+    printf("# UDispatch::add: keyword '%s' is registered already\n", keyword);
+    return false;
+  }
+  for (int i = 0; i < TABLE_SIZE; i++)
+  {
+    Entry * e = &table[(h + i) & (TABLE_SIZE - 1)];
+    if (not e->used)
+    { // fill and then publish
+      strncpy(e->key, keyword, MAX_KEY_LENGTH);
+      e->keyLength = n;
+      e->decode = decode;
+      e->used.store(true, std::memory_order_release);
+      return true;
+    }
+  }
+  printf("# UDispatch::add: no space for keyword '%s'\n", keyword);
+  return false;
+}
+
+bool UDispatch::decode(const char* msg, UTime& msgTime)
+{ // keyword is up to first space (or end of line)
+  int n = strcspn(msg, " \r\n");
+  Entry * e = nullptr;
+  if (n > 0 and n < MAX_KEY_LENGTH)
+    e = find(msg, n, hashKey(msg, n));
+  if (e == nullptr)
+  {
+    unknownCnt++;
+    return false;
+  }
+  int64_t t0 = UTimeBase::monoNs();
+  bool used = e->decode(msg, msgTime);
+  int64_t ns = UTimeBase::monoNs() - t0;
+  arrival(e, msgTime);
+  e->decodeNs += ns;
+  if (ns > e->decodeMaxNs)
+    e->decodeMaxNs = ns;
+  return used;
+}
+
+bool UDispatch::arrived(const char* keyword, UTime& msgTime)
+{
+  int n = strlen(keyword);
+  Entry * e = nullptr;
+  if (n > 0 and n < MAX_KEY_LENGTH)
+    e = find(keyword, n, hashKey(keyword, n));
+  if (e == nullptr)
+    return false;
+  arrival(e, msgTime);
+  return true;
+}
+
+bool UDispatch::addBin(int type, BinDecodeFunc decode)
+{
+  if (type <= 0 or type >= MAX_BIN_TYPES)
+  {
+    printf("# UDispatch::addBin: frame type %d is invalid\n", type);
+    return false;
+  }
+  BinEntry & b = binTable[type];
+  if (b.used)
+  {
+    printf("# UDispatch::addBin: frame type %d is registered already\n", type);
+    return false;
+  }
+  // fill and then publish
+  b.decode = decode;
+  b.used.store(true, std::memory_order_release);
+  return true;
+}
+
+bool UDispatch::decodeBin(int type, const uint8_t* payload, UTime& msgTime)
+{
+  if (type <= 0 or type >= MAX_BIN_TYPES or
+      not binTable[type].used.load(std::memory_order_acquire))
+    return false;
+  binTable[type].decode(payload, msgTime);
+  return true;
+}
+
+void UDispatch::arrival(Entry* e, UTime& msgTime)
+{
+  if (e->count == 0)
+    e->firstAt = msgTime;
+  else
+  { // interval and jitter
+    double dt = msgTime - e->lastAt;
+    e->interval.add(dt);
+    if (e->count > 1)
+    {
+      double d = dt - e->lastInterval;
+      if (d < 0)
+        d = -d;
+      e->jitter += (d - e->jitter) / 16.0;
+    }
+    e->lastInterval = dt;
+  }
+  e->lastAt = msgTime;
+  e->count++;
+}
+
+void UDispatch::printStats(bool rates, IntervalFunc expected)
+{
+  printf("# UDispatch:: keyword  count  mean(us)  max(us)\n");
+  for (int i = 0; i < TABLE_SIZE; i++)
+  {
+    Entry & e = table[i];
+    if (e.used and e.count > 0)
+      printf("#   %-8s %7d %8.2f %8.1f\n", e.key, e.count,
+             e.decodeNs / 1000.0 / e.count, e.decodeMaxNs / 1000.0);
+  }
+  if (unknownCnt > 0)
+    printf("#   (unknown) %4d\n", unknownCnt);
+  if (not rates)
+    return;
+  printf("# UDispatch:: keyword  rate(/s)  expected  jitter(ms)\n");
+  for (int i = 0; i < TABLE_SIZE; i++)
+  {
+    Entry & e = table[i];
+    if (not e.used or e.count < 2)
+      continue;
+    double dt = e.lastAt - e.firstAt;
+    double rate = 0;
+    if (dt > 0)
+      rate = (e.count - 1) / dt;
+    double ex = 0;
+    if (expected != nullptr)
+    {
+      double iv = expected(e.key);
+      if (iv > 0)
+        ex = 1.0 / iv;
+    }
+    printf("#   %-8s %8.1f %9.1f %10.3f\n", e.key, rate, ex, e.jitter * 1000);
+  }
+  printf("# UDispatch:: interval  count  mean(us)   max(us)  histogram (from us:count)\n");
+  for (int i = 0; i < TABLE_SIZE; i++)
+  {
+    Entry & e = table[i];
+    if (e.used and e.count >= 2)
+      e.interval.print(e.key);
+  }
+}
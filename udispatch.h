@@ -0,0 +1,129 @@
+/* #***************************************************************************
+ #*   Copyright (C) 2023 by DTU
+ #*   jcan@dtu.dk
+ #*
+ #*
+ #* The MIT License (MIT)  https://mit-license.org/
+ #*
+ #* Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+ #* and associated documentation files (the “Software”), to deal in the Software without restriction,
+ #* including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ #* sublicense, and/or sell copies of the Software, and to permit persons to whom the Software
+ #* is furnished to do so, subject to the following conditions:
+ #*
+ #* The above copyright notice and this permission notice shall be included in all copies
+ #* or substantial portions of the Software.
+ #*
+ #* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ #* INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ #* PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+ #* FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ #* ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ #* THE SOFTWARE. */
+
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <functional>
+
+#include "utime.h"
+#include "udelayhist.h"
+
+/**
+ * Dispatch of received Teensy messages to the module decode functions,
+ * using the first token (keyword) of the message, e.g. 'enc' or 'hbt'.
+ * Modules register their keywords at setup, the lookup is
+ * a hash table, so the cost is independent of the number of modules.
+ * Keywords are added by the setup thread, while the receive thread
+ * dispatch, a slot is therefore published only when it is complete.
+ * Count and decode time is maintained for each keyword, and
+ * the arrival rate, with a histogram of the intervals and the
+ * interval jitter (as RFC 3550).
+ * Binary frames (see UBinFrame) are dispatched the same way,
+ * using the frame type as key.
+ * */
+class UDispatch
+{
+public:
+  /// decode function, gets the full message (e.g. "enc 123 456\n")
+  typedef std::function<bool (const char * msg, UTime & msgTime)> DecodeFunc;
+  /**
+   * Add a keyword and its decode function
+   * \param keyword is first token of message, like "enc"
+   * \returns false if keyword is in use already or table is full */
+  bool add(const char * keyword, DecodeFunc decode);
+  /**
+   * Decode message using the registered function for its keyword
+   * \param msg is CRC checked message (without the CRC)
+   * \returns false if keyword is not registered (or decoder did not use it) */
+  bool decode(const char * msg, UTime & msgTime);
+  /**
+   * Count an arrival for a keyword, that is not decoded here (e.g. a binary frame)
+   * \returns false if keyword is not registered */
+  bool arrived(const char * keyword, UTime & msgTime);
+  /// decode function for a binary frame payload
+  typedef std::function<void (const uint8_t * payload, UTime & msgTime)> BinDecodeFunc;
+  /**
+   * Add a binary frame type and its decode function
+   * \param type is frame type (UBinFrame::FrameType)
+   * \returns false if type is invalid or in use already */
+  bool addBin(int type, BinDecodeFunc decode);
+  /**
+   * Decode binary frame payload using the registered function for its type
+   * \param payload is CRC checked payload of the expected size
+   * \returns false if no decoder is registered for the type */
+  bool decodeBin(int type, const uint8_t * payload, UTime & msgTime);
+  /// expected interval (sec) for a keyword, 0 if not known
+  typedef std::function<double (const char * keyword)> IntervalFunc;
+  /**
+   * Print count and decode time for each keyword
+   * \param rates prints also rate and interval statistics,
+   *              with the expected rate from this function (if not nullptr) */
+  void printStats(bool rates = false, IntervalFunc expected = nullptr);
+  /// messages with no registered keyword
+  int unknownCnt = 0;
+
+private:
+  static const int MAX_KEY_LENGTH = 16;
+  /// table size, must be power of 2 and well above number of keywords
+  static const int TABLE_SIZE = 64;
+  struct Entry
+  {
+    char key[MAX_KEY_LENGTH];
+    int keyLength;
+    DecodeFunc decode;
+    /// set, when entry is complete
+    std::atomic<bool> used = {false};
+    // statistics (updated by receive thread only)
+    int count = 0;
+    int64_t decodeNs = 0;
+    int64_t decodeMaxNs = 0;
+    UTime firstAt;
+    UTime lastAt;
+    double lastInterval = 0;
+    double jitter = 0;
+    UDelayHist interval;
+  };
+  Entry table[TABLE_SIZE];
+  /// binary decoders, indexed by frame type
+  static const int MAX_BIN_TYPES = 32;
+  struct BinEntry
+  {
+    BinDecodeFunc decode;
+    /// set, when entry is complete
+    std::atomic<bool> used = {false};
+  };
+  BinEntry binTable[MAX_BIN_TYPES];
+  /**
+   * find keyword in table
+   * \returns entry or nullptr if not found */
+  Entry * find(const char * key, int n, uint32_t hash);
+  /** update arrival statistics */
+  void arrival(Entry * e, UTime & msgTime);
+  static uint32_t hashKey(const char * key, int n);
+};
+
+/**
+ * Make this visible to the rest of the software */
+extern UDispatch dispatch;
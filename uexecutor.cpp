@@ -0,0 +1,184 @@
+/* #***************************************************************************
+ #*   Copyright (C) 2023 by DTU
+ #*   jcan@dtu.dk
+ #*
+ #*
+ #* The MIT License (MIT)  https://mit-license.org/
+ #*
+ #* Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+ #* and associated documentation files (the “Software”), to deal in the Software without restriction,
+ #* including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ #* sublicense, and/or sell copies of the Software, and to permit persons to whom the Software
+ #* is furnished to do so, subject to the following conditions:
+ #*
+ #* The above copyright notice and this permission notice shall be included in all copies
+ #* or substantial portions of the Software.
+ #*
+ #* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ #* INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ #* PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+ #* FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ #* ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ #* THE SOFTWARE. */
+
+#include <stdio.h>
+#include <limits.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <algorithm>
+
+#include "uexecutor.h"
+#include "uservice.h"
+#include "urealtime.h"
+#include "utimebase.h"
+
+UExecutor executor;
+
+static const char * groupName[UExecutor::GROUP_CNT] = {"encoder", "edge"};
+
+void UExecutor::setup()
+{
+  if (not ini.has("executor"))
+  { // control chain on one thread, run at every sensor sample
+    ini["executor"]["enabled"] = "false";
+    ini["executor"]["; rt_priority is SCHED_FIFO priority (1..99), 0 is normal scheduling"] = "";
+    ini["executor"]["rt_priority"] = "50";
+    ini["executor"]["cpu"] = "-1";
+    ini["executor"]["; budget_ms is max time for a pass (counted if longer)"] = "";
+    ini["executor"]["budget_ms"] = "2";
+  }
+  enabled = ini["executor"]["enabled"] == "true";
+  rtPriority = strtol(ini["executor"]["rt_priority"].c_str(), nullptr, 10);
+  cpu = strtol(ini["executor"]["cpu"].c_str(), nullptr, 10);
+  budgetNs = int64_t(strtof(ini["executor"]["budget_ms"].c_str(), nullptr) * 1e6);
+}
+
+bool UExecutor::add(Group group, int order, const char* name, StepFunc step)
+{
+  if (not enabled or th1 != nullptr)
+    return false;
+  Step s;
+  s.order = order;
+  s.name = name;
+  s.step = step;
+  std::vector<Step> & v = groups[group].steps;
+  // keep the order (and the add order for same order)
+  auto it = std::upper_bound(v.begin(), v.end(), s,
+                             [](const Step & a, const Step & b) { return a.order < b.order; });
+  v.insert(it, s);
+  return true;
+}
+
+void UExecutor::start()
+{
+  if (not enabled or th1 != nullptr)
+    return;
+  stop = false;
+  th1 = new std::thread(runObj, this);
+  running = true;
+  // a [realtime] profile for the executor thread is used instead
+  bool useProfile = realtime.has("executor");
+  if (rtPriority > 0 and not useProfile)
+  {
+    sched_param sp;
+    sp.sched_priority = rtPriority;
+    int e = pthread_setschedparam(th1->native_handle(), SCHED_FIFO, &sp);
+    if (e != 0)
+      printf("# UExecutor::start: no real-time priority (error %d), needs CAP_SYS_NICE\n", e);
+  }
+  if (cpu >= 0 and not useProfile)
+  {
+    cpu_set_t cs;
+    CPU_ZERO(&cs);
+    CPU_SET(cpu, &cs);
+    if (pthread_setaffinity_np(th1->native_handle(), sizeof(cs), &cs) != 0)
+      printf("# UExecutor::start: failed to use CPU %d\n", cpu);
+  }
+  printf("# UExecutor::start: %d encoder steps, %d edge steps\n",
+         int(groups[ENCODER].steps.size()), int(groups[EDGE].steps.size()));
+}
+
+void UExecutor::trigger(Group group)
+{
+  if (not running)
+    return;
+  uint32_t bit = 1 << group;
+  groups[group].triggerNs.store(UTimeBase::monoNs(), std::memory_order_relaxed);
+  uint32_t was = pending.fetch_or(bit, std::memory_order_seq_cst);
+  if (was & bit)
+    // last sample is not handled yet
+    groups[group].overrunCnt++;
+  if (waiting.load(std::memory_order_seq_cst) > 0)
+    syscall(SYS_futex, &pending, FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+}
+
+void UExecutor::pass(int group)
+{
+  RateGroup & g = groups[group];
+  int64_t t0 = UTimeBase::monoNs();
+  int64_t t = t0;
+  for (Step & s : g.steps)
+  {
+    s.step();
+    int64_t t2 = UTimeBase::monoNs();
+    int64_t dt = t2 - t;
+    s.sumNs += dt;
+    if (dt > s.maxNs)
+      s.maxNs = dt;
+    t = t2;
+  }
+  g.passCnt++;
+  if (t - t0 > budgetNs)
+    g.budgetCnt++;
+  g.latency.add((t - g.triggerNs.load(std::memory_order_relaxed)) * 1e-9);
+}
+
+void UExecutor::run()
+{
+  realtime.apply("executor");
+  while (not stop and not service.stop)
+  {
+    waiting.fetch_add(1, std::memory_order_seq_cst);
+    if (pending.load(std::memory_order_seq_cst) == 0)
+    { // sleep until a sample (or timeout to test for stop)
+      timespec ts = {0, 50000000};
+      syscall(SYS_futex, &pending, FUTEX_WAIT_PRIVATE, 0, &ts, nullptr, 0);
+    }
+    waiting.fetch_sub(1, std::memory_order_relaxed);
+    uint32_t p = pending.exchange(0, std::memory_order_acquire);
+    // in group order, i.e. encoder group first
+    for (int i = 0; i < GROUP_CNT; i++)
+      if (p & (1 << i))
+        pass(i);
+  }
+}
+
+void UExecutor::terminate()
+{
+  if (th1 == nullptr)
+    return;
+  running = false;
+  stop = true;
+  th1->join();
+  delete th1;
+  th1 = nullptr;
+  printf("# UExecutor:: rate group passes, overruns (sample before pass finished), over budget (%.1f ms)\n",
+         budgetNs * 1e-6);
+  for (int i = 0; i < GROUP_CNT; i++)
+  {
+    RateGroup & g = groups[i];
+    if (g.steps.empty())
+      continue;
+    printf("# UExecutor:: %-7s %7d passes, %d overruns, %d over budget\n",
+           groupName[i], g.passCnt, g.overrunCnt, g.budgetCnt);
+    for (Step & s : g.steps)
+      printf("#     %-10s mean %7.1f us, max %7.1f us\n", s.name,
+             g.passCnt > 0 ? s.sumNs * 1e-3 / g.passCnt : 0.0, s.maxNs * 1e-3);
+    printf("#   %-7s %7s %9s %9s %s\n", "latency", "count", "mean(us)", "max(us)", "bins (us:count)");
+    g.latency.print(groupName[i]);
+  }
+}
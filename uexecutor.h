@@ -0,0 +1,121 @@
+/* #***************************************************************************
+ #*   Copyright (C) 2023 by DTU
+ #*   jcan@dtu.dk
+ #*
+ #*
+ #* The MIT License (MIT)  https://mit-license.org/
+ #*
+ #* Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+ #* and associated documentation files (the “Software”), to deal in the Software without restriction,
+ #* including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ #* sublicense, and/or sell copies of the Software, and to permit persons to whom the Software
+ #* is furnished to do so, subject to the following conditions:
+ #*
+ #* The above copyright notice and this permission notice shall be included in all copies
+ #* or substantial portions of the Software.
+ #*
+ #* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ #* INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ #* PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+ #* FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ #* ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ #* THE SOFTWARE. */
+
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <vector>
+
+#include "udelayhist.h"
+
+/**
+ * Runs the control chain as rate groups on one (real-time) thread.
+ * A rate group is started by a sensor sample, e.g. every encoder
+ * update, and runs the step functions of its modules in order
+ * (e.g. pose, heading, motor), so the delay from sensor sample to
+ * actuator command is one pass, and the same every sample.
+ * Modules add their step function at setup, if the executor is
+ * not enabled, then the modules run their own thread as before.
+ * Overruns (a new sample before the pass of the last is finished)
+ * and passes longer than the budget are counted.
+ * */
+class UExecutor
+{
+public:
+  /// rate groups, started by a sensor sample
+  enum Group {ENCODER, EDGE, GROUP_CNT};
+  typedef std::function<void ()> StepFunc;
+  /**
+   * Read configuration (before setup of the modules) */
+  void setup();
+  /**
+   * Add a step function to a rate group
+   * \param order is the order in the group (lowest first)
+   * \param name is used in statistics
+   * \returns false if the executor is not enabled (the module should use its own thread) */
+  bool add(Group group, int order, const char * name, StepFunc step);
+  /**
+   * Start the thread (after setup of all modules) */
+  void start();
+  /**
+   * A new sample for a rate group (from the sensor module) */
+  void trigger(Group group);
+  /**
+   * Stop the thread and print statistics */
+  void terminate();
+  /**
+   * Is the executor in use */
+  inline bool isEnabled()
+  {
+    return enabled;
+  }
+
+private:
+  void run();
+  static void runObj(UExecutor * obj)
+  { // called, when thread is started
+    obj->run();
+  }
+  /** run all steps in a group */
+  void pass(int group);
+  struct Step
+  {
+    int order;
+    const char * name;
+    StepFunc step;
+    // statistics
+    int64_t maxNs = 0;
+    int64_t sumNs = 0;
+  };
+  struct RateGroup
+  {
+    std::vector<Step> steps;
+    /// time of the sample that started the group
+    std::atomic<int64_t> triggerNs = {0};
+    // statistics
+    int passCnt = 0;
+    int overrunCnt = 0;
+    int budgetCnt = 0;
+    /// from trigger to end of pass
+    UDelayHist latency;
+  };
+  RateGroup groups[GROUP_CNT];
+  /// a bit for each group with a new sample (futex word)
+  std::atomic<uint32_t> pending = {0};
+  std::atomic<int> waiting = {0};
+  bool enabled = false;
+  std::atomic<bool> stop = {false};
+  std::atomic<bool> running = {false};
+  int rtPriority = 0;
+  int cpu = -1;
+  /// max time for a pass (ns)
+  int64_t budgetNs = 2000000;
+  std::thread * th1 = nullptr;
+};
+
+/**
+ * Make this visible to the rest of the software */
+extern UExecutor executor;
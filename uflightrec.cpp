@@ -0,0 +1,146 @@
+/* #***************************************************************************
+ #*   Copyright (C) 2023 by DTU
+ #*   jcan@dtu.dk
+ #*
+ #*
+ #* The MIT License (MIT)  https://mit-license.org/
+ #*
+ #* Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+ #* and associated documentation files (the “Software”), to deal in the Software without restriction,
+ #* including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ #* sublicense, and/or sell copies of the Software, and to permit persons to whom the Software
+ #* is furnished to do so, subject to the following conditions:
+ #*
+ #* The above copyright notice and this permission notice shall be included in all copies
+ #* or substantial portions of the Software.
+ #*
+ #* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ #* INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ #* PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+ #* FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ #* ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ #* THE SOFTWARE. */
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "uflightrec.h"
+#include "ulogger.h"
+
+UFlightRecorder::~UFlightRecorder()
+{
+  free(ring);
+}
+
+void UFlightRecorder::setup(size_t bytes)
+{
+  size = (bytes + 7) / 8 * 8;
+  ring = (char *)malloc(size);
+  if (ring == nullptr)
+  {
+    perror("# UFlightRecorder::setup");
+    size = 0;
+    return;
+  }
+  // touch the pages now, not in the data path
+  memset(ring, 0, size);
+  mlock(ring, size);
+  head = 0;
+  tail = 0;
+}
+
+UFlightRecorder::Entry * UFlightRecorder::at(uint64_t & pos)
+{ // skip padding at the end of the ring
+  while (pos < head)
+  {
+    uint64_t left = size - pos % size;
+    Entry * e = (Entry *)(ring + pos % size);
+    if (left < sizeof(Entry))
+      pos += left;
+    else if (e->file == nullptr)
+      pos += e->size;
+    else
+      return e;
+  }
+  return nullptr;
+}
+
+bool UFlightRecorder::add(const ULogRecord * r)
+{
+  if (ring == nullptr)
+    return false;
+  uint64_t need = (sizeof(Entry) + r->used + 7) / 8 * 8;
+  uint64_t left = size - head % size;
+  // padding, if the entry would wrap
+  uint64_t pad = 0;
+  if (left < need)
+    pad = left;
+  // make room by removing the oldest
+  while (head + pad + need - tail > size)
+  {
+    uint64_t p = tail;
+    Entry * e = at(p);
+    if (e == nullptr or (pinned and tail >= pinPos))
+    { // no more space
+      dropCnt++;
+      return false;
+    }
+    tail = p + e->size;
+  }
+  if (pad > 0)
+  { // fill to end of ring
+    if (pad >= sizeof(Entry))
+    {
+      Entry * e = (Entry *)(ring + head % size);
+      e->size = pad;
+      e->file = nullptr;
+    }
+    head += pad;
+  }
+  Entry * e = (Entry *)(ring + head % size);
+  e->size = need;
+  e->valueSize = r->valueSize;
+  e->used = r->used;
+  e->file = r->file;
+  e->format = r->format;
+  e->types = r->types;
+  e->write = r->write;
+  e->us = r->us;
+  memcpy(e->data(), r->data, r->used);
+  head += need;
+  addCnt++;
+  return true;
+}
+
+uint64_t UFlightRecorder::find(int64_t us)
+{ // from the oldest
+  uint64_t pos = tail;
+  while (true)
+  {
+    uint64_t p = pos;
+    Entry * e = at(p);
+    if (e == nullptr or e->us >= us)
+      return p;
+    pos = p + e->size;
+  }
+}
+
+const UFlightRecorder::Entry * UFlightRecorder::next(uint64_t & pos)
+{
+  if (pos < tail)
+    pos = tail;
+  Entry * e = at(pos);
+  if (e != nullptr)
+    pos += e->size;
+  return e;
+}
+
+int64_t UFlightRecorder::oldestUs()
+{
+  uint64_t p = tail;
+  Entry * e = at(p);
+  if (e == nullptr)
+    return 0;
+  return e->us;
+}
@@ -0,0 +1,108 @@
+/* #***************************************************************************
+ #*   Copyright (C) 2023 by DTU
+ #*   jcan@dtu.dk
+ #*
+ #*
+ #* The MIT License (MIT)  https://mit-license.org/
+ #*
+ #* Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+ #* and associated documentation files (the “Software”), to deal in the Software without restriction,
+ #* including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ #* sublicense, and/or sell copies of the Software, and to permit persons to whom the Software
+ #* is furnished to do so, subject to the following conditions:
+ #*
+ #* The above copyright notice and this permission notice shall be included in all copies
+ #* or substantial portions of the Software.
+ #*
+ #* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ #* INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ #* PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+ #* FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ #* ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ #* THE SOFTWARE. */
+
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+
+struct ULogRecord;
+
+/**
+ * RAM ring of log records for the flight recorder (see ULogger).
+ * The memory is allocated at setup, the oldest records are
+ * overwritten by new records, except from a pinned position
+ * (records being written to disk), then new records are dropped.
+ * Positions are byte counts since setup (not wrapped).
+ * Used by the logger thread only.
+ * */
+class UFlightRecorder
+{
+public:
+  /** a kept record, the values (of size 'used') follow the entry */
+  struct Entry
+  {
+    /// bytes used by entry (8 byte aligned), file is nullptr for padding
+    uint32_t size;
+    uint16_t valueSize;
+    uint16_t used;
+    FILE * file;
+    const char * format;
+    const char * types;
+    void (*write)(ULogRecord * r);
+    int64_t us;
+    /// the values after this entry
+    char * data()
+    {
+      return reinterpret_cast<char *>(this + 1);
+    }
+    const char * data() const
+    {
+      return reinterpret_cast<const char *>(this + 1);
+    }
+  };
+  static_assert(sizeof(Entry) % 8 == 0, "entry size must keep the values 8 byte aligned");
+  ~UFlightRecorder();
+  /**
+   * Allocate ring
+   * \param bytes is the RAM to use */
+  void setup(size_t bytes);
+  /**
+   * Keep a copy of this record
+   * \returns false if dropped (ring full of pinned records) */
+  bool add(const ULogRecord * r);
+  /**
+   * Position of the oldest kept record at or after this time */
+  uint64_t find(int64_t us);
+  /**
+   * Get record at 'pos' and advance 'pos'
+   * \returns nullptr if no more records */
+  const Entry * next(uint64_t & pos);
+  /**
+   * Do not overwrite records from this position */
+  void pin(uint64_t pos)
+  {
+    pinned = true;
+    pinPos = pos;
+  }
+  void unpin()
+  {
+    pinned = false;
+  }
+  /** time of oldest kept record */
+  int64_t oldestUs();
+
+public:
+  int addCnt = 0;
+  int dropCnt = 0;
+
+private:
+  /** get entry at position, after skipping padding */
+  Entry * at(uint64_t & pos);
+  char * ring = nullptr;
+  uint64_t size = 0;
+  uint64_t head = 0;
+  uint64_t tail = 0;
+  bool pinned = false;
+  uint64_t pinPos = 0;
+};
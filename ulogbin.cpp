@@ -0,0 +1,403 @@
+/* #***************************************************************************
+ #*   Copyright (C) 2023 by DTU
+ #*   jcan@dtu.dk
+ #*
+ #*
+ #* The MIT License (MIT)  https://mit-license.org/
+ #*
+ #* Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+ #* and associated documentation files (the “Software”), to deal in the Software without restriction,
+ #* including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ #* sublicense, and/or sell copies of the Software, and to permit persons to whom the Software
+ #* is furnished to do so, subject to the following conditions:
+ #*
+ #* The above copyright notice and this permission notice shall be included in all copies
+ #* or substantial portions of the Software.
+ #*
+ #* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ #* INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ #* PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+ #* FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ #* ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ #* THE SOFTWARE. */
+
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <algorithm>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "ulogbin.h"
+
+static const char FILE_MAGIC[8] = {'U','L','O','G','B','I','N','1'};
+static const char END_MAGIC[8] = {'U','L','O','G','E','N','D','1'};
+
+int ULogBin::format(FILE * out, const char * format, const char * types, const uint8_t * values, int size)
+{ // one printf segment (text and one conversion) for each value,
+  // to get exactly the same text as one printf with all values
+  int n = 0;
+  int offset = 0;
+  const char * p1 = format;
+  const char * t = types;
+  std::string seg;
+  while (*p1 != '\0')
+  {
+    seg.clear();
+    bool conversion = false;
+    while (*p1 != '\0' and not conversion)
+    {
+      if (p1[0] == '%' and p1[1] == '%')
+      {
+        seg += "%%";
+        p1 += 2;
+      }
+      else if (*p1 == '%')
+      { // flags, width, precision, length and specifier
+        const char * e = p1 + 1 + strspn(p1 + 1, "-+ #0123456789.hlLqjzt");
+        if (*e != '\0')
+          e++;
+        seg.append(p1, e - p1);
+        p1 = e;
+        conversion = true;
+      }
+      else
+        seg += *p1++;
+    }
+    int sz = 0;
+    switch (*t)
+    {
+      case 'b': case 'a': case 'A': sz = 1; break;
+      case 'h': case 'H': case 's': sz = 2; break;
+      case 'i': case 'I': case 'f': sz = 4; break;
+      case 'l': case 'L': case 'd': sz = 8; break;
+      default: break;
+    }
+    if (sz > 0)
+      offset = (offset + sz - 1) / sz * sz;
+    if (not conversion or sz == 0 or offset + sz > size)
+    { // text only (or missing value)
+      n += fprintf(out, seg.c_str(), 0);
+      continue;
+    }
+    const uint8_t * v = values + offset;
+    offset += sz;
+    switch (*t++)
+    { // same argument types as for the printf in the module
+      case 'b': { bool x; memcpy(&x, v, sz); n += fprintf(out, seg.c_str(), x); break; }
+      case 'a': { int8_t x; memcpy(&x, v, sz); n += fprintf(out, seg.c_str(), x); break; }
+      case 'A': { uint8_t x; memcpy(&x, v, sz); n += fprintf(out, seg.c_str(), x); break; }
+      case 'h': { int16_t x; memcpy(&x, v, sz); n += fprintf(out, seg.c_str(), x); break; }
+      case 'H': { uint16_t x; memcpy(&x, v, sz); n += fprintf(out, seg.c_str(), x); break; }
+      case 'i': { int32_t x; memcpy(&x, v, sz); n += fprintf(out, seg.c_str(), x); break; }
+      case 'I': { uint32_t x; memcpy(&x, v, sz); n += fprintf(out, seg.c_str(), x); break; }
+      case 'l': { long x; memcpy(&x, v, sz); n += fprintf(out, seg.c_str(), x); break; }
+      case 'L': { unsigned long x; memcpy(&x, v, sz); n += fprintf(out, seg.c_str(), x); break; }
+      case 'f': { float x; memcpy(&x, v, sz); n += fprintf(out, seg.c_str(), x); break; }
+      case 'd': { double x; memcpy(&x, v, sz); n += fprintf(out, seg.c_str(), x); break; }
+      case 's':
+      { // offset to string after the values
+        uint16_t x;
+        memcpy(&x, v, sz);
+        const char * s = "";
+        if (x < size and memchr(values + x, '\0', size - x) != nullptr)
+          s = (const char *)values + x;
+        n += fprintf(out, seg.c_str(), s);
+        break;
+      }
+    }
+  }
+  return n;
+}
+
+/////////////////////////////////////////////////////
+
+ULogBinWriter::~ULogBinWriter()
+{
+  if (fd >= 0)
+    close();
+}
+
+bool ULogBinWriter::open(const char * filename, int64_t us)
+{
+  fd = ::open(filename, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0664);
+  if (fd < 0)
+  {
+    perror("# ULogBinWriter::open");
+    return false;
+  }
+  ULogBin::FileHead h;
+  memcpy(h.magic, FILE_MAGIC, sizeof(h.magic));
+  h.startUs = us;
+  put(&h, sizeof(h));
+  return true;
+}
+
+void ULogBinWriter::text(const char * s, int n, int64_t us)
+{
+  block(ULogBin::TEXT, 0, us, s, n);
+}
+
+void ULogBinWriter::record(const char * format, const char * types, int valueSize,
+                           int64_t us, const char * data, int size)
+{
+  auto key = std::make_pair(format, types);
+  auto it = channels.find(key);
+  int ch;
+  if (it == channels.end())
+  { // new channel, save schema: value size, types and format
+    ch = schemas.size();
+    channels[key] = ch;
+    std::string s;
+    uint16_t vs = valueSize;
+    s.append((const char *)&vs, sizeof(vs));
+    s.append(types);
+    s += '\0';
+    s.append(format);
+    s += '\0';
+    schemas.push_back(s);
+    block(ULogBin::SCHEMA, ch, us, s.data(), s.size());
+  }
+  else
+    ch = it->second;
+  if (index.empty() or sinceIndex >= INDEX_RECORDS or us - index.back().us >= INDEX_US)
+  {
+    index.push_back({us, pos});
+    sinceIndex = 0;
+  }
+  sinceIndex++;
+  block(ULogBin::DATA, ch, us, data, size);
+}
+
+long long ULogBinWriter::close()
+{
+  if (fd < 0)
+    return 0;
+  // schema copy and index, for a reader that need not scan
+  ULogBin::FileEnd e;
+  e.footer = pos;
+  for (int i = 0; i < (int)schemas.size(); i++)
+    block(ULogBin::SCHEMA, i, 0, schemas[i].data(), schemas[i].size());
+  block(ULogBin::INDEX, 0, 0, index.data(), index.size() * sizeof(ULogBin::IndexEntry));
+  memcpy(e.magic, END_MAGIC, sizeof(e.magic));
+  put(&e, sizeof(e));
+  flush();
+  // release the space allocated ahead
+  if (ftruncate(fd, pos) != 0)
+    perror("# ULogBinWriter::close");
+  ::close(fd);
+  fd = -1;
+  return pos;
+}
+
+void ULogBinWriter::block(int type, int channel, int64_t us, const void* data, int size)
+{
+  ULogBin::BlockHead h;
+  h.type = type;
+  h.channel = channel;
+  h.size = size;
+  h.us = us;
+  put(&h, sizeof(h));
+  put(data, size);
+  const char zero[8] = {0};
+  int pad = ULogBin::blockSize(h.size) - sizeof(h) - h.size;
+  if (pad > 0)
+    put(zero, pad);
+}
+
+void ULogBinWriter::put(const void* data, int n)
+{
+  const char * p1 = (const char *)data;
+  while (n > 0)
+  {
+    int m = std::min(n, BUFFER_SIZE - buffered);
+    memcpy(buffer + buffered, p1, m);
+    buffered += m;
+    pos += m;
+    p1 += m;
+    n -= m;
+    if (buffered == BUFFER_SIZE)
+      flush();
+  }
+}
+
+void ULogBinWriter::flush()
+{
+  if (fd < 0)
+    return;
+  if (pos + BUFFER_SIZE > allocated)
+  { // allocate file space ahead (if supported by the file system)
+    if (fallocate(fd, FALLOC_FL_KEEP_SIZE, allocated, ALLOCATE_CHUNK) == 0)
+      allocated += ALLOCATE_CHUNK;
+    else
+      allocated = pos + ALLOCATE_CHUNK;
+  }
+  const char * p1 = buffer;
+  while (buffered > 0)
+  {
+    int n = write(fd, p1, buffered);
+    if (n < 0 and errno == EINTR)
+      continue;
+    if (n <= 0)
+    {
+      perror("# ULogBinWriter::flush");
+      break;
+    }
+    p1 += n;
+    buffered -= n;
+  }
+  buffered = 0;
+}
+
+/////////////////////////////////////////////////////
+
+ULogBinReader::~ULogBinReader()
+{
+  close();
+}
+
+bool ULogBinReader::open(const char* filename)
+{
+  close();
+  int fd = ::open(filename, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return false;
+  struct stat st;
+  if (fstat(fd, &st) == 0 and st.st_size >= (off_t)sizeof(ULogBin::FileHead))
+  {
+    mapSize = st.st_size;
+    void * m = mmap(nullptr, mapSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (m != MAP_FAILED)
+      map = (const uint8_t *)m;
+  }
+  ::close(fd);
+  if (map == nullptr)
+    return false;
+  const ULogBin::FileHead * h = (const ULogBin::FileHead *)map;
+  if (memcmp(h->magic, FILE_MAGIC, sizeof(h->magic)) != 0)
+  {
+    close();
+    return false;
+  }
+  startUs = h->startUs;
+  dataEnd = mapSize;
+  const ULogBin::FileEnd * e = (const ULogBin::FileEnd *)(map + mapSize - sizeof(ULogBin::FileEnd));
+  complete = mapSize >= sizeof(ULogBin::FileHead) + sizeof(ULogBin::FileEnd) and
+             memcmp(e->magic, END_MAGIC, sizeof(e->magic)) == 0 and
+             e->footer >= dataStart and e->footer < mapSize;
+  Block b;
+  if (complete)
+  { // channels and index from the end of the file
+    size_t pos = e->footer;
+    dataEnd = mapSize - sizeof(ULogBin::FileEnd);
+    while (next(pos, b))
+    {
+      if (b.type == ULogBin::SCHEMA)
+        addSchema(b);
+      else if (b.type == ULogBin::INDEX)
+      {
+        const ULogBin::IndexEntry * ie = (const ULogBin::IndexEntry *)b.data;
+        index.assign(ie, ie + b.size / sizeof(ULogBin::IndexEntry));
+      }
+    }
+    dataEnd = e->footer;
+  }
+  else
+  { // not closed, scan all blocks
+    size_t pos = dataStart;
+    size_t at = pos;
+    int cnt = 0;
+    while (next(pos, b))
+    {
+      if (b.type == ULogBin::SCHEMA)
+        addSchema(b);
+      else if (b.type == ULogBin::DATA)
+      {
+        if (index.empty() or cnt >= ULogBinWriter::INDEX_RECORDS or
+            b.us - index.back().us >= ULogBinWriter::INDEX_US)
+        {
+          index.push_back({b.us, at});
+          cnt = 0;
+        }
+        cnt++;
+      }
+      at = pos;
+    }
+    // ignore a partly written block
+    dataEnd = at;
+  }
+  return true;
+}
+
+void ULogBinReader::close()
+{
+  if (map != nullptr)
+    munmap((void*)map, mapSize);
+  map = nullptr;
+  mapSize = 0;
+  channels.clear();
+  index.clear();
+  complete = false;
+}
+
+bool ULogBinReader::next(size_t& pos, Block& b)
+{
+  if (map == nullptr or pos + sizeof(ULogBin::BlockHead) > dataEnd)
+    return false;
+  const ULogBin::BlockHead * h = (const ULogBin::BlockHead *)(map + pos);
+  if (h->type < ULogBin::TEXT or h->type > ULogBin::INDEX or
+      pos + ULogBin::blockSize(h->size) > dataEnd)
+    return false;
+  b.type = h->type;
+  b.channel = h->channel;
+  b.us = h->us;
+  b.data = map + pos + sizeof(ULogBin::BlockHead);
+  b.size = h->size;
+  pos += ULogBin::blockSize(h->size);
+  return true;
+}
+
+size_t ULogBinReader::seek(int64_t us)
+{ // last index entry before this time
+  auto it = std::lower_bound(index.begin(), index.end(), us,
+                             [](const ULogBin::IndexEntry & e, int64_t t) { return e.us < t; });
+  size_t pos = dataStart;
+  if (it != index.begin())
+    pos = (it - 1)->pos;
+  // then the first data block at or after
+  Block b;
+  size_t at = pos;
+  while (next(pos, b))
+  {
+    if (b.type == ULogBin::DATA and b.us >= us)
+      return at;
+    at = pos;
+  }
+  return dataEnd;
+}
+
+void ULogBinReader::toText(const Block& b, FILE* out)
+{
+  if (b.type == ULogBin::TEXT)
+    fwrite(b.data, 1, b.size, out);
+  else if (b.type == ULogBin::DATA and b.channel < (int)channels.size())
+  {
+    const Channel & ch = channels[b.channel];
+    ULogBin::format(out, ch.format.c_str(), ch.types.c_str(), b.data, b.size);
+  }
+}
+
+void ULogBinReader::addSchema(const Block& b)
+{ // value size, types and format
+  if (b.size < 4 or b.data[b.size - 1] != '\0')
+    return;
+  if (b.channel >= (int)channels.size())
+    channels.resize(b.channel + 1);
+  Channel & ch = channels[b.channel];
+  uint16_t vs;
+  memcpy(&vs, b.data, sizeof(vs));
+  ch.valueSize = vs;
+  ch.types = (const char *)b.data + 2;
+  ch.format = (const char *)b.data + 2 + ch.types.size() + 1;
+}
@@ -0,0 +1,198 @@
+/* #***************************************************************************
+ #*   Copyright (C) 2023 by DTU
+ #*   jcan@dtu.dk
+ #*
+ #*
+ #* The MIT License (MIT)  https://mit-license.org/
+ #*
+ #* Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+ #* and associated documentation files (the “Software”), to deal in the Software without restriction,
+ #* including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ #* sublicense, and/or sell copies of the Software, and to permit persons to whom the Software
+ #* is furnished to do so, subject to the following conditions:
+ #*
+ #* The above copyright notice and this permission notice shall be included in all copies
+ #* or substantial portions of the Software.
+ #*
+ #* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ #* INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ #* PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+ #* FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ #* ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ #* THE SOFTWARE. */
+
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <map>
+
+/**
+ * Binary logfile format (written by ULogger if [service] log_binary = true).
+ *
+ * A file starts with a 16 byte header ("ULOGBIN1" and the start time in us),
+ * then a sequence of blocks, each with a 16 byte block head and a payload
+ * padded to 8 bytes:
+ * - TEXT: text written directly to the file (e.g. the '%' header lines).
+ * - SCHEMA: defines a channel (a log call site): value size, value type codes
+ *   (see ULogArg) and the printf format, given before the first record.
+ * - DATA: one log line: host time (us) and the values of the channel,
+ *   fixed width for a channel, but strings (if any) follow the values.
+ * - INDEX: written at close: time and file position every INDEX_RECORDS
+ *   records or INDEX_US, after a copy of all SCHEMA blocks.
+ * The file ends with the position of the schema copy and "ULOGEND1".
+ * A file without an end (not closed) can still be read, the reader
+ * then scans the blocks.
+ * */
+namespace ULogBin
+{
+  enum BlockType {TEXT = 1, SCHEMA = 2, DATA = 3, INDEX = 4};
+  struct FileHead
+  {
+    char magic[8];
+    int64_t startUs;
+  };
+  struct BlockHead
+  {
+    uint16_t type;
+    uint16_t channel;
+    uint32_t size; // payload size (without padding)
+    int64_t us;
+  };
+  struct FileEnd
+  {
+    uint64_t footer; // position of first SCHEMA copy
+    char magic[8];
+  };
+  struct IndexEntry
+  {
+    int64_t us;
+    uint64_t pos;
+  };
+  /// bytes used by a block of this payload size
+  inline size_t blockSize(size_t size)
+  {
+    return sizeof(BlockHead) + (size + 7) / 8 * 8;
+  }
+  /**
+   * Write record values as text, exactly as fprintf(out, format, values...)
+   * \param values are the packed values (as in ULogRecord), strings are
+   * an offset from 'values'
+   * \returns number of characters written */
+  int format(FILE * out, const char * format, const char * types, const uint8_t * values, int size);
+}
+
+/**
+ * Writes one binary logfile,
+ * file space is allocated (fallocate) in chunks ahead of the writes,
+ * and the written data is buffered.
+ * Used by the logger thread only.
+ * */
+class ULogBinWriter
+{
+public:
+  ~ULogBinWriter();
+  /**
+   * Create file
+   * \returns false if the file can not be created */
+  bool open(const char * filename, int64_t us);
+  /**
+   * Save text written directly to the logfile */
+  void text(const char * s, int n, int64_t us);
+  /**
+   * Save a log record
+   * \param format and types (pointers to constants) identify the channel */
+  void record(const char * format, const char * types, int valueSize,
+              int64_t us, const char * data, int size);
+  /**
+   * Write the index and the end of the file, and close.
+   * \returns bytes written to the file */
+  long long close();
+  /** bytes written (or buffered) so far */
+  long long bytes()
+  {
+    return pos;
+  }
+
+public:
+  /// file space allocated ahead of the writes
+  static const int ALLOCATE_CHUNK = 4 * 1024 * 1024;
+  static const int BUFFER_SIZE = 64 * 1024;
+  /// index interval
+  static const int INDEX_RECORDS = 256;
+  static const int INDEX_US = 100000;
+
+private:
+  void block(int type, int channel, int64_t us, const void * data, int size);
+  void put(const void * data, int n);
+  void flush();
+  int fd = -1;
+  char buffer[BUFFER_SIZE];
+  int buffered = 0;
+  /// position in file (including buffer)
+  uint64_t pos = 0;
+  uint64_t allocated = 0;
+  /// channels and their SCHEMA block
+  std::map<std::pair<const char*, const char*>, int> channels;
+  std::vector<std::string> schemas;
+  /// time index
+  std::vector<ULogBin::IndexEntry> index;
+  int sinceIndex = 0;
+};
+
+/**
+ * Reads a binary logfile (memory mapped).
+ * */
+class ULogBinReader
+{
+public:
+  ~ULogBinReader();
+  /**
+   * Open and map the file, and get channels and time index
+   * \returns false if not a (readable) binary logfile */
+  bool open(const char * filename);
+  void close();
+  /** one block from the file */
+  struct Block
+  {
+    int type;
+    int channel;
+    int64_t us;
+    const uint8_t * data;
+    int size;
+  };
+  /**
+   * Get the block at file position 'pos' and advance 'pos' to the next.
+   * \returns false at the end of the data */
+  bool next(size_t & pos, Block & b);
+  /**
+   * File position of the first DATA block at or after this time
+   * (using the time index), for next(). */
+  size_t seek(int64_t us);
+  /**
+   * Write a TEXT or DATA block as in the text logfile */
+  void toText(const Block & b, FILE * out);
+
+public:
+  struct Channel
+  {
+    std::string format;
+    std::string types;
+    int valueSize;
+  };
+  std::vector<Channel> channels;
+  std::vector<ULogBin::IndexEntry> index;
+  int64_t startUs = 0;
+  /// position of first block and end of data blocks
+  size_t dataStart = sizeof(ULogBin::FileHead);
+  size_t dataEnd = 0;
+  /// false if the file was not closed (index build by scan)
+  bool complete = false;
+
+private:
+  void addSchema(const Block & b);
+  const uint8_t * map = nullptr;
+  size_t mapSize = 0;
+};
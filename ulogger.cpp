@@ -0,0 +1,582 @@
+/* #***************************************************************************
+ #*   Copyright (C) 2023 by DTU
+ #*   jcan@dtu.dk
+ #*
+ #*
+ #* The MIT License (MIT)  https://mit-license.org/
+ #*
+ #* Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+ #* and associated documentation files (the “Software”), to deal in the Software without restriction,
+ #* including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ #* sublicense, and/or sell copies of the Software, and to permit persons to whom the Software
+ #* is furnished to do so, subject to the following conditions:
+ #*
+ #* The above copyright notice and this permission notice shall be included in all copies
+ #* or substantial portions of the Software.
+ #*
+ #* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ #* INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ #* PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+ #* FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ #* ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ #* THE SOFTWARE. */
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include <string>
+#include <algorithm>
+
+#include "ulogger.h"
+#include "ulogbin.h"
+#include "uflightrec.h"
+#include "ulogzip.h"
+#include "urealtime.h"
+#include "utimebase.h"
+
+ULogger logger;
+
+ULogger::~ULogger()
+{
+  terminate();
+  delete flight;
+}
+
+void ULogger::setup(bool binaryFiles, int cpu)
+{
+  if (running)
+    return;
+  binary = binaryFiles;
+  // the shared ring for threads beyond the per-thread rings
+  rings[MAX_RINGS - 1].setup(RING_SIZE);
+  ringReady[MAX_RINGS - 1] = true;
+  stop = false;
+  running = true;
+  th1 = new std::thread(runObj, this);
+  if (cpu >= 0)
+  { // keep formatting and compression away from the control threads
+    cpu_set_t cs;
+    CPU_ZERO(&cs);
+    CPU_SET(cpu, &cs);
+    if (pthread_setaffinity_np(th1->native_handle(), sizeof(cs), &cs) != 0)
+      printf("# ULogger::setup: failed to use CPU %d for writer thread\n", cpu);
+  }
+}
+
+void ULogger::setupFiles(int level, float dirMegaBytes)
+{
+  if (running)
+    return;
+  compressLevel = std::min(level, 9);
+  dirBudget = (long long)(dirMegaBytes * 1e6);
+}
+
+void ULogger::setDecimation(const std::string & filename, int every)
+{
+  if (every > 1)
+    decimation[filename] = every;
+}
+
+void ULogger::setupFlight(float preSec, float postSec, int megaBytes, float minInterval)
+{
+  if (running or flight != nullptr or megaBytes <= 0)
+    return;
+  flightPre = preSec;
+  flightPost = postSec;
+  flightMinInterval = minInterval;
+  flight = new UFlightRecorder();
+  flight->setup(size_t(megaBytes) * 1024 * 1024);
+}
+
+void ULogger::terminate()
+{
+  if (th1 == nullptr)
+    return;
+  stop = true;
+  th1->join();
+  delete th1;
+  th1 = nullptr;
+  running = false;
+  if (flightState == FLIGHT_COLLECT)
+    // not all after-trigger time, but write what there is
+    flightStartWrite();
+  if (flightState == FLIGHT_WRITE)
+    flightDump(INT_MAX);
+  // files not closed by the modules (or kept for the flight recorder)
+  while (not openFiles.empty())
+  {
+    auto it = openFiles.begin();
+    if (it->second->writer != nullptr)
+      close(it->first);
+    else
+    {
+      release(it->first, it->second);
+      openFiles.erase(it);
+    }
+  }
+  int dropped = 0;
+  for (int i = 0; i < MAX_RINGS; i++)
+    dropped += dropCnt[i];
+  printf("# ULogger:: %d lines written from %d threads, max backlog %d, dropped %d (ring full)\n",
+         writeCnt, std::min(int(ringCnt), MAX_RINGS - 1), maxBacklog, dropped);
+  if (not fileStat.empty())
+  {
+    printf("# ULogger:: %-24s %8s %8s %9s %9s %6s %7s\n",
+           "text logfile", "lines", "skipped", "raw kB", "disk kB", "ratio", "cpu ms");
+    for (auto & fs : fileStat)
+      printf("# ULogger:: %-24s %8d %8d %9.1f %9.1f %6.1f %7.1f\n", fs.name.c_str(),
+             fs.lines, fs.skipped, fs.rawBytes / 1e3, fs.diskBytes / 1e3,
+             double(fs.rawBytes) / std::max(fs.diskBytes, 1ll), fs.cpuNs / 1e6);
+  }
+  if (budgetDropCnt > 0)
+    printf("# ULogger:: %d lines dropped (over disk budget of %.1f MB)\n", budgetDropCnt, dirBudget / 1e6);
+  if (binFileCnt > 0)
+    printf("# ULogger:: %d binary logfiles, %.1f MB\n", binFileCnt, binBytes / 1e6);
+  if (flight != nullptr)
+    printf("# ULogger:: flight recorder: %d dumps (%d lines), %d triggers ignored, "
+           "%d lines kept in RAM, %d dropped (RAM full while dumping)\n",
+           flightDumpCnt, flightLineCnt, flightIgnoredCnt, flight->addCnt, flight->dropCnt);
+}
+
+FILE * ULogger::open(const char* filename)
+{
+  OpenFile * of = new OpenFile();
+  std::string fn = filename;
+  size_t n = fn.rfind('/');
+  if (n != std::string::npos)
+  {
+    of->dir = fn.substr(0, n + 1);
+    of->name = fn.substr(n + 1);
+  }
+  else
+    of->name = fn;
+  auto d = decimation.find(of->name);
+  if (d != decimation.end())
+    of->decimate = d->second;
+  if (not binary and flight == nullptr and compressLevel == 0 and
+      dirBudget == 0 and of->decimate == 1)
+  { // plain text logfile
+    delete of;
+    return fopen(filename, "w");
+  }
+  if (binary)
+  { // binary logfile is '.bin'
+    n = of->name.size();
+    if (n > 4 and of->name.substr(n - 4) == ".txt")
+      of->name.replace(n - 4, 4, ".bin");
+    else
+      of->name += ".bin";
+  }
+  bool isOK = true;
+  FILE * f = nullptr;
+  if (not binary and flight == nullptr)
+    // text logfile, written through a ULogZip
+    f = openText(of->dir + of->name, of->zip);
+  else
+  {
+    if (flight == nullptr)
+    {
+      of->writer = new ULogBinWriter();
+      isOK = of->writer->open((of->dir + of->name).c_str(), nowUs());
+    }
+    if (isOK)
+      // header text (and other direct writes) are kept in memory
+      f = open_memstream(&of->text, &of->textSize);
+  }
+  if (f == nullptr)
+  {
+    delete of->writer;
+    delete of;
+    return nullptr;
+  }
+  std::lock_guard<std::mutex> lock(openLock);
+  openFiles[f] = of;
+  if (of->writer != nullptr)
+    binFileCnt++;
+  return f;
+}
+
+FILE * ULogger::openText(std::string filename, ULogZip *& zip)
+{
+  if (compressLevel > 0)
+    filename += ".gz";
+  zip = new ULogZip();
+  FILE * f = zip->open(filename.c_str(), compressLevel, &diskBytes);
+  if (f == nullptr)
+  {
+    delete zip;
+    zip = nullptr;
+  }
+  return f;
+}
+
+int64_t ULogger::nowUs()
+{ // epoch time, as UTime
+  return timebase.toEpochNs(timebase.nowNs()) / 1000;
+}
+
+int ULogger::producerRing()
+{
+  thread_local ULogger * owner = nullptr;
+  thread_local int ring = -1;
+  if (owner != this)
+  { // first log line from this thread
+    owner = this;
+    int n = ringCnt.fetch_add(1);
+    if (n < MAX_RINGS - 1)
+    {
+      rings[n].setup(RING_SIZE);
+      ringReady[n].store(true, std::memory_order_release);
+      ring = n;
+    }
+    else
+      ring = MAX_RINGS - 1;
+  }
+  return ring;
+}
+
+void ULogger::close(FILE* file)
+{
+  if (file == nullptr)
+    return;
+  if (not running)
+  {
+    ULogRecord rec;
+    rec.file = file;
+    rec.write = closeRecord;
+    rec.us = nowUs();
+    if (not writeOpened(&rec))
+      fclose(file);
+    return;
+  }
+  int r = producerRing();
+  int idx = rings[r].claim();
+  while (idx < 0)
+  { // the close must not be dropped
+    usleep(1000);
+    idx = rings[r].claim();
+  }
+  ULogRecord & rec = rings[r].slot(idx);
+  rec.file = file;
+  rec.format = nullptr;
+  rec.write = closeRecord;
+  rec.us = nowUs();
+  rec.seq = seqNext.fetch_add(1, std::memory_order_relaxed);
+  rec.used = 0;
+  rings[r].publish(idx);
+}
+
+void ULogger::trigger(const char* reason)
+{
+  if (flight == nullptr or not running)
+    return;
+  int r = producerRing();
+  int idx = rings[r].claim();
+  if (idx < 0)
+  {
+    dropCnt[r]++;
+    return;
+  }
+  ULogRecord & rec = rings[r].slot(idx);
+  rec.file = nullptr;
+  rec.format = reason;
+  rec.write = triggerRecord;
+  rec.us = nowUs();
+  rec.seq = seqNext.fetch_add(1, std::memory_order_relaxed);
+  rec.used = 0;
+  rings[r].publish(idx);
+}
+
+void ULogger::closeRecord(ULogRecord* r)
+{
+  fclose(r->file);
+}
+
+void ULogger::takeText(FILE * f, OpenFile * of, bool all, std::string & text)
+{ // the memory stream is updated by fflush
+  flockfile(f);
+  fflush(f);
+  size_t from = all ? 0 : of->textTaken;
+  if (of->textSize > from)
+    text.assign(of->text + from, of->textSize - from);
+  else
+    text.clear();
+  of->textTaken = of->textSize;
+  funlockfile(f);
+}
+
+void ULogger::release(FILE * f, OpenFile * of)
+{
+  fclose(f);
+  if (of->zip != nullptr)
+    // closed, so all is counted
+    fileStats(of);
+  free(of->text);
+  delete of->writer;
+  delete of->zip;
+  delete of;
+}
+
+bool ULogger::skipRecord(OpenFile * of, ULogRecord * r)
+{ // a line may be logged in more parts, the last ends with a newline
+  if (of->lineStart)
+  {
+    of->skip = (of->decimate > 1 and of->lineCnt % of->decimate != 0);
+    if (overBudget and not of->skip)
+    {
+      of->skip = true;
+      budgetDropCnt++;
+    }
+    of->lineCnt++;
+    if (of->skip)
+      of->skipCnt++;
+  }
+  int n = strlen(r->format);
+  of->lineStart = n > 0 and r->format[n - 1] == '\n';
+  return of->skip;
+}
+
+void ULogger::fileStats(OpenFile * of)
+{
+  FileStat fs;
+  fs.name = of->name;
+  fs.lines = of->lineCnt;
+  fs.skipped = of->skipCnt;
+  fs.rawBytes = of->zip->rawBytes;
+  fs.diskBytes = of->zip->diskBytes;
+  fs.cpuNs = of->zip->cpuNs;
+  fileStat.push_back(fs);
+}
+
+void ULogger::fileCheck()
+{
+  std::lock_guard<std::mutex> lock(openLock);
+  long long n = diskBytes + binBytes;
+  for (auto & f : openFiles)
+  {
+    if (f.second->zip != nullptr)
+      f.second->zip->flush();
+    if (f.second->writer != nullptr)
+      n += f.second->writer->bytes();
+  }
+  if (dirBudget > 0 and n > dirBudget and not overBudget)
+  {
+    printf("# ULogger:: logfiles use %.1f MB, over budget, no more lines are logged\n", n / 1e6);
+    overBudget = true;
+  }
+}
+
+bool ULogger::writeOpened(ULogRecord* r)
+{
+  std::lock_guard<std::mutex> lock(openLock);
+  auto it = openFiles.find(r->file);
+  if (it == openFiles.end())
+    return false;
+  OpenFile * of = it->second;
+  if (r->write != closeRecord and skipRecord(of, r))
+    return true;
+  if (of->zip != nullptr)
+  { // text logfile
+    if (r->write == closeRecord)
+    {
+      release(r->file, of);
+      openFiles.erase(it);
+    }
+    else
+      r->write(r);
+    return true;
+  }
+  if (flight != nullptr)
+  { // keep in RAM only, the file is kept (for a dump) until terminate
+    if (r->write != closeRecord)
+      flight->add(r);
+    return true;
+  }
+  // text written directly to the file since last record
+  std::string text;
+  takeText(r->file, of, false, text);
+  if (not text.empty())
+    of->writer->text(text.c_str(), text.size(), r->us);
+  if (r->write == closeRecord)
+  {
+    binBytes += of->writer->close();
+    release(r->file, of);
+    openFiles.erase(it);
+  }
+  else
+    of->writer->record(r->format, r->types, r->valueSize, r->us, r->data, r->used);
+  return true;
+}
+
+void ULogger::flightTrigger(ULogRecord* r)
+{
+  if (flightState != FLIGHT_IDLE or r->us - lastTriggerUs < int64_t(flightMinInterval * 1e6))
+  {
+    flightIgnoredCnt++;
+    return;
+  }
+  lastTriggerUs = r->us;
+  flightReason = r->format;
+  flightAt = r->us;
+  // keep the lines from before the trigger
+  flightPos = flight->find(flightAt - int64_t(flightPre * 1e6));
+  flight->pin(flightPos);
+  flightState = FLIGHT_COLLECT;
+  printf("# ULogger:: flight recorder triggered by '%s'\n", flightReason);
+}
+
+void ULogger::flightStartWrite()
+{
+  std::string dir;
+  if (not openFiles.empty())
+    dir = openFiles.begin()->second->dir;
+  const int MSL = 100;
+  char s[MSL];
+  snprintf(s, MSL, "flight_%03d_%s/", flightDumpCnt + 1, flightReason);
+  flightDir = dir + s;
+  mkdir(flightDir.c_str(), 0775);
+  flightState = FLIGHT_WRITE;
+}
+
+bool ULogger::flightDump(int maxLines)
+{
+  int64_t to = flightAt + int64_t(flightPost * 1e6);
+  std::lock_guard<std::mutex> lock(openLock);
+  for (int n = 0; n < maxLines; n++)
+  {
+    const UFlightRecorder::Entry * e = flight->next(flightPos);
+    if (e == nullptr or e->us > to)
+    { // finished
+      int64_t first = to;
+      for (auto & f : openFiles)
+      {
+        OpenFile * of = f.second;
+        if (of->dumpText != nullptr)
+          fclose(of->dumpText);
+        delete of->dumpZip;
+        if (of->dumpBin != nullptr)
+          delete of->dumpBin; // closes the file
+        of->dumpText = nullptr;
+        of->dumpZip = nullptr;
+        of->dumpBin = nullptr;
+      }
+      if (flight->oldestUs() > 0)
+        first = std::max(flight->oldestUs(), flightAt - int64_t(flightPre * 1e6));
+      flight->unpin();
+      flightDumpCnt++;
+      flightState = FLIGHT_IDLE;
+      printf("# ULogger:: flight recorder dump of '%s' (from %.1f s before) in %s\n",
+             flightReason, (flightAt - first) * 1e-6, flightDir.c_str());
+      return true;
+    }
+    // dumped lines may be overwritten
+    flight->pin(flightPos);
+    auto it = openFiles.find(e->file);
+    if (it == openFiles.end())
+      continue;
+    OpenFile * of = it->second;
+    if (of->dumpText == nullptr and of->dumpBin == nullptr)
+    { // first line to this file, create it with the header
+      std::string fn = flightDir + of->name;
+      std::string text;
+      takeText(it->first, of, true, text);
+      if (binary)
+      {
+        of->dumpBin = new ULogBinWriter();
+        if (of->dumpBin->open(fn.c_str(), e->us))
+          of->dumpBin->text(text.c_str(), text.size(), e->us);
+      }
+      else
+      {
+        of->dumpText = openText(fn, of->dumpZip);
+        if (of->dumpText != nullptr)
+          fwrite(text.c_str(), 1, text.size(), of->dumpText);
+      }
+    }
+    if (of->dumpBin != nullptr)
+      of->dumpBin->record(e->format, e->types, e->valueSize, e->us, e->data(), e->used);
+    else if (of->dumpText != nullptr)
+    { // format as the logfile line
+      ULogRecord rec;
+      rec.file = of->dumpText;
+      rec.format = e->format;
+      rec.types = e->types;
+      rec.valueSize = e->valueSize;
+      rec.used = e->used;
+      memcpy(rec.data, e->data(), e->used);
+      e->write(&rec);
+    }
+    flightLineCnt++;
+  }
+  return false;
+}
+
+int ULogger::writeAvailable()
+{ // oldest record first from all rings
+  int n = 0;
+  int backlog = 0;
+  for (int i = 0; i < MAX_RINGS; i++)
+    if (ringReady[i].load(std::memory_order_acquire))
+      backlog += rings[i].size();
+  if (backlog > maxBacklog)
+    maxBacklog = backlog;
+  while (true)
+  {
+    ULogRecord * first = nullptr;
+    int firstRing = 0;
+    for (int i = 0; i < MAX_RINGS; i++)
+    {
+      if (not ringReady[i].load(std::memory_order_acquire))
+        continue;
+      ULogRecord * r = rings[i].front();
+      if (r != nullptr and (first == nullptr or int32_t(r->seq - first->seq) < 0))
+      {
+        first = r;
+        firstRing = i;
+      }
+    }
+    if (first == nullptr)
+      break;
+    if (first->write == triggerRecord)
+      flightTrigger(first);
+    else
+    {
+      if (first->write != closeRecord)
+        writeCnt++;
+      if (not writeOpened(first))
+        first->write(first);
+    }
+    rings[firstRing].pop();
+    n++;
+  }
+  return n;
+}
+
+void ULogger::run()
+{
+  realtime.apply("logger");
+  while (true)
+  {
+    bool last = stop;
+    int n = writeAvailable();
+    if (last)
+      break;
+    if (nowUs() - fileCheckUs > 1000000)
+    {
+      fileCheckUs = nowUs();
+      fileCheck();
+    }
+    if (flightState == FLIGHT_COLLECT and
+        nowUs() > flightAt + int64_t((flightPost + 0.1) * 1e6))
+      // all lines to the end of the window should be here
+      flightStartWrite();
+    if (flightState == FLIGHT_WRITE)
+      // a part of the dump, between the new lines
+      flightDump(2000);
+    else if (n == 0)
+      usleep(2000);
+  }
+}
@@ -0,0 +1,402 @@
+/* #***************************************************************************
+ #*   Copyright (C) 2023 by DTU
+ #*   jcan@dtu.dk
+ #*
+ #*
+ #* The MIT License (MIT)  https://mit-license.org/
+ #*
+ #* Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+ #* and associated documentation files (the “Software”), to deal in the Software without restriction,
+ #* including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ #* sublicense, and/or sell copies of the Software, and to permit persons to whom the Software
+ #* is furnished to do so, subject to the following conditions:
+ #*
+ #* The above copyright notice and this permission notice shall be included in all copies
+ #* or substantial portions of the Software.
+ #*
+ #* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ #* INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ #* PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+ #* FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ #* ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ #* THE SOFTWARE. */
+
+#pragma once
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <atomic>
+#include <map>
+#include <string>
+#include <mutex>
+#include <thread>
+#include <tuple>
+#include <vector>
+#include <type_traits>
+#include "uring.h"
+
+class ULogBinWriter;
+class UFlightRecorder;
+class ULogZip;
+
+/**
+ * One logfile line waiting to be written.
+ * The values are packed in binary (in 'data') in call order,
+ * each aligned to its size, strings are copied to 'data' after the values.
+ * The line is formatted by the log writer thread using the format string,
+ * that must be a string constant. */
+struct ULogRecord
+{
+  static const int MAX_DATA = 464;
+  FILE * file;
+  const char * format;
+  /// value type codes (see ULogArg), one for each value
+  const char * types;
+  /// format and write the record (or close the file)
+  void (*write)(ULogRecord * r);
+  /// host time of the log call (us since epoch)
+  int64_t us;
+  /// sequence number, to keep the order across threads
+  uint32_t seq;
+  /// bytes used in 'data' by values and by values and strings
+  uint16_t valueSize;
+  uint16_t used;
+  /// values, then strings (one extra byte for an empty string)
+  alignas(8) char data[MAX_DATA + 1];
+};
+
+/**
+ * How a log value is kept in a record:
+ * numbers are copied, strings are copied into the record
+ * and kept as an offset (truncated if no more space).
+ * The type code tells the binary logfile reader how to
+ * get the value: 'b' bool, 'a','h','i','l' signed integer
+ * of 1, 2, 4, 8 bytes, 'A','H','I','L' unsigned, 'f' float,
+ * 'd' double, 's' string (offset). */
+template <class T>
+struct ULogArg
+{
+  typedef T stored;
+  static_assert(sizeof(T) <= 8, "log values must be at most 8 bytes");
+  static constexpr char code =
+      std::is_same<T, bool>::value ? 'b' :
+      std::is_floating_point<T>::value ? (sizeof(T) == 4 ? 'f' : 'd') :
+      std::is_signed<T>::value ? "?ahhiiiil"[sizeof(T)] : "?AHHIIIIL"[sizeof(T)];
+  static inline T put(T v, ULogRecord *) { return v; }
+  static inline T get(T v, ULogRecord *) { return v; }
+};
+
+template <>
+struct ULogArg<const char *>
+{
+  typedef uint16_t stored;
+  static constexpr char code = 's';
+  static inline uint16_t put(const char * s, ULogRecord * r)
+  {
+    if (s == nullptr or r->used >= ULogRecord::MAX_DATA)
+      return ULogRecord::MAX_DATA;
+    uint16_t offset = r->used;
+    int n = strnlen(s, ULogRecord::MAX_DATA - offset);
+    memcpy(r->data + offset, s, n);
+    r->data[offset + n] = '\0';
+    r->used = offset + n + 1;
+    return offset;
+  }
+  static inline const char * get(uint16_t offset, ULogRecord * r)
+  {
+    return r->data + offset;
+  }
+};
+
+template <>
+struct ULogArg<char *> : ULogArg<const char *>
+{
+};
+
+/**
+ * Logfile writer, so that no data or control thread
+ * waits for the SD-card.
+ * Each producer thread has its own lock-free ring of fixed size records,
+ * a log call copies the values to a record and returns;
+ * a writer thread formats and writes the lines (in call order)
+ * with the same text layout as a direct fprintf.
+ * If a ring is full, the line is dropped and counted.
+ * Logfiles opened with open() may instead be written in the binary
+ * format (see ULogBinWriter), text written directly to the file
+ * (e.g. the '%' header) is then kept in the binary file too.
+ * With the flight recorder, lines to these logfiles are kept in RAM
+ * only, and written around a trigger(), see setupFlight().
+ * Text logfiles may be gzip compressed, decimated and limited
+ * to a disk budget, see setupFiles().
+ * Logfiles must be closed with close(), to keep the order.
+ * */
+class ULogger
+{
+public:
+  ~ULogger();
+  /**
+   * Start the writer thread, before this
+   * (and after terminate) log lines are written directly
+   * \param binary if true, then files opened with open() are
+   * written in the binary log format
+   * \param cpu is the CPU core for the writer thread (-1 is any) */
+  void setup(bool binary = false, int cpu = -1);
+  /**
+   * Storage of files opened with open() (call before setup).
+   * \param compressLevel is gzip level (1..9) for text logfiles, the
+   * files are then named '.txt.gz', 0 is no compression.
+   * \param dirMegaBytes is the disk space for all logfiles, when used,
+   * further lines are dropped (counted). 0 is no limit. */
+  void setupFiles(int compressLevel, float dirMegaBytes);
+  /**
+   * Keep only every 'every' line of this logfile (call before open)
+   * \param filename is the logfile name without path, e.g. "log_pose.txt" */
+  void setDecimation(const std::string & filename, int every);
+  /**
+   * Use the flight recorder (call before setup):
+   * lines to files opened with open() are kept in RAM, and written only
+   * when triggered - from 'preSec' before to 'postSec' after the trigger -
+   * to a directory 'flight_NNN_reason/' next to the logfiles,
+   * as the usual logfiles (text or binary).
+   * \param megaBytes is the RAM used for the kept lines
+   * \param minInterval is the minimum time between triggers (sec) */
+  void setupFlight(float preSec, float postSec, int megaBytes, float minInterval);
+  /**
+   * Flight recorder trigger, ignored if not used, if a dump is in
+   * progress or if too soon after the last trigger.
+   * \param reason is a string constant, e.g. "edge_lost" */
+  void trigger(const char * reason);
+  /**
+   * Is the flight recorder in use */
+  inline bool flightRecorder()
+  {
+    return flight != nullptr;
+  }
+  /**
+   * Write all pending lines, stop the writer thread and print statistics */
+  void terminate();
+  /**
+   * Open a logfile for writing (replaces fopen(filename, "w")).
+   * If binary, then the file is named '.bin' (not '.txt') and
+   * in the binary format, but the returned FILE* is used as for
+   * a text file. With the flight recorder, no file is created here.
+   * If compressed, then the file is named '.txt.gz'.
+   * \returns nullptr if the file could not be created */
+  FILE * open(const char * filename);
+  /**
+   * Log a line - like fprintf(file, format, ...)
+   * \param file is an open logfile (nothing is logged if nullptr)
+   * \param format is a printf format, must be a string constant
+   * \param args are numbers or strings (strings are copied) */
+  template <class... A>
+  void log(FILE * file, const char * format, A... args)
+  {
+    static_assert(valueSize<A...>() <= ULogRecord::MAX_DATA / 2, "too many values in one log line");
+    if (file == nullptr)
+      return;
+    if (not running)
+    {
+      fprintf(file, format, args...);
+      return;
+    }
+    int r = producerRing();
+    int idx = rings[r].claim();
+    if (idx < 0)
+    { // writer is behind (slow storage), drop line
+      dropCnt[r]++;
+      return;
+    }
+    ULogRecord & rec = rings[r].slot(idx);
+    rec.file = file;
+    rec.format = format;
+    rec.types = typeCodes<A...>();
+    rec.write = writeRecord<A...>;
+    rec.us = nowUs();
+    rec.seq = seqNext.fetch_add(1, std::memory_order_relaxed);
+    rec.valueSize = valueSize<A...>();
+    rec.used = rec.valueSize;
+    int offset = 0;
+    (pack<A>(rec, offset, args), ...);
+    (void)offset; // if no values
+    rings[r].publish(idx);
+  }
+  /**
+   * Close a logfile (replaces fclose), when all lines to it are written.
+   * Nothing must be logged to the file after this call. */
+  void close(FILE * file);
+  /**
+   * Size and alignment of a value in a record */
+  static constexpr int alignUp(int offset, int size)
+  {
+    return (offset + size - 1) / size * size;
+  }
+
+public:
+  /// producer rings (per thread), the last is shared if more threads
+  static const int MAX_RINGS = 32;
+  /// records in each ring
+  static const int RING_SIZE = 512;
+
+private:
+  template <class... A>
+  static constexpr int valueSize()
+  {
+    int n = 0;
+    ((n = alignUp(n, sizeof(typename ULogArg<A>::stored)) + sizeof(typename ULogArg<A>::stored)), ...);
+    return n;
+  }
+  template <class... A>
+  static const char * typeCodes()
+  {
+    static const char codes[] = {ULogArg<A>::code..., '\0'};
+    return codes;
+  }
+  template <class A>
+  static inline void pack(ULogRecord & rec, int & offset, A v)
+  {
+    typename ULogArg<A>::stored s = ULogArg<A>::put(v, &rec);
+    offset = alignUp(offset, sizeof(s));
+    memcpy(rec.data + offset, &s, sizeof(s));
+    offset += sizeof(s);
+  }
+  template <class A>
+  static inline typename ULogArg<A>::stored unpack(ULogRecord * r, int & offset)
+  {
+    typename ULogArg<A>::stored s;
+    offset = alignUp(offset, sizeof(s));
+    memcpy(&s, r->data + offset, sizeof(s));
+    offset += sizeof(s);
+    return s;
+  }
+  template <class... A>
+  static void writeRecord(ULogRecord * r)
+  {
+    int offset = 0;
+    // braced init unpacks in order
+    std::tuple<typename ULogArg<A>::stored...> v{unpack<A>(r, offset)...};
+    (void)offset;
+    std::apply([r](auto... s) { fprintf(r->file, r->format, ULogArg<A>::get(s, r)...); }, v);
+  }
+  static void closeRecord(ULogRecord * r);
+  static void triggerRecord(ULogRecord *)
+  { // handled by the writer thread
+  }
+  static int64_t nowUs();
+  /** get (or create) the ring for this thread */
+  int producerRing();
+  /** write available records in sequence order
+   * \returns number of records written */
+  int writeAvailable();
+  /** write (or close) a record to a logfile opened with open()
+   * in binary, flight recorder, compressed or decimated mode
+   * \returns false if not such a logfile */
+  bool writeOpened(ULogRecord * r);
+  struct OpenFile;
+  /** create text logfile (compressed or counted)
+   * \returns nullptr if not created */
+  FILE * openText(std::string filename, ULogZip *& zip);
+  /** skip whole lines from decimation or disk budget */
+  bool skipRecord(OpenFile * of, ULogRecord * r);
+  /** statistics for a logfile being closed */
+  void fileStats(OpenFile * of);
+  /** flush compressed files and test disk budget (every second) */
+  void fileCheck();
+  /** text written directly to the file (since last time) */
+  void takeText(FILE * f, OpenFile * of, bool all, std::string & text);
+  /** delete file kept in memory */
+  void release(FILE * f, OpenFile * of);
+  /** flight recorder functions (writer thread) */
+  void flightTrigger(ULogRecord * r);
+  void flightStartWrite();
+  /** write some lines of the flight recorder dump
+   * \returns true when finished */
+  bool flightDump(int maxLines);
+  /** writer thread */
+  void run();
+  static void runObj(ULogger * obj)
+  { // called, when thread is started
+    obj->run();
+  }
+  //
+  URing<ULogRecord> rings[MAX_RINGS];
+  std::atomic<bool> ringReady[MAX_RINGS] = {};
+  std::atomic<int> ringCnt = {0};
+  std::atomic<int> dropCnt[MAX_RINGS] = {};
+  std::atomic<uint32_t> seqNext = {0};
+  std::atomic<bool> running = {false};
+  std::atomic<bool> stop = {false};
+  std::thread * th1 = nullptr;
+  /// binary logfiles
+  bool binary = false;
+  /// text logfile compression, decimation and disk budget
+  int compressLevel = 0;
+  long long dirBudget = 0;
+  std::map<std::string, int> decimation;
+  std::atomic<long long> diskBytes = {0};
+  bool overBudget = false;
+  int64_t fileCheckUs = 0;
+  /// logfiles opened with open() (not plain text)
+  struct OpenFile
+  {
+    /// logfile name (without path) and path
+    std::string name;
+    std::string dir;
+    /// binary logfile (not flight recorder)
+    ULogBinWriter * writer = nullptr;
+    /// text logfile (compressed or counted)
+    ULogZip * zip = nullptr;
+    /// decimation (keep every line is 1)
+    int decimate = 1;
+    int lineCnt = 0;
+    int skipCnt = 0;
+    bool lineStart = true;
+    bool skip = false;
+    /// text written to the FILE* given to the module (a memory stream)
+    char * text = nullptr;
+    size_t textSize = 0;
+    size_t textTaken = 0;
+    /// flight recorder dump files
+    FILE * dumpText = nullptr;
+    ULogZip * dumpZip = nullptr;
+    ULogBinWriter * dumpBin = nullptr;
+  };
+  std::map<FILE*, OpenFile*> openFiles;
+  std::mutex openLock;
+  /// flight recorder
+  UFlightRecorder * flight = nullptr;
+  float flightPre = 5;
+  float flightPost = 2;
+  float flightMinInterval = 10;
+  enum FlightState {FLIGHT_IDLE, FLIGHT_COLLECT, FLIGHT_WRITE};
+  FlightState flightState = FLIGHT_IDLE;
+  const char * flightReason = "";
+  int64_t flightAt = 0;
+  int64_t lastTriggerUs = 0;
+  uint64_t flightPos = 0;
+  std::string flightDir;
+  int flightDumpCnt = 0;
+  int flightIgnoredCnt = 0;
+  int flightLineCnt = 0;
+  /// statistics
+  int writeCnt = 0;
+  int maxBacklog = 0;
+  int binFileCnt = 0;
+  long long binBytes = 0;
+  /// closed text logfiles
+  struct FileStat
+  {
+    std::string name;
+    int lines;
+    int skipped;
+    long long rawBytes;
+    long long diskBytes;
+    long long cpuNs;
+  };
+  std::vector<FileStat> fileStat;
+  int budgetDropCnt = 0;
+};
+
+/**
+ * Make this visible to the rest of the software */
+extern ULogger logger;
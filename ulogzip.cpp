@@ -0,0 +1,156 @@
+/* #***************************************************************************
+ #*   Copyright (C) 2023 by DTU
+ #*   jcan@dtu.dk
+ #*
+ #*
+ #* The MIT License (MIT)  https://mit-license.org/
+ #*
+ #* Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+ #* and associated documentation files (the “Software”), to deal in the Software without restriction,
+ #* including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ #* sublicense, and/or sell copies of the Software, and to permit persons to whom the Software
+ #* is furnished to do so, subject to the following conditions:
+ #*
+ #* The above copyright notice and this permission notice shall be included in all copies
+ #* or substantial portions of the Software.
+ #*
+ #* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ #* INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ #* PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+ #* FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ #* ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ #* THE SOFTWARE. */
+
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+
+#include "ulogzip.h"
+
+static long long threadCpuNs()
+{
+  timespec t;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t);
+  return (long long)t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+ULogZip::~ULogZip()
+{ // normally closed by fclose of the FILE*
+  if (file != nullptr)
+    fclose(file);
+}
+
+FILE * ULogZip::open(const char * filename, int level, std::atomic<long long> * diskBytes)
+{
+  fd = ::open(filename, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0664);
+  if (fd < 0)
+  {
+    perror("# ULogZip::open");
+    return nullptr;
+  }
+  total = diskBytes;
+  compress = level > 0;
+  if (compress)
+  { // gzip format (windowBits + 16), so zcat can read the file
+    memset(&zs, 0, sizeof(zs));
+    if (deflateInit2(&zs, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+    {
+      printf("# ULogZip::open: zlib init failed\n");
+      ::close(fd);
+      fd = -1;
+      return nullptr;
+    }
+  }
+  cookie_io_functions_t io = {nullptr, writeObj, nullptr, closeObj};
+  file = fopencookie(this, "w", io);
+  if (file == nullptr)
+    close();
+  return file;
+}
+
+ssize_t ULogZip::writeObj(void* obj, const char* buf, size_t size)
+{
+  ((ULogZip *)obj)->write(buf, size);
+  return size;
+}
+
+int ULogZip::closeObj(void* obj)
+{
+  ULogZip * z = (ULogZip *)obj;
+  z->file = nullptr;
+  z->close();
+  return 0;
+}
+
+void ULogZip::write(const char* buf, size_t size)
+{
+  long long t0 = threadCpuNs();
+  rawBytes += size;
+  if (compress)
+  {
+    zs.next_in = (Bytef *)buf;
+    zs.avail_in = size;
+    deflateAll(Z_NO_FLUSH);
+  }
+  else
+    put(buf, size);
+  cpuNs += threadCpuNs() - t0;
+}
+
+void ULogZip::flush()
+{
+  if (file == nullptr)
+    return;
+  long long t0 = threadCpuNs();
+  // text buffered in the FILE*
+  fflush(file);
+  if (compress)
+    deflateAll(Z_SYNC_FLUSH);
+  cpuNs += threadCpuNs() - t0;
+}
+
+void ULogZip::deflateAll(int flush)
+{
+  do
+  {
+    zs.next_out = (Bytef *)out;
+    zs.avail_out = OUT_SIZE;
+    deflate(&zs, flush);
+    put(out, OUT_SIZE - zs.avail_out);
+  } while (zs.avail_out == 0);
+}
+
+void ULogZip::put(const void* data, int n)
+{
+  const char * p1 = (const char *)data;
+  while (n > 0)
+  {
+    ssize_t w = ::write(fd, p1, n);
+    if (w <= 0)
+    { // disk full or similar, the rest is lost
+      perror("# ULogZip::put");
+      break;
+    }
+    p1 += w;
+    n -= w;
+    diskBytes += w;
+    if (total != nullptr)
+      *total += w;
+  }
+}
+
+void ULogZip::close()
+{
+  if (fd < 0)
+    return;
+  if (compress)
+  {
+    zs.next_in = nullptr;
+    zs.avail_in = 0;
+    deflateAll(Z_FINISH);
+    deflateEnd(&zs);
+  }
+  ::close(fd);
+  fd = -1;
+}
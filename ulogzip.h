@@ -0,0 +1,75 @@
+/* #***************************************************************************
+ #*   Copyright (C) 2023 by DTU
+ #*   jcan@dtu.dk
+ #*
+ #*
+ #* The MIT License (MIT)  https://mit-license.org/
+ #*
+ #* Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+ #* and associated documentation files (the “Software”), to deal in the Software without restriction,
+ #* including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ #* sublicense, and/or sell copies of the Software, and to permit persons to whom the Software
+ #* is furnished to do so, subject to the following conditions:
+ #*
+ #* The above copyright notice and this permission notice shall be included in all copies
+ #* or substantial portions of the Software.
+ #*
+ #* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ #* INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ #* PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+ #* FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ #* ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ #* THE SOFTWARE. */
+
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <atomic>
+#include <zlib.h>
+
+/**
+ * A text logfile written through a FILE* (fopencookie),
+ * optionally gzip compressed (zlib deflate) as the text is written.
+ * Bytes and CPU time are counted for statistics, and bytes written
+ * to disk are added to a shared counter (for a disk budget).
+ * Link with -lz.
+ * */
+class ULogZip
+{
+public:
+  ~ULogZip();
+  /**
+   * Create file
+   * \param level is zlib compression level (1..9), 0 is no compression
+   * \param diskBytes is added the bytes written to disk (may be nullptr)
+   * \returns FILE* to write to (closed with fclose), or nullptr */
+  FILE * open(const char * filename, int level, std::atomic<long long> * diskBytes);
+  /**
+   * Write the compressed data so far to disk (a sync point
+   * in the gzip stream) - e.g. once a second */
+  void flush();
+
+public:
+  /// statistics
+  long long rawBytes = 0;
+  long long diskBytes = 0;
+  /// thread CPU time used in write and compression
+  long long cpuNs = 0;
+
+private:
+  static ssize_t writeObj(void * obj, const char * buf, size_t size);
+  static int closeObj(void * obj);
+  void write(const char * buf, size_t size);
+  /** compress all input, and write output to file */
+  void deflateAll(int flush);
+  void put(const void * data, int n);
+  void close();
+  static const int OUT_SIZE = 64 * 1024;
+  int fd = -1;
+  FILE * file = nullptr;
+  bool compress = false;
+  z_stream zs;
+  char out[OUT_SIZE];
+  std::atomic<long long> * total = nullptr;
+};
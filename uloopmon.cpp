@@ -0,0 +1,253 @@
+/* #***************************************************************************
+ #*   Copyright (C) 2023 by DTU
+ #*   jcan@dtu.dk
+ #*
+ #*
+ #* The MIT License (MIT)  https://mit-license.org/
+ #*
+ #* Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+ #* and associated documentation files (the “Software”), to deal in the Software without restriction,
+ #* including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ #* sublicense, and/or sell copies of the Software, and to permit persons to whom the Software
+ #* is furnished to do so, subject to the following conditions:
+ #*
+ #* The above copyright notice and this permission notice shall be included in all copies
+ #* or substantial portions of the Software.
+ #*
+ #* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ #* INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ #* PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+ #* FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ #* ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ #* THE SOFTWARE. */
+
+#include <time.h>
+#include <math.h>
+#include <unistd.h>
+#include <algorithm>
+
+#include "uloopmon.h"
+#include "uservice.h"
+#include "ulogger.h"
+#include "steensy.h"
+#include "cmixer.h"
+
+ULoopWatch loopwatch;
+
+static int64_t nowNs()
+{ // same time base as the sample times
+  return timebase.nowNs();
+}
+
+void ULoopMon::setup(const char* loopName, float samplePeriod)
+{
+  name = loopName;
+  setSamplePeriod(samplePeriod);
+  loopwatch.add(this);
+}
+
+void ULoopMon::setSamplePeriod(float sec)
+{
+  periodNs = int64_t(sec * 1e9);
+}
+
+void ULoopMon::begin(UTimeNs & sampleTime)
+{
+  sample = sampleTime;
+  beginNs = nowNs();
+  if (lastBeginNs > 0)
+  {
+    int64_t dt = beginNs - lastBeginNs;
+    periodHist.add(dt * 1e-9);
+    int64_t p = periodNs;
+    if (p > 0 and dt > p + p / 2)
+      // one or more samples were not used
+      skipCnt += int((dt + p / 2) / p) - 1;
+  }
+  lastBeginNs = beginNs;
+}
+
+void ULoopMon::end()
+{
+  int64_t t = nowNs();
+  execHist.add((t - beginNs) * 1e-9);
+  int64_t lateNs = t - sample.ns;
+  lateHist.add(lateNs * 1e-9);
+  if (periodNs > 0 and lateNs > periodNs)
+    missCnt++;
+  if (lateNs > lateMaxNs)
+    lateMaxNs = lateNs;
+  lastEndNs = t;
+  cycles++;
+}
+
+void ULoopMon::print()
+{ // values may be updated while printing, so a cycle may be missing
+  printf("# ULoopMon:: %-8s %7u cycles, %d deadline misses (%.1f ms), %d skipped samples, %d stalls\n",
+         name, cycles.load(), missCnt.load(), periodNs * 1e-6, skipCnt.load(), stallCnt);
+  printf("#   %-7s %7s %9s %9s %s\n", "time", "count", "mean(us)", "max(us)", "bins (us:count)");
+  periodHist.print("period");
+  execHist.print("exec");
+  lateHist.print("sample");
+}
+
+void ULoopWatch::setup()
+{
+  if (not ini.has("watchdog"))
+  { // control loop watchdog
+    ini["watchdog"]["enabled"] = "true";
+    ini["watchdog"]["; stall_ms: no cycle for this long (at least 4 sample periods) is logged"] = "";
+    ini["watchdog"]["stall_ms"] = "100";
+    ini["watchdog"]["; stop_ms: no cycle for this long (at least 8 sample periods) stops the robot, 0 is never"] = "";
+    ini["watchdog"]["stop_ms"] = "0";
+    ini["watchdog"]["; stop_exit: terminate the app after a watchdog stop"] = "";
+    ini["watchdog"]["stop_exit"] = "false";
+    ini["watchdog"]["log"] = "true";
+  }
+  if (not ini["watchdog"].has("release_ms"))
+  { // a stopped loop running for this long releases the stop
+    ini["watchdog"]["release_ms"] = "1000";
+  }
+  enabled = ini["watchdog"]["enabled"] == "true";
+  stallNs = int64_t(strtof(ini["watchdog"]["stall_ms"].c_str(), nullptr) * 1e6);
+  stopNs = int64_t(strtof(ini["watchdog"]["stop_ms"].c_str(), nullptr) * 1e6);
+  releaseNs = int64_t(strtof(ini["watchdog"]["release_ms"].c_str(), nullptr) * 1e6);
+  stopExit = ini["watchdog"]["stop_exit"] == "true";
+  if (ini["watchdog"]["log"] == "true")
+  {
+    std::string fn = service.logPath + "log_loops.txt";
+    logfile = logger.open(fn.c_str());
+    fprintf(logfile, "%% Control loop timing every second (%s)\n", fn.c_str());
+    fprintf(logfile, "%% For each loop:\n");
+    fprintf(logfile, "%% 1 \tTime (sec)\n");
+    fprintf(logfile, "%% 2 \tLoop name\n");
+    fprintf(logfile, "%% 3 \tCycles (total)\n");
+    fprintf(logfile, "%% 4 \tDeadline misses (total)\n");
+    fprintf(logfile, "%% 5 \tSkipped samples (total)\n");
+    fprintf(logfile, "%% 6 \tMax sample to end of cycle in last second (ms)\n");
+    fprintf(logfile, "%% 7 \tWatchdog level (0 = OK, 1 = stalled, 2 = stopped)\n");
+  }
+  stop = false;
+  th1 = new std::thread(runObj, this);
+}
+
+void ULoopWatch::add(ULoopMon* loop)
+{
+  std::lock_guard<std::mutex> guard(loopsLock);
+  for (ULoopMon * l : loops)
+    if (l == loop)
+      return;
+  loops.push_back(loop);
+}
+
+void ULoopWatch::check(ULoopMon* loop, int64_t now)
+{
+  int64_t p = loop->periodNs;
+  if (loop->cycles == 0 or p == 0)
+    // not started (e.g. no robot hardware), or the stream is stopped
+    return;
+  // no data while the Teensy is disconnected, and the streams
+  // restart after a reconnect
+  int64_t age = now - std::max(loop->lastEndNs.load(), linkUpNs);
+  int64_t stall = std::max(stallNs, 4 * p);
+  if (age < stall)
+  {
+    if (loop->level == 1)
+    {
+      printf("# ULoopWatch:: %s is running again after %.0f ms\n", loop->name, age * 1e-6);
+      loop->level = 0;
+    }
+    else if (loop->level == 2)
+    { // release the stop when running for a while
+      if (loop->runningSinceNs == 0)
+        loop->runningSinceNs = now;
+      else if (now - loop->runningSinceNs >= releaseNs)
+      {
+        printf("# ULoopWatch:: %s has run for %.0f ms again - releasing the stop\n",
+               loop->name, (now - loop->runningSinceNs) * 1e-6);
+        loop->level = 0;
+        loop->runningSinceNs = 0;
+        stoppedCnt--;
+        if (stoppedCnt == 0 and not manualBeforeStop)
+          // back to the mission
+          mixer.setManualControl(false, 0, 0);
+      }
+    }
+    return;
+  }
+  loop->runningSinceNs = 0;
+  if (not linkOpen)
+    // no escalation while Teensy is disconnected
+    return;
+  if (loop->level == 0)
+  {
+    loop->level = 1;
+    loop->stallCnt++;
+    printf("# ULoopWatch:: %s has stalled (no cycle for %.0f ms)\n", loop->name, age * 1e-6);
+    logger.trigger("stall");
+  }
+  if (loop->level == 1 and stopNs > 0 and age > std::max(stopNs, 8 * p))
+  { // safe stop
+    loop->level = 2;
+    printf("# ULoopWatch:: %s stalled for %.0f ms - stopping the robot\n", loop->name, age * 1e-6);
+    if (stoppedCnt == 0)
+      manualBeforeStop = not mixer.autonomous();
+    stoppedCnt++;
+    mixer.setManualControl(true, 0, 0);
+    teensy1.send("motv 0 0\n");
+    if (stopExit)
+      service.stopNow("watchdog");
+  }
+}
+
+void ULoopWatch::run()
+{
+  int64_t logNs = nowNs();
+  while (not stop and not service.stop)
+  {
+    usleep(20000);
+    int64_t now = nowNs();
+    bool open = teensy1.teensyConnectionOpen;
+    if (open and not linkOpen)
+      // (re)connected
+      linkUpNs = now;
+    linkOpen = open;
+    bool doLog = logfile != nullptr and now - logNs >= 1000000000;
+    UTime t("now");
+    std::lock_guard<std::mutex> guard(loopsLock);
+    for (ULoopMon * l : loops)
+    {
+      if (enabled)
+        check(l, now);
+      if (doLog)
+        logger.log(logfile, "%lu.%04ld %s %u %d %d %.3f %d\n", t.getSec(), t.getMicrosec()/100,
+                   l->name, l->cycles.load(), l->missCnt.load(), l->skipCnt.load(),
+                   l->lateMaxNs.exchange(0) * 1e-6, l->level);
+    }
+    if (doLog)
+      logNs = now;
+  }
+}
+
+void ULoopWatch::print()
+{
+  std::lock_guard<std::mutex> guard(loopsLock);
+  for (ULoopMon * l : loops)
+    l->print();
+}
+
+void ULoopWatch::terminate()
+{
+  if (th1 == nullptr)
+    return;
+  stop = true;
+  th1->join();
+  delete th1;
+  th1 = nullptr;
+  if (logfile != nullptr)
+  {
+    logger.close(logfile);
+    logfile = nullptr;
+  }
+  print();
+}
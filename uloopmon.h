@@ -0,0 +1,155 @@
+/* #***************************************************************************
+ #*   Copyright (C) 2023 by DTU
+ #*   jcan@dtu.dk
+ #*
+ #*
+ #* The MIT License (MIT)  https://mit-license.org/
+ #*
+ #* Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+ #* and associated documentation files (the “Software”), to deal in the Software without restriction,
+ #* including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ #* sublicense, and/or sell copies of the Software, and to permit persons to whom the Software
+ #* is furnished to do so, subject to the following conditions:
+ #*
+ #* The above copyright notice and this permission notice shall be included in all copies
+ #* or substantial portions of the Software.
+ #*
+ #* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ #* INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ #* PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+ #* FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ #* ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ #* THE SOFTWARE. */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "utime.h"
+#include "udelayhist.h"
+
+/**
+ * Timing of one control loop, e.g. CMotor, updated by the loop thread
+ * with begin() and end() around each cycle.
+ * The deadline for a cycle is the (subscribed) sample period, counted
+ * from the sensor sample time to the end of the cycle
+ * (e.g. when 'motv' is sent).
+ * */
+class ULoopMon
+{
+public:
+  /**
+   * \param name is used in statistics (and is the loop name for the watchdog)
+   * \param samplePeriod is the sensor sample period (sec) */
+  void setup(const char * name, float samplePeriod);
+  /**
+   * When the subscribed sample period changes (sec) */
+  void setSamplePeriod(float sec);
+  /**
+   * A cycle is started
+   * \param sampleTime is the time of the sensor sample used */
+  void begin(UTimeNs & sampleTime);
+  /**
+   * The cycle is finished (output is sent) */
+  void end();
+  /**
+   * Print statistics (may be called while running) */
+  void print();
+  const char * name = "loop";
+  /// finished cycles
+  std::atomic<uint32_t> cycles = {0};
+  /// time of last end() (monotonic ns)
+  std::atomic<int64_t> lastEndNs = {0};
+  /// sample period (ns)
+  std::atomic<int64_t> periodNs = {0};
+  /// max sample to end of cycle since last logged (ns)
+  std::atomic<int64_t> lateMaxNs = {0};
+  /// sample to end of cycle longer than the sample period
+  std::atomic<int> missCnt = {0};
+  /// samples not used (from the time between cycles)
+  std::atomic<int> skipCnt = {0};
+  /// watchdog escalation level (0 = OK, 1 = stalled, 2 = safe stop)
+  int level = 0;
+  int stallCnt = 0;
+  /// running again after a safe stop since (ns), 0 if not
+  int64_t runningSinceNs = 0;
+
+private:
+  UTimeNs sample;
+  int64_t beginNs = 0;
+  int64_t lastBeginNs = 0;
+  /// time between cycles
+  UDelayHist periodHist;
+  /// time from begin to end
+  UDelayHist execHist;
+  /// time from sensor sample to end
+  UDelayHist lateHist;
+};
+
+/**
+ * Watchdog for the control loops, and statistics of all loops.
+ * A loop that has not finished a cycle for a while is logged (and
+ * triggers the flight recorder), and if it stays stalled, the robot
+ * is stopped (motor voltage 0 and mixer in manual mode with zero velocity),
+ * if enabled with [watchdog] stop_ms.
+ * The stop is released when the loop has run for release_ms again.
+ * Loops are not watched while the Teensy is disconnected, and the
+ * time is counted from the reconnect.
+ * Statistics are printed with the 'loops' keyboard command,
+ * saved every second in log_loops.txt, and printed at terminate.
+ * */
+class ULoopWatch
+{
+public:
+  /**
+   * Read configuration and start the watchdog */
+  void setup();
+  /**
+   * Add a loop to be watched (called by ULoopMon::setup) */
+  void add(ULoopMon * loop);
+  /**
+   * Print statistics of all loops */
+  void print();
+  /**
+   * Stop the watchdog and print statistics */
+  void terminate();
+
+private:
+  void run();
+  static void runObj(ULoopWatch * obj)
+  { // called, when thread is started
+    obj->run();
+  }
+  /** check one loop, and escalate if needed */
+  void check(ULoopMon * loop, int64_t now);
+  std::vector<ULoopMon *> loops;
+  std::mutex loopsLock;
+  FILE * logfile = nullptr;
+  bool enabled = false;
+  bool stop = false;
+  bool stopExit = false;
+  /// time without a cycle before a loop is stalled (ns)
+  int64_t stallNs = 0;
+  /// time without a cycle before safe stop (ns), 0 is never
+  int64_t stopNs = 0;
+  /// time running again before a safe stop is released (ns)
+  int64_t releaseNs = 0;
+  /// loops in safe stop
+  int stoppedCnt = 0;
+  /// mixer was in manual mode before the first safe stop
+  bool manualBeforeStop = false;
+  /// Teensy connection was open at last check
+  bool linkOpen = false;
+  /// time the Teensy connection was (re)opened (ns)
+  int64_t linkUpNs = 0;
+  std::thread * th1 = nullptr;
+};
+
+/**
+ * Make this visible to the rest of the software */
+extern ULoopWatch loopwatch;
@@ -26,6 +26,7 @@
 #include <string.h>
 #include <math.h>
 #include "upid.h"
+#include "ulogger.h"
 
 
 // PID controller class:
@@ -38,31 +39,33 @@ void UPID::setup(float sTime, float proportional, float lead_tau, float lead_alp
   // integrator
   taui = tau_integrator;
   useIntegrator = taui > 1e-3;
+  useLead = taud > 1e-3;
   // sample time from encoder module
-  sampleTime = sTime;
-  //
-  // Calculate PID parameters - see PID function for explanation
+  setSampleTime(sTime);
+}
+
+void UPID::setSampleTime(float sTime)
+{ // Calculate PID parameters - see PID function for explanation
+  // calculated in local values first, as the controller
+  // may be running while the sample time is changed
+  float e0 = 1.0, e1 = 0, u1 = 0, i0 = 0.0;
   // lead
-  useLead = taud > 1e-3;
   if (useLead)
   {
-    float lu0 = sampleTime + 2.0 * taud * alpha;
-    le0 = (sampleTime + 2.0 * taud)/lu0;
-    le1 = (sampleTime - 2.0 * taud)/lu0;
-    lu1 = (sampleTime - 2.0 * alpha * taud)/lu0;
-  }
-  else
-  { // no lead/lag
-    le0 = 1.0;
-    le1 = 0;
-    lu1 = 0;
+    float lu0 = sTime + 2.0 * taud * alpha;
+    e0 = (sTime + 2.0 * taud)/lu0;
+    e1 = (sTime - 2.0 * taud)/lu0;
+    u1 = (sTime - 2.0 * alpha * taud)/lu0;
   }
   // integrator
   if (useIntegrator)
-    ie = sampleTime/(taui * 2.0);
-  else
-    ie = 0.0;
+    i0 = sTime/(taui * 2.0);
   //
+  le0 = e0;
+  le1 = e1;
+  lu1 = u1;
+  ie = i0;
+  sampleTime = sTime;
 }
 
 void UPID::logPIDparams(FILE* logfile, bool andColumns)
@@ -163,11 +166,11 @@ void UPID::resetHistory()
 }
 
 
-void UPID::saveToLog(FILE* logfile, UTime t)
+void UPID::saveToLog(FILE* logfile, UTimeNs t)
 {// log_pose
   if (logfile != nullptr)
   {
-    fprintf(logfile, "%lu.%04ld %.3f %.3f %.3f %.3f %.3f %.3f %d\n",
+    logger.log(logfile, "%lu.%04ld %.3f %.3f %.3f %.3f %.3f %.3f %d\n",
             t.getSec(), t.getMicrosec()/100,
             r, m,
             ep1,
@@ -38,6 +38,10 @@ public:
              float lead_tau,     // lead time constant (sec) = 1/(w_m*sqrt(alpha))
              float lead_alpha,
              float tau_integrator);
+  /**
+   * change sample time (sec), e.g. when the measurement
+   * subscription rate is changed; lead and integrator are recalculated */
+  void setSampleTime(float sTime);
   /**
    * PID controller
    * \param reference is the set-point reference
@@ -58,7 +62,7 @@ public:
    * \param logfile is a valid file handle
    * \param t is the time where the values are valid
    * */
-  void saveToLog(FILE * logfile, UTime t);
+  void saveToLog(FILE * logfile, UTimeNs t);
   /**
    * reference and measurement may be in radians
    * ensure correct folding of angles. */
@@ -0,0 +1,306 @@
+/* #***************************************************************************
+ #*   Copyright (C) 2023 by DTU
+ #*   jcan@dtu.dk
+ #*
+ #*
+ #* The MIT License (MIT)  https://mit-license.org/
+ #*
+ #* Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+ #* and associated documentation files (the “Software”), to deal in the Software without restriction,
+ #* including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ #* sublicense, and/or sell copies of the Software, and to permit persons to whom the Software
+ #* is furnished to do so, subject to the following conditions:
+ #*
+ #* The above copyright notice and this permission notice shall be included in all copies
+ #* or substantial portions of the Software.
+ #*
+ #* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ #* INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ #* PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+ #* FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ #* ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ #* THE SOFTWARE. */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <malloc.h>
+#include <alloca.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <atomic>
+#include <thread>
+
+#include "urealtime.h"
+#include "uservice.h"
+#include "udelayhist.h"
+#include "utimebase.h"
+
+URealtime realtime;
+
+void URealtime::setup()
+{
+  if (not ini.has("realtime"))
+  { // scheduling profile for the threads
+    ini["realtime"]["enabled"] = "false";
+    ini["realtime"]["; lock_memory: mlockall, memory is locked when used (and not returned)"] = "";
+    ini["realtime"]["lock_memory"] = "true";
+    ini["realtime"]["; stack_prefault_kb: stack used at thread start, so it is mapped"] = "";
+    ini["realtime"]["stack_prefault_kb"] = "256";
+    ini["realtime"]["; vision_threads: max OpenCV threads (0 is OpenCV default)"] = "";
+    ini["realtime"]["vision_threads"] = "2";
+    ini["realtime"]["; thread = policy (fifo, rr or other) priority (1..99, 0 for other) CPUs (e.g. 3, 0-2 or any)"] = "";
+    ini["realtime"]["; 'main' is used at setup, and is inherited by threads not listed"] = "";
+    ini["realtime"]["main"] = "other 0 0-2";
+    ini["realtime"]["teensy"] = "fifo 60 3";
+    ini["realtime"]["teensy_writer"] = "fifo 58 3";
+    ini["realtime"]["executor"] = "fifo 55 3";
+    ini["realtime"]["pose"] = "fifo 55 3";
+    ini["realtime"]["heading"] = "fifo 54 3";
+    ini["realtime"]["motor"] = "fifo 53 3";
+    ini["realtime"]["medge"] = "fifo 52 3";
+    ini["realtime"]["cedge"] = "fifo 51 3";
+    ini["realtime"]["gpio"] = "fifo 40 3";
+    ini["realtime"]["cam"] = "other 0 0-2";
+    ini["realtime"]["logger"] = "other 0 0-2";
+  }
+  enabled = ini["realtime"]["enabled"] == "true";
+  prefaultKb = strtol(ini["realtime"]["stack_prefault_kb"].c_str(), nullptr, 10);
+  if (prefaultKb > 4096)
+    // default stack is 8MB
+    prefaultKb = 4096;
+  visionThreads = strtol(ini["realtime"]["vision_threads"].c_str(), nullptr, 10);
+  profiles.clear();
+  for (auto const& it : ini["realtime"])
+  { // all other lines are thread profiles
+    const std::string & key = it.first;
+    if (key.empty() or key[0] == ';' or key == "enabled" or key == "lock_memory" or
+        key == "stack_prefault_kb" or key == "vision_threads")
+      continue;
+    Profile p;
+    if (decodeProfile(key.c_str(), it.second, p))
+      profiles[key] = p;
+  }
+  struct rusage ru;
+  getrusage(RUSAGE_SELF, &ru);
+  minFltSetup = ru.ru_minflt;
+  majFltSetup = ru.ru_majflt;
+  if (not enabled)
+    return;
+  if (ini["realtime"]["lock_memory"] == "true")
+  { // keep heap memory once used (no trim or mmap'ed blocks)
+    mallopt(M_TRIM_THRESHOLD, -1);
+    mallopt(M_MMAP_MAX, 0);
+    int flags = MCL_CURRENT | MCL_FUTURE;
+#ifdef MCL_ONFAULT
+    // lock pages when used, not the full stack of every thread
+    flags |= MCL_ONFAULT;
+#endif
+    if (mlockall(flags) == 0)
+      memoryLocked = true;
+    else
+      printf("# URealtime::setup: mlockall failed (%s), needs CAP_IPC_LOCK or 'ulimit -l'\n",
+             strerror(errno));
+  }
+  // inherited by all threads started from here
+  apply("main");
+}
+
+bool URealtime::decodeProfile(const char* name, const std::string& s, Profile& p)
+{
+  p.line = s;
+  char pol[16];
+  char cpus[64] = "any";
+  int prio = 0;
+  int n = sscanf(s.c_str(), "%15s %d %63s", pol, &prio, cpus);
+  if (n < 1)
+    return false;
+  if (strcmp(pol, "fifo") == 0)
+    p.policy = SCHED_FIFO;
+  else if (strcmp(pol, "rr") == 0)
+    p.policy = SCHED_RR;
+  else if (strcmp(pol, "other") == 0)
+    p.policy = SCHED_OTHER;
+  else
+  {
+    printf("# URealtime:: unknown policy '%s' for %s (fifo, rr or other)\n", pol, name);
+    return false;
+  }
+  if (p.policy == SCHED_OTHER)
+    p.priority = 0;
+  else
+    p.priority = prio;
+  p.useCpus = strcmp(cpus, "any") != 0;
+  if (p.useCpus)
+  { // e.g. "3" or "0-2" or "0,2-3"
+    CPU_ZERO(&p.cpus);
+    const char * p1 = cpus;
+    while (*p1 != '\0')
+    {
+      char * p2;
+      int a = strtol(p1, &p2, 10);
+      int b = a;
+      if (p2 == p1)
+        break;
+      if (*p2 == '-')
+      {
+        p1 = p2 + 1;
+        b = strtol(p1, &p2, 10);
+      }
+      for (int c = a; c <= b and c < CPU_SETSIZE; c++)
+        CPU_SET(c, &p.cpus);
+      p1 = p2;
+      if (*p1 == ',')
+        p1++;
+    }
+    p.useCpus = CPU_COUNT(&p.cpus) > 0;
+  }
+  return true;
+}
+
+int URealtime::setThread(const Profile& p)
+{
+  sched_param sp;
+  sp.sched_priority = p.priority;
+  int e = pthread_setschedparam(pthread_self(), p.policy, &sp);
+  if (e == 0 and p.useCpus)
+    e = pthread_setaffinity_np(pthread_self(), sizeof(p.cpus), &p.cpus);
+  return e;
+}
+
+void URealtime::prefaultStack()
+{
+  if (prefaultKb <= 0)
+    return;
+  size_t n = size_t(prefaultKb) * 1024;
+  volatile char * stack = (volatile char *)alloca(n);
+  for (size_t i = 0; i < n; i += 4096)
+    stack[i] = 0;
+}
+
+bool URealtime::has(const char* name)
+{
+  return enabled and profiles.count(name) > 0;
+}
+
+bool URealtime::apply(const char* name, bool force)
+{
+  if (not enabled and not force)
+    return false;
+  auto it = profiles.find(name);
+  if (it == profiles.end())
+    return false;
+  const Profile & p = it->second;
+  int e = setThread(p);
+  prefaultStack();
+  if (e != 0)
+    printf("# URealtime::apply: thread %s can not use '%s' (%s)%s\n", name,
+           p.line.c_str(), strerror(e),
+           e == EPERM ? ", needs CAP_SYS_NICE or 'ulimit -r'" : "");
+  if (not force)
+  {
+    std::lock_guard<std::mutex> guard(appliedLock);
+    applied.push_back({name, pid_t(syscall(SYS_gettid)), p.line, e});
+  }
+  return e == 0;
+}
+
+/** normal scheduling on all CPUs (the profile off) */
+static void useAnyCpu()
+{
+  sched_param sp;
+  sp.sched_priority = 0;
+  pthread_setschedparam(pthread_self(), SCHED_OTHER, &sp);
+  cpu_set_t cs;
+  CPU_ZERO(&cs);
+  int n = sysconf(_SC_NPROCESSORS_CONF);
+  for (int c = 0; c < n and c < CPU_SETSIZE; c++)
+    CPU_SET(c, &cs);
+  pthread_setaffinity_np(pthread_self(), sizeof(cs), &cs);
+}
+
+void URealtime::jitterTest(float sec)
+{
+  const int64_t periodNs = 1000000;
+  int loops = int(sec * 1e9 / periodNs);
+  int cpuCnt = std::thread::hardware_concurrency();
+  printf("# URealtime:: jitter test, %d ms period thread (as 'motor'), %.1f sec, load on %d CPUs (as 'main')\n",
+         int(periodNs / 1000000), sec, cpuCnt);
+  printf("#   %-7s %7s %9s %9s %s\n", "wakeup", "count", "mean(us)", "max(us)", "bins (us:count)");
+  for (int on = 0; on < 2; on++)
+  {
+    const char * name = on ? "on" : "off";
+    std::atomic<bool> stopLoad = {false};
+    std::vector<std::thread *> load;
+    for (int i = 0; i < cpuCnt; i++)
+      load.push_back(new std::thread([this, on, &stopLoad]()
+      { // image processing like load, memory allocation and copy
+        if (on)
+          apply("main", true);
+        else
+          useAnyCpu();
+        const size_t sz = 2000000;
+        while (not stopLoad)
+        {
+          std::vector<uint8_t> a(sz, 1);
+          std::vector<uint8_t> b(a);
+          unsigned s = 0;
+          for (size_t k = 0; k < sz; k += 64)
+            s += b[k];
+          if (s == 0)
+            printf("# never\n");
+        }
+      }));
+    UDelayHist hist;
+    long majFlt = 0;
+    std::thread sampler([&]()
+    { // the periodic thread
+      if (on)
+        apply("motor", true);
+      else
+        useAnyCpu();
+      int64_t next = UTimeBase::monoNs();
+      for (int i = 0; i < loops; i++)
+      {
+        next += periodNs;
+        timespec ts = {time_t(next / 1000000000), long(next % 1000000000)};
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr);
+        hist.add((UTimeBase::monoNs() - next) * 1e-9);
+      }
+      struct rusage ru;
+      getrusage(RUSAGE_THREAD, &ru);
+      majFlt = ru.ru_majflt;
+    });
+    sampler.join();
+    stopLoad = true;
+    for (std::thread * t : load)
+    {
+      t->join();
+      delete t;
+    }
+    hist.print(name);
+    if (majFlt > 0)
+      printf("#   %-7s %ld major page faults\n", name, majFlt);
+  }
+  if (not enabled)
+    printf("# URealtime:: profile is not enabled in robot.ini ([realtime] enabled = false)\n");
+}
+
+void URealtime::terminate()
+{
+  if (not enabled)
+    return;
+  struct rusage ru;
+  getrusage(RUSAGE_SELF, &ru);
+  printf("# URealtime:: memory locked %s, page faults after setup: %ld minor, %ld major\n",
+         memoryLocked ? "yes" : "no", ru.ru_minflt - minFltSetup, ru.ru_majflt - majFltSetup);
+  printf("# URealtime:: %-14s %7s %-16s %s\n", "thread", "tid", "profile", "result");
+  std::lock_guard<std::mutex> guard(appliedLock);
+  for (Applied & a : applied)
+    printf("# URealtime:: %-14s %7d %-16s %s\n", a.name.c_str(), a.tid, a.use.c_str(),
+           a.error == 0 ? "ok" : strerror(a.error));
+}
@@ -0,0 +1,118 @@
+/* #***************************************************************************
+ #*   Copyright (C) 2023 by DTU
+ #*   jcan@dtu.dk
+ #*
+ #*
+ #* The MIT License (MIT)  https://mit-license.org/
+ #*
+ #* Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+ #* and associated documentation files (the “Software”), to deal in the Software without restriction,
+ #* including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ #* sublicense, and/or sell copies of the Software, and to permit persons to whom the Software
+ #* is furnished to do so, subject to the following conditions:
+ #*
+ #* The above copyright notice and this permission notice shall be included in all copies
+ #* or substantial portions of the Software.
+ #*
+ #* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ #* INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ #* PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+ #* FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ #* ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ #* THE SOFTWARE. */
+
+#pragma once
+
+#include <sched.h>
+#include <sys/types.h>
+#include <mutex>
+#include <string>
+#include <map>
+#include <vector>
+
+/**
+ * Real-time profile from the [realtime] section in robot.ini.
+ * Each named thread can get a scheduling policy, priority and a
+ * set of CPUs, e.g. 'motor = fifo 53 3', so the control threads
+ * can have a core of their own, and the vision (OpenCV) and
+ * other threads are kept on the remaining cores.
+ * The 'main' line is used at setup (before any thread is started),
+ * so all threads without a line of their own inherit this.
+ * Memory can be locked (mlockall), and the stack of a thread
+ * is touched when the profile is applied, to avoid page faults later.
+ * */
+class URealtime
+{
+public:
+  /**
+   * Read the profile, lock memory and set the main thread CPUs.
+   * To be called before any other thread is started. */
+  void setup();
+  /**
+   * Use the profile for this thread (the calling thread)
+   * \param name is the thread name in the ini-file
+   * \param force use the profile also when not enabled (for jitter test)
+   * \returns true if used */
+  bool apply(const char * name, bool force = false);
+  /**
+   * Is there a (usable) profile for this thread name */
+  bool has(const char * name);
+  /**
+   * Wake-up jitter of a periodic (1 ms) thread, with load on all
+   * CPUs, first without and then with the profile.
+   * \param sec is the test time for each */
+  void jitterTest(float sec);
+  /**
+   * Print what is used */
+  void terminate();
+  /**
+   * Is the profile in use */
+  inline bool isEnabled()
+  {
+    return enabled;
+  }
+  /// max number of OpenCV threads (0 is OpenCV default)
+  int visionThreads = 0;
+
+private:
+  struct Profile
+  {
+    int policy = SCHED_OTHER;
+    int priority = 0;
+    /// CPU set is used, else any CPU
+    bool useCpus = false;
+    cpu_set_t cpus;
+    /// the line from the ini-file
+    std::string line;
+  };
+  /** decode the line for this name
+   * \returns false if not a usable profile */
+  bool decodeProfile(const char * name, const std::string & s, Profile & p);
+  /// all thread profiles, decoded at setup, so the threads
+  /// do not read the ini-structure (other modules may still add to it)
+  std::map<std::string, Profile> profiles;
+  /** set policy and CPUs for calling thread
+   * \returns 0 or errno value */
+  int setThread(const Profile & p);
+  /** touch this much stack, so it is mapped (and locked) */
+  void prefaultStack();
+  struct Applied
+  {
+    std::string name;
+    pid_t tid;
+    std::string use;
+    int error;
+  };
+  std::vector<Applied> applied;
+  std::mutex appliedLock;
+  bool enabled = false;
+  bool memoryLocked = false;
+  int prefaultKb = 0;
+  /// page faults at setup (to see the effect of lock_memory)
+  long minFltSetup = 0;
+  long majFltSetup = 0;
+};
+
+/**
+ * Make this visible to the rest of the software */
+extern URealtime realtime;
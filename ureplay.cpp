@@ -0,0 +1,128 @@
+/* #***************************************************************************
+ #*   Copyright (C) 2023 by DTU
+ #*   jcan@dtu.dk
+ #*
+ #*
+ #* The MIT License (MIT)  https://mit-license.org/
+ #*
+ #* Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+ #* and associated documentation files (the “Software”), to deal in the Software without restriction,
+ #* including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ #* sublicense, and/or sell copies of the Software, and to permit persons to whom the Software
+ #* is furnished to do so, subject to the following conditions:
+ #*
+ #* The above copyright notice and this permission notice shall be included in all copies
+ #* or substantial portions of the Software.
+ #*
+ #* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ #* INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ #* PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+ #* FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ #* ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ #* THE SOFTWARE. */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "ureplay.h"
+
+void UReplay::setup(const char* keywords)
+{
+  const char * p1 = keywords;
+  keywordCnt = 0;
+  while (keywordCnt < MAX_KEYWORDS)
+  {
+    p1 += strspn(p1, " ,");
+    int n = strcspn(p1, " ,");
+    if (n == 0)
+      break;
+    if (n >= MKL)
+      n = MKL - 1;
+    strncpy(keyword[keywordCnt], p1, n);
+    keyword[keywordCnt][n] = '\0';
+    keywordCnt++;
+    p1 += strcspn(p1, " ,");
+  }
+}
+
+void UReplay::record(const char* msg)
+{
+  if (*msg == '!')
+    msg++;
+  int n = strcspn(msg, " \n");
+  bool used = false;
+  for (int i = 0; i < keywordCnt and not used; i++)
+    used = strncmp(msg, keyword[i], n) == 0 and keyword[i][n] == '\0';
+  if (not used)
+    return;
+  // key is first keyword, or two words for commands with a stream or servo number
+  const char * p1 = msg + n;
+  bool stream = strncmp(msg, "sub ", 4) == 0 or strncmp(msg, "bin ", 4) == 0;
+  if (stream or strncmp(msg, "servo ", 6) == 0)
+  {
+    p1 += strspn(p1, " ");
+    p1 += strcspn(p1, " \n");
+  }
+  int kn = p1 - msg;
+  // a subscription with rate 0 is no subscription
+  bool remove = false;
+  if (strncmp(msg, "sub ", 4) == 0)
+  {
+    char * p2;
+    long rate = strtol(p1, &p2, 10);
+    remove = p2 != p1 and rate == 0;
+  }
+  if (kn >= MKL or strlen(msg) + 2 >= MML)
+  { // not expected
+    printf("# UReplay::record: command too long to replay '%s'\n", msg);
+    return;
+  }
+  std::lock_guard<std::mutex> guard(lock);
+  int i;
+  for (i = 0; i < cnt; i++)
+  {
+    if (strncmp(entry[i].key, msg, kn) == 0 and entry[i].key[kn] == '\0')
+      break;
+  }
+  if (remove)
+  { // remove the 'bin' request for the stream too, so that it follows
+    // a new 'sub' for the stream, e.g. 'sub enc 0' removes 'bin enc'
+    char binKey[MKL];
+    snprintf(binKey, MKL, "bin%.*s", kn - 3, msg + 3);
+    int j = 0;
+    for (int k = 0; k < cnt; k++)
+    { // keep order of the rest
+      if (k == i or strcmp(entry[k].key, binKey) == 0)
+        continue;
+      if (j != k)
+        entry[j] = entry[k];
+      j++;
+    }
+    cnt = j;
+    return;
+  }
+  if (i == cnt)
+  { // new key
+    if (cnt >= MAX_ENTRIES)
+    {
+      printf("# UReplay::record: no space for '%s'\n", msg);
+      return;
+    }
+    strncpy(entry[i].key, msg, kn);
+    entry[i].key[kn] = '\0';
+    cnt++;
+  }
+  // keep with one new-line
+  int m = strcspn(msg, "\n");
+  memcpy(entry[i].msg, msg, m);
+  entry[i].msg[m] = '\n';
+  entry[i].msg[m + 1] = '\0';
+}
+
+void UReplay::forEach(std::function<void(const char * msg)> f)
+{
+  std::lock_guard<std::mutex> guard(lock);
+  for (int i = 0; i < cnt; i++)
+    f(entry[i].msg);
+}
@@ -0,0 +1,73 @@
+/* #***************************************************************************
+ #*   Copyright (C) 2023 by DTU
+ #*   jcan@dtu.dk
+ #*
+ #*
+ #* The MIT License (MIT)  https://mit-license.org/
+ #*
+ #* Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+ #* and associated documentation files (the “Software”), to deal in the Software without restriction,
+ #* including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ #* sublicense, and/or sell copies of the Software, and to permit persons to whom the Software
+ #* is furnished to do so, subject to the following conditions:
+ #*
+ #* The above copyright notice and this permission notice shall be included in all copies
+ #* or substantial portions of the Software.
+ #*
+ #* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ #* INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ #* PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+ #* FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ #* ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ #* THE SOFTWARE. */
+
+#pragma once
+
+#include <mutex>
+#include <functional>
+
+/**
+ * The stateful commands send to the Teensy (subscriptions, sensor setup),
+ * so that the Teensy state can be restored after a reconnect.
+ * Only the latest command for each key is kept, the key is the first keyword,
+ * or the first two words for 'sub', 'bin' and 'servo' (e.g. 'sub enc'),
+ * a 'sub' with rate 0 removes the subscription (and the 'bin' request for the stream).
+ * Commands are kept in the order they were first given.
+ * */
+class UReplay
+{
+public:
+  /**
+   * Set keywords for the commands to keep
+   * \param keywords is a space (or comma) separated list, e.g. 'sub lip irc' */
+  void setup(const char * keywords);
+  /**
+   * Keep this command, if it is stateful
+   * \param msg is command without CRC, e.g. 'sub enc 8\n' */
+  void record(const char * msg);
+  /**
+   * Call f for each kept command (in order) */
+  void forEach(std::function<void(const char * msg)> f);
+  int size()
+  {
+    return cnt;
+  }
+  /// number of times the commands were replayed
+  int replayCnt = 0;
+
+private:
+  static const int MAX_KEYWORDS = 16;
+  static const int MAX_ENTRIES = 48;
+  static const int MKL = 24;
+  static const int MML = 100;
+  char keyword[MAX_KEYWORDS][MKL];
+  int keywordCnt = 0;
+  struct Entry
+  {
+    char key[MKL];
+    char msg[MML];
+  };
+  Entry entry[MAX_ENTRIES];
+  int cnt = 0;
+  std::mutex lock;
+};
@@ -0,0 +1,155 @@
+/* #***************************************************************************
+ #*   Copyright (C) 2024 by DTU
+ #*   jcan@dtu.dk
+ #*
+ #*
+ #* The MIT License (MIT)  https://mit-license.org/
+ #*
+ #* Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+ #* and associated documentation files (the “Software”), to deal in the Software without restriction,
+ #* including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ #* sublicense, and/or sell copies of the Software, and to permit persons to whom the Software
+ #* is furnished to do so, subject to the following conditions:
+ #*
+ #* The above copyright notice and this permission notice shall be included in all copies
+ #* or substantial portions of the Software.
+ #*
+ #* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ #* INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ #* PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+ #* FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ #* ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ #* THE SOFTWARE. */
+
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+
+/**
+ * Bounded multi-producer single-consumer ring of preallocated slots.
+ * Producers claim a slot, fill it in place and publish it;
+ * no allocation and no lock, and a full ring is reported to the producer.
+ * The consumer (one thread only) sees the slots in claim order.
+ * Based on the bounded queue by D. Vyukov, with a sequence number per slot.
+ * */
+template <class T>
+class URing
+{
+public:
+  ~URing()
+  {
+    delete [] cells;
+  }
+  /**
+   * Allocate the slots, must be called before use (and only once)
+   * \param size is rounded up to a power of 2 */
+  void setup(int size)
+  {
+    int n = 2;
+    while (n < size)
+      n *= 2;
+    cells = new Cell[n];
+    mask = n - 1;
+    for (int i = 0; i < n; i++)
+      cells[i].seq.store(i, std::memory_order_relaxed);
+    enqueuePos.store(0);
+    dequeuePos.store(0);
+  }
+  /**
+   * Producer: reserve a slot
+   * \returns slot index, or -1 if the ring is full */
+  int claim()
+  {
+    if (cells == nullptr)
+      return -1;
+    uint32_t pos = enqueuePos.load(std::memory_order_relaxed);
+    while (true)
+    {
+      Cell * c = &cells[pos & mask];
+      uint32_t seq = c->seq.load(std::memory_order_acquire);
+      int32_t dif = int32_t(seq - pos);
+      if (dif == 0)
+      { // slot is free, try to get it
+        if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+        {
+          c->pos = pos;
+          return pos & mask;
+        }
+      }
+      else if (dif < 0)
+        // full
+        return -1;
+      else
+        // another producer got it, try next
+        pos = enqueuePos.load(std::memory_order_relaxed);
+    }
+  }
+  /**
+   * Producer: get the claimed slot (to fill it) */
+  inline T & slot(int idx)
+  {
+    return cells[idx].item;
+  }
+  /**
+   * Producer: make a filled slot visible to the consumer */
+  inline void publish(int idx)
+  {
+    cells[idx].seq.store(cells[idx].pos + 1, std::memory_order_release);
+  }
+  /**
+   * Consumer: get item number i from the front of the ring
+   * \returns nullptr if this item is not available (yet) */
+  T * at(int i)
+  {
+    if (cells == nullptr)
+      return nullptr;
+    uint32_t pos = dequeuePos.load(std::memory_order_relaxed) + i;
+    Cell * c = &cells[pos & mask];
+    if (c->seq.load(std::memory_order_acquire) == pos + 1)
+      return &c->item;
+    else
+      return nullptr;
+  }
+  /**
+   * Consumer: get front item, or nullptr if empty */
+  inline T * front()
+  {
+    return at(0);
+  }
+  /**
+   * Consumer: release the front item (must be available) */
+  void pop()
+  {
+    uint32_t pos = dequeuePos.load(std::memory_order_relaxed);
+    cells[pos & mask].seq.store(pos + mask + 1, std::memory_order_release);
+    dequeuePos.store(pos + 1, std::memory_order_relaxed);
+  }
+  /**
+   * Number of claimed slots (including slots still being filled) */
+  inline int size()
+  {
+    return int(enqueuePos.load(std::memory_order_relaxed) - dequeuePos.load(std::memory_order_relaxed));
+  }
+  inline bool empty()
+  {
+    return front() == nullptr;
+  }
+  inline int capacity()
+  {
+    return mask + 1;
+  }
+
+private:
+  struct Cell
+  {
+    std::atomic<uint32_t> seq;
+    uint32_t pos;
+    T item;
+  };
+  Cell * cells = nullptr;
+  uint32_t mask = 0;
+  // separate cache lines for producers and consumer
+  alignas(64) std::atomic<uint32_t> enqueuePos = {0};
+  alignas(64) std::atomic<uint32_t> dequeuePos = {0};
+};
@@ -0,0 +1,110 @@
+/* #***************************************************************************
+ #*   Copyright (C) 2023 by DTU
+ #*   jcan@dtu.dk
+ #*
+ #*
+ #* The MIT License (MIT)  https://mit-license.org/
+ #*
+ #* Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+ #* and associated documentation files (the “Software”), to deal in the Software without restriction,
+ #* including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ #* sublicense, and/or sell copies of the Software, and to permit persons to whom the Software
+ #* is furnished to do so, subject to the following conditions:
+ #*
+ #* The above copyright notice and this permission notice shall be included in all copies
+ #* or substantial portions of the Software.
+ #*
+ #* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ #* INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ #* PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+ #* FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ #* ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ #* THE SOFTWARE. */
+
+#include "urtt.h"
+
+/// lower limit for 4 * rttvar (sec), as the host scheduling
+/// and USB polling adds jitter that is not seen in a few samples
+static const double RTT_GRANULARITY = 0.002;
+/// highest number of doublings
+static const int MAX_BACKOFF = 10;
+
+void URtt::setup(double initialRto, double minRto, double maxRto)
+{
+  this->minRto = minRto;
+  if (this->minRto < 0.001)
+    this->minRto = 0.001;
+  this->maxRto = maxRto;
+  if (this->maxRto < this->minRto)
+    this->maxRto = this->minRto;
+  this->initialRto = initialRto;
+  if (this->initialRto < this->minRto)
+    this->initialRto = this->minRto;
+  else if (this->initialRto > this->maxRto)
+    this->initialRto = this->maxRto;
+  reset();
+}
+
+void URtt::reset()
+{
+  std::lock_guard<std::mutex> guard(lock);
+  rto = initialRto;
+  srtt = 0;
+  rttvar = 0;
+  minRtt = 0;
+  maxRtt = 0;
+}
+
+void URtt::sample(double rtt)
+{
+  if (rtt <= 0)
+    return;
+  std::lock_guard<std::mutex> guard(lock);
+  if (srtt == 0)
+  { // first sample
+    srtt = rtt;
+    rttvar = rtt / 2.0;
+  }
+  else
+  { // rttvar is updated with the old srtt
+    double d = rtt - srtt;
+    if (d < 0)
+      d = -d;
+    rttvar += (d - rttvar) / 4.0;
+    srtt += (rtt - srtt) / 8.0;
+  }
+  double k = 4 * rttvar;
+  if (k < RTT_GRANULARITY)
+    k = RTT_GRANULARITY;
+  rto = srtt + k;
+  if (rto < minRto)
+    rto = minRto;
+  else if (rto > maxRto)
+    rto = maxRto;
+  if (minRtt == 0 or rtt < minRtt)
+    minRtt = rtt;
+  if (rtt > maxRtt)
+    maxRtt = rtt;
+  sampleCnt++;
+}
+
+void URtt::ambiguous()
+{
+  ambiguousCnt++;
+}
+
+double URtt::getRto(int sendCnt)
+{
+  int b = sendCnt - 1;
+  if (b < 0)
+    b = 0;
+  else if (b > MAX_BACKOFF)
+    b = MAX_BACKOFF;
+  std::lock_guard<std::mutex> guard(lock);
+  if (b > maxBackoff)
+    maxBackoff = b;
+  double t = rto * (1 << b);
+  if (t > maxRto)
+    t = maxRto;
+  return t;
+}
@@ -0,0 +1,93 @@
+/* #***************************************************************************
+ #*   Copyright (C) 2023 by DTU
+ #*   jcan@dtu.dk
+ #*
+ #*
+ #* The MIT License (MIT)  https://mit-license.org/
+ #*
+ #* Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+ #* and associated documentation files (the “Software”), to deal in the Software without restriction,
+ #* including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ #* sublicense, and/or sell copies of the Software, and to permit persons to whom the Software
+ #* is furnished to do so, subject to the following conditions:
+ #*
+ #* The above copyright notice and this permission notice shall be included in all copies
+ #* or substantial portions of the Software.
+ #*
+ #* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ #* INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ #* PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+ #* FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ #* ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ #* THE SOFTWARE. */
+
+#pragma once
+
+#include <mutex>
+
+/**
+ * Retransmit timeout for messages that the Teensy confirms,
+ * estimated from the confirm round-trip times as in TCP (RFC 6298):
+ * a smoothed round-trip time and a smoothed mean deviation, and
+ * RTO = srtt + 4 * rttvar, limited to [min, max].
+ * Only messages send once give a sample, a confirm for a resend
+ * message can not be related to one of the sends (Karn's rule).
+ * Each resend of a message doubles its timeout (backoff).
+ * */
+class URtt
+{
+public:
+  /**
+   * Set limits and clear
+   * \param initialRto is RTO (sec) until the first sample
+   * \param minRto is lowest RTO (sec)
+   * \param maxRto is highest RTO (sec), also with backoff */
+  void setup(double initialRto, double minRto, double maxRto);
+  /**
+   * Forget all samples (e.g. after a reconnect) */
+  void reset();
+  /**
+   * A round-trip time (sec) from a message send once */
+  void sample(double rtt);
+  /**
+   * A confirm of a resend message (no sample) */
+  void ambiguous();
+  /**
+   * Time (sec) to wait for confirm, before a resend
+   * \param sendCnt is number of times the message is send (1 = first send),
+   *                the timeout is doubled for each resend */
+  double getRto(int sendCnt);
+  double getSrtt()
+  {
+    return srtt;
+  }
+  double getRttVar()
+  {
+    return rttvar;
+  }
+  double getMinRtt()
+  {
+    return minRtt;
+  }
+  double getMaxRtt()
+  {
+    return maxRtt;
+  }
+  // statistics
+  int sampleCnt = 0;
+  int ambiguousCnt = 0;
+  /// largest backoff used (number of doublings)
+  int maxBackoff = 0;
+
+private:
+  double initialRto = 0.04;
+  double minRto = 0.005;
+  double maxRto = 0.5;
+  /// current estimate (no backoff)
+  double rto = 0.04;
+  double srtt = 0;
+  double rttvar = 0;
+  double minRtt = 0;
+  double maxRtt = 0;
+  std::mutex lock;
+};
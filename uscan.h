@@ -0,0 +1,171 @@
+/* #***************************************************************************
+ #*   Copyright (C) 2023 by DTU
+ #*   jcan@dtu.dk
+ #*
+ #*
+ #* The MIT License (MIT)  https://mit-license.org/
+ #*
+ #* Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+ #* and associated documentation files (the “Software”), to deal in the Software without restriction,
+ #* including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ #* sublicense, and/or sell copies of the Software, and to permit persons to whom the Software
+ #* is furnished to do so, subject to the following conditions:
+ #*
+ #* The above copyright notice and this permission notice shall be included in all copies
+ #* or substantial portions of the Software.
+ #*
+ #* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ #* INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ #* PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+ #* FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ #* ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ #* THE SOFTWARE. */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <charconv>
+
+/**
+ * Allocation free scanner for space separated numeric fields,
+ * like the values in 'enc 1234 -5678' or 'gyro0 0.12 -0.3 1.0'.
+ * Integers (and floats, when the C++ library has it)
+ * are converted with std::from_chars, that do not depend on locale.
+ * Each get() advances past one field, a failed conversion
+ * stops the scan, and count() tells how many fields were converted.
+ * e.g.
+ *   UScan sc(p1);
+ *   sc.get(enc, 2);
+ *   if (not sc.ok(2))
+ *     sc.report("SEncoder::decode", msg);
+ * */
+class UScan
+{
+public:
+  /**
+   * \param line is the first character to scan (e.g. after the keyword)
+   * \param end is end of line, if nullptr, then scan to the zero termination */
+  UScan(const char * line, const char * end = nullptr);
+  /**
+   * Get one field
+   * \returns false if not a number (then the scan stops) */
+  inline bool get(int & v) { return getInt(v); }
+  inline bool get(int64_t & v) { return getInt(v); }
+  inline bool get(bool & v)
+  {
+    int i = 0;
+    bool isOK = getInt(i);
+    if (isOK)
+      v = i != 0;
+    return isOK;
+  }
+  inline bool get(float & v) { return getReal(v); }
+  inline bool get(double & v) { return getReal(v); }
+  /**
+   * Get a number of fields of the same type
+   * \returns number of fields converted */
+  template <class T>
+  int get(T * v, int n)
+  {
+    int i = 0;
+    for (; i < n; i++)
+    {
+      if (not get(v[i]))
+        break;
+    }
+    return i;
+  }
+  /**
+   * Number of fields converted so far */
+  inline int count() const
+  {
+    return fieldCnt;
+  }
+  /**
+   * All fields so far converted, and at least 'fields' fields converted */
+  inline bool ok(int fields) const
+  {
+    return not failed and fieldCnt >= fields;
+  }
+  /**
+   * Position after last converted field */
+  inline const char * position() const
+  {
+    return p;
+  }
+  /**
+   * Report a malformed line on the console
+   * (and count it in malformedCnt)
+   * \param who is the function name to show
+   * \param line is the full line to show */
+  void report(const char * who, const char * line);
+  /// number of malformed lines reported
+  static int malformedCnt;
+
+private:
+  const char * p;
+  const char * end;
+  int fieldCnt = 0;
+  bool failed = false;
+  /// skip white space, \returns false at end of line
+  inline bool skip()
+  {
+    while (p < end and (*p == ' ' or *p == '\t' or *p == '+'))
+      p++;
+    return p < end and *p != '\n' and *p != '\r';
+  }
+  template <class T>
+  bool getInt(T & v)
+  {
+    if (failed or not skip())
+    {
+      failed = true;
+      return false;
+    }
+    auto r = std::from_chars(p, end, v);
+    if (r.ec != std::errc())
+    {
+      failed = true;
+      return false;
+    }
+    p = r.ptr;
+    if (p < end and *p == '.')
+    { // a decimal value in an integer field, e.g. "12.5", is truncated
+      p++;
+      while (p < end and *p >= '0' and *p <= '9')
+        p++;
+    }
+    fieldCnt++;
+    return true;
+  }
+  template <class T>
+  bool getReal(T & v)
+  {
+    if (failed or not skip())
+    {
+      failed = true;
+      return false;
+    }
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+    auto r = std::from_chars(p, end, v);
+    bool isOK = r.ec == std::errc();
+    const char * q = r.ptr;
+#else
+    // floating point from_chars is missing (e.g. gcc 10)
+    char * q;
+    v = strtoReal(p, &q, v);
+    bool isOK = q != p;
+#endif
+    if (not isOK)
+    {
+      failed = true;
+      return false;
+    }
+    p = q;
+    fieldCnt++;
+    return true;
+  }
+  static inline float strtoReal(const char * s, char ** q, float) { return strtof(s, q); }
+  static inline double strtoReal(const char * s, char ** q, double) { return strtod(s, q); }
+};
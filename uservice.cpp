@@ -24,8 +24,12 @@
 
 #include <stdio.h>
 #include <signal.h>
+#include <string.h>
+#include <ctype.h>
 #include "CLI/CLI.hpp"
 #include <filesystem>
+#include <algorithm>
+#include <vector>
 
 #include "uini.h"
 #include "cmotor.h"
@@ -47,12 +51,23 @@
 #include "sstate.h"
 #include "steensy.h"
 #include "uservice.h"
+#include "ulogger.h"
+#include "uexecutor.h"
+#include "urealtime.h"
+#include "uloopmon.h"
+#include "utimebase.h"
 
 #define REV "$Id: uservice.cpp 586 2024-01-24 12:42:37Z jcan $"
 // define the service class
 UService service;
 // make a configuration structure
 mINI::INIStructure ini;
+// sensor streams that can change rate with the stream profile,
+// grouped by the ini-section that holds the default rate
+static const int STREAM_GROUPS = 4;
+static const char * streamSection[STREAM_GROUPS] = {"encoder", "edge", "dist", "imu"};
+static const char * streamName[STREAM_GROUPS][2] = {{"enc", nullptr}, {"liv", nullptr},
+                                                    {"ir", nullptr}, {"gyro0", "acc0"}};
 
 void signal_callback_handler(int signum)
 { // called when pressing ctrl-C
@@ -96,6 +111,12 @@ bool UService::setup(int argc,char **argv)
   cli.add_flag("-g,--gyro", calibGyro, "Calibrate gyro offset");
   float testSec = 0.0;
   cli.add_option("-t,--time", testSec, "Open all sensors for some time (seconds)");
+  float benchSec = 0.0;
+  cli.add_option("-B,--bench", benchSec, "Teensy link round-trip and throughput benchmark for some time (seconds)");
+  float jitterSec = 0.0;
+  cli.add_option("-J,--jitter", jitterSec, "Thread wake-up jitter with real-time profile off and on (seconds each)");
+  int confirmWindow = 0;
+  cli.add_option("-W,--window", confirmWindow, "Teensy messages send before confirm (overrides robot.ini)");
   // rename feature
   int  regbotNumber{-1};
   cli.add_option("-n,--number", regbotNumber, "Set robot number to Regbot part [0..150]");
@@ -137,6 +158,8 @@ bool UService::setup(int argc,char **argv)
   { // save this number to the Teensy (Robobot) and exit
     teensy1.regbotHardware = regbotHardware;
   }
+  if (confirmWindow > 0)
+    teensy1.confirmWindow = confirmWindow;
   //
   // create an ini-file structure
   iniFile = new mINI::INIFile(iniFileName);
@@ -150,6 +173,44 @@ bool UService::setup(int argc,char **argv)
     ini["service"]["logpath"] = "log_%d/";
     ini["service"]["; The '%d' will be replaced with date and timestamp (Must end with a '/')."] = "";
   }
+  if (not ini.has("stream_profile"))
+  { // subscription rates for mission phases, see setStreamProfile()
+    ini["stream_profile"]["; name = encoder <ms> edge <ms> dist <ms> imu <ms> (missing stream uses its rate_ms)."] = "";
+    ini["stream_profile"]["parked"] = "encoder 50 edge 100 dist 200 imu 100";
+    ini["stream_profile"]["turn"] = "encoder 8 edge 100 dist 100 imu 12";
+    ini["stream_profile"]["fast_line"] = "encoder 8 edge 5 dist 100 imu 50";
+  }
+  if (not ini["service"].has("log_binary"))
+  { // binary logfiles (convert to text with tools/logbin2txt)
+    ini["service"]["log_binary"] = "false";
+  }
+  if (not ini["service"].has("log_compress"))
+  { // text logfile storage (written by a logger thread)
+    ini["service"]["; log_compress is gzip level 1..9 (files are .txt.gz), 0 is no compression"] = "";
+    ini["service"]["log_compress"] = "0";
+    ini["service"]["; log_dir_mb is max size of logfiles in a run, log_disk_mb is max for all"] = "";
+    ini["service"]["; log directories, the oldest are removed at start (0 is no limit)"] = "";
+    ini["service"]["log_dir_mb"] = "0";
+    ini["service"]["log_disk_mb"] = "0";
+    ini["service"]["; log_cpu is CPU core for the logger thread (-1 is any)"] = "";
+    ini["service"]["log_cpu"] = "-1";
+  }
+  if (not ini.has("log_decimate"))
+  { // keep every N'th line of a logfile only
+    ini["log_decimate"]["; logfile = N, e.g. log_pose.txt = 5"] = "";
+  }
+  if (not ini.has("flight"))
+  { // flight recorder, logfile lines kept in RAM and written around a trigger only
+    ini["flight"]["enabled"] = "false";
+    ini["flight"]["pre_sec"] = "5";
+    ini["flight"]["post_sec"] = "2";
+    ini["flight"]["ram_mb"] = "32";
+    ini["flight"]["; min_interval is minimum time (sec) between triggers"] = "";
+    ini["flight"]["min_interval"] = "10";
+    ini["flight"]["; triggers: CRC errors within 1 sec, and motor control later than deadline after pose update"] = "";
+    ini["flight"]["crc_burst"] = "5";
+    ini["flight"]["deadline_ms"] = "30";
+  }
   teensyConnect = not (camImg or camCal or ini["service"]["use_robot_hardware"] == "false");
   //
   if (arucoID >= 0)
@@ -163,12 +224,20 @@ bool UService::setup(int argc,char **argv)
   { // initialize all elements
     logPath = ini["service"]["logpath"];
     int n = logPath.find("%d");
+    // the part after the date
+    std::string suffix;
     if (n > 0)
     { // date should be added to path
       UTime t("now");
       std::string dpart = t.getForFilename();
+      suffix = logPath.substr(n + 2);
       logPath.replace(n, 2, dpart);
     }
+    float dirMb = strtof(ini["service"]["log_dir_mb"].c_str(), nullptr);
+    float diskMb = strtof(ini["service"]["log_disk_mb"].c_str(), nullptr);
+    if (n > 0 and diskMb > 0)
+      // a new directory for every run, so remove old to make space
+      logRotate(logPath.substr(0, n), suffix, diskMb, dirMb);
     std::error_code e;
     bool ok = filesystem::create_directory(logPath, e);
     if (ok)
@@ -177,6 +246,26 @@ bool UService::setup(int argc,char **argv)
     { // failed (probably: path exist already)
       std::perror("#*** UService:: Failed to create log path:");
     }
+    // real or virtual clock, before any thread is started
+    timebase.setup();
+    // scheduling profile, before any thread is started
+    realtime.setup();
+    // logfiles are written by the logger thread
+    if (ini["flight"]["enabled"] == "true")
+      logger.setupFlight(strtof(ini["flight"]["pre_sec"].c_str(), nullptr),
+                         strtof(ini["flight"]["post_sec"].c_str(), nullptr),
+                         strtol(ini["flight"]["ram_mb"].c_str(), nullptr, 10),
+                         strtof(ini["flight"]["min_interval"].c_str(), nullptr));
+    logger.setupFiles(strtol(ini["service"]["log_compress"].c_str(), nullptr, 10), dirMb);
+    for (auto & d : ini["log_decimate"])
+      if (d.first[0] != ';')
+        logger.setDecimation(d.first, strtol(d.second.c_str(), nullptr, 10));
+    logger.setup(ini["service"]["log_binary"] == "true",
+                 realtime.has("logger") ? -1 : strtol(ini["service"]["log_cpu"].c_str(), nullptr, 10));
+    // control modules may run in rate groups
+    executor.setup();
+    // control loop timing and watchdog
+    loopwatch.setup();
     if (teensyConnect)
     { // open the main data source
       printf("# UService::setup: open to Teensy\n");
@@ -214,6 +303,11 @@ bool UService::setup(int argc,char **argv)
     joyLogi.setup();
     cam.setup();
     aruco.setup();
+    // all control steps are added
+    executor.start();
+    // rates as subscribed by the sensor modules
+    for (int g = 0; g < STREAM_GROUPS; g++)
+      streamRate[g] = ini[streamSection[g]]["rate_ms"];
     setupComplete = true;
     usleep(2000);
     //
@@ -257,6 +351,16 @@ bool UService::setup(int argc,char **argv)
       theEnd = true;
     }
   }
+  if (not theEnd and benchSec > 0.05)
+  { // benchmark the link to Teensy, then terminate
+    teensy1.benchmark(benchSec);
+    theEnd = true;
+  }
+  if (not theEnd and jitterSec > 0.05)
+  { // compare wake-up jitter with and without the real-time profile, then terminate
+    realtime.jitterTest(jitterSec);
+    theEnd = true;
+  }
   if (not theEnd)
   { // start listen to the keyboard
     th1 = new std::thread(runObj, this);
@@ -287,26 +391,139 @@ bool UService::setup(int argc,char **argv)
   return theEnd;
 }
 
-bool UService::decode(const char* msg, UTime& msgTime)
-{ // decode messages from Teensy
-  bool used = true;
-  if      (state.decode(msg, msgTime)) {}
-  else if (encoder.decode(msg, msgTime)) {}
-  else if (imu.decode(msg, msgTime)) {}
-  else if (servo.decode(msg, msgTime)) {}
-  else if (sedge.decode(msg, msgTime)) {}
-  else if (dist.decode(msg, msgTime)) {}
-  //
-  // add other Teensy data users here
-  //
-  else
-    used = false;
-  return used;
+bool UService::setStreamProfile(const char * name)
+{ // change subscription rates to fit a mission phase
+  if (not setupComplete)
+    return false;
+  std::string rate[STREAM_GROUPS];
+  for (int g = 0; g < STREAM_GROUPS; g++)
+    rate[g] = ini[streamSection[g]]["rate_ms"];
+  if (strcmp(name, "default") != 0)
+  { // e.g. "encoder 8 edge 5 dist 100 imu 50"
+    if (not ini["stream_profile"].has(name))
+    {
+      printf("# UService::setStreamProfile: no profile '%s' in [stream_profile]\n", name);
+      return false;
+    }
+    std::string profile = ini["stream_profile"][name];
+    const char * p1 = profile.c_str();
+    char key[32];
+    int ms, n;
+    while (sscanf(p1, "%31s %d%n", key, &ms, &n) == 2)
+    {
+      p1 += n;
+      for (int g = 0; g < STREAM_GROUPS; g++)
+        if (strcmp(key, streamSection[g]) == 0)
+          rate[g] = std::to_string(ms);
+    }
+  }
+  for (int g = 0; g < STREAM_GROUPS; g++)
+  { // resubscribe changed streams only
+    if (rate[g] == streamRate[g])
+      continue;
+    for (int i = 0; i < 2 and streamName[g][i] != nullptr; i++)
+      teensy1.subscribe(streamName[g][i], rate[g]);
+    streamRate[g] = rate[g];
+    // controllers driven by this stream
+    float sampleTime = strtof(rate[g].c_str(), nullptr) / 1000.0;
+    // deadline of the loops (a stopped stream is not watched)
+    if (g == 0)
+    {
+      motor.loopMon.setSamplePeriod(sampleTime);
+      heading.loopMon.setSamplePeriod(sampleTime);
+    }
+    else if (g == 1)
+      cedge.loopMon.setSamplePeriod(sampleTime);
+    if (sampleTime < 0.001)
+      continue; // stream stopped, keep old sample time
+    if (g == 0)
+    {
+      motor.setSampleTime(sampleTime);
+      heading.setSampleTime(sampleTime);
+    }
+    else if (g == 1)
+      cedge.setSampleTime(sampleTime);
+  }
+  streamProfile = name;
+  printf("# UService::setStreamProfile: '%s' (encoder %s, edge %s, dist %s, imu %s ms)\n", name,
+         streamRate[0].c_str(), streamRate[1].c_str(), streamRate[2].c_str(), streamRate[3].c_str());
+  return true;
+}
+
+/**
+ * Is this a date as from UTime::getForFilename(), e.g. "20231005_142501.123" */
+static bool isFilenameDate(const std::string & s, size_t pos)
+{
+  const char * pattern = "dddddddd_dddddd.ddd";
+  size_t n = strlen(pattern);
+  if (s.size() < pos + n)
+    return false;
+  for (size_t i = 0; i < n; i++)
+  {
+    if (pattern[i] == 'd' ? not isdigit((unsigned char)s[pos + i]) : s[pos + i] != pattern[i])
+      return false;
+  }
+  return true;
+}
+
+void UService::logRotate(const std::string & prefix, const std::string & suffix,
+                         float diskMegaBytes, float dirMegaBytes)
+{ // prefix may include a path, e.g. "log/log_"
+  filesystem::path pp(prefix);
+  filesystem::path dir = pp.parent_path();
+  std::string start = pp.filename();
+  std::string end = suffix;
+  if (not end.empty() and end.back() == '/')
+    end.pop_back();
+  if (start.empty() or end.find('/') != std::string::npos)
+  { // only directories named as 'start' + date + 'end' are removed
+    printf("# UService::logRotate: log_disk_mb is ignored, logpath must have a name "
+           "with the %%d in the last part, e.g. 'log/log_%%d/'\n");
+    return;
+  }
+  if (dir.empty())
+    dir = ".";
+  // e.g. "log_20231005_142501.123"
+  size_t nameLength = start.size() + strlen("20231005_142501.123") + end.size();
+  std::vector<std::pair<filesystem::file_time_type, filesystem::path>> logDirs;
+  std::vector<uintmax_t> logSize;
+  uintmax_t total = 0;
+  std::error_code e;
+  for (auto & d : filesystem::directory_iterator(dir, e))
+  {
+    std::string name = d.path().filename();
+    if (not d.is_directory() or name.size() != nameLength or
+        name.compare(0, start.size(), start) != 0 or
+        not isFilenameDate(name, start.size()) or
+        name.compare(name.size() - end.size(), end.size(), end) != 0)
+      continue;
+    logDirs.push_back({d.last_write_time(), d.path()});
+  }
+  // oldest first
+  std::sort(logDirs.begin(), logDirs.end());
+  for (auto & d : logDirs)
+  {
+    uintmax_t n = 0;
+    for (auto & f : filesystem::recursive_directory_iterator(d.second, e))
+      if (f.is_regular_file())
+        n += f.file_size();
+    logSize.push_back(n);
+    total += n;
+  }
+  uintmax_t budget = diskMegaBytes * 1e6;
+  uintmax_t need = dirMegaBytes * 1e6;
+  for (int i = 0; i < (int)logDirs.size() and total + need > budget; i++)
+  {
+    printf("# UService::logRotate: removing %s (%.1f MB)\n", logDirs[i].second.c_str(), logSize[i] / 1e6);
+    filesystem::remove_all(logDirs[i].second, e);
+    total -= logSize[i];
+  }
 }
 
 void UService::stopNow(const char * who)
 { // request a terminate and exit
   printf("# UService:: %s say stop now\n", who);
+  logger.trigger("estop");
   stopNowRequest = true;
 }
 
@@ -321,6 +538,9 @@ void UService::terminate()
   stop = true; // stop all threads, when finished current activity
   //
   usleep(100000);
+  // stop control steps before the modules close their logfiles
+  executor.terminate();
+  loopwatch.terminate();
   joyLogi.terminate();
   encoder.terminate();
   pose.terminate();
@@ -340,6 +560,10 @@ void UService::terminate()
   pyvision.terminate();
   cam.terminate();
   aruco.terminate();
+  // write the remaining log lines and close logfiles
+  logger.terminate();
+  // threads and page faults with the real-time profile
+  realtime.terminate();
   // service must be the last to close
   if (not ini.has("ini"))
   {
@@ -375,6 +599,9 @@ void UService::run()
       cin >> keyString;
       if (keyString == "stop")
         signal_callback_handler(-1);
+      else if (keyString == "loops")
+        // control loop timing
+        loopwatch.print();
       else
         gotKeyInput = true;
     }
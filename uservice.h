@@ -37,9 +37,15 @@ public:
     */
     bool setup(int argc,char **argv);
     /**
-     * decode messages from Teensy
-     * \param msg already CRC checked text line from teensy */
-    bool decode(const char * msg, UTime & msgTime);
+     * Change the subscription rates of the sensor streams to a
+     * named profile, e.g. "fast_line" or "parked", from the
+     * [stream_profile] ini section, to save link bandwidth and CPU
+     * in mission phases where a stream is of little use.
+     * The motor, heading and edge controller sample times follow.
+     * \param name is the profile name, "default" is the rate_ms
+     * values from the sensor sections.
+     * \returns false if the profile is not found */
+    bool setStreamProfile(const char * name);
     /**
      * decode command-line parameters */
     bool readCommandLineParameters(int argc, char ** argv);
@@ -61,6 +67,12 @@ public:
     /**
      * Return the SVN version string (version part) */
     std::string getVersionString();
+    /**
+     * Are all modules set up */
+    bool isSetupComplete()
+    {
+      return setupComplete;
+    }
 
 public:
     // file with calibration values etc.
@@ -76,8 +88,16 @@ public:
     bool gotKeyInput;
     std::string keyString;
     bool asDaemon = false;
+    // current stream profile name
+    std::string streamProfile = "default";
 
 private:
+    /**
+     * Remove the oldest log directories (named as 'prefix' + date + 'suffix')
+     * until the rest, and a new directory of 'dirMegaBytes',
+     * is within 'diskMegaBytes' */
+    void logRotate(const std::string & prefix, const std::string & suffix,
+                   float diskMegaBytes, float dirMegaBytes);
     static void runObj(UService * obj)
     { // called, when thread is started
         // transfer to the class run() function.
@@ -90,6 +110,8 @@ private:
         obj->run2();
     }
     std::thread * th2;
+    /// subscribed rate (ms) for each stream group (encoder, edge, dist, imu)
+    std::string streamRate[4];
     //
     bool terminating = false;
     bool setupComplete = false;
@@ -0,0 +1,507 @@
+/* #***************************************************************************
+ #*   Copyright (C) 2023 by DTU
+ #*   jcan@dtu.dk
+ #*
+ #*
+ #* The MIT License (MIT)  https://mit-license.org/
+ #*
+ #* Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+ #* and associated documentation files (the “Software”), to deal in the Software without restriction,
+ #* including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ #* sublicense, and/or sell copies of the Software, and to permit persons to whom the Software
+ #* is furnished to do so, subject to the following conditions:
+ #*
+ #* The above copyright notice and this permission notice shall be included in all copies
+ #* or substantial portions of the Software.
+ #*
+ #* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ #* INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ #* PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+ #* FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ #* ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ #* THE SOFTWARE. */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "uteensyemu.h"
+#include "ubinframe.h"
+
+const char * UTeensyEmu::streamName[ST_CNT] = {"hbt", "enc", "liv", "ir", "svo", "gyro0", "acc0"};
+const int UTeensyEmu::streamBinType[ST_CNT] = {UBinFrame::BIN_HBT, UBinFrame::BIN_ENC, UBinFrame::BIN_LIV,
+                                               UBinFrame::BIN_IR, 0, UBinFrame::BIN_GYRO, UBinFrame::BIN_ACC};
+
+void UTeensyEmu::reset(double now, unsigned int seed)
+{
+  startTime = now;
+  simTime = now;
+  lastDue = now;
+  rnd.seed(seed);
+  pending.clear();
+  rxLine.clear();
+  rxQueue.clear();
+  rxFreeAt = now;
+  busyTime = 0;
+  loadFrom = now;
+  for (int i = 0; i < ST_CNT; i++)
+    subs[i] = Sub();
+  for (int i = 0; i < 2; i++)
+  {
+    motv[i] = 0;
+    wheelVel[i] = 0;
+    encPos[i] = 0;
+  }
+  lineSensorOn = false;
+  for (int i = 0; i < 5; i++)
+  {
+    servoOn[i] = false;
+    servoPos[i] = 0;
+    servoVel[i] = 0;
+  }
+}
+
+void UTeensyEmu::received(const char* data, int n, double now)
+{ // collect lines
+  for (int i = 0; i < n; i++)
+  {
+    if (data[i] == '\n')
+    {
+      if (rxCapacity > 0)
+        bufferLine(rxLine.c_str(), now);
+      else
+        handleLine(rxLine.c_str(), now);
+      rxLine.clear();
+    }
+    else if (rxLine.size() < 400)
+      rxLine += data[i];
+  }
+}
+
+void UTeensyEmu::bufferLine(const char* line, double now)
+{ // each line takes 1/rxCapacity to handle
+  if ((int)rxQueue.size() >= rxBufferLines)
+  { // no space, like a full USB buffer
+    rxOverflowCnt++;
+    return;
+  }
+  double cost = 1.0 / rxCapacity;
+  if (rxFreeAt < now)
+    rxFreeAt = now;
+  rxFreeAt += cost;
+  busyTime += cost;
+  rxQueue.push_back({rxFreeAt, line});
+}
+
+int UTeensyEmu::getLoad(double now)
+{ // a base load of 20% for the control loop, the rest is line handling
+  double dt = now - loadFrom;
+  double busy = 0;
+  if (dt > 0)
+    busy = busyTime / dt;
+  if (busy > 1)
+    busy = 1;
+  busyTime = 0;
+  loadFrom = now;
+  return 20 + lround(busy * 80);
+}
+
+void UTeensyEmu::handleLine(const char* line, double now)
+{ // line is without new-line, like ';23!sub enc 8'
+  if (line[0] != ';' or strlen(line) < 4)
+    return;
+  rxLineCnt++;
+  if (impair.loss > 0 and uni(rnd) < impair.loss)
+  { // lost on the way
+    rxLostCnt++;
+    return;
+  }
+  int sum = 0;
+  for (const char * p1 = &line[3]; *p1 != '\0'; p1++)
+  {
+    if (*p1 >= ' ')
+      sum += *p1;
+  }
+  int crc = (line[1] - '0') * 10 + line[2] - '0';
+  if (crc != (sum % 99) + 1)
+  { // firmware ignores messages with CRC error
+    rxCrcErrCnt++;
+    return;
+  }
+  const char * msg = &line[3];
+  if (*msg == '!')
+  { // confirm request, reply with the full message (as the firmware)
+    std::string s = "confirm ";
+    s += msg;
+    sendLine(s.c_str(), now);
+    confirmCnt++;
+    msg++;
+  }
+  command(msg, now);
+}
+
+int UTeensyEmu::findStream(const char* name)
+{
+  for (int i = 0; i < ST_CNT; i++)
+  {
+    if (strcmp(name, streamName[i]) == 0)
+      return i;
+  }
+  return -1;
+}
+
+void UTeensyEmu::command(const char* msg, double now)
+{
+  const int MSL = 100;
+  char s[MSL];
+  char key[20];
+  if (sscanf(msg, "%19s", key) != 1)
+    return;
+  const char * p1 = msg + strlen(key);
+  if (strcmp(key, "sub") == 0)
+  { // sub stream interval_ms
+    char sn[20];
+    float ms = 0;
+    if (sscanf(p1, "%19s %f", sn, &ms) == 2)
+    {
+      int st = findStream(sn);
+      if (st >= 0)
+      {
+        if (ms > 0)
+        {
+          subs[st].interval = ms / 1000.0 / rateFactor;
+          subs[st].next = now + subs[st].interval;
+        }
+        else
+          subs[st].interval = 0;
+      }
+    }
+  }
+  else if (strcmp(key, "bin") == 0)
+  { // bin stream 1 (or 0, or 2 for timestamped frames)
+    char sn[20];
+    int on = 0;
+    if (binarySupport and sscanf(p1, "%19s %d", sn, &on) == 2)
+    {
+      int st = findStream(sn);
+      if (st >= 0 and streamBinType[st] > 0)
+      {
+        subs[st].binary = on != 0;
+        subs[st].timestamp = on == 2;
+        snprintf(s, MSL, "bin %s %d", sn, on);
+        sendLine(s, now);
+      }
+    }
+  }
+  else if (strcmp(key, "motv") == 0)
+  {
+    motv[0] = strtof(p1, (char**)&p1);
+    motv[1] = strtof(p1, (char**)&p1);
+  }
+  else if (strcmp(key, "stop") == 0)
+  {
+    motv[0] = 0;
+    motv[1] = 0;
+  }
+  else if (strcmp(key, "leave") == 0)
+  { // client leaves, stop motors and data
+    motv[0] = 0;
+    motv[1] = 0;
+    unsubscribeAll();
+  }
+  else if (strcmp(key, "servo") == 0)
+  { // servo index position velocity, position 10000 is disable
+    int i = strtol(p1, (char**)&p1, 10) - 1;
+    int pos = strtol(p1, (char**)&p1, 10);
+    int vel = strtol(p1, (char**)&p1, 10);
+    if (i >= 0 and i < 5)
+    {
+      servoOn[i] = pos != 10000;
+      if (servoOn[i])
+        servoPos[i] = pos;
+      servoVel[i] = vel;
+    }
+  }
+  else if (strcmp(key, "lip") == 0)
+  { // lip on white high ...
+    lineSensorOn = strtol(p1, nullptr, 10) != 0;
+  }
+  else if (strcmp(key, "enc0") == 0)
+  {
+    encPos[0] = 0;
+    encPos[1] = 0;
+  }
+  else if (strcmp(key, "idi") == 0 or strcmp(key, "hbti") == 0)
+  { // identity
+    snprintf(s, MSL, "dname robobot %s", name.c_str());
+    sendLine(s, now);
+  }
+  else if (strcmp(key, "setidx") == 0)
+    idx = strtol(p1, nullptr, 10);
+  else if (strcmp(key, "sethw") == 0)
+    hwType = strtol(p1, nullptr, 10);
+  // other commands (encrev, motr, gyrocal, irc, eew, disp ...) are accepted and ignored
+}
+
+void UTeensyEmu::unsubscribeAll()
+{
+  for (int i = 0; i < ST_CNT; i++)
+  {
+    subs[i].interval = 0;
+    subs[i].binary = false;
+    subs[i].timestamp = false;
+  }
+}
+
+void UTeensyEmu::queueOut(std::string && data, double now)
+{ // add impairment and keep order
+  double at = now + impair.latency;
+  if (impair.jitter > 0)
+    at += uni(rnd) * impair.jitter;
+  if (at < lastDue)
+    at = lastDue;
+  lastDue = at;
+  if (at <= now and pending.empty())
+  {
+    if (output)
+      output(data.c_str(), data.size());
+  }
+  else
+    pending.push_back({at, std::move(data)});
+}
+
+void UTeensyEmu::sendLine(const char* msg, double now)
+{
+  if (impair.loss > 0 and uni(rnd) < impair.loss)
+  {
+    txLostCnt++;
+    return;
+  }
+  int sum = 0;
+  for (const char * p1 = msg; *p1 != '\0'; p1++)
+  {
+    if (*p1 >= ' ')
+      sum += *p1;
+  }
+  char crc[8];
+  snprintf(crc, sizeof(crc), ";%02d", (sum % 99) + 1);
+  std::string s = crc;
+  s += msg;
+  if (s.back() != '\n')
+    s += '\n';
+  if (impair.corrupt > 0 and uni(rnd) < impair.corrupt and s.size() > 5)
+  { // change one bit in one character (not the new-line)
+    int i = 3 + int(uni(rnd) * (s.size() - 4));
+    char c = s[i] ^ 0x01;
+    if (c >= ' ')
+    {
+      s[i] = c;
+      txCorruptCnt++;
+    }
+  }
+  txLineCnt++;
+  queueOut(std::move(s), now);
+}
+
+void UTeensyEmu::sendFrame(int stream, const uint8_t* payload, int len, double now)
+{
+  if (impair.loss > 0 and uni(rnd) < impair.loss)
+  { // lost, but sequence number is used
+    txLostCnt++;
+    subs[stream].seq++;
+    return;
+  }
+  char buf[UBinFrame::HDR + 4 + UBinFrame::MAX_PAYLOAD + UBinFrame::TAIL];
+  // sample time in us since start (wraps after 71 minutes)
+  uint32_t us = uint32_t(int64_t((now - startTime) * 1e6));
+  int n = UBinFrame::pack((uint8_t*)buf, streamBinType[stream], subs[stream].seq++, payload, len,
+                          subs[stream].timestamp, us);
+  if (impair.corrupt > 0 and uni(rnd) < impair.corrupt)
+  {
+    buf[UBinFrame::headerSize(buf[1]) + int(uni(rnd) * len)] ^= 0x01;
+    txCorruptCnt++;
+  }
+  txFrameCnt++;
+  queueOut(std::string(buf, n), now);
+}
+
+void UTeensyEmu::simulate(double now)
+{ // first order motor model and encoders
+  double dt = now - simTime;
+  if (dt <= 0)
+    return;
+  simTime = now;
+  double a = 1.0;
+  if (motorTau > 0 and dt < motorTau * 10)
+    a = 1.0 - exp(-dt / motorTau);
+  double ticksPerMeter = gear * encTickPerRev / (M_PI * wheelDiameter);
+  for (int i = 0; i < 2; i++)
+  {
+    wheelVel[i] += (motv[i] * motorGain - wheelVel[i]) * a;
+    encPos[i] += wheelVel[i] * dt * ticksPerMeter;
+  }
+}
+
+void UTeensyEmu::sendStream(int stream, double now)
+{
+  const int MSL = 200;
+  char s[MSL];
+  uint8_t p[UBinFrame::MAX_PAYLOAD];
+  bool bin = subs[stream].binary;
+  double tt = now - startTime;
+  // left encoder counts backwards when driving forward
+  int32_t enc[2] = {int32_t(-lround(encPos[0])), int32_t(lround(encPos[1]))};
+  switch (stream)
+  {
+    case ST_HBT:
+      if (bin)
+      {
+        UBinFrame::putF64(p, tt);
+        UBinFrame::putI16(&p[8], idx);
+        UBinFrame::putI16(&p[10], version);
+        UBinFrame::putF32(&p[12], 12.1);
+        p[16] = 0;
+        p[17] = hwType;
+        p[18] = getLoad(now);
+        p[19] = 3;
+        sendFrame(stream, p, 20, now);
+      }
+      else
+      {
+        snprintf(s, MSL, "hbt %.4f %d %d 12.10 0 %d %d 1 1", tt, idx, version, hwType, getLoad(now));
+        sendLine(s, now);
+      }
+      break;
+    case ST_ENC:
+      if (bin)
+      {
+        UBinFrame::putI32(p, enc[0]);
+        UBinFrame::putI32(&p[4], enc[1]);
+        sendFrame(stream, p, 8, now);
+      }
+      else
+      {
+        snprintf(s, MSL, "enc %d %d", enc[0], enc[1]);
+        sendLine(s, now);
+      }
+      break;
+    case ST_LIV:
+    { // a line under the middle sensors, moving slowly from side to side
+      int v[8];
+      double pos = 3.5 + 1.5 * sin(tt * 0.5);
+      for (int i = 0; i < 8; i++)
+      {
+        if (lineSensorOn)
+          v[i] = 200 + int(600 * exp(-(i - pos) * (i - pos)));
+        else
+          v[i] = 0;
+      }
+      if (bin)
+      {
+        for (int i = 0; i < 8; i++)
+          UBinFrame::putI16(&p[i * 2], v[i]);
+        sendFrame(stream, p, 16, now);
+      }
+      else
+      {
+        snprintf(s, MSL, "liv %d %d %d %d %d %d %d %d", v[0], v[1], v[2], v[3], v[4], v[5], v[6], v[7]);
+        sendLine(s, now);
+      }
+      break;
+    }
+    case ST_IR:
+      if (bin)
+      {
+        UBinFrame::putF32(p, 0.5);
+        UBinFrame::putF32(&p[4], 0.6);
+        UBinFrame::putI32(&p[8], 1000);
+        UBinFrame::putI32(&p[12], 2000);
+        sendFrame(stream, p, 16, now);
+      }
+      else
+        sendLine("ir 0.500 0.600 1000 2000", now);
+      break;
+    case ST_SVO:
+    {
+      int n = snprintf(s, MSL, "svo");
+      for (int i = 0; i < 5; i++)
+        n += snprintf(&s[n], MSL - n, " %d %d %d", servoOn[i], servoPos[i], servoVel[i]);
+      sendLine(s, now);
+      break;
+    }
+    case ST_GYRO:
+    { // turn rate (deg/s) from wheel velocity
+      float gz = (wheelVel[1] - wheelVel[0]) / wheelBase * 180.0 / M_PI;
+      if (bin)
+      {
+        UBinFrame::putF32(p, 0);
+        UBinFrame::putF32(&p[4], 0);
+        UBinFrame::putF32(&p[8], gz);
+        sendFrame(stream, p, 12, now);
+      }
+      else
+      {
+        snprintf(s, MSL, "gyro0 0.0000 0.0000 %.4f", gz);
+        sendLine(s, now);
+      }
+      break;
+    }
+    case ST_ACC:
+      if (bin)
+      {
+        UBinFrame::putF32(p, 0);
+        UBinFrame::putF32(&p[4], 0);
+        UBinFrame::putF32(&p[8], 1.0);
+        sendFrame(stream, p, 12, now);
+      }
+      else
+        sendLine("acc0 0.0000 0.0000 1.0000", now);
+      break;
+    default:
+      break;
+  }
+}
+
+void UTeensyEmu::tick(double now)
+{
+  simulate(now);
+  while (not rxQueue.empty() and rxQueue.front().at <= now)
+  {
+    handleLine(rxQueue.front().line.c_str(), now);
+    rxQueue.pop_front();
+  }
+  for (int i = 0; i < ST_CNT; i++)
+  {
+    Sub & sb = subs[i];
+    if (sb.interval > 0 and now >= sb.next)
+    {
+      sb.next += sb.interval;
+      if (sb.next < now)
+        // too far behind, skip samples
+        sb.next = now + sb.interval;
+      sendStream(i, now);
+    }
+  }
+  while (not pending.empty() and pending.front().at <= now)
+  {
+    if (output)
+      output(pending.front().data.c_str(), pending.front().data.size());
+    pending.pop_front();
+  }
+}
+
+double UTeensyEmu::nextEventAt()
+{
+  double t = simTime + 1.0;
+  for (int i = 0; i < ST_CNT; i++)
+  {
+    if (subs[i].interval > 0 and subs[i].next < t)
+      t = subs[i].next;
+  }
+  if (not pending.empty() and pending.front().at < t)
+    t = pending.front().at;
+  if (not rxQueue.empty() and rxQueue.front().at < t)
+    t = rxQueue.front().at;
+  return t;
+}
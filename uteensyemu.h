@@ -0,0 +1,184 @@
+/* #***************************************************************************
+ #*   Copyright (C) 2023 by DTU
+ #*   jcan@dtu.dk
+ #*
+ #*
+ #* The MIT License (MIT)  https://mit-license.org/
+ #*
+ #* Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+ #* and associated documentation files (the “Software”), to deal in the Software without restriction,
+ #* including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ #* sublicense, and/or sell copies of the Software, and to permit persons to whom the Software
+ #* is furnished to do so, subject to the following conditions:
+ #*
+ #* The above copyright notice and this permission notice shall be included in all copies
+ #* or substantial portions of the Software.
+ #*
+ #* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ #* INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ #* PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+ #* FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ #* ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ #* THE SOFTWARE. */
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <deque>
+#include <random>
+#include <functional>
+
+/**
+ * Protocol level emulation of the Teensy (Regbot) firmware.
+ * Handles the ';NN' CRC line protocol, confirms messages marked with '!',
+ * and sends the subscribed data streams (enc, liv, ir, hbt, svo, gyro0, acc0)
+ * at the requested rate, as text lines or binary frames (see UBinFrame),
+ * optionally with the Teensy sample time.
+ * Motor voltage (motv), servo and line sensor (lip) commands changes
+ * the emulated state.
+ * Latency, jitter, loss and CRC corruption can be added to test the host side.
+ * A limited command handling capacity can be set, then lines from the host
+ * are buffered and handled at that rate, the busy time is reported as load in 'hbt'.
+ *
+ * The class has no i/o of its own, received characters are given to received(),
+ * tick() must be called (at the latest) at nextEventAt(), and
+ * anything to the host is delivered by the output function.
+ * All times are in seconds from any (monotonic) clock.
+ * */
+class UTeensyEmu
+{
+public:
+  /// link impairment
+  struct Impair
+  {
+    /// delay of all replies (sec)
+    double latency = 0;
+    /// additional random delay [0..jitter] (sec), order is kept
+    double jitter = 0;
+    /// probability of loosing a line (both directions)
+    double loss = 0;
+    /// probability of a corrupted reply (CRC error)
+    double corrupt = 0;
+  };
+  Impair impair;
+  /// identity
+  std::string name = "emu";
+  int idx = 2;
+  int version = 1430;
+  int hwType = 9;
+  /// multiply subscription rates (e.g. 4 gives 4 times more data)
+  double rateFactor = 1.0;
+  /// lines from host handled per second (0 = no limit)
+  double rxCapacity = 0;
+  /// lines buffered before the next is lost (with limited capacity)
+  int rxBufferLines = 64;
+  /// reply to 'bin stream 1' requests (else ignore, like an older firmware)
+  bool binarySupport = true;
+  /// robot geometry (as [pose] in robot.ini)
+  double gear = 19.0;
+  double encTickPerRev = 68;
+  double wheelDiameter = 0.146;
+  double wheelBase = 0.243;
+  /// motor model, steady state wheel velocity (m/s) per volt and time constant
+  double motorGain = 0.07;
+  double motorTau = 0.05;
+  /// send to host (data and size)
+  std::function<void(const char * data, int n)> output;
+  // statistics
+  int rxLineCnt = 0;
+  int rxCrcErrCnt = 0;
+  int rxLostCnt = 0;
+  /// lines lost as receive buffer was full
+  int rxOverflowCnt = 0;
+  int confirmCnt = 0;
+  int txLineCnt = 0;
+  int txFrameCnt = 0;
+  int txLostCnt = 0;
+  int txCorruptCnt = 0;
+
+public:
+  /**
+   * Start (or restart) emulation, like a Teensy power on.
+   * \param now is current time
+   * \param seed for random impairment (0 = fixed default) */
+  void reset(double now, unsigned int seed = 0);
+  /**
+   * Characters from host */
+  void received(const char * data, int n, double now);
+  /**
+   * Send data that is due and update the emulated state */
+  void tick(double now);
+  /**
+   * Time when tick() is needed next */
+  double nextEventAt();
+  /**
+   * Stop all subscriptions (like 'leave') */
+  void unsubscribeAll();
+
+private:
+  enum Stream {ST_HBT, ST_ENC, ST_LIV, ST_IR, ST_SVO, ST_GYRO, ST_ACC, ST_CNT};
+  static const char * streamName[ST_CNT];
+  /// binary frame type for stream (0 = no binary format)
+  static const int streamBinType[ST_CNT];
+  struct Sub
+  {
+    double interval = 0; // 0 = off
+    double next = 0;
+    bool binary = false;
+    /// binary with Teensy timestamp ('bin stream 2')
+    bool timestamp = false;
+    uint16_t seq = 0;
+  };
+  Sub subs[ST_CNT];
+  /// delayed output
+  struct Pending
+  {
+    double at;
+    std::string data;
+  };
+  std::deque<Pending> pending;
+  double lastDue = 0;
+  /// partial line from host
+  std::string rxLine;
+  /// lines waiting to be handled (with limited capacity)
+  struct RxLine
+  {
+    double at;
+    std::string line;
+  };
+  std::deque<RxLine> rxQueue;
+  /// time when the last line in rxQueue is handled
+  double rxFreeAt = 0;
+  /// time used handling lines since loadFrom
+  double busyTime = 0;
+  double loadFrom = 0;
+  std::mt19937 rnd;
+  std::uniform_real_distribution<double> uni{0.0, 1.0};
+  double startTime = 0;
+  double simTime = 0;
+  // emulated state
+  double motv[2] = {0};
+  double wheelVel[2] = {0};
+  double encPos[2] = {0};
+  bool lineSensorOn = false;
+  int servoPos[5] = {0};
+  int servoVel[5] = {0};
+  bool servoOn[5] = {false};
+
+private:
+  void handleLine(const char * line, double now);
+  /** buffer line, when capacity is limited */
+  void bufferLine(const char * line, double now);
+  /** load (%) since last call, as in 'hbt' */
+  int getLoad(double now);
+  void command(const char * msg, double now);
+  /** send text line (without CRC and new-line) */
+  void sendLine(const char * msg, double now);
+  /** send binary frame */
+  void sendFrame(int stream, const uint8_t * payload, int len, double now);
+  void queueOut(std::string && data, double now);
+  void sendStream(int stream, double now);
+  void simulate(double now);
+  int findStream(const char * name);
+};
@@ -67,24 +67,24 @@ unsigned long UTime::getSec()
 
 /////////////////////////////////////////
 
-float UTime::getDecSec()
+double UTime::getDecSec()
 {
   if (valid)
-    return float(time.tv_sec) + float(time.tv_usec) * 1e-6;
+    return double(time.tv_sec) + double(time.tv_usec) * 1e-6;
   else
     return 0;
 }
 
 /////////////////////////////////////////
 
-float UTime::getDecSec(UTime t1)
+double UTime::getDecSec(UTime t1)
 { // get time compared to t1
-  return float(time.tv_sec - t1.time.tv_sec) + float(time.tv_usec - t1.time.tv_usec) * 1e-6;
+  return double(time.tv_sec - t1.time.tv_sec) + double(time.tv_usec - t1.time.tv_usec) * 1e-6;
 }
 
 /////////////////////////////////////////
 
-float UTime::getTimePassed()
+double UTime::getTimePassed()
 {
   UTime t;
   t.now();
@@ -93,6 +93,22 @@ float UTime::getTimePassed()
 
 /////////////////////////////////////////
 
+void UTime::now()
+{ // monotonic time base, with offset to epoch time
+  setNs(timebase.toEpochNs(timebase.nowNs()));
+}
+
+/////////////////////////////////////////
+
+void UTime::setNs(int64_t ns)
+{
+  time.tv_sec = ns / 1000000000;
+  time.tv_usec = (ns % 1000000000) / 1000;
+  valid = true;
+}
+
+/////////////////////////////////////////
+
 long UTime::getMilisec()
 {
   if (valid)
@@ -26,11 +26,16 @@
 #define UTIME_H
 
 #include <sys/time.h>
+#include <stdint.h>
+#include <string>
+#include "utimebase.h"
 
 
 /**
 Class encapsulation the time structure used by 'gettimeofday'
 with resolution in years down to micro-seconds.
+The time is from the time base (see UTimeBase), i.e. monotonic
+time with a fixed offset to epoch time.
 The class has functions to make simple time calculations and
 conversion to and from string in localized format. */
 class UTime
@@ -59,17 +64,23 @@ public:
   unsigned long getMicrosec();
   /**
   Get second value with microsecond as decimals */
-  float getDecSec();
+  double getDecSec();
   /**
   Get time since t1 as decimal seconds. */
-  float getDecSec(UTime t1);
+  double getDecSec(UTime t1);
   /**
   Get time past since this time in seconds */
-  float getTimePassed();
+  double getTimePassed();
   /**
-  Set time value to system time now using gettimeofday() */
-  inline void now()
-  { gettimeofday(&time, nullptr); valid = true; }
+  Set time value to now (from the time base) */
+  void now();
+  /**
+  Time as nanoseconds since epoch */
+  inline int64_t getNs() const
+  { return int64_t(time.tv_sec) * 1000000000 + int64_t(time.tv_usec) * 1000; }
+  /**
+  Set time from nanoseconds since epoch */
+  void setNs(int64_t ns);
   /**
   Set time from a timeval structure */
   void setTime(timeval iTime);
@@ -146,26 +157,26 @@ public:
     return result;
   };
   /**
-  Compare two times, where other is a float float */
-  inline bool operator< (float other)
+  Compare with a time in decimal seconds */
+  inline bool operator< (double other)
   {
     return ((getDecSec() - other) < 0.0);
   };
   /**
-  Compare two times, where other is a float float */
-  inline bool operator> (float other)
+  Compare with a time in decimal seconds */
+  inline bool operator> (double other)
   {
     return ((getDecSec() - other) > 0.0);
   };
   /**
-  Compare two times, where other is a float float */
-  inline bool operator<= (float other)
+  Compare with a time in decimal seconds */
+  inline bool operator<= (double other)
   {
     return ((getDecSec() - other) <= 0.0);
   };
   /**
-  Compare two times, where other is a float float */
-  inline bool operator>= (float other)
+  Compare with a time in decimal seconds */
+  inline bool operator>= (double other)
   {
     return ((getDecSec() - other) >= 0.0);
   };
@@ -181,7 +192,7 @@ public:
   };
   /**
   Subtract two UTime values and get result in decimal seconds */
-  inline float operator- (UTime old)
+  inline double operator- (UTime old)
   { return getDecSec(old);};
   /**
   Add a number of seconds to this time */
@@ -0,0 +1,138 @@
+/* #***************************************************************************
+ #*   Copyright (C) 2023 by DTU
+ #*   jcan@dtu.dk
+ #*
+ #*
+ #* The MIT License (MIT)  https://mit-license.org/
+ #*
+ #* Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+ #* and associated documentation files (the “Software”), to deal in the Software without restriction,
+ #* including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ #* sublicense, and/or sell copies of the Software, and to permit persons to whom the Software
+ #* is furnished to do so, subject to the following conditions:
+ #*
+ #* The above copyright notice and this permission notice shall be included in all copies
+ #* or substantial portions of the Software.
+ #*
+ #* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ #* INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ #* PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+ #* FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ #* ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ #* THE SOFTWARE. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "utimebase.h"
+#include "utime.h"
+#include "uservice.h"
+
+UTimeBase timebase;
+
+int64_t UTimeBase::monoNs()
+{
+  timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return int64_t(t.tv_sec) * 1000000000 + t.tv_nsec;
+}
+
+int64_t UTimeBase::epochOffsetNs()
+{ // fixed at first use, so a later change of system time has no effect
+  static const int64_t offset = []()
+  {
+    timespec t;
+    clock_gettime(CLOCK_REALTIME, &t);
+    return int64_t(t.tv_sec) * 1000000000 + t.tv_nsec - monoNs();
+  }();
+  return offset;
+}
+
+void UTimeBase::setup()
+{
+  if (not ini.has("clock"))
+  { // time base
+    ini["clock"]["; virtual clock for simulation (transport = loop) or replay"] = "";
+    ini["clock"]["virtual"] = "false";
+    ini["clock"]["; rate is virtual seconds per real second, 0 is as fast as data is used"] = "";
+    ini["clock"]["rate"] = "1";
+  }
+  if (ini["clock"]["virtual"] == "true")
+  {
+    double r = strtod(ini["clock"]["rate"].c_str(), nullptr);
+    if (r <= 0 and ini.get("teensy").get("transport") != "loop")
+    { // stepped time needs the in-process emulator, a real Teensy
+      // (or a socket) sends data in real time
+      printf("# UTimeBase::setup: stepped clock (rate 0) needs [teensy] transport = loop, using rate 1\n");
+      r = 1;
+    }
+    setVirtual(r);
+    printf("# UTimeBase::setup: virtual clock, rate %g%s\n", rate, rate == 0 ? " (stepped)" : "");
+  }
+}
+
+void UTimeBase::setVirtual(double virtualRate)
+{
+  if (virtualRate < 0)
+    virtualRate = 0;
+  int64_t t = nowNs();
+  realStartNs = monoNs();
+  virtualStartNs = t;
+  steppedNs = t;
+  rate = virtualRate;
+  isVirtual = true;
+}
+
+int64_t UTimeBase::virtualNs()
+{
+  if (rate == 0)
+    return steppedNs.load(std::memory_order_acquire);
+  return virtualStartNs + int64_t((monoNs() - realStartNs) * rate);
+}
+
+void UTimeBase::advanceTo(int64_t ns)
+{
+  int64_t t = steppedNs.load(std::memory_order_relaxed);
+  while (ns > t and not steppedNs.compare_exchange_weak(t, ns, std::memory_order_release))
+    ;
+}
+
+int64_t UTimeBase::realNs(int64_t ns)
+{
+  if (not isVirtual)
+    return ns;
+  if (rate == 0)
+    return 0;
+  return int64_t(ns / rate);
+}
+
+unsigned long UTimeNs::getSec() const
+{
+  if (ns == 0)
+    return 0;
+  return timebase.toEpochNs(ns) / 1000000000;
+}
+
+unsigned long UTimeNs::getMicrosec() const
+{
+  if (ns == 0)
+    return 0;
+  return (timebase.toEpochNs(ns) % 1000000000) / 1000;
+}
+
+UTime UTimeNs::getUTime() const
+{
+  UTime t;
+  if (ns != 0)
+    t.setNs(timebase.toEpochNs(ns));
+  return t;
+}
+
+UTimeNs UTimeNs::from(const UTime & t)
+{
+  UTimeNs r;
+  if (t.valid)
+    r.ns = timebase.fromEpochNs(t.getNs());
+  return r;
+}
@@ -0,0 +1,168 @@
+/* #***************************************************************************
+ #*   Copyright (C) 2023 by DTU
+ #*   jcan@dtu.dk
+ #*
+ #*
+ #* The MIT License (MIT)  https://mit-license.org/
+ #*
+ #* Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+ #* and associated documentation files (the “Software”), to deal in the Software without restriction,
+ #* including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ #* sublicense, and/or sell copies of the Software, and to permit persons to whom the Software
+ #* is furnished to do so, subject to the following conditions:
+ #*
+ #* The above copyright notice and this permission notice shall be included in all copies
+ #* or substantial portions of the Software.
+ #*
+ #* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ #* INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ #* PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+ #* FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ #* ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ #* THE SOFTWARE. */
+
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+
+class UTime;
+
+/**
+ * Time base of the app in nanoseconds, from the monotonic clock
+ * (CLOCK_MONOTONIC), so it is not changed by NTP or by setting the
+ * system time. UTime (dates and logfiles) is the same time with
+ * an offset to epoch time, found at the first use.
+ *
+ * The clock may be virtual (the [clock] section in robot.ini),
+ * for simulation (the 'loop' transport with the Teensy emulator) or replay:
+ * with a rate (e.g. 5 is five times real time), or stepped (rate 0),
+ * where time is only advanced by the simulation (or replay), i.e. as fast as
+ * the data is used.
+ * All values are zero initialized, so the real clock can be used before
+ * the constructors of global objects are finished.
+ * */
+class UTimeBase
+{
+public:
+  /**
+   * Read configuration, to be called before any thread is started */
+  void setup();
+  /**
+   * Time now (ns) */
+  inline int64_t nowNs()
+  {
+    if (not isVirtual)
+      return monoNs();
+    return virtualNs();
+  }
+  /**
+   * Epoch time (ns since 1970) of a time base value */
+  inline int64_t toEpochNs(int64_t ns)
+  {
+    return ns + epochOffsetNs();
+  }
+  /**
+   * Time base value of an epoch time (ns since 1970) */
+  inline int64_t fromEpochNs(int64_t epochNs)
+  {
+    return epochNs - epochOffsetNs();
+  }
+  /**
+   * Use a virtual clock, starting at the time now
+   * \param rate is virtual seconds per real second, 0 is stepped by advanceTo() */
+  void setVirtual(double rate);
+  /**
+   * Virtual clock in steps (time is advanced by simulation or replay) */
+  inline bool isStepped()
+  {
+    return isVirtual and rate == 0;
+  }
+  /**
+   * Advance a stepped clock to this time (is never set back) */
+  void advanceTo(int64_t ns);
+  /**
+   * Real time (ns) needed for this (virtual) time interval, 0 if stepped */
+  int64_t realNs(int64_t ns);
+  /**
+   * The monotonic clock (ns) */
+  static int64_t monoNs();
+
+private:
+  int64_t virtualNs();
+  int64_t epochOffsetNs();
+  bool isVirtual = false;
+  double rate = 1.0;
+  /// real and virtual time when virtual clock started
+  int64_t realStartNs = 0;
+  int64_t virtualStartNs = 0;
+  /// virtual time in stepped mode
+  std::atomic<int64_t> steppedNs = {0};
+};
+
+/**
+ * Make this visible to the rest of the software */
+extern UTimeBase timebase;
+
+/**
+ * Time in nanoseconds in the time base, a plain 64 bit value
+ * that is cheap to copy (e.g. in a UTopic), for time stamps in the data
+ * path from sensor to control. 0 is not set.
+ * */
+class UTimeNs
+{
+public:
+  int64_t ns = 0;
+  /**
+   * Set to time now */
+  inline void now()
+  {
+    ns = timebase.nowNs();
+  }
+  inline void clear()
+  {
+    ns = 0;
+  }
+  inline bool isValid() const
+  {
+    return ns != 0;
+  }
+  /**
+   * Time since this time (sec) */
+  inline double getTimePassed() const
+  {
+    return (timebase.nowNs() - ns) * 1e-9;
+  }
+  /**
+   * Difference (sec) */
+  inline double operator- (const UTimeNs & old) const
+  {
+    return (ns - old.ns) * 1e-9;
+  }
+  inline bool operator< (const UTimeNs & other) const
+  {
+    return ns < other.ns;
+  }
+  inline bool operator> (const UTimeNs & other) const
+  {
+    return ns > other.ns;
+  }
+  inline bool operator== (const UTimeNs & other) const
+  {
+    return ns == other.ns;
+  }
+  inline void operator+= (double seconds)
+  {
+    ns += int64_t(seconds * 1e9);
+  }
+  /**
+   * Epoch seconds and microseconds in second (e.g. for logfiles) */
+  unsigned long getSec() const;
+  unsigned long getMicrosec() const;
+  /**
+   * As UTime (e.g. for date and time strings) */
+  UTime getUTime() const;
+  /**
+   * From a UTime value */
+  static UTimeNs from(const UTime & t);
+};
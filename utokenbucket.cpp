@@ -0,0 +1,181 @@
+/* #***************************************************************************
+ #*   Copyright (C) 2023 by DTU
+ #*   jcan@dtu.dk
+ #*
+ #*
+ #* The MIT License (MIT)  https://mit-license.org/
+ #*
+ #* Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+ #* and associated documentation files (the “Software”), to deal in the Software without restriction,
+ #* including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ #* sublicense, and/or sell copies of the Software, and to permit persons to whom the Software
+ #* is furnished to do so, subject to the following conditions:
+ #*
+ #* The above copyright notice and this permission notice shall be included in all copies
+ #* or substantial portions of the Software.
+ #*
+ #* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ #* INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ #* PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+ #* FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ #* ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ #* THE SOFTWARE. */
+
+#include "utokenbucket.h"
+
+/// extra round-trip time allowed above rttFactor * minRtt (sec),
+/// as USB polling adds up to about a ms to short round trips
+static const double RTT_SLACK = 0.002;
+/// factor used after setup and reset
+static const double START_FACTOR = 0.5;
+
+void UTokenBucket::setup(double maxBytesPerSec, double maxMsgPerSec, double burstSec,
+                         double reserve, double minFactor)
+{
+  maxBytes = maxBytesPerSec;
+  maxMsgs = maxMsgPerSec;
+  if (maxBytes < 100)
+    maxBytes = 100;
+  if (maxMsgs < 10)
+    maxMsgs = 10;
+  burst = burstSec;
+  if (burst < 0.001)
+    burst = 0.001;
+  this->reserve = reserve;
+  if (this->reserve < 0)
+    this->reserve = 0;
+  else if (this->reserve > 0.9)
+    this->reserve = 0.9;
+  this->minFactor = minFactor;
+  if (this->minFactor < 0.01)
+    this->minFactor = 0.01;
+  else if (this->minFactor > 1)
+    this->minFactor = 1;
+  reset();
+}
+
+void UTokenBucket::reset()
+{
+  std::lock_guard<std::mutex> guard(lock);
+  factor = START_FACTOR;
+  if (factor < minFactor)
+    factor = minFactor;
+  byteTokens = burst * maxBytes * factor;
+  msgTokens = burst * maxMsgs * factor;
+  minRtt = 0;
+  srtt = 0;
+  lastRefill.now();
+}
+
+void UTokenBucket::refill(UTime & now)
+{ // called with lock locked
+  double dt = now - lastRefill;
+  // host clock may be adjusted
+  if (dt < 0)
+    dt = 0;
+  else if (dt > 1.0)
+    dt = 1.0;
+  lastRefill = now;
+  double rb = factor * maxBytes;
+  double rm = factor * maxMsgs;
+  byteTokens += dt * rb;
+  if (byteTokens > burst * rb)
+    byteTokens = burst * rb;
+  msgTokens += dt * rm;
+  if (msgTokens > burst * rm)
+    msgTokens = burst * rm;
+}
+
+double UTokenBucket::waitTime(int bytes, bool urgent, UTime & now)
+{
+  std::lock_guard<std::mutex> guard(lock);
+  refill(now);
+  if (urgent)
+    return 0;
+  double rb = factor * maxBytes;
+  double rm = factor * maxMsgs;
+  // normal messages must leave the reserve in the bucket,
+  // but a message larger than the bucket must be possible too
+  double needBytes = bytes + reserve * burst * rb;
+  if (needBytes > burst * rb)
+    needBytes = burst * rb;
+  double needMsgs = 1 + reserve * burst * rm;
+  if (needMsgs > burst * rm)
+    needMsgs = burst * rm;
+  double w = 0;
+  if (byteTokens < needBytes)
+    w = (needBytes - byteTokens) / rb;
+  if (msgTokens < needMsgs)
+  {
+    double wm = (needMsgs - msgTokens) / rm;
+    if (wm > w)
+      w = wm;
+  }
+  if (w > 0)
+    waitCnt++;
+  return w;
+}
+
+void UTokenBucket::take(int bytes, UTime & now)
+{
+  std::lock_guard<std::mutex> guard(lock);
+  refill(now);
+  if (byteTokens < bytes or msgTokens < 1)
+    debtCnt++;
+  byteTokens -= bytes;
+  msgTokens -= 1;
+  // limit the debt to one bucket
+  double rb = factor * maxBytes;
+  double rm = factor * maxMsgs;
+  if (byteTokens < -burst * rb)
+    byteTokens = -burst * rb;
+  if (msgTokens < -burst * rm)
+    msgTokens = -burst * rm;
+}
+
+void UTokenBucket::decrease()
+{ // called with lock locked,
+  // at most once per round-trip time, as the effect is not seen before
+  double hold = srtt;
+  if (hold < 0.1)
+    hold = 0.1;
+  if (lastDecrease.getTimePassed() < hold)
+    return;
+  factor *= 0.7;
+  if (factor < minFactor)
+    factor = minFactor;
+  decreaseCnt++;
+  lastDecrease.now();
+}
+
+void UTokenBucket::loadReport(float load)
+{
+  std::lock_guard<std::mutex> guard(lock);
+  lastLoad = load;
+  bool rttOK = srtt == 0 or srtt <= rttFactor * minRtt + RTT_SLACK;
+  if (load > loadHigh)
+    decrease();
+  else if (load < loadLow and rttOK and factor < 1.0 and
+           lastDecrease.getTimePassed() > 1.0)
+  { // room for more, increase slowly
+    factor += 0.05;
+    if (factor > 1.0)
+      factor = 1.0;
+    increaseCnt++;
+  }
+}
+
+void UTokenBucket::rttSample(double rtt)
+{
+  if (rtt <= 0)
+    return;
+  std::lock_guard<std::mutex> guard(lock);
+  if (minRtt == 0 or rtt < minRtt)
+    minRtt = rtt;
+  if (srtt == 0)
+    srtt = rtt;
+  else
+    srtt += (rtt - srtt) / 8.0;
+  if (srtt > rttFactor * minRtt + RTT_SLACK)
+    decrease();
+}
@@ -0,0 +1,129 @@
+/* #***************************************************************************
+ #*   Copyright (C) 2023 by DTU
+ #*   jcan@dtu.dk
+ #*
+ #*
+ #* The MIT License (MIT)  https://mit-license.org/
+ #*
+ #* Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+ #* and associated documentation files (the “Software”), to deal in the Software without restriction,
+ #* including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ #* sublicense, and/or sell copies of the Software, and to permit persons to whom the Software
+ #* is furnished to do so, subject to the following conditions:
+ #*
+ #* The above copyright notice and this permission notice shall be included in all copies
+ #* or substantial portions of the Software.
+ #*
+ #* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ #* INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ #* PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+ #* FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ #* ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ #* THE SOFTWARE. */
+
+#pragma once
+
+#include <mutex>
+
+#include "utime.h"
+
+/**
+ * Token bucket pacing of the traffic to the Teensy,
+ * limiting both bytes per second and messages per second.
+ * The rates are the configured max rates times a rate factor,
+ * the factor is adapted (additive increase, multiplicative decrease)
+ * from the load reported by the Teensy (in 'hbt') and from the
+ * confirm round-trip time, so that the link runs close to what
+ * the Teensy can handle.
+ * A part of the bucket is reserved for urgent messages (motor commands),
+ * urgent messages are never delayed, but may take the bucket into debt,
+ * that then delays the normal traffic.
+ * */
+class UTokenBucket
+{
+public:
+  /// Teensy load (%) above this reduces the rate
+  float loadHigh = 80;
+  /// Teensy load (%) below this allows a higher rate
+  float loadLow = 60;
+  /// round-trip time above this factor times the minimum reduces the rate
+  float rttFactor = 3;
+
+public:
+  /**
+   * Set limits
+   * \param maxBytesPerSec is the byte rate at rate factor 1
+   * \param maxMsgPerSec is the message rate at rate factor 1
+   * \param burstSec is bucket size in seconds of max rate
+   * \param reserve is part of bucket (0..1) reserved for urgent messages
+   * \param minFactor is the lowest rate factor used */
+  void setup(double maxBytesPerSec, double maxMsgPerSec, double burstSec,
+             double reserve, double minFactor);
+  /**
+   * Full bucket and half rate, e.g. after a reconnect */
+  void reset();
+  /**
+   * Time (sec) until a message of this size may be send.
+   * \param bytes is message size
+   * \param urgent is a message that may use the reserve and go into debt.
+   * \returns 0 if it may be send now (always for urgent messages) */
+  double waitTime(int bytes, bool urgent, UTime & now);
+  /**
+   * Take tokens for a message (just) send */
+  void take(int bytes, UTime & now);
+  /**
+   * Teensy load (%) from 'hbt', adjusts the rate factor */
+  void loadReport(float load);
+  /**
+   * Round-trip time (sec) of a confirmed message (not resend) */
+  void rttSample(double rtt);
+  /**
+   * Current rate factor (minFactor..1) */
+  float getRateFactor()
+  {
+    return factor;
+  }
+  double getByteRate()
+  {
+    return factor * maxBytes;
+  }
+  double getMsgRate()
+  {
+    return factor * maxMsgs;
+  }
+  double getMinRtt()
+  {
+    return minRtt;
+  }
+  double getSmoothRtt()
+  {
+    return srtt;
+  }
+  // statistics
+  int decreaseCnt = 0;
+  int increaseCnt = 0;
+  /// number of times a message had to wait for tokens
+  int waitCnt = 0;
+  /// urgent messages send with too few tokens
+  int debtCnt = 0;
+  float lastLoad = 0;
+
+private:
+  void refill(UTime & now);
+  void decrease();
+  double maxBytes = 50000;
+  double maxMsgs = 1000;
+  double burst = 0.05;
+  double reserve = 0.25;
+  double minFactor = 0.1;
+  // current state
+  double factor = 0.5;
+  double byteTokens = 0;
+  double msgTokens = 0;
+  UTime lastRefill;
+  UTime lastDecrease;
+  /// lowest and smoothed round-trip time (sec), 0 = no samples yet
+  double minRtt = 0;
+  double srtt = 0;
+  std::mutex lock;
+};
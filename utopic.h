@@ -0,0 +1,106 @@
+/* #***************************************************************************
+ #*   Copyright (C) 2023 by DTU
+ #*   jcan@dtu.dk
+ #*
+ #*
+ #* The MIT License (MIT)  https://mit-license.org/
+ #*
+ #* Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+ #* and associated documentation files (the “Software”), to deal in the Software without restriction,
+ #* including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ #* sublicense, and/or sell copies of the Software, and to permit persons to whom the Software
+ #* is furnished to do so, subject to the following conditions:
+ #*
+ #* The above copyright notice and this permission notice shall be included in all copies
+ #* or substantial portions of the Software.
+ #*
+ #* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ #* INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ #* PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+ #* FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ #* ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ #* THE SOFTWARE. */
+
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+/**
+ * Latest value of a data stream from one producer thread to any number
+ * of consumer threads. The consumers get a consistent copy (a seqlock,
+ * the copy is made again if the producer wrote meanwhile),
+ * and may sleep until a new value is published (a futex on the sequence number).
+ * No lock is taken, and the producer is never blocked.
+ * T should be a small struct of plain values (it is copied at every read).
+ * */
+template <class T>
+class UTopic
+{
+public:
+  /**
+   * Producer: set new value and wake waiting consumers */
+  void publish(const T & value)
+  {
+    uint32_t s = seq.load(std::memory_order_relaxed);
+    // odd while writing
+    seq.store(s + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    data = value;
+    seq.store(s + 2, std::memory_order_seq_cst);
+    if (waiters.load(std::memory_order_seq_cst) > 0)
+      syscall(SYS_futex, &seq, FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+  }
+  /**
+   * Consumer: get a consistent copy of the latest value
+   * \returns the update count of this value (0 if never published) */
+  uint32_t read(T & value) const
+  {
+    while (true)
+    {
+      uint32_t s1 = seq.load(std::memory_order_acquire);
+      if (s1 & 1)
+        // being written
+        continue;
+      value = data;
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (seq.load(std::memory_order_relaxed) == s1)
+        return s1 / 2;
+    }
+  }
+  /**
+   * Number of published values */
+  inline uint32_t count() const
+  {
+    return seq.load(std::memory_order_acquire) / 2;
+  }
+  /**
+   * Consumer: wait for a value newer than 'seen'
+   * \param seen is the update count of the latest value used
+   * \param timeoutUs is max wait time (e.g. to test for stop)
+   * \returns update count, equal to 'seen' if timeout */
+  uint32_t wait(uint32_t seen, int timeoutUs)
+  {
+    waiters.fetch_add(1, std::memory_order_seq_cst);
+    uint32_t s = seq.load(std::memory_order_seq_cst);
+    if (s / 2 == seen)
+    { // no new value, sleep until the sequence number changes
+      timespec ts = {timeoutUs / 1000000, (timeoutUs % 1000000) * 1000};
+      syscall(SYS_futex, &seq, FUTEX_WAIT_PRIVATE, s, &ts, nullptr, 0);
+    }
+    waiters.fetch_sub(1, std::memory_order_relaxed);
+    // may be odd (being written), then read() waits
+    return (seq.load(std::memory_order_acquire) + 1) / 2;
+  }
+
+private:
+  /// sequence number, twice the update count, odd while writing
+  std::atomic<uint32_t> seq = {0};
+  std::atomic<int> waiters = {0};
+  T data;
+};
@@ -0,0 +1,299 @@
+/* #***************************************************************************
+ #*   Copyright (C) 2023 by DTU
+ #*   jcan@dtu.dk
+ #*
+ #*
+ #* The MIT License (MIT)  https://mit-license.org/
+ #*
+ #* Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+ #* and associated documentation files (the “Software”), to deal in the Software without restriction,
+ #* including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ #* sublicense, and/or sell copies of the Software, and to permit persons to whom the Software
+ #* is furnished to do so, subject to the following conditions:
+ #*
+ #* The above copyright notice and this permission notice shall be included in all copies
+ #* or substantial portions of the Software.
+ #*
+ #* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ #* INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ #* PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+ #* FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ #* ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ #* THE SOFTWARE. */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <math.h>
+#include <algorithm>
+#include <termios.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/eventfd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include "utransport.h"
+#include "utimebase.h"
+
+void UTransportFd::close()
+{
+  if (fd >= 0)
+  {
+    ::close(fd);
+    fd = -1;
+  }
+}
+
+ssize_t UTransportFd::read(void* buf, size_t n)
+{
+  return ::read(fd, buf, n);
+}
+
+ssize_t UTransportFd::writev(const iovec* iov, int n)
+{
+  if (isSocket)
+  {
+    struct msghdr mh;
+    memset(&mh, 0, sizeof(mh));
+    mh.msg_iov = (struct iovec *)iov;
+    mh.msg_iovlen = n;
+    return sendmsg(fd, &mh, MSG_NOSIGNAL);
+  }
+  return ::writev(fd, iov, n);
+}
+
+void UTransportFd::waitWritable(int ms)
+{
+  struct pollfd pfd = {fd, POLLOUT, 0};
+  poll(&pfd, 1, ms);
+}
+
+void UTransportFd::setNonBlocking()
+{
+  int flags;
+  if (-1 == (flags = fcntl(fd, F_GETFL, 0)))
+    flags = 0;
+  fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+bool UTransportSerial::open()
+{
+  fd = ::open(name.c_str(), O_RDWR | O_NOCTTY | O_NDELAY);
+  if (fd == -1)
+    return false;
+  setNonBlocking();
+  struct termios options;
+  tcgetattr(fd, &options);
+  options.c_cflag = B115200 | CS8 | CLOCAL | CREAD; //<Set baud rate
+  options.c_iflag = IGNPAR;
+  options.c_oflag = 0;
+  options.c_lflag = 0;
+  tcsetattr(fd, TCSANOW, &options);
+  tcflush(fd, TCIFLUSH);
+  return true;
+}
+
+bool UTransportTcp::open()
+{
+  struct addrinfo hints;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  struct addrinfo * res = nullptr;
+  std::string ps = std::to_string(port);
+  if (getaddrinfo(host.c_str(), ps.c_str(), &hints, &res) != 0 or res == nullptr)
+  {
+    errno = EHOSTUNREACH;
+    return false;
+  }
+  isSocket = true;
+  for (struct addrinfo * a = res; a != nullptr and fd < 0; a = a->ai_next)
+  {
+    fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+    if (fd < 0)
+      continue;
+    // connect with a timeout, so that the receive thread is not stuck
+    setNonBlocking();
+    int r = connect(fd, a->ai_addr, a->ai_addrlen);
+    if (r < 0 and errno == EINPROGRESS)
+    {
+      struct pollfd pfd = {fd, POLLOUT, 0};
+      int err = ETIMEDOUT;
+      if (poll(&pfd, 1, 300) > 0)
+      {
+        socklen_t len = sizeof(err);
+        getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len);
+      }
+      r = err == 0 ? 0 : -1;
+      errno = err;
+    }
+    if (r < 0)
+    {
+      int e = errno;
+      close();
+      errno = e;
+    }
+  }
+  freeaddrinfo(res);
+  if (fd < 0)
+    return false;
+  // small messages should go at once
+  int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  return true;
+}
+
+bool UTransportUnix::open()
+{
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (name.size() >= sizeof(addr.sun_path))
+  {
+    errno = ENAMETOOLONG;
+    return false;
+  }
+  strncpy(addr.sun_path, name.c_str(), sizeof(addr.sun_path) - 1);
+  isSocket = true;
+  fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0)
+    return false;
+  if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+  {
+    int e = errno;
+    close();
+    errno = e;
+    return false;
+  }
+  setNonBlocking();
+  return true;
+}
+
+///////////////////////////////////////////////////////////////////
+
+static double timeSec()
+{ // the time base, so the emulator follows a virtual clock too
+  return timebase.nowNs() * 1e-9;
+}
+
+bool UTransportLoop::open()
+{
+  if (running)
+    return true;
+  eventFd = eventfd(0, EFD_NONBLOCK);
+  if (eventFd < 0)
+    return false;
+  rxBuf.clear();
+  rxBuf.reserve(MAX_BUFFER);
+  emu.output = [this](const char * data, int n)
+  { // called with lock locked, a reader that is behind loses data (like a full USB buffer)
+    if (rxBuf.size() + n > MAX_BUFFER)
+      return;
+    rxBuf.append(data, n);
+    uint64_t one = 1;
+    if (::write(eventFd, &one, sizeof(one)) < 0)
+      perror("# UTransportLoop::output");
+  };
+  emu.reset(timeSec());
+  running = true;
+  th = new std::thread(&UTransportLoop::run, this);
+  return true;
+}
+
+void UTransportLoop::close()
+{
+  if (not running)
+    return;
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    running = false;
+  }
+  wake.notify_one();
+  th->join();
+  delete th;
+  th = nullptr;
+  ::close(eventFd);
+  eventFd = -1;
+}
+
+ssize_t UTransportLoop::read(void* buf, size_t n)
+{
+  std::lock_guard<std::mutex> guard(lock);
+  if (rxBuf.empty())
+  {
+    errno = EAGAIN;
+    return -1;
+  }
+  if (n > rxBuf.size())
+    n = rxBuf.size();
+  memcpy(buf, rxBuf.data(), n);
+  rxBuf.erase(0, n);
+  if (rxBuf.empty())
+  { // clear the event (new data will set it again)
+    uint64_t ev;
+    if (::read(eventFd, &ev, sizeof(ev)) < 0 and errno != EAGAIN)
+      perror("# UTransportLoop::read");
+  }
+  return n;
+}
+
+ssize_t UTransportLoop::writev(const iovec* iov, int n)
+{
+  ssize_t sum = 0;
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    if (not running)
+    {
+      errno = EPIPE;
+      return -1;
+    }
+    double now = timeSec();
+    for (int i = 0; i < n; i++)
+    {
+      emu.received((const char *)iov[i].iov_base, iov[i].iov_len, now);
+      sum += iov[i].iov_len;
+    }
+  }
+  // replies may be due at once
+  wake.notify_one();
+  return sum;
+}
+
+void UTransportLoop::waitWritable(int /*ms*/)
+{ // never full
+}
+
+void UTransportLoop::run()
+{
+  std::unique_lock<std::mutex> guard(lock);
+  while (running)
+  {
+    if (timebase.isStepped())
+    { // virtual time is advanced here, as fast as the data is read
+      if (rxBuf.empty())
+        // (rounded up, so the event is due)
+        timebase.advanceTo(int64_t(ceil(std::min(emu.nextEventAt(), timeSec() + 0.01) * 1e9)));
+      else
+      { // wait for the reader
+        wake.wait_for(guard, std::chrono::microseconds(50));
+        continue;
+      }
+    }
+    double now = timeSec();
+    emu.tick(now);
+    double wait = emu.nextEventAt() - timeSec();
+    if (wait > 0.01)
+      wait = 0.01;
+    if (wait > 0)
+    { // real time for a (virtual) wait, when stepped just a pause to let the others in
+      int64_t ns = timebase.isStepped() ? 20000 : timebase.realNs(int64_t(wait * 1e9));
+      wake.wait_for(guard, std::chrono::nanoseconds(ns));
+    }
+  }
+}
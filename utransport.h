@@ -0,0 +1,182 @@
+/* #***************************************************************************
+ #*   Copyright (C) 2023 by DTU
+ #*   jcan@dtu.dk
+ #*
+ #*
+ #* The MIT License (MIT)  https://mit-license.org/
+ #*
+ #* Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+ #* and associated documentation files (the “Software”), to deal in the Software without restriction,
+ #* including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ #* sublicense, and/or sell copies of the Software, and to permit persons to whom the Software
+ #* is furnished to do so, subject to the following conditions:
+ #*
+ #* The above copyright notice and this permission notice shall be included in all copies
+ #* or substantial portions of the Software.
+ #*
+ #* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ #* INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ #* PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+ #* FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ #* ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ #* THE SOFTWARE. */
+
+#pragma once
+
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include "uteensyemu.h"
+
+/**
+ * The byte stream to the Teensy, STeensy does not know the kind of connection.
+ * The receive thread polls pollFd() (for POLLIN and hang-up) and reads,
+ * the writer thread writes, both non-blocking.
+ * Selected with [teensy] transport in robot.ini.
+ * */
+class UTransport
+{
+public:
+  virtual ~UTransport() {}
+  /**
+   * Open the connection
+   * \returns false if not possible (now), errno tells why */
+  virtual bool open() = 0;
+  virtual void close() = 0;
+  virtual bool isOpen() = 0;
+  /**
+   * File descriptor that is readable when there is data (or an error) */
+  virtual int pollFd() = 0;
+  /**
+   * Read available data (non-blocking)
+   * \returns bytes read, 0 if closed, or -1 with errno (EAGAIN if no data) */
+  virtual ssize_t read(void * buf, size_t n) = 0;
+  /**
+   * Write (non-blocking), may write a part only
+   * \returns bytes written, or -1 with errno (EAGAIN if no space) */
+  virtual ssize_t writev(const struct iovec * iov, int n) = 0;
+  /**
+   * Wait (up to ms) for space to write, after an EAGAIN */
+  virtual void waitWritable(int ms) = 0;
+  /// for messages, e.g. '/dev/ttyACM0' or 'localhost:24001'
+  std::string name;
+};
+
+/**
+ * Base for transports that are a file descriptor */
+class UTransportFd : public UTransport
+{
+public:
+  ~UTransportFd()
+  {
+    close();
+  }
+  void close() override;
+  bool isOpen() override
+  {
+    return fd >= 0;
+  }
+  int pollFd() override
+  {
+    return fd;
+  }
+  ssize_t read(void * buf, size_t n) override;
+  ssize_t writev(const struct iovec * iov, int n) override;
+  void waitWritable(int ms) override;
+protected:
+  int fd = -1;
+  /// write with no SIGPIPE, if the other end is closed
+  bool isSocket = false;
+  /** set fd non-blocking */
+  void setNonBlocking();
+};
+
+/**
+ * USB serial device (the real Teensy) */
+class UTransportSerial : public UTransportFd
+{
+public:
+  UTransportSerial(const std::string & device)
+  {
+    name = device;
+  }
+  bool open() override;
+};
+
+/**
+ * TCP connection, e.g. to a simulator */
+class UTransportTcp : public UTransportFd
+{
+public:
+  UTransportTcp(const std::string & host, int port)
+    : host(host), port(port)
+  {
+    name = host + ":" + std::to_string(port);
+  }
+  bool open() override;
+private:
+  std::string host;
+  int port;
+};
+
+/**
+ * Unix domain (stream) socket, e.g. to an emulator on the same computer */
+class UTransportUnix : public UTransportFd
+{
+public:
+  UTransportUnix(const std::string & path)
+  {
+    name = path;
+  }
+  bool open() override;
+};
+
+/**
+ * Emulated Teensy (UTeensyEmu) in this process, with no i/o,
+ * to measure the host software alone.
+ * Written data is handled by the emulator at once, data from the
+ * emulator is buffered, and an eventfd tells the receive thread.
+ * A thread runs the emulator subscriptions. */
+class UTransportLoop : public UTransport
+{
+public:
+  UTransportLoop()
+  {
+    name = "loop";
+  }
+  ~UTransportLoop()
+  {
+    close();
+  }
+  /// the emulator, configure before open()
+  UTeensyEmu emu;
+  bool open() override;
+  void close() override;
+  bool isOpen() override
+  {
+    return running;
+  }
+  int pollFd() override
+  {
+    return eventFd;
+  }
+  ssize_t read(void * buf, size_t n) override;
+  ssize_t writev(const struct iovec * iov, int n) override;
+  void waitWritable(int ms) override;
+private:
+  static const size_t MAX_BUFFER = 65536;
+  /// data from emulator, not read yet
+  std::string rxBuf;
+  int eventFd = -1;
+  std::atomic<bool> running = {false};
+  std::thread * th = nullptr;
+  std::mutex lock;
+  std::condition_variable wake;
+  /** emulator thread */
+  void run();
+};